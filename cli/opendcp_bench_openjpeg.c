@@ -0,0 +1,140 @@
+/*
+    OpenDCP: Builds Digital Cinema Packages
+    Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <openjpeg.h>
+
+#include "opendcp.h"
+#include "opendcp_encoder.h"
+
+double wall_time() {
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart / freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+#endif
+}
+
+/* a noisy gradient, so the encoder has real work to do */
+void fill_image(opendcp_image_t *image, int frame) {
+    int c, i, size = image->w * image->h;
+    unsigned int seed = frame * 2654435761u + 1;
+
+    for (c = 0; c < image->n_components; c++) {
+        for (i = 0; i < size; i++) {
+            seed = seed * 1103515245u + 12345u;
+            image->component[c].data[i] = ((i % image->w) * 4 + c * 512 + (seed >> 24)) & 4095;
+        }
+    }
+}
+
+/* encode frames, setting the encoder context up again for every frame when cold. the
+   context holds the cinema parameters and the openjpeg image, the codec itself is
+   created for every frame in both cases since openjpeg cannot reuse one */
+double encode_frames(opendcp_t *opendcp, opendcp_image_t *image, int frames, int cold, size_t *bytes) {
+    opendcp_buffer_t buffer;
+    double start;
+    int i;
+
+    opendcp_encode_openjpeg_release();
+    *bytes = 0;
+    start  = wall_time();
+
+    for (i = 0; i < frames; i++) {
+        if (cold) {
+            opendcp_encode_openjpeg_release();
+        }
+
+        fill_image(image, i);
+        opendcp_buffer_init(&buffer, NULL, 0);
+
+        if (opendcp_encode_openjpeg_buffer(opendcp, image, &buffer) != OPENDCP_NO_ERROR) {
+            fprintf(stderr, "encoding frame %d failed\n", i);
+            exit(OPENDCP_ERROR);
+        }
+
+        *bytes += buffer.size;
+        opendcp_buffer_free(&buffer);
+    }
+
+    return wall_time() - start;
+}
+
+int main (int argc, char **argv) {
+    opendcp_t *opendcp;
+    opendcp_image_t *image;
+    double cold, warm;
+    size_t cold_bytes, warm_bytes;
+    int frames = 24;
+    int w = 2048, h = 1080;
+
+    if (argc > 1) {
+        frames = atoi(argv[1]);
+    }
+
+    if (argc > 3) {
+        w = atoi(argv[2]);
+        h = atoi(argv[3]);
+    }
+
+    if (frames < 1 || w < 1 || h < 1) {
+        printf("usage: opendcp_bench_openjpeg [frames] [width height]\n");
+        return -1;
+    }
+
+    opendcp = opendcp_create();
+    opendcp->cinema_profile = w > 2048 ? DCP_CINEMA4K : DCP_CINEMA2K;
+    opendcp->frame_rate     = 24;
+
+    image = opendcp_image_create(3, w, h);
+
+    if (!image) {
+        fprintf(stderr, "could not allocate a %dx%d image\n", w, h);
+        return OPENDCP_ERROR;
+    }
+
+    /* interleave the runs so neither one gets all the warm caches */
+    warm  = encode_frames(opendcp, image, 1, 0, &warm_bytes);
+    cold  = encode_frames(opendcp, image, frames, 1, &cold_bytes);
+    warm  = encode_frames(opendcp, image, frames, 0, &warm_bytes);
+
+    printf("%d frames %dx%d, openjpeg %s, wall time\n", frames, w, h, opj_version());
+    printf("  context set up per frame:  %8.2f ms/frame (%lu bytes)\n", cold * 1000 / frames, (unsigned long)cold_bytes);
+    printf("  context reused:            %8.2f ms/frame (%lu bytes)\n", warm * 1000 / frames, (unsigned long)warm_bytes);
+    printf("  parameter and image setup: %8.2f ms/frame\n", (cold - warm) * 1000 / frames);
+    printf("  the codec is created and set up for every frame in both runs\n");
+
+    opendcp_encode_openjpeg_release();
+    opendcp_image_free(image);
+    opendcp_delete(opendcp);
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+    OpenDCP: Builds Digital Cinema Packages
+    Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <KM_prng.h>
+
+#define MAX_THREADS 64
+
+/* the size of an IV or a UUID, the common case when writing an asset */
+#define FILL_SIZE   16
+
+typedef struct {
+    int       calls;
+    pthread_t thread;
+} bench_thread_t;
+
+double wall_time() {
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart / freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+#endif
+}
+
+/* each thread gets a new generator, so the first call pays for seeding it */
+void *fill_random(void *arg) {
+    bench_thread_t *t = (bench_thread_t *)arg;
+    Kumu::FortunaRNG RNG;
+    byte_t buf[FILL_SIZE];
+    int i;
+
+    for (i = 0; i < t->calls; i++) {
+        RNG.FillRandom(buf, FILL_SIZE);
+    }
+
+    return NULL;
+}
+
+int main (int argc, char **argv) {
+    bench_thread_t threads[MAX_THREADS];
+    double start, elapsed, base = 0;
+    int calls = 200000;
+    int n, i;
+
+    if (argc > 1) {
+        calls = atoi(argv[1]);
+    }
+
+    if (calls < 1) {
+        printf("usage: opendcp_bench_prng [calls per thread]\n");
+        return -1;
+    }
+
+    /* seed the shared generator outside the timed runs */
+    Kumu::FortunaRNG RNG;
+
+    printf("%d calls of %d bytes per thread\n", calls, FILL_SIZE);
+    printf("  threads   calls/s      scaling\n");
+
+    for (n = 1; n <= MAX_THREADS; n *= 2) {
+        start = wall_time();
+
+        for (i = 0; i < n; i++) {
+            threads[i].calls = calls;
+
+            if (pthread_create(&threads[i].thread, NULL, fill_random, &threads[i])) {
+                fprintf(stderr, "could not start thread %d\n", i);
+                return -1;
+            }
+        }
+
+        for (i = 0; i < n; i++) {
+            pthread_join(threads[i].thread, NULL);
+        }
+
+        elapsed = wall_time() - start;
+
+        if (n == 1) {
+            base = calls / elapsed;
+        }
+
+        printf("  %7d   %10.0f   %6.2fx\n", n, n * calls / elapsed, n * calls / elapsed / base);
+    }
+
+    return 0;
+}
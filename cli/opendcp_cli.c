@@ -90,9 +90,9 @@ filelist_t *get_filelist(const char *path, const char *filter) {
     DIR *d;
     struct stat st_in;
     struct dirent *de;
-    char **names = 0, **tmp;
-
-    size_t cnt = 0, len = 0;
+    char *scan = NULL, *name, *tmp_names;
+    size_t *offset = NULL, *tmp_offset;
+    size_t cnt = 0, len = 0, scan_used = 0, scan_len = 0, path_len, name_len, i;
     filelist_t *filelist;
 
     if (stat(path, &st_in) != 0 ) {
@@ -113,55 +113,107 @@ filelist_t *get_filelist(const char *path, const char *filter) {
 
     OPENDCP_LOG(LOG_DEBUG, "reading directory");
 
+    /* the names are packed back to back, only their offsets are kept */
     while ((de = readdir(d))) {
         if (!file_selector(de->d_name, filter)) {
             continue;
         }
 
+        name_len = strlen(de->d_name) + 1;
+
         if (cnt >= len) {
-            len = 2 * len + 1;
+            len = 2 * len + 64;
 
-            if (len > SIZE_MAX / sizeof * names) {
+            if (len > SIZE_MAX / sizeof * offset) {
                 break;
             }
 
-            tmp = realloc(names, len * sizeof * names);
+            tmp_offset = realloc(offset, len * sizeof * offset);
 
-            if (!tmp) {
+            if (!tmp_offset) {
                 break;
             }
 
-            names = tmp;
+            offset = tmp_offset;
         }
 
-        names[cnt] = malloc(strlen(de->d_name) + 1);
+        if (scan_used + name_len > scan_len) {
+            scan_len = 2 * scan_len + name_len + 4096;
+            tmp_names = realloc(scan, scan_len);
 
-        if (!names[cnt]) {
-            break;
+            if (!tmp_names) {
+                break;
+            }
+
+            scan = tmp_names;
         }
 
-        snprintf(names[cnt++], strlen(de->d_name) + 1, "%s", de->d_name);
-        OPENDCP_LOG(LOG_DEBUG, "Found %s", de->d_name);
+        memcpy(scan + scan_used, de->d_name, name_len);
+        offset[cnt++] = scan_used;
+        scan_used += name_len;
     }
 
     closedir(d);
 
     OPENDCP_LOG(LOG_DEBUG, "found %d files", cnt);
-    filelist = filelist_alloc(cnt);
 
-    if (names) {
-        while (cnt-- > 0) {
-            OPENDCP_LOG(LOG_DEBUG, "Adding file %s", names[cnt]);
-            snprintf(filelist->files[cnt], MAX_FILENAME_LENGTH, "%s/%s", path, names[cnt]);
-            free(names[cnt]);
-        }
+    /* one block holds every "<path>/<name>" */
+    path_len = strlen(path);
+    filelist = filelist_alloc_names(cnt, scan_used + cnt * (path_len + 1));
+
+    if (filelist) {
+        name = filelist->names;
 
-        free(names);
+        for (i = 0; i < cnt; i++) {
+            name_len = strlen(scan + offset[i]);
+            filelist->files[i] = name;
+            memcpy(name, path, path_len);
+            name[path_len] = '/';
+            memcpy(name + path_len + 1, scan + offset[i], name_len + 1);
+            name += path_len + 1 + name_len + 1;
+        }
     }
 
+    free(scan);
+    free(offset);
+
     return filelist;
 }
 
+/**
+Get a filelist from a printf style frame sequence pattern
+
+The directory is not read, names like shot_%06d.dpx are generated for
+each frame number when they are first used.
+
+@param  pattern the sequence pattern, for example shot_%06d.dpx
+@param  range the frame numbers as "first:last"
+@return filelist_t pointer, NULL on failure
+*/
+filelist_t *get_filelist_sequence(const char *pattern, const char *range) {
+    int first_number, last_number;
+    char end;
+
+    if (range == NULL || sscanf(range, "%d:%d%c", &first_number, &last_number, &end) != 2) {
+        OPENDCP_LOG(LOG_ERROR, "invalid sequence range %s, expected first:last", range ? range : "");
+        return NULL;
+    }
+
+    if (first_number < 0 || last_number < first_number) {
+        OPENDCP_LOG(LOG_ERROR, "invalid sequence range %d:%d", first_number, last_number);
+        return NULL;
+    }
+
+    if (!is_sequence_pattern(pattern)) {
+        OPENDCP_LOG(LOG_ERROR, "%s is not a sequence pattern, it needs one integer conversion like %%06d", pattern);
+        return NULL;
+    }
+
+    OPENDCP_LOG(LOG_DEBUG, "sequence %s frames %d to %d", pattern, first_number, last_number);
+
+    return filelist_alloc_pattern(pattern, first_number, last_number);
+}
+
 int find_seq_offset(char str1[], char str2[]) {
     unsigned int i;
     unsigned int offset = 0;
@@ -19,9 +19,27 @@
 #ifndef OPENDCP_CLI_H
 #define OPENDCP_CLI_H
 
+typedef struct {
+    filelist_t     *filelist;
+    int            next;
+    int            end;
+    long long      max_bytes;
+    long long      bytes_in_flight;
+    long long      *size;
+    unsigned char  *state;
+    int            hits;
+    int            misses;
+} opendcp_prefetch_t;
+
 int check_extension(char *filename, char *pattern);
 char *get_basename(const char *filename);
 int find_ext_offset(char str[]);
 int find_seq_offset (char str1[], char str2[]);
 filelist_t *get_filelist(const char *path, const char *filter);
+filelist_t *get_filelist_sequence(const char *pattern, const char *range);
+
+/* readahead */
+opendcp_prefetch_t *opendcp_prefetch_create(filelist_t *filelist, int start, int end, long long max_bytes);
+void opendcp_prefetch_frame(opendcp_prefetch_t *prefetch, int frame);
+void opendcp_prefetch_free(opendcp_prefetch_t *prefetch);
 #endif
@@ -48,6 +48,10 @@ char *basename_noext(const char *str);
 int   is_dir(char *path);
 void  build_j2k_filename(const char *in, char *path, char *out);
 void  progress_bar(int val, int total);
+double wall_time();
+int   link_j2k_file(const char *target, const char *link_name);
+int   publish_j2k_pair(filelist_t *filelist, char **out_dir, int *leader, opendcp_ratecontrol_t *rc, int frame, int state);
+filelist_t *get_filelist_pairs(char *in_path_left, char *in_path_right, const char *extensions);
 void  version();
 void  dcp_usage();
 
@@ -66,28 +70,43 @@ void dcp_usage() {
 
     fprintf(fp, "\n%s version %s %s\n\n", OPENDCP_NAME, OPENDCP_VERSION, OPENDCP_COPYRIGHT);
     fprintf(fp, "Usage:\n");
-    fprintf(fp, "       opendcp_j2k -i <file> -o <file> [options ...]\n\n");
+    fprintf(fp, "       opendcp_j2k -i <file> -o <file> [options ...]\n");
+    fprintf(fp, "       opendcp_j2k -1 <dir> -2 <dir> -o <dir> [options ...]\n");
+    fprintf(fp, "       opendcp_j2k -i <pattern> -N <first>:<last> -o <dir> [options ...]\n\n");
     fprintf(fp, "Required:\n");
-    fprintf(fp, "       -i | --input <file>            - input file or directory\n");
+    fprintf(fp, "       -i | --input <file>            - input file, directory or frame sequence pattern like shot_%%06d.dpx\n");
+    fprintf(fp, "       -1 | --left <dir>              - left eye input directory, encodes 3D pairs into <output>/left and <output>/right\n");
+    fprintf(fp, "       -2 | --right <dir>             - right eye input directory\n");
     fprintf(fp, "       -o | --output <file>           - output file or directory\n");
     fprintf(fp, "\n");
     fprintf(fp, "Options:\n");
     fprintf(fp, "       -r | --rate <rate>                 - frame rate (default 24)\n");
     fprintf(fp, "       -p | --profile <profile>           - profile cinema2k | cinema4k (default cinema2k)\n");
     fprintf(fp, "       -b | --bw                          - max Mbps bandwitdh (default: 250)\n");
+    fprintf(fp, "       -B | --target_bw <Mbps>            - average Mbps to aim for, frames are analyzed first and get a share by complexity, max --bw (default off)\n");
     fprintf(fp, "       -3 | --3d                          - adjust frame rate for 3D\n");
     fprintf(fp, "       -e | --encoder <openjpeg | kakadu> - jpeg2000 encoder (default openjpeg)\n");
     fprintf(fp, "       -x | --no_xyz                      - do not perform rgb->xyz color conversion\n");
     fprintf(fp, "       -c | --colorspace <color>          - select source colorpsace: (srgb, rec709, p3, srgb_complex, rec709_complex)\n");
     fprintf(fp, "       -f | --calculate                   - Calculate RGB->XYZ values instead of using LUT\n");
     fprintf(fp, "       -g | --dpx <linear | film | video> - process dpx image as linear, log film, or log video (default linear)\n");
-    fprintf(fp, "       -z | --resize                      - resize image to DCI compliant resolution\n");
+    fprintf(fp, "       -z | --resize[=<method>]           - resize image to DCI compliant resolution, method: nearest, bilinear, bicubic, lanczos (default nearest)\n");
+    fprintf(fp, "       -k | --container <flat | scope | full> - fit image into a DCI container, adding letterbox/pillarbox mattes\n");
+    fprintf(fp, "       -N | --sequence <first>:<last>     - frame numbers of a sequence pattern input, the directory is not listed\n");
     fprintf(fp, "       -s | --start                       - start frame\n");
     fprintf(fp, "       -d | --end                         - end frame\n");
     fprintf(fp, "       -t | --threads <threads>           - set number of threads (default 4)\n");
+    fprintf(fp, "       -y | --codec_threads <threads>     - max threads used inside one frame when fewer frames than threads are in flight, 0 disables (default threads, needs OpenJPEG 2.4)\n");
+    fprintf(fp, "       -q | --kakadu <command>            - kakadu compressor command (default kdu_compress)\n");
+    fprintf(fp, "       -u | --kakadu_stream               - keep one kakadu worker per thread and stream raw frames to it, the command must speak the worker protocol (not on windows)\n");
     fprintf(fp, "       -m | --tmp_dir                     - sets temporary directory (usually tmpfs one) to save there temporary tiffs for Kakadu\n");
     fprintf(fp, "       -n | --no_overwrite                - do not overwrite existing jpeg2000 files\n");
+    fprintf(fp, "       -D | --dedup                       - encode runs of byte-identical consecutive source files once and link the rest\n");
+    fprintf(fp, "       -C | --cache <dir>                 - reuse codestreams of frames encoded before with the same content and settings\n");
+    fprintf(fp, "       -S | --cache_size <MB>             - size the encode cache is trimmed to, least recently used first (default 10240)\n");
+    fprintf(fp, "       -a | --readahead <MB>              - maximum MB of input frames to read ahead, 0 disables (default 256)\n");
     fprintf(fp, "       -l | --log_level <level>           - sets the log level 0:Quiet, 1:Error, 2:Warn (default),  3:Info, 4:Debug\n");
+    fprintf(fp, "       -j | --log_json <file>             - also write log messages as json lines to file (- for stdout)\n");
     fprintf(fp, "       -h | --help                        - show help\n");
     fprintf(fp, "       -v | --version                     - show version\n");
     fprintf(fp, "\n\n");
@@ -123,8 +142,14 @@ char *basename_noext(const char *str) {
         return NULL;
     }
 
-    char *base = strrchr(str, '/') + 1;
-    char *ext  = strrchr(str, '.');
+    const char *base = strrchr(str, '/');
+    const char *ext  = strrchr(str, '.');
+
+    base = base ? base + 1 : str;
+
+    if (ext == NULL || ext < base) {
+        return strdup(base);
+    }
 
     return strndup(base, ext - base);
 }
@@ -145,6 +170,132 @@ void build_j2k_filename(const char *in, char *path, char *out) {
     }
 }
 
+double wall_time() {
+#ifdef OPENMP
+    return omp_get_wtime();
+#else
+    return (double)time(NULL);
+#endif
+}
+
+/* share the codestream of a repeated frame, copy it where links are not available */
+int link_j2k_file(const char *target, const char *link_name) {
+    opendcp_buffer_t buffer;
+    int result;
+
+    remove(link_name);
+
+#ifndef _WIN32
+    if (link(target, link_name) == 0) {
+        return OPENDCP_NO_ERROR;
+    }
+#endif
+
+    opendcp_buffer_init(&buffer, NULL, 0);
+    result = opendcp_buffer_load(&buffer, target);
+
+    if (result == OPENDCP_NO_ERROR) {
+        result = opendcp_buffer_save(&buffer, link_name);
+    }
+
+    opendcp_buffer_free(&buffer);
+
+    return result;
+}
+
+/* 3D pair state bits of an eye, the codestream is done and was written aside as .part */
+#define PAIR_DONE(eye)     (1 << (eye))
+#define PAIR_PART(eye)     (4 << (eye))
+#define PAIR_COMPLETE      (PAIR_DONE(0) | PAIR_DONE(1))
+
+/* move both codestreams of a finished 3D frame into place, repeated eyes are linked to their run */
+int publish_j2k_pair(filelist_t *filelist, char **out_dir, int *leader, opendcp_ratecontrol_t *rc, int frame, int state) {
+    char out[MAX_FILENAME_LENGTH];
+    char src[MAX_FILENAME_LENGTH];
+    int eye, c;
+
+    for (eye = 0; eye < 2; eye++) {
+        c = frame * 2 + eye;
+        build_j2k_filename(filelist_file(filelist, c), out_dir[eye], out);
+
+        /* the run leader is an earlier frame of the same eye, so it is already in place */
+        if (leader && leader[c] >= 0) {
+            build_j2k_filename(filelist_file(filelist, leader[c]), out_dir[eye], src);
+
+            if (link_j2k_file(src, out) != OPENDCP_NO_ERROR) {
+                OPENDCP_LOG(LOG_ERROR, "could not link %s to %s", out, src);
+                return OPENDCP_ERROR;
+            }
+
+            if (rc) {
+                opendcp_ratecontrol_end(rc, c, rc->achieved[leader[c] - rc->start]);
+            }
+        }
+        else if (state & PAIR_PART(eye)) {
+            snprintf(src, sizeof(src), "%s.part", out);
+#ifdef _WIN32
+            remove(out);
+#endif
+
+            if (rename(src, out)) {
+                OPENDCP_LOG(LOG_ERROR, "could not rename %s to %s", src, out);
+                return OPENDCP_ERROR;
+            }
+        }
+    }
+
+    OPENDCP_LOG(LOG_DEBUG, "3D frame %d ready", frame + 1);
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* interleave the left and right eye sequences, left frames at even indexes */
+filelist_t *get_filelist_pairs(char *in_path_left, char *in_path_right, const char *extensions) {
+    filelist_t *left, *right, *filelist = NULL;
+    int x, gap_left, gap_right;
+    size_t size = 0;
+    char *name;
+
+    left  = get_filelist(in_path_left, extensions);
+    right = get_filelist(in_path_right, extensions);
+
+    if (left == NULL || right == NULL || left->nfiles < 1) {
+        OPENDCP_LOG(LOG_ERROR, "No 3D input files located");
+    }
+    else if (left->nfiles != right->nfiles) {
+        OPENDCP_LOG(LOG_ERROR, "Mismatching file count for 3D images left: %d right: %d", left->nfiles, right->nfiles);
+    }
+    else if (filelist_order(left, &gap_left) != OPENDCP_NO_ERROR || filelist_order(right, &gap_right) != OPENDCP_NO_ERROR) {
+        OPENDCP_LOG(LOG_ERROR, "Could not order image files");
+    }
+    else {
+        if (gap_left != OPENDCP_NO_ERROR) {
+            OPENDCP_LOG(LOG_WARN, "Filenames not sequential between %s and %s.", left->files[gap_left], left->files[gap_left + 1]);
+        }
+
+        if (gap_right != OPENDCP_NO_ERROR) {
+            OPENDCP_LOG(LOG_WARN, "Filenames not sequential between %s and %s.", right->files[gap_right], right->files[gap_right + 1]);
+        }
+
+        for (x = 0; x < left->nfiles; x++) {
+            size += strlen(left->files[x]) + strlen(right->files[x]) + 2;
+        }
+
+        filelist = filelist_alloc_names(left->nfiles * 2, size);
+
+        for (x = 0, name = filelist ? filelist->names : NULL; filelist && x < filelist->nfiles; x++) {
+            filelist->files[x] = name;
+            strcpy(name, x % 2 ? right->files[x / 2] : left->files[x / 2]);
+            name += strlen(name) + 1;
+        }
+    }
+
+    filelist_free(left);
+    filelist_free(right);
+
+    return filelist;
+}
+
 int is_dir(char *path) {
     struct stat st_in;
 
@@ -195,7 +346,32 @@ int main (int argc, char **argv) {
     opendcp_t *opendcp;
     char *in_path  = NULL;
     char *out_path = NULL;
+    char *in_path_left  = NULL;
+    char *in_path_right = NULL;
+    char *sequence = NULL;
+    char out_left[MAX_FILENAME_LENGTH];
+    char out_right[MAX_FILENAME_LENGTH];
+    char *out_dir[2];
+    int first, last, stride = 1;
+    int pairs_ready = 0;
+    unsigned char *pair_state = NULL;
+    int readahead  = 256;
+    int target_bw  = 0;
+    int cache_size = 10240;
+    int dedup      = 0;
+    int *leader    = NULL;
+    int dup_frames = 0, dup_runs = 0, encoded = 0;
+    double encode_time = 0.0;
+    unsigned long long *hash = NULL;
+    int *hashed = NULL;
+    char *cache_path = NULL;
+    int rate_frames;
+    double average_bw, peak_bw;
+    char *log_json = NULL;
     filelist_t *filelist;
+    opendcp_prefetch_t *prefetch = NULL;
+    opendcp_ratecontrol_t *rate_control = NULL;
+    opendcp_cache_t *cache = NULL;
 
 #ifndef _WIN32
     struct sigaction sig_action;
@@ -220,6 +396,7 @@ int main (int argc, char **argv) {
     opendcp->j2k.encoder     = OPENDCP_ENCODER_OPENJPEG;
     opendcp->j2k.start_frame = 1;
     opendcp->j2k.bw          = 250;
+    opendcp->j2k.codec_threads = -1;
     opendcp->tmp_path        = NULL;
 #ifdef OPENMP
     openmp_flag              = 1;
@@ -231,7 +408,11 @@ int main (int argc, char **argv) {
     {
         static struct option long_options[] =
         {
+            {"left",           required_argument, 0, '1'},
+            {"right",          required_argument, 0, '2'},
+            {"readahead",      required_argument, 0, 'a'},
             {"bw",             required_argument, 0, 'b'},
+            {"target_bw",      required_argument, 0, 'B'},
             {"colorspace",     required_argument, 0, 'c'},
             {"end",            required_argument, 0, 'd'},
             {"encoder",        required_argument, 0, 'e'},
@@ -239,6 +420,9 @@ int main (int argc, char **argv) {
             {"dpx ",           required_argument, 0, 'g'},
             {"help",           required_argument, 0, 'h'},
             {"input",          required_argument, 0, 'i'},
+            {"sequence",       required_argument, 0, 'N'},
+            {"container",      required_argument, 0, 'k'},
+            {"log_json",       required_argument, 0, 'j'},
             {"log_level",      required_argument, 0, 'l'},
             {"tmp_dir",        required_argument, 0, 'm'},
             {"output",         required_argument, 0, 'o'},
@@ -246,18 +430,24 @@ int main (int argc, char **argv) {
             {"rate",           required_argument, 0, 'r'},
             {"start",          required_argument, 0, 's'},
             {"threads",        required_argument, 0, 't'},
+            {"kakadu",         required_argument, 0, 'q'},
+            {"codec_threads",  required_argument, 0, 'y'},
+            {"cache",          required_argument, 0, 'C'},
+            {"cache_size",     required_argument, 0, 'S'},
             {"3d",             no_argument,       0, '3'},
             {"no_overwrite",   no_argument,       0, 'n'},
+            {"kakadu_stream",  no_argument,       0, 'u'},
             {"version",        no_argument,       0, 'v'},
             {"no_xyz",         no_argument,       0, 'x'},
-            {"resize",         no_argument,       0, 'z'},
+            {"resize",         optional_argument, 0, 'z'},
+            {"dedup",          no_argument,       0, 'D'},
             {0, 0, 0, 0}
         };
 
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "b:c:d:e:g:i:l:m:o:p:r:s:t:w:3fhnvxz",
+        c = getopt_long (argc, argv, "1:2:a:b:B:c:C:d:De:g:i:j:k:l:m:N:o:p:q:r:s:S:t:w:y:3fhnuvxz::",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -280,10 +470,38 @@ int main (int argc, char **argv) {
                 opendcp->stereoscopic = 1;
                 break;
 
+            case '1':
+                in_path_left = optarg;
+                break;
+
+            case '2':
+                in_path_right = optarg;
+                break;
+
+            case 'a':
+                readahead = atoi(optarg);
+                break;
+
             case 'b':
                 opendcp->j2k.bw = atoi(optarg);
                 break;
 
+            case 'B':
+                target_bw = atoi(optarg);
+                break;
+
+            case 'C':
+                cache_path = optarg;
+                break;
+
+            case 'D':
+                dedup = 1;
+                break;
+
+            case 'S':
+                cache_size = atoi(optarg);
+                break;
+
             case 'c':
                 if (!strcmp(optarg, "srgb")) {
                     opendcp->j2k.lut = CP_SRGB;
@@ -315,6 +533,23 @@ int main (int argc, char **argv) {
                 opendcp->j2k.xyz_method = 1;
                 break;
 
+            case 'k':
+                if (!strcmp(optarg, "flat")) {
+                    opendcp->j2k.container = CONTAINER_FLAT;
+                }
+                else if (!strcmp(optarg, "scope")) {
+                    opendcp->j2k.container = CONTAINER_SCOPE;
+                }
+                else if (!strcmp(optarg, "full")) {
+                    opendcp->j2k.container = CONTAINER_FULL;
+                }
+                else {
+                    fprintf(stderr, "Invalid container argument\n");
+                    exit(1);
+                }
+
+                break;
+
             case 'e':
                 if (!strcmp(optarg, "openjpeg")) {
                     opendcp->j2k.encoder = OPENDCP_ENCODER_OPENJPEG;
@@ -360,6 +595,14 @@ int main (int argc, char **argv) {
                 in_path = optarg;
                 break;
 
+            case 'j':
+                log_json = optarg;
+                break;
+
+            case 'N':
+                sequence = optarg;
+                break;
+
             case 'l':
                 opendcp->log_level = atoi(optarg);
                 break;
@@ -402,6 +645,18 @@ int main (int argc, char **argv) {
                 opendcp->threads = atoi(optarg);
                 break;
 
+            case 'y':
+                opendcp->j2k.codec_threads = atoi(optarg);
+                break;
+
+            case 'q':
+                opendcp->j2k.kakadu = optarg;
+                break;
+
+            case 'u':
+                opendcp->j2k.kakadu_stream = 1;
+                break;
+
             case 'x':
                 opendcp->j2k.xyz = 0;
                 break;
@@ -411,7 +666,23 @@ int main (int argc, char **argv) {
                 break;
 
             case 'z':
-                opendcp->j2k.resize = 1;
+                if (optarg == NULL || !strcmp(optarg, "nearest")) {
+                    opendcp->j2k.resize = NEAREST_PIXEL;
+                }
+                else if (!strcmp(optarg, "bilinear")) {
+                    opendcp->j2k.resize = BILINEAR;
+                }
+                else if (!strcmp(optarg, "bicubic")) {
+                    opendcp->j2k.resize = BICUBIC;
+                }
+                else if (!strcmp(optarg, "lanczos")) {
+                    opendcp->j2k.resize = LANCZOS;
+                }
+                else {
+                    fprintf(stderr, "Invalid resize argument\n");
+                    exit(1);
+                }
+
                 break;
         }
     }
@@ -419,6 +690,22 @@ int main (int argc, char **argv) {
     /* set log level */
     opendcp_log_init(opendcp->log_level);
 
+    /* by default a frame may use every thread when it is the only one left */
+    if (opendcp->j2k.codec_threads < 0) {
+        opendcp->j2k.codec_threads = opendcp_encode_openjpeg_threads_supported() ? opendcp->threads : 1;
+    }
+    else if (opendcp->j2k.codec_threads > 1 && !opendcp_encode_openjpeg_threads_supported()) {
+        OPENDCP_LOG(LOG_WARN, "this OpenJPEG cannot encode a frame with several threads, ignoring --codec_threads");
+        opendcp->j2k.codec_threads = 1;
+    }
+
+    if (log_json && opendcp_log_json(opendcp->log_level, log_json)) {
+        dcp_fatal(opendcp, "Could not open json log file");
+    }
+
+    /* workers hand log messages to a single writer thread */
+    opendcp_log_async_start();
+
     if (opendcp_encoder_enable("j2c", NULL, opendcp->j2k.encoder)) {
         dcp_fatal(opendcp, "Could not enabled encoder");
     }
@@ -462,10 +749,15 @@ int main (int argc, char **argv) {
 
     /* encoder check */
     if (opendcp->j2k.encoder == OPENDCP_ENCODER_KAKADU) {
-        result = system("kdu_compress -u >/dev/null 2>&1");
+        char probe[MAX_PATH_LENGTH + 32];
+        const char *kakadu = opendcp->j2k.kakadu ? opendcp->j2k.kakadu : "kdu_compress";
+
+        /* probe the command that will actually run, -u prints its usage */
+        snprintf(probe, sizeof(probe), "%s -u >/dev/null 2>&1", kakadu);
+        result = system(probe);
 
         if (result >> 8 != 0) {
-            dcp_fatal(opendcp, "kdu_compress was not found. Either add to path or remove -e 1 flag");
+            dcp_fatal(opendcp, "%s was not found. Either add to path or remove -e 1 flag", kakadu);
         }
     }
 
@@ -477,12 +769,39 @@ int main (int argc, char **argv) {
         opendcp->j2k.bw *= 1000000;
     }
 
+    /* target bandwidth check */
+    if (target_bw < 0 || target_bw > opendcp->j2k.bw / 1000000) {
+        dcp_fatal(opendcp, "Target bandwidth must be between 0 and the max bandwidth, but %d was specified", target_bw);
+    }
+
     /* input path check */
-    if (in_path == NULL) {
+    if (in_path_left || in_path_right) {
+        if (in_path_left == NULL || in_path_right == NULL) {
+            dcp_fatal(opendcp, "3D encoding needs both left and right input directories");
+        }
+
+        if (in_path || sequence) {
+            dcp_fatal(opendcp, "Use either --input or --left/--right, sequence patterns are not supported for 3D pairs");
+        }
+
+        if (!is_dir(in_path_left) || !is_dir(in_path_right)) {
+            dcp_fatal(opendcp, "Left and right inputs must be directories");
+        }
+
+        /* pairs share the stereoscopic bit budget */
+        opendcp->stereoscopic = 1;
+        stride = 2;
+    }
+    else if (in_path == NULL) {
         dcp_fatal(opendcp, "Missing input file");
     }
-
-    if (in_path[strlen(in_path) - 1] == '/') {
+    else if (is_sequence_pattern(in_path) && sequence == NULL) {
+        dcp_fatal(opendcp, "Input %s looks like a sequence pattern, give its frame numbers with --sequence <first>:<last>", in_path);
+    }
+    else if (sequence && !is_sequence_pattern(in_path)) {
+        dcp_fatal(opendcp, "--sequence needs a frame sequence pattern input like shot_%%06d.dpx");
+    }
+    else if (in_path[strlen(in_path) - 1] == '/') {
         in_path[strlen(in_path) - 1] = '\0';
     }
 
@@ -496,16 +815,48 @@ int main (int argc, char **argv) {
     }
 
     /* make sure path modes are ok */
-    if (is_dir(in_path) && !is_dir(out_path)) {
+    if ((stride == 2 || sequence || is_dir(in_path)) && !is_dir(out_path)) {
         dcp_fatal(opendcp, "Input is a directory, so output must also be a directory");
     }
 
-    /* get file list */
-    OPENDCP_LOG(LOG_DEBUG, "searching path %s", in_path);
+    /* each eye has its own output directory, as opendcp_mxf --left/--right expect */
+    if (stride == 2) {
+        snprintf(out_left,  sizeof(out_left),  "%s/left",  out_path);
+        snprintf(out_right, sizeof(out_right), "%s/right", out_path);
+#ifdef _WIN32
+        mkdir(out_left);
+        mkdir(out_right);
+#else
+        mkdir(out_left, 0755);
+        mkdir(out_right, 0755);
+#endif
+
+        if (!is_dir(out_left) || !is_dir(out_right)) {
+            dcp_fatal(opendcp, "Could not create %s and %s", out_left, out_right);
+        }
+
+        out_dir[0] = out_left;
+        out_dir[1] = out_right;
+    }
+    else {
+        out_dir[0] = out_path;
+        out_dir[1] = out_path;
+    }
 
+    /* get file list */
     char *extensions = opendcp_decoder_extensions();
 
-    filelist = get_filelist(in_path, extensions);
+    if (stride == 2) {
+        OPENDCP_LOG(LOG_DEBUG, "searching paths %s and %s", in_path_left, in_path_right);
+        filelist = get_filelist_pairs(in_path_left, in_path_right, extensions);
+    }
+    else if (sequence) {
+        filelist = get_filelist_sequence(in_path, sequence);
+    }
+    else {
+        OPENDCP_LOG(LOG_DEBUG, "searching path %s", in_path);
+        filelist = get_filelist(in_path, extensions);
+    }
 
     if (extensions != NULL) {
         free(extensions);
@@ -515,14 +866,14 @@ int main (int argc, char **argv) {
         dcp_fatal(opendcp, "No input files located");
     }
 
-    /* end frame check */
+    /* end frame check, a frame is a pair of files in 3D */
     if (opendcp->j2k.end_frame) {
-        if (opendcp->j2k.end_frame > filelist->nfiles) {
+        if (opendcp->j2k.end_frame > filelist->nfiles / stride) {
             dcp_fatal(opendcp, "End frame is greater than the actual frame count");
         }
     }
     else {
-        opendcp->j2k.end_frame = filelist->nfiles;
+        opendcp->j2k.end_frame = filelist->nfiles / stride;
     }
 
     /* start frame check */
@@ -530,53 +881,183 @@ int main (int argc, char **argv) {
         dcp_fatal(opendcp, "Start frame must be less than end frame");
     }
 
-    OPENDCP_LOG(LOG_DEBUG, "checking file sequence", in_path);
+    /* the range of files to encode, left and right of a pair are adjacent */
+    first = (opendcp->j2k.start_frame - 1) * stride;
+    last  = opendcp->j2k.end_frame * stride;
+
+    /* 3D pairs were ordered per eye, a sequence pattern is in order by construction */
+    if (stride == 1 && !sequence) {
+        OPENDCP_LOG(LOG_DEBUG, "checking file sequence", in_path);
+
+        /* Sort files by index, and make sure they're sequential. */
+        if (filelist_order(filelist, &rc) != OPENDCP_NO_ERROR) {
+            dcp_fatal(opendcp, "Could not order image files");
+        }
+
+        if (rc != OPENDCP_NO_ERROR) {
+            OPENDCP_LOG(LOG_WARN, "Filenames not sequential between %s and %s.", filelist_file(filelist, rc), filelist_file(filelist, rc + 1));
+        }
+    }
+    else {
+        pair_state = calloc(opendcp->j2k.end_frame, 1);
+        pairs_ready = opendcp->j2k.start_frame - 1;
 
-    /* Sort files by index, and make sure they're sequential. */
-    if (order_indexed_files(filelist->files, filelist->nfiles) != OPENDCP_NO_ERROR) {
-        dcp_fatal(opendcp, "Could not order image files");
+        if (!pair_state) {
+            dcp_fatal(opendcp, "Could not allocate 3D pair state");
+        }
     }
 
-    rc = ensure_sequential(filelist->files, filelist->nfiles);
+    /* readahead check */
+    if (readahead < 0) {
+        dcp_fatal(opendcp, "Readahead must be 0 or greater");
+    }
 
-    if (rc != OPENDCP_NO_ERROR) {
-        OPENDCP_LOG(LOG_WARN, "Filenames not sequential between %s and %s.", filelist->files[rc], filelist->files[rc + 1]);
+    if (readahead) {
+        prefetch = opendcp_prefetch_create(filelist, first, last, (long long)readahead * 1024 * 1024);
     }
 
-    if (opendcp->log_level > 0 && opendcp->log_level < 3) {
-        progress_bar(0, 0);
+    /* encode cache check */
+    if (cache_path) {
+        if (cache_size < 1) {
+            dcp_fatal(opendcp, "Cache size must be greater than 0");
+        }
+
+        cache = opendcp_cache_open(cache_path, (long long)cache_size * 1024 * 1024);
+
+        if (!cache) {
+            dcp_fatal(opendcp, "Could not open encode cache %s", cache_path);
+        }
+
+        opendcp->j2k.cache = cache;
     }
 
+    /* the achieved bit rate is always reported, frames are only budgeted with a target */
+    rate_control = opendcp_ratecontrol_create(opendcp, first, last - first, target_bw * 1000000);
+    opendcp->j2k.rate_control = rate_control;
+
+    /* each worker reuses the frame buffers it released */
+    opendcp_image_pool_size(opendcp->threads);
+
 #ifdef OPENMP
     omp_set_num_threads(opendcp->threads);
     OPENDCP_LOG(LOG_DEBUG, "OpenMP Enable");
 #endif
 
-    count = opendcp->j2k.start_frame;
+    if (rate_control && target_bw) {
+        if (opendcp->log_level > 0) {
+            printf("  Analyzing %d frames for rate control\n", rate_control->nframes);
+        }
+
+        #pragma omp parallel for private(c) schedule(dynamic, 1)
 
-    #pragma omp parallel for private(c)
+        for (c = first; c < last; c++) {
+            #pragma omp flush(SIGINT_received)
 
-    for (c = opendcp->j2k.start_frame - 1; c < opendcp->j2k.end_frame; c++) {
+            /* only a sample of the frames is decoded, the rest are interpolated */
+            if ((c - first) % rate_control->analyze_step && c != last - 1) {
+                continue;
+            }
+
+            if (!SIGINT_received) {
+                opendcp_ratecontrol_analyze(rate_control, c, filelist_file(filelist, c));
+            }
+        }
+
+        opendcp_ratecontrol_allocate(rate_control);
+    }
+
+    /* each repeated frame points to the first of its run */
+    if (dedup) {
+        hash   = calloc(filelist->nfiles, sizeof(*hash));
+        hashed = calloc(filelist->nfiles, sizeof(*hashed));
+        leader = malloc(filelist->nfiles * sizeof(*leader));
+
+        if (!hash || !hashed || !leader) {
+            dcp_fatal(opendcp, "Could not allocate duplicate frame detection");
+        }
+
+        for (c = 0; c < filelist->nfiles; c++) {
+            leader[c] = -1;
+        }
+    }
+
+    if (opendcp->log_level > 0 && opendcp->log_level < 3) {
+        progress_bar(0, 0);
+    }
+
+    count = first + 1;
+
+    /* hand out frames in order so the readahead window stays ahead of every worker,
+       in 3D the two eyes of a frame go to adjacent workers */
+    #pragma omp parallel for private(c) schedule(dynamic, 1) ordered
+
+    for (c = first; c < last; c++) {
         #pragma omp flush(SIGINT_received)
 
+        /* hash each source as its frame is read, in frame order, a frame whose bytes match the previous
+           frame of its eye joins that run, a matching hash alone is not taken as proof */
+        if (leader) {
+            #pragma omp ordered
+            {
+                if (!SIGINT_received) {
+                    hashed[c] = opendcp_hash_file(filelist_file(filelist, c), 0, &hash[c]) == OPENDCP_NO_ERROR;
+
+                    if (hashed[c] && c - stride >= first && hashed[c - stride] && hash[c] == hash[c - stride]) {
+                        int run = leader[c - stride] >= 0 ? leader[c - stride] : c - stride;
+
+                        if (opendcp_compare_files(filelist_file(filelist, run), filelist_file(filelist, c))) {
+                            leader[c] = run;
+                            dup_runs += leader[c - stride] < 0;
+                            dup_frames++;
+                        }
+                        else {
+                            OPENDCP_LOG(LOG_WARN, "%s has the hash of %s but different contents, encoding it", filelist_file(filelist, c), filelist_file(filelist, run));
+                        }
+                    }
+                }
+            }
+        }
+
         /* check for non-ascii filenames under windows */
 #ifdef _WIN32
 
-        if (is_filename_ascii(filelist->files[c]) == 0) {
-            OPENDCP_LOG(LOG_WARN, "Filename %s contains non-ascii characters, skipping", filelist->files[c]);
+        if (is_filename_ascii(filelist_file(filelist, c)) == 0) {
+            OPENDCP_LOG(LOG_WARN, "Filename %s contains non-ascii characters, skipping", filelist_file(filelist, c));
             continue;
         }
 
 #endif
 
         char out[MAX_FILENAME_LENGTH];
-        build_j2k_filename(filelist->files[c], out_path, out);
+        char part[MAX_FILENAME_LENGTH];
+        double start_time;
+        int written = 0;
+        build_j2k_filename(filelist_file(filelist, c), out_dir[c % stride], out);
+
+        /* 3D codestreams are written aside and only moved into place as whole pairs in frame order */
+        snprintf(part, sizeof(part), "%s.part", out);
 
         if (!SIGINT_received) {
-            OPENDCP_LOG(LOG_INFO, "JPEG2000 conversion %s started OPENMP: %d", filelist->files[c], openmp_flag);
+            OPENDCP_LOG(LOG_INFO, "JPEG2000 conversion %s started OPENMP: %d", filelist_file(filelist, c), openmp_flag);
+
+            /* release the frame from the readahead window */
+            opendcp_prefetch_frame(prefetch, c);
+
+            /* repeated frames are linked to the first of their run afterwards */
+            if (leader && leader[c] >= 0) {
+                result = OPENDCP_NO_ERROR;
+            }
+            else if(access(out, F_OK) != 0 || opendcp->j2k.no_overwrite == 0) {
+                start_time = wall_time();
+                result = convert_to_j2k_frame(opendcp, filelist_file(filelist, c), pair_state ? part : out, c);
+                written = 1;
+                start_time = wall_time() - start_time;
 
-            if(access(out, F_OK) != 0 || opendcp->j2k.no_overwrite == 0) {
-                result = convert_to_j2k(opendcp, filelist->files[c], out);
+                #pragma omp atomic
+                encode_time += start_time;
+
+                #pragma omp atomic
+                encoded++;
             }
             else {
                 result = OPENDCP_NO_ERROR;
@@ -584,16 +1065,36 @@ int main (int argc, char **argv) {
 
             if (count) {
                 if (opendcp->log_level > 0 && opendcp->log_level < 3) {
-                    progress_bar(count, opendcp->j2k.end_frame);
+                    progress_bar(count, last);
                 }
             }
 
             if (result == OPENDCP_ERROR) {
-                OPENDCP_LOG(LOG_ERROR, "JPEG2000 conversion %s failed", filelist->files[c]);
+                OPENDCP_LOG(LOG_ERROR, "JPEG2000 conversion %s failed", filelist_file(filelist, c));
                 dcp_fatal(opendcp, "Exiting...");
             }
             else {
-                OPENDCP_LOG(LOG_INFO, "JPEG2000 conversion %s complete", filelist->files[c]);
+                OPENDCP_LOG(LOG_INFO, "JPEG2000 conversion %s complete", filelist_file(filelist, c));
+            }
+
+            /* publish every pair that is now complete, in frame order, pairs_ready is the next one */
+            if (pair_state) {
+                int published = OPENDCP_NO_ERROR;
+
+                #pragma omp critical (opendcp_pairs)
+                {
+                    pair_state[c / 2] |= PAIR_DONE(c % 2) | (written ? PAIR_PART(c % 2) : 0);
+
+                    while (published == OPENDCP_NO_ERROR && pairs_ready < opendcp->j2k.end_frame &&
+                           (pair_state[pairs_ready] & PAIR_COMPLETE) == PAIR_COMPLETE) {
+                        published = publish_j2k_pair(filelist, out_dir, leader, rate_control, pairs_ready, pair_state[pairs_ready]);
+                        pairs_ready += published == OPENDCP_NO_ERROR;
+                    }
+                }
+
+                if (published == OPENDCP_ERROR) {
+                    dcp_fatal(opendcp, "Exiting...");
+                }
             }
 
             count++;
@@ -601,7 +1102,54 @@ int main (int argc, char **argv) {
     }
 
     if (opendcp->log_level > 0 && opendcp->log_level < 3) {
-        progress_bar(count - 1, opendcp->j2k.end_frame);
+        progress_bar(count - 1, last);
+    }
+
+    if (leader) {
+        free(hash);
+        free(hashed);
+        OPENDCP_LOG(LOG_INFO, "%d repeated frames in %d runs", dup_frames, dup_runs);
+    }
+
+    /* the worker threads stay alive in the OpenMP pool, free their encoder contexts now */
+    #pragma omp parallel
+    {
+        opendcp_encode_openjpeg_release();
+        opendcp_encode_kakadu_release();
+    }
+
+    /* every run leader is written now, share its codestream with the repeats, 3D pairs did as they were published */
+    if (leader && !pair_state) {
+        for (c = first; c < last && !SIGINT_received; c++) {
+            char out[MAX_FILENAME_LENGTH];
+            char run[MAX_FILENAME_LENGTH];
+
+            if (leader[c] < 0) {
+                continue;
+            }
+
+            build_j2k_filename(filelist_file(filelist, leader[c]), out_dir[c % stride], run);
+            build_j2k_filename(filelist_file(filelist, c), out_dir[c % stride], out);
+
+            if (link_j2k_file(run, out) != OPENDCP_NO_ERROR) {
+                OPENDCP_LOG(LOG_ERROR, "could not link %s to %s", out, run);
+                dcp_fatal(opendcp, "Exiting...");
+            }
+
+            if (rate_control) {
+                opendcp_ratecontrol_end(rate_control, c, rate_control->achieved[leader[c] - rate_control->start]);
+            }
+        }
+    }
+
+    if (pair_state) {
+        OPENDCP_LOG(LOG_INFO, "3D pairs complete through frame %d", pairs_ready);
+        free(pair_state);
+    }
+
+    if (prefetch) {
+        OPENDCP_LOG(LOG_INFO, "readahead hits: %d misses: %d", prefetch->hits, prefetch->misses);
+        opendcp_prefetch_free(prefetch);
     }
 
     filelist_free(filelist);
@@ -610,6 +1158,39 @@ int main (int argc, char **argv) {
         printf("\n");
     }
 
+    if (rate_control) {
+        opendcp_ratecontrol_stats(rate_control, &rate_frames, &average_bw, &peak_bw);
+
+        if (rate_frames && opendcp->log_level > 0) {
+            printf("  Bit rate: %.2f Mbps average, %.2f Mbps peak over %d codestreams\n", average_bw / 1000000, peak_bw / 1000000, rate_frames);
+        }
+
+        OPENDCP_LOG(LOG_INFO, "bit rate %.0f average, %.0f peak over %d frames", average_bw, peak_bw, rate_frames);
+        opendcp->j2k.rate_control = NULL;
+        opendcp_ratecontrol_free(rate_control);
+    }
+
+    if (leader) {
+        if (dup_frames && opendcp->log_level > 0) {
+            printf("  Repeated frames: %d byte-identical source files in %d runs encoded once, about %.1fs of encoding saved\n", dup_frames, dup_runs,
+                   encoded ? encode_time / encoded * dup_frames : 0.0);
+        }
+
+        free(leader);
+    }
+
+    if (cache) {
+        if (opendcp->log_level > 0) {
+            printf("  Cache: %d hits, %d misses (%.1f%% hit rate), %d stored, %d evicted\n", cache->hits, cache->misses,
+                   cache->hits + cache->misses ? 100.0 * cache->hits / (cache->hits + cache->misses) : 0.0, cache->stores, cache->evictions);
+        }
+
+        OPENDCP_LOG(LOG_INFO, "encode cache hits: %d misses: %d stores: %d evictions: %d", cache->hits, cache->misses, cache->stores, cache->evictions);
+        opendcp->j2k.cache = NULL;
+        opendcp_cache_close(cache);
+    }
+
+    opendcp_image_pool_drain();
     opendcp_delete(opendcp);
 
     exit(0);
@@ -0,0 +1,167 @@
+/*
+    OpenDCP: Builds Digital Cinema Packages
+    Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* a kdu_compress stand-in, so the kakadu encoder can be tested without
+   kakadu. it takes the kdu_compress arguments opendcp passes and encodes with
+   openjpeg. with "-i - -o -" it is a stream mode worker: raw planar 16-bit
+   little endian frames of Sdims on stdin, "J2C <length>\n" and the codestream
+   on stdout for each */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "opendcp.h"
+#include "opendcp_image.h"
+#include "opendcp_encoder.h"
+
+static void usage() {
+    printf("usage: opendcp_kakadu_standin -i <file | -> -o <file | -> [Sdims={h,w}] [Scomponents=n] [Sprecision=p]\n"
+           "                              [Sprofile=CINEMA2K | CINEMA4K] [Creslengths=bytes] ...\n");
+}
+
+/* read one frame, returns 1 at the end of the input before a frame starts */
+static int read_frame(opendcp_image_t *image, unsigned char *line) {
+    int c, x, y, got;
+
+    for (c = 0; c < image->n_components; c++) {
+        int *data = image->component[c].data;
+
+        for (y = 0; y < image->h; y++) {
+            got = fread(line, 2, image->w, stdin);
+
+            if (got == 0 && c == 0 && y == 0) {
+                return 1;
+            }
+
+            if (got != image->w) {
+                return OPENDCP_ERROR;
+            }
+
+            for (x = 0; x < image->w; x++) {
+                *data++ = line[2 * x] | line[2 * x + 1] << 8;
+            }
+        }
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+static int stream(opendcp_t *opendcp, int w, int h, int precision) {
+    opendcp_image_t *image;
+    opendcp_buffer_t buffer;
+    unsigned char *line;
+    int result;
+
+    image = opendcp_image_create(3, w, h);
+    line  = malloc(2 * w);
+
+    if (!image || !line) {
+        printf("error: could not allocate a %dx%d frame\n", w, h);
+        return OPENDCP_ERROR;
+    }
+
+    image->precision = precision;
+
+    while ((result = read_frame(image, line)) == OPENDCP_NO_ERROR) {
+        opendcp_buffer_init(&buffer, NULL, 0);
+
+        if (opendcp_encode_openjpeg_buffer(opendcp, image, &buffer) != OPENDCP_NO_ERROR) {
+            printf("error: encoding failed\n");
+            fflush(stdout);
+            opendcp_buffer_free(&buffer);
+            result = OPENDCP_ERROR;
+            break;
+        }
+
+        printf("J2C %lu\n", (unsigned long)buffer.size);
+        fwrite(buffer.data, 1, buffer.size, stdout);
+        fflush(stdout);
+        opendcp_buffer_free(&buffer);
+    }
+
+    free(line);
+    opendcp_image_free(image);
+
+    return result == 1 ? OPENDCP_NO_ERROR : OPENDCP_ERROR;
+}
+
+int main (int argc, char **argv) {
+    opendcp_t *opendcp;
+    opendcp_image_t *image = NULL;
+    char *in = NULL, *out = NULL;
+    int w = 0, h = 0, components = 3, precision = 12, max_cs_len = 0;
+    int profile = DCP_CINEMA2K;
+    int i, result;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-u")) {
+            usage();
+            return 0;
+        }
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            in = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out = argv[++i];
+        }
+        else if (!strcmp(argv[i], "Sprofile=CINEMA4K")) {
+            profile = DCP_CINEMA4K;
+        }
+        else if (sscanf(argv[i], "Sdims={%d,%d}", &h, &w) == 2 ||
+                 sscanf(argv[i], "Scomponents=%d", &components) == 1 ||
+                 sscanf(argv[i], "Sprecision=%d", &precision) == 1 ||
+                 sscanf(argv[i], "Creslengths=%d", &max_cs_len) == 1) {
+            continue;
+        }
+
+        /* other kdu_compress arguments, such as per component lengths or -quiet, are accepted and ignored */
+    }
+
+    if (!in || !out) {
+        usage();
+        return -1;
+    }
+
+    opendcp = opendcp_create();
+    opendcp->cinema_profile = profile;
+    opendcp->frame_rate     = 24;
+    opendcp->j2k.bw         = max_cs_len ? max_cs_len * 8 * opendcp->frame_rate : MAX_DCP_JPEG_BITRATE;
+
+    if (!strcmp(in, "-") && !strcmp(out, "-")) {
+        if (w < 1 || h < 1 || components != 3) {
+            printf("error: stream mode needs Sdims and 3 components\n");
+            return -1;
+        }
+
+        result = stream(opendcp, w, h, precision);
+    }
+    else if (read_image(&image, in) == OPENDCP_NO_ERROR && image) {
+        result = opendcp_encode_openjpeg(opendcp, image, out);
+        opendcp_image_free(image);
+    }
+    else {
+        fprintf(stderr, "could not read %s\n", in);
+        result = OPENDCP_ERROR;
+    }
+
+    opendcp_encode_openjpeg_release();
+    opendcp_delete(opendcp);
+
+    return result == OPENDCP_NO_ERROR ? 0 : 1;
+}
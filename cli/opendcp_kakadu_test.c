@@ -0,0 +1,128 @@
+/*
+    OpenDCP: Builds Digital Cinema Packages
+    Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "opendcp.h"
+#include "opendcp_image.h"
+#include "opendcp_encoder.h"
+
+static int failures = 0;
+
+static void check(const char *name, int ok) {
+    if (ok) {
+        printf("  ok    %s\n", name);
+    } else {
+        printf("  FAIL  %s\n", name);
+        failures++;
+    }
+}
+
+static unsigned int be32(const unsigned char *p) {
+    return (unsigned int)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+/* a codestream starts with SOC and SIZ, which carries the image size */
+static int codestream_is(opendcp_buffer_t *buffer, int w, int h) {
+    const unsigned char *p = buffer->data;
+
+    if (buffer->size < 24 || p[0] != 0xff || p[1] != 0x4f || p[2] != 0xff || p[3] != 0x51) {
+        return 0;
+    }
+
+    return (int)(be32(p + 8) - be32(p + 16)) == w && (int)(be32(p + 12) - be32(p + 20)) == h;
+}
+
+/* a noisy 12-bit gradient */
+static void fill_image(opendcp_image_t *image, int frame) {
+    int c, i, size = image->w * image->h;
+    unsigned int seed = frame * 2654435761u + 1;
+
+    for (c = 0; c < image->n_components; c++) {
+        for (i = 0; i < size; i++) {
+            seed = seed * 1103515245u + 12345u;
+            image->component[c].data[i] = ((i % image->w) * 2 + c * 512 + (seed >> 26)) & 4095;
+        }
+    }
+}
+
+/* encode one frame through the worker of this thread */
+static int encode_frame(opendcp_t *opendcp, int w, int h, int frame) {
+    opendcp_image_t *image;
+    opendcp_buffer_t buffer;
+    int ok;
+
+    image = opendcp_image_create(3, w, h);
+
+    if (!image) {
+        return 0;
+    }
+
+    fill_image(image, frame);
+    opendcp_buffer_init(&buffer, NULL, 0);
+    ok = opendcp_encode_kakadu_buffer(opendcp, image, &buffer) == OPENDCP_NO_ERROR && codestream_is(&buffer, w, h);
+    opendcp_buffer_free(&buffer);
+    opendcp_image_free(image);
+
+    return ok;
+}
+
+int main (int argc, char **argv) {
+    opendcp_t *opendcp;
+    int i, ok;
+
+    if (argc < 2) {
+        printf("usage: opendcp_kakadu_test <kakadu stand-in>\n");
+        return -1;
+    }
+
+    opendcp_log_init(argc > 2 ? atoi(argv[2]) : 0);
+
+    opendcp = opendcp_create();
+    opendcp->cinema_profile    = DCP_CINEMA2K;
+    opendcp->frame_rate        = 24;
+    opendcp->j2k.bw            = 125000000;
+    opendcp->j2k.kakadu        = argv[1];
+    opendcp->j2k.kakadu_stream = 1;
+
+    printf("streaming frames to %s\n", argv[1]);
+
+    for (i = 0, ok = 1; i < 3; i++) {
+        ok &= encode_frame(opendcp, 2048, 858, i);
+    }
+
+    check("frames through one worker", ok);
+
+    /* a new frame size restarts the worker with new Sdims */
+    check("changed frame size", encode_frame(opendcp, 1998, 1080, 3));
+    check("previous frame size", encode_frame(opendcp, 2048, 858, 4));
+
+    /* a worker that exits at once must fail the frame, not kill the encoder with SIGPIPE */
+    opendcp->j2k.kakadu = "false";
+    check("failing worker", !encode_frame(opendcp, 2048, 858, 5));
+
+    opendcp->j2k.kakadu = argv[1];
+    check("worker after a failure", encode_frame(opendcp, 2048, 858, 6));
+
+    opendcp_encode_kakadu_release();
+    opendcp_delete(opendcp);
+
+    return failures ? OPENDCP_ERROR : 0;
+}
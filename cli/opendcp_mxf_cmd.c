@@ -44,7 +44,7 @@ void dcp_usage() {
     fprintf(fp, "Usage:\n");
     fprintf(fp, "       opendcp_mxf -i <file> -o <file> [options ...]\n\n");
     fprintf(fp, "Required:\n");
-    fprintf(fp, "       -i | --input <file | dir>      - input file or directory.\n");
+    fprintf(fp, "       -i | --input <file | dir>      - input file, directory or frame sequence pattern like reel_%%06d.j2c\n");
     fprintf(fp, "       -1 | --left <dir>              - left channel input images when creating a 3D essence\n");
     fprintf(fp, "       -2 | --right <dir>             - right channel input images when creating a 3D essence\n");
     fprintf(fp, "       -o | --output <file>           - output mxf file\n");
@@ -52,6 +52,7 @@ void dcp_usage() {
     fprintf(fp, "Options:\n");
     fprintf(fp, "       -n | --ns <interop | smpte>    - Generate SMPTE or MXF Interop labels (default smpte)\n");
     fprintf(fp, "       -r | --rate <rate>             - frame rate (default 24)\n");
+    fprintf(fp, "       -N | --sequence <first>:<last> - frame numbers of a sequence pattern input, the directory is not listed\n");
     fprintf(fp, "       -s | --start <frame>           - start frame\n");
     fprintf(fp, "       -d | --end  <frame>            - end frame\n");
     fprintf(fp, "       -p | --slideshow  <duration>   - create slideshow with each image having duration specified (in seconds)\n");
@@ -75,6 +76,12 @@ filelist_t *get_filelist_3d(char *in_path_left, char *in_path_right) {
     left  = get_filelist(in_path_left, "j2c,j2k");
     right = get_filelist(in_path_right, "j2c,j2k");
 
+    if (left == NULL || right == NULL) {
+        filelist_free(left);
+        filelist_free(right);
+        return NULL;
+    }
+
     if (left->nfiles != right->nfiles) {
         OPENDCP_LOG(LOG_ERROR, "Mismatching file count for 3D images left: %d right: %d", left->nfiles, right->nfiles);
         filelist_free(left);
@@ -83,16 +90,13 @@ filelist_t *get_filelist_3d(char *in_path_left, char *in_path_right) {
     }
 
     /* Sort files by index, and make sure they're sequential. */
-    if (order_indexed_files(left->files, left->nfiles) != OPENDCP_NO_ERROR ||
-            order_indexed_files(right->files, right->nfiles) != OPENDCP_NO_ERROR) {
+    if (filelist_order(left, &rc) != OPENDCP_NO_ERROR) {
         OPENDCP_LOG(LOG_WARN, "Could not order image files");
         filelist_free(left);
         filelist_free(right);
         return NULL;
     }
 
-    rc = ensure_sequential(left->files, left->nfiles);
-
     if (rc != OPENDCP_NO_ERROR) {
         OPENDCP_LOG(LOG_WARN, "Filenames not sequential between %s and %s.", left->files[rc], left->files[rc + 1]);
         filelist_free(left);
@@ -100,7 +104,12 @@ filelist_t *get_filelist_3d(char *in_path_left, char *in_path_right) {
         return NULL;
     }
 
-    rc = ensure_sequential(right->files, left->nfiles);
+    if (filelist_order(right, &rc) != OPENDCP_NO_ERROR) {
+        OPENDCP_LOG(LOG_WARN, "Could not order image files");
+        filelist_free(left);
+        filelist_free(right);
+        return NULL;
+    }
 
     if (rc != OPENDCP_NO_ERROR) {
         OPENDCP_LOG(LOG_WARN, "Filenames not sequential between %s and %s.", right->files[rc], right->files[rc + 1]);
@@ -112,8 +121,8 @@ filelist_t *get_filelist_3d(char *in_path_left, char *in_path_right) {
     filelist = filelist_alloc(left->nfiles + right->nfiles);
 
     for (x = 0; x < filelist->nfiles; y++, x += 2) {
-        snprintf(filelist->files[x], sizeof(filelist->files[x]), "%s", left->files[y]);
-        snprintf(filelist->files[x + 1], sizeof(filelist->files[x + 1]), "%s", right->files[y]);
+        snprintf(filelist->files[x], MAX_FILENAME_LENGTH, "%s", left->files[y]);
+        snprintf(filelist->files[x + 1], MAX_FILENAME_LENGTH, "%s", right->files[y]);
     }
 
     filelist_free(left);
@@ -166,6 +175,7 @@ int main (int argc, char **argv) {
     char *in_path = NULL;
     char *in_path_left = NULL;
     char *in_path_right = NULL;
+    char *sequence = NULL;
     char *out_path = NULL;
     filelist_t *filelist;
     char key_id[40];
@@ -192,6 +202,7 @@ int main (int argc, char **argv) {
             {"key",            required_argument, 0, 'k'},
             {"help",           required_argument, 0, 'h'},
             {"input",          required_argument, 0, 'i'},
+            {"sequence",       required_argument, 0, 'N'},
             {"left",           required_argument, 0, '1'},
             {"right",          required_argument, 0, '2'},
             {"ns",             required_argument, 0, 'n'},
@@ -208,7 +219,7 @@ int main (int argc, char **argv) {
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "1:2:d:i:k:n:o:r:s:p:u:l:3hv",
+        c = getopt_long (argc, argv, "1:2:d:i:k:n:N:o:r:s:p:u:l:3hv",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -283,6 +294,10 @@ int main (int argc, char **argv) {
                 in_path = optarg;
                 break;
 
+            case 'N':
+                sequence = optarg;
+                break;
+
             case '1':
                 in_path_left = optarg;
                 opendcp->stereoscopic = 1;
@@ -365,6 +380,12 @@ int main (int argc, char **argv) {
         if (in_path == NULL) {
             dcp_fatal(opendcp, "Missing input file");
         }
+        else if (is_sequence_pattern(in_path) && sequence == NULL) {
+            dcp_fatal(opendcp, "Input %s looks like a sequence pattern, give its frame numbers with --sequence <first>:<last>", in_path);
+        }
+        else if (sequence && !is_sequence_pattern(in_path)) {
+            dcp_fatal(opendcp, "--sequence needs a frame sequence pattern input like reel_%%06d.j2c");
+        }
     }
 
     if (out_path == NULL) {
@@ -374,18 +395,21 @@ int main (int argc, char **argv) {
     if (opendcp->stereoscopic) {
         filelist = get_filelist_3d(in_path_left, in_path_right);
     }
+    else if (sequence) {
+        /* generated in order, names are only made when the writer reaches them */
+        filelist = get_filelist_sequence(in_path, sequence);
+    }
     else {
         filelist = get_filelist(in_path, "j2c,j2k,wav");
+        int rc = OPENDCP_NO_ERROR;
 
         /* Sort files by index, and make sure they're sequential. */
-        if (order_indexed_files(filelist->files, filelist->nfiles) != OPENDCP_NO_ERROR) {
+        if (filelist && filelist_order(filelist, &rc) != OPENDCP_NO_ERROR) {
             dcp_fatal(opendcp, "Could not order image files");
         }
 
-        int rc = ensure_sequential(filelist->files, filelist->nfiles);
-
         if (rc != OPENDCP_NO_ERROR) {
-            OPENDCP_LOG(LOG_WARN, "Filenames not sequential between %s and %s.", filelist->files[rc], filelist->files[rc + 1]);
+            OPENDCP_LOG(LOG_WARN, "Filenames not sequential between %s and %s.", filelist_file(filelist, rc), filelist_file(filelist, rc + 1));
         }
     }
 
@@ -405,8 +429,8 @@ int main (int argc, char **argv) {
 
     /* check for non-ascii filenames under windows */
     for (c = 0; c < filelist->nfiles; c++) {
-        if (is_filename_ascii(filelist->files[c]) == 0) {
-            OPENDCP_LOG(LOG_ERROR, "Filename %s contains non-ascii characters, skipping", filelist->files[c]);
+        if (is_filename_ascii(filelist_file(filelist, c)) == 0) {
+            OPENDCP_LOG(LOG_ERROR, "Filename %s contains non-ascii characters, skipping", filelist_file(filelist, c));
             dcp_fatal(opendcp, "Filenames cannot contain non-ascii characters");
         }
     }
@@ -448,14 +472,22 @@ int main (int argc, char **argv) {
         opendcp->mxf.file_done.callback  = write_done_cb;
     }
 
-    int class = get_file_essence_class(filelist->files[0], 1);
+    int class = get_file_essence_class(filelist_file(filelist, 0), 1);
+
+    /* catch a mixed sequence from its headers before any essence is wrapped */
+    if (class == ACT_PICTURE && get_file_essence_type(filelist_file(filelist, 0)) == AET_JPEG_2000) {
+        if (check_j2k_sequence(opendcp, filelist, opendcp->mxf.start_frame - 1, opendcp->mxf.end_frame,
+                               &opendcp->mxf.frame_size) != OPENDCP_NO_ERROR) {
+            dcp_fatal(opendcp, "JPEG2000 sequence does not match its first frame");
+        }
+    }
 
     if (opendcp->log_level > 0 && opendcp->log_level < 3) {
         progress_bar();
     }
 
     if (class == ACT_SOUND) {
-        total = get_wav_duration(filelist->files[0], opendcp->frame_rate);
+        total = get_wav_duration(filelist_file(filelist, 0), opendcp->frame_rate);
     }
     else {
         total = opendcp->mxf.duration;
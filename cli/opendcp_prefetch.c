@@ -0,0 +1,225 @@
+/*
+    OpenDCP: Builds Digital Cinema Packages
+    Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "opendcp.h"
+#include "opendcp_cli.h"
+
+enum PREFETCH_STATE {
+    PREFETCH_IDLE = 0,
+    PREFETCH_ISSUED,
+    PREFETCH_READY,
+    PREFETCH_CONSUMED
+};
+
+static void prefetch_fill(opendcp_prefetch_t *prefetch);
+
+/* ask the kernel to start reading a file in the background */
+static int prefetch_file(const char *filename, long long size) {
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+
+    if (fd < 0) {
+        return OPENDCP_ERROR;
+    }
+
+#if defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fd, 0, size, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+    {
+        struct radvisory ra;
+        ra.ra_offset = 0;
+        ra.ra_count  = size;
+        fcntl(fd, F_RDADVISE, &ra);
+    }
+#else
+    (void)size;
+#endif
+
+    close(fd);
+
+    return OPENDCP_NO_ERROR;
+}
+
+/**
+create a readahead scheduler
+
+The scheduler walks the ordered filelist and asks the operating system to
+read upcoming frames while the current ones are being encoded. The number
+of bytes that have been requested but not yet consumed is capped, a frame
+is charged its file size when it is claimed.
+
+@param  filelist the ordered list of input files
+@param  start the first frame index (zero based)
+@param  end one past the last frame index
+@param  max_bytes the maximum number of bytes in flight
+@return opendcp_prefetch_t pointer, NULL on failure
+*/
+opendcp_prefetch_t *opendcp_prefetch_create(filelist_t *filelist, int start, int end, long long max_bytes) {
+    opendcp_prefetch_t *prefetch;
+
+    if (filelist == NULL || end <= start || max_bytes <= 0) {
+        return NULL;
+    }
+
+    prefetch = malloc(sizeof(opendcp_prefetch_t));
+
+    if (!prefetch) {
+        return NULL;
+    }
+
+    memset(prefetch, 0, sizeof(opendcp_prefetch_t));
+
+    prefetch->state = calloc(filelist->nfiles, sizeof(*prefetch->state));
+    prefetch->size  = calloc(filelist->nfiles, sizeof(*prefetch->size));
+
+    if (!prefetch->state || !prefetch->size) {
+        opendcp_prefetch_free(prefetch);
+        return NULL;
+    }
+
+    prefetch->filelist  = filelist;
+    prefetch->next      = start;
+    prefetch->end       = end;
+    prefetch->max_bytes = max_bytes;
+
+    OPENDCP_LOG(LOG_DEBUG, "readahead enabled, %lld bytes in flight", max_bytes);
+
+    /* prime the window before the workers start */
+    prefetch_fill(prefetch);
+
+    return prefetch;
+}
+
+/* claim the next frame to prefetch and charge its size to the window, returns -1 if the window is full */
+static int prefetch_claim(opendcp_prefetch_t *prefetch) {
+    struct stat st;
+    long long size;
+    int frame = -1;
+
+    #pragma omp critical (opendcp_prefetch)
+    {
+        while (prefetch->next < prefetch->end && prefetch->state[prefetch->next] != PREFETCH_IDLE) {
+            prefetch->next++;
+        }
+
+        if (prefetch->next < prefetch->end) {
+            /* a missing frame costs nothing, it is reported when it is advised */
+            size = stat(filelist_file(prefetch->filelist, prefetch->next), &st) == 0 ? (long long)st.st_size : 0;
+
+            /* an empty window takes any frame, so a frame larger than the window is still read ahead */
+            if (!prefetch->bytes_in_flight || prefetch->bytes_in_flight + size <= prefetch->max_bytes) {
+                frame = prefetch->next++;
+                prefetch->state[frame] = PREFETCH_ISSUED;
+                prefetch->size[frame]  = size;
+                prefetch->bytes_in_flight += size;
+            }
+        }
+    }
+
+    return frame;
+}
+
+/* fill the readahead window */
+static void prefetch_fill(opendcp_prefetch_t *prefetch) {
+    int frame;
+
+    while ((frame = prefetch_claim(prefetch)) >= 0) {
+        if (prefetch_file(filelist_file(prefetch->filelist, frame), prefetch->size[frame]) != OPENDCP_NO_ERROR) {
+            /* a sequence pattern is never listed, so this is the first sign of a missing frame */
+            OPENDCP_LOG(prefetch->filelist->pattern ? LOG_WARN : LOG_DEBUG, "readahead could not open %s",
+                        filelist_file(prefetch->filelist, frame));
+        }
+
+        #pragma omp critical (opendcp_prefetch)
+        {
+            /* a worker may have reached the frame while it was being advised */
+            if (prefetch->state[frame] == PREFETCH_ISSUED) {
+                prefetch->state[frame] = PREFETCH_READY;
+            }
+        }
+    }
+}
+
+/**
+notify the scheduler that a worker is about to read a frame
+
+The frame is released from the readahead window, the hit/miss counters are
+updated and the window is refilled.
+
+@param  prefetch a readahead scheduler, may be NULL
+@param  frame the frame index (zero based)
+@return NONE
+*/
+void opendcp_prefetch_frame(opendcp_prefetch_t *prefetch, int frame) {
+    if (prefetch == NULL || frame < 0 || frame >= prefetch->filelist->nfiles) {
+        return;
+    }
+
+    #pragma omp critical (opendcp_prefetch)
+    {
+        if (prefetch->state[frame] == PREFETCH_READY) {
+            prefetch->hits++;
+        }
+        else {
+            prefetch->misses++;
+        }
+
+        /* the frame was charged when it was claimed */
+        if (prefetch->state[frame] == PREFETCH_READY || prefetch->state[frame] == PREFETCH_ISSUED) {
+            prefetch->bytes_in_flight -= prefetch->size[frame];
+        }
+
+        prefetch->state[frame] = PREFETCH_CONSUMED;
+    }
+
+    prefetch_fill(prefetch);
+}
+
+/**
+free a readahead scheduler
+
+@param  prefetch a readahead scheduler
+@return NONE
+*/
+void opendcp_prefetch_free(opendcp_prefetch_t *prefetch) {
+    if (prefetch == NULL) {
+        return;
+    }
+
+    if (prefetch->state) {
+        free(prefetch->state);
+    }
+
+    if (prefetch->size) {
+        free(prefetch->size);
+    }
+
+    free(prefetch);
+}
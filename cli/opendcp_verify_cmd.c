@@ -0,0 +1,271 @@
+/*
+    OpenDCP: Builds Digital Cinema Packages
+    Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+#include "opendcp.h"
+
+void dcp_usage() {
+    FILE *fp;
+    fp = stdout;
+
+    fprintf(fp, "\n%s version %s %s\n\n", OPENDCP_NAME, OPENDCP_VERSION, OPENDCP_COPYRIGHT);
+    fprintf(fp, "Verifies every asset of a DCP against its packing list and composition playlists\n\n");
+    fprintf(fp, "Usage:\n");
+    fprintf(fp, "       opendcp_verify -i <dir> [options ...]\n\n");
+    fprintf(fp, "Required:\n");
+    fprintf(fp, "       -i | --input <dir>             - DCP directory containing the ASSETMAP\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "Options:\n");
+    fprintf(fp, "       -t | --threads <threads>       - assets hashed at once, spread over the drives they live on (default 4)\n");
+    fprintf(fp, "       -k | --key <key>               - content key, encrypted track files have every frame HMAC checked\n");
+    fprintf(fp, "       -l | --log_level <level>       - sets the log level 0:Quiet, 1:Error, 2:Warn (default),  3:Info, 4:Debug\n");
+    fprintf(fp, "       -h | --help                    - show help\n");
+    fprintf(fp, "       -v | --version                 - show version\n");
+    fprintf(fp, "\n\n");
+
+    fclose(fp);
+    exit(0);
+}
+
+void version() {
+    FILE *fp;
+
+    fp = stdout;
+    fprintf(fp, "\n%s version %s %s\n\n", OPENDCP_NAME, OPENDCP_VERSION, OPENDCP_COPYRIGHT);
+
+    exit(0);
+}
+
+double wall_time() {
+#ifdef OPENMP
+    return omp_get_wtime();
+#else
+    return (double)time(NULL);
+#endif
+}
+
+/* the largest unclaimed asset on the drive with the fewest readers, -1 when done */
+int next_asset(opendcp_verify_t *verify, unsigned char *claimed, int *readers) {
+    int i, best = -1;
+
+    for (i = 0; i < verify->asset_count; i++) {
+        opendcp_verify_asset_t *a = &verify->asset[i];
+        opendcp_verify_asset_t *b = best < 0 ? NULL : &verify->asset[best];
+
+        if (claimed[i]) {
+            continue;
+        }
+
+        if (b == NULL || readers[a->device] < readers[b->device] ||
+            (readers[a->device] == readers[b->device] && a->size > b->size)) {
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+int main (int argc, char **argv) {
+    int c, i, errors = 0, done = 0;
+    char *in_path = NULL;
+    byte_t key[16];
+    int key_flag = 0;
+    int *readers;
+    unsigned char *claimed;
+    long long bytes = 0;
+    double start_time;
+    opendcp_t *opendcp;
+    opendcp_verify_t *verify;
+
+    if ( argc <= 1 ) {
+        dcp_usage();
+    }
+
+    opendcp = opendcp_create();
+    opendcp->threads = 4;
+
+    /* parse options */
+    while (1)
+    {
+        static struct option long_options[] =
+        {
+            {"help",           required_argument, 0, 'h'},
+            {"input",          required_argument, 0, 'i'},
+            {"key",            required_argument, 0, 'k'},
+            {"log_level",      required_argument, 0, 'l'},
+            {"threads",        required_argument, 0, 't'},
+            {"version",        no_argument,       0, 'v'},
+            {0, 0, 0, 0}
+        };
+
+        /* getopt_long stores the option index here. */
+        int option_index = 0;
+
+        c = getopt_long (argc, argv, "i:k:l:t:hv",
+                         long_options, &option_index);
+
+        /* Detect the end of the options. */
+        if (c == -1) {
+            break;
+        }
+
+        switch (c)
+        {
+            case 0:
+
+                /* If this option set a flag, do nothing else now. */
+                if (long_options[option_index].flag != 0) {
+                    break;
+                }
+
+                break;
+
+            case 'h':
+                dcp_usage();
+                break;
+
+            case 'i':
+                in_path = optarg;
+                break;
+
+            case 'k':
+                if (!is_key(optarg) || hex2bin(optarg, key, 16)) {
+                    dcp_fatal(opendcp, "Invalid encryption key format");
+                }
+
+                key_flag = 1;
+                break;
+
+            case 'l':
+                opendcp->log_level = atoi(optarg);
+                break;
+
+            case 't':
+                opendcp->threads = atoi(optarg);
+                break;
+
+            case 'v':
+                version();
+                break;
+        }
+    }
+
+    opendcp_log_init(opendcp->log_level);
+
+    if (opendcp->log_level > 0) {
+        printf("\nOpenDCP Verify %s %s\n", OPENDCP_VERSION, OPENDCP_COPYRIGHT);
+    }
+
+    if (in_path == NULL) {
+        dcp_fatal(opendcp, "Missing input directory");
+    }
+
+    if (in_path[strlen(in_path) - 1] == '/') {
+        in_path[strlen(in_path) - 1] = '\0';
+    }
+
+    if (opendcp->threads < 1) {
+        dcp_fatal(opendcp, "Threads must be 1 or greater");
+    }
+
+    verify = opendcp_verify_open(in_path);
+
+    if (verify == NULL) {
+        dcp_fatal(opendcp, "Could not read the asset map and packing list of %s", in_path);
+    }
+
+    claimed = calloc(verify->asset_count ? verify->asset_count : 1, 1);
+    readers = calloc(verify->device_count, sizeof(*readers));
+
+    if (!claimed || !readers) {
+        dcp_fatal(opendcp, "Could not allocate verification state");
+    }
+
+#ifdef OPENMP
+    omp_set_num_threads(opendcp->threads);
+#endif
+
+    start_time = wall_time();
+
+    /* assets are claimed one at a time, so a worker moves on to whichever drive is least busy */
+    #pragma omp parallel private(i)
+    {
+        while (1) {
+            #pragma omp critical (opendcp_verify)
+            {
+                i = next_asset(verify, claimed, readers);
+
+                if (i >= 0) {
+                    claimed[i] = 1;
+                    readers[verify->asset[i].device]++;
+                }
+            }
+
+            if (i < 0) {
+                break;
+            }
+
+            OPENDCP_LOG(LOG_INFO, "verifying %s", verify->asset[i].filename);
+            opendcp_verify_asset(verify, i, key_flag ? key : NULL);
+
+            #pragma omp critical (opendcp_verify)
+            {
+                readers[verify->asset[i].device]--;
+                done++;
+
+                if (verify->asset[i].result == OPENDCP_NO_ERROR) {
+                    bytes += verify->asset[i].size;
+                    OPENDCP_LOG(LOG_INFO, "%s OK", verify->asset[i].filename);
+                }
+                else {
+                    errors++;
+                    OPENDCP_LOG(LOG_ERROR, "%s %s: %s", verify->asset[i].uuid,
+                                verify->asset[i].filename, OPENDCP_ERROR_STRING[verify->asset[i].result]);
+                }
+
+                if (opendcp->log_level > 0 && opendcp->log_level < 3) {
+                    printf("  Verifying [%d/%d]\r", done, verify->asset_count);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    start_time = wall_time() - start_time;
+
+    if (opendcp->log_level > 0) {
+        printf("\n  %d assets, %d failed, %.1f MB in %.1f seconds (%.1f MB/s)\n", verify->asset_count, errors,
+               bytes / 1048576.0, start_time, start_time > 0 ? bytes / 1048576.0 / start_time : 0.0);
+    }
+
+    free(claimed);
+    free(readers);
+    opendcp_verify_free(verify);
+    opendcp_delete(opendcp);
+
+    exit(errors ? OPENDCP_ERROR : OPENDCP_NO_ERROR);
+}
@@ -0,0 +1,345 @@
+/*
+    OpenDCP: Builds Digital Cinema Packages
+    Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "opendcp.h"
+#include "sha1.h"
+
+#define ASSET_UUID  "4b2a4c6e-8f43-4e67-9d7b-2f4c1a5e0d11"
+#define MXF_UUID    "c3e1d7a2-6b5f-4f80-a2c9-1e8d4b7f3a33"
+#define CPL_UUID    "e7b4a1f9-2d6c-4b3e-9f51-8a0c6d2e5b44"
+#define PKL_UUID    "9a0f3e8c-5c1d-4a3b-8e2f-6d7c9b1a4e22"
+
+/* larger than one digest read, so the asset spans several blocks */
+#define ASSET_SIZE  (20 * 1024 * 1024 + 123)
+
+/* the sound track, one second of 24-bit 48 kHz mono at 24 frames per second */
+#define MXF_FRAMES  24
+#define WAV_RATE    48000
+
+static const byte_t mxf_key[16]   = { 0x4f, 0x70, 0x65, 0x6e, 0x44, 0x43, 0x50, 0x20, 0x76, 0x65, 0x72, 0x69, 0x66, 0x79, 0x21, 0x00 };
+static const byte_t wrong_key[16] = { 0x4f, 0x70, 0x65, 0x6e, 0x44, 0x43, 0x50, 0x20, 0x76, 0x65, 0x72, 0x69, 0x66, 0x79, 0x21, 0x01 };
+
+static int failures = 0;
+
+static void check(const char *name, int result, int expected) {
+    if (result == expected) {
+        printf("  ok    %s\n", name);
+    } else {
+        printf("  FAIL  %s: %s, expected %s\n", name, OPENDCP_ERROR_NAME[result], OPENDCP_ERROR_NAME[expected]);
+        failures++;
+    }
+}
+
+/* write a sha1 as base64 */
+static void encode_digest(const unsigned char *hash, char *digest) {
+    static const char *b64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    int i, j, v;
+
+    for (i = j = 0; i < SHA1_BLOCK_SIZE; i += 3) {
+        v = hash[i] << 16 | (i + 1 < SHA1_BLOCK_SIZE ? hash[i + 1] << 8 : 0) | (i + 2 < SHA1_BLOCK_SIZE ? hash[i + 2] : 0);
+        digest[j++] = b64[v >> 18 & 63];
+        digest[j++] = b64[v >> 12 & 63];
+        digest[j++] = i + 1 < SHA1_BLOCK_SIZE ? b64[v >> 6 & 63] : '=';
+        digest[j++] = i + 2 < SHA1_BLOCK_SIZE ? b64[v & 63] : '=';
+    }
+
+    digest[j] = '\0';
+}
+
+/* the sha1 of a file as base64, returns its size or -1 */
+static long long file_digest(const char *filename, char *digest) {
+    unsigned char hash[SHA1_BLOCK_SIZE];
+    unsigned char data[65536];
+    long long size = 0;
+    sha1_t sha;
+    size_t n;
+    FILE *fp;
+
+    fp = fopen(filename, "rb");
+
+    if (!fp) {
+        return -1;
+    }
+
+    sha1_init(&sha);
+
+    while ((n = fread(data, 1, sizeof(data), fp)) > 0) {
+        sha1_update(&sha, data, n);
+        size += n;
+    }
+
+    fclose(fp);
+    sha1_final(&sha, hash);
+    encode_digest(hash, digest);
+
+    return size;
+}
+
+/* write a deterministic asset and return its sha1 as base64 */
+static int write_asset(const char *filename, char *digest) {
+    unsigned char hash[SHA1_BLOCK_SIZE];
+    unsigned char *data;
+    unsigned int seed = 1;
+    sha1_t sha;
+    FILE *fp;
+    int i;
+
+    data = malloc(ASSET_SIZE);
+    fp   = fopen(filename, "wb");
+
+    if (!data || !fp) {
+        return OPENDCP_ERROR;
+    }
+
+    for (i = 0; i < ASSET_SIZE; i++) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = seed >> 24;
+    }
+
+    fwrite(data, 1, ASSET_SIZE, fp);
+    fclose(fp);
+
+    sha1_init(&sha);
+    sha1_update(&sha, data, ASSET_SIZE);
+    sha1_final(&sha, hash);
+    free(data);
+
+    encode_digest(hash, digest);
+
+    return OPENDCP_NO_ERROR;
+}
+
+static void put_le(FILE *fp, unsigned int v, int bytes) {
+    while (bytes--) {
+        fputc(v & 0xff, fp);
+        v >>= 8;
+    }
+}
+
+/* write a 24-bit mono wav of MXF_FRAMES frames and wrap it in an encrypted track file with HMAC values */
+static int write_mxf_asset(const char *path, const char *filename) {
+    char wav[MAX_PATH_LENGTH];
+    opendcp_t *opendcp;
+    filelist_t *filelist;
+    int samples = WAV_RATE / 24 * MXF_FRAMES;
+    int i, result;
+    FILE *fp;
+
+    snprintf(wav, sizeof(wav), "%s/sound.wav", path);
+    fp = fopen(wav, "wb");
+
+    if (!fp) {
+        return OPENDCP_ERROR;
+    }
+
+    fputs("RIFF", fp);
+    put_le(fp, 36 + samples * 3, 4);
+    fputs("WAVEfmt ", fp);
+    put_le(fp, 16, 4);
+    put_le(fp, 1, 2);
+    put_le(fp, 1, 2);
+    put_le(fp, WAV_RATE, 4);
+    put_le(fp, WAV_RATE * 3, 4);
+    put_le(fp, 3, 2);
+    put_le(fp, 24, 2);
+    fputs("data", fp);
+    put_le(fp, samples * 3, 4);
+
+    for (i = 0; i < samples; i++) {
+        put_le(fp, (i * 977) & 0xffffff, 3);
+    }
+
+    fclose(fp);
+
+    opendcp = opendcp_create();
+    opendcp->frame_rate = 24;
+    opendcp->ns         = XML_NS_SMPTE;
+    opendcp->mxf.key_flag = 1;
+    memcpy(opendcp->mxf.key_value, mxf_key, sizeof(mxf_key));
+
+    filelist = filelist_alloc(1);
+    snprintf(filelist->files[0], MAX_FILENAME_LENGTH, "%s", wav);
+
+    result = write_mxf(opendcp, filelist, (char *)filename);
+
+    filelist_free(filelist);
+    opendcp_delete(opendcp);
+    remove(wav);
+
+    return result;
+}
+
+/* write the composition playlist, its sound track claims intrinsic_duration frames */
+static void write_playlist(const char *filename, int intrinsic_duration) {
+    FILE *fp;
+
+    fp = fopen(filename, "w");
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<CompositionPlaylist xmlns=\"http://www.smpte-ra.org/schemas/429-7/2006/CPL\">\n"
+                "  <Id>urn:uuid:%s</Id>\n"
+                "  <ReelList>\n"
+                "    <Reel>\n"
+                "      <AssetList>\n"
+                "        <MainSound><Id>urn:uuid:%s</Id><EditRate>24 1</EditRate>\n"
+                "          <IntrinsicDuration>%d</IntrinsicDuration><EntryPoint>0</EntryPoint><Duration>%d</Duration></MainSound>\n"
+                "      </AssetList>\n"
+                "    </Reel>\n"
+                "  </ReelList>\n"
+                "</CompositionPlaylist>\n", CPL_UUID, MXF_UUID, intrinsic_duration, intrinsic_duration);
+    fclose(fp);
+}
+
+/* write the asset map and the packing list, the digests of the track file and the playlist are taken from disk */
+static void write_package(const char *path, const char *digest) {
+    char filename[MAX_PATH_LENGTH];
+    char mxf_digest[40], cpl_digest[40];
+    long long mxf_size, cpl_size;
+    FILE *fp;
+
+    snprintf(filename, sizeof(filename), "%s/sound.mxf", path);
+    mxf_size = file_digest(filename, mxf_digest);
+    snprintf(filename, sizeof(filename), "%s/CPL.xml", path);
+    cpl_size = file_digest(filename, cpl_digest);
+
+    snprintf(filename, sizeof(filename), "%s/ASSETMAP.xml", path);
+    fp = fopen(filename, "w");
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<AssetMap xmlns=\"http://www.smpte-ra.org/schemas/429-9/2007/AM\">\n"
+                "  <AssetList>\n"
+                "    <Asset><Id>urn:uuid:%s</Id><PackingList>true</PackingList>\n"
+                "      <ChunkList><Chunk><Path>PKL.xml</Path></Chunk></ChunkList></Asset>\n"
+                "    <Asset><Id>urn:uuid:%s</Id>\n"
+                "      <ChunkList><Chunk><Path>asset.bin</Path></Chunk></ChunkList></Asset>\n"
+                "    <Asset><Id>urn:uuid:%s</Id>\n"
+                "      <ChunkList><Chunk><Path>sound.mxf</Path></Chunk></ChunkList></Asset>\n"
+                "    <Asset><Id>urn:uuid:%s</Id>\n"
+                "      <ChunkList><Chunk><Path>CPL.xml</Path></Chunk></ChunkList></Asset>\n"
+                "  </AssetList>\n"
+                "</AssetMap>\n", PKL_UUID, ASSET_UUID, MXF_UUID, CPL_UUID);
+    fclose(fp);
+
+    snprintf(filename, sizeof(filename), "%s/PKL.xml", path);
+    fp = fopen(filename, "w");
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<PackingList xmlns=\"http://www.smpte-ra.org/schemas/429-8/2007/PKL\">\n"
+                "  <Id>urn:uuid:%s</Id>\n"
+                "  <AssetList>\n"
+                "    <Asset><Id>urn:uuid:%s</Id><Hash>%s</Hash><Size>%d</Size>\n"
+                "      <Type>application/octet-stream</Type></Asset>\n"
+                "    <Asset><Id>urn:uuid:%s</Id><Hash>%s</Hash><Size>%lld</Size>\n"
+                "      <Type>application/mxf</Type></Asset>\n"
+                "    <Asset><Id>urn:uuid:%s</Id><Hash>%s</Hash><Size>%lld</Size>\n"
+                "      <Type>text/xml</Type></Asset>\n"
+                "  </AssetList>\n"
+                "</PackingList>\n", PKL_UUID, ASSET_UUID, digest, ASSET_SIZE,
+                MXF_UUID, mxf_digest, mxf_size, CPL_UUID, cpl_digest, cpl_size);
+    fclose(fp);
+}
+
+/* verify the package again and return the result of one asset */
+static int verify_package(const char *path, const char *uuid, const byte_t *key) {
+    opendcp_verify_t *verify;
+    int i, result = OPENDCP_ERROR;
+
+    verify = opendcp_verify_open(path);
+
+    if (!verify) {
+        return OPENDCP_ERROR;
+    }
+
+    for (i = 0; i < verify->asset_count; i++) {
+        if (!strcmp(verify->asset[i].uuid, uuid)) {
+            result = opendcp_verify_asset(verify, i, key);
+        }
+    }
+
+    opendcp_verify_free(verify);
+
+    return result;
+}
+
+int main (int argc, char **argv) {
+    char asset[MAX_PATH_LENGTH];
+    char mxf[MAX_PATH_LENGTH];
+    char cpl[MAX_PATH_LENGTH];
+    char digest[40];
+    const char *path = argc > 1 ? argv[1] : "opendcp_verify_test";
+    FILE *fp;
+    int c;
+
+    opendcp_log_init(argc > 2 ? atoi(argv[2]) : 0);
+
+#ifdef _WIN32
+    mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+
+    snprintf(asset, sizeof(asset), "%s/asset.bin", path);
+    snprintf(mxf, sizeof(mxf), "%s/sound.mxf", path);
+    snprintf(cpl, sizeof(cpl), "%s/CPL.xml", path);
+
+    if (write_asset(asset, digest) != OPENDCP_NO_ERROR) {
+        fprintf(stderr, "could not write %s\n", asset);
+        return OPENDCP_ERROR;
+    }
+
+    if (write_mxf_asset(path, mxf) != OPENDCP_NO_ERROR) {
+        fprintf(stderr, "could not write %s\n", mxf);
+        return OPENDCP_ERROR;
+    }
+
+    write_playlist(cpl, MXF_FRAMES);
+    write_package(path, digest);
+
+    printf("verifying %s\n", path);
+    check("intact asset", verify_package(path, ASSET_UUID, NULL), OPENDCP_NO_ERROR);
+    check("track file", verify_package(path, MXF_UUID, NULL), OPENDCP_NO_ERROR);
+    check("track file hmac", verify_package(path, MXF_UUID, mxf_key), OPENDCP_NO_ERROR);
+    check("track file wrong key", verify_package(path, MXF_UUID, wrong_key), OPENDCP_VERIFY_HMAC);
+
+    /* the playlist claims one frame more than the track file has */
+    write_playlist(cpl, MXF_FRAMES + 1);
+    write_package(path, digest);
+    check("wrong duration", verify_package(path, MXF_UUID, NULL), OPENDCP_VERIFY_DURATION);
+
+    /* same size, one byte changed in the last block */
+    fp = fopen(asset, "r+b");
+    fseek(fp, ASSET_SIZE - 7, SEEK_SET);
+    c = fgetc(fp);
+    fseek(fp, ASSET_SIZE - 7, SEEK_SET);
+    fputc(c ^ 1, fp);
+    fclose(fp);
+    check("changed byte", verify_package(path, ASSET_UUID, NULL), OPENDCP_VERIFY_HASH);
+
+    fp = fopen(asset, "ab");
+    fputc(0, fp);
+    fclose(fp);
+    check("grown asset", verify_package(path, ASSET_UUID, NULL), OPENDCP_VERIFY_SIZE);
+
+    remove(asset);
+    check("missing asset", verify_package(path, ASSET_UUID, NULL), OPENDCP_VERIFY_MISSING);
+
+    return failures ? OPENDCP_ERROR : 0;
+}
@@ -84,6 +84,7 @@ void dcp_usage() {
     fprintf(fp, "       -k | --kind <kind>             - Content kind (test, feature, trailer, policy, teaser, etc)\n");
     fprintf(fp, "       -x | --width                   - Force aspect width (overrides detect value)\n");
     fprintf(fp, "       -y | --height                  - Force aspect height (overrides detected value)\n");
+    fprintf(fp, "       -u | --state <file>            - Package state file, unchanged assets reuse the information and digest of the last run\n");
     fprintf(fp, "       -l | --log_level <level>       - Set the log level 0:Quiet, 1:Error, 2:Warn (default),  3:Info, 4:Debug\n");
     fprintf(fp, "\n\n");
 
@@ -139,7 +140,9 @@ int main (int argc, char **argv) {
     int width  = 0;
     char buffer[80];
     opendcp_t *opendcp;
-    reel_list_t reel_list[MAX_REELS];
+    int reel_capacity = 0;
+    char *state_file = NULL;
+    reel_list_t *reel_list = NULL;
 
     if ( argc <= 1 ) {
         dcp_usage();
@@ -164,6 +167,7 @@ int main (int argc, char **argv) {
             {"rating",         required_argument, 0, 'm'},
             {"reel",           required_argument, 0, 'r'},
             {"title",          required_argument, 0, 't'},
+            {"state",          required_argument, 0, 'u'},
             {"root",           required_argument, 0, '1'},
             {"ca",             required_argument, 0, '2'},
             {"signer",         required_argument, 0, '3'},
@@ -178,7 +182,7 @@ int main (int argc, char **argv) {
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "a:b:e:svdhi:k:r:l:m:n:t:x:y:p:1:2:3:",
+        c = getopt_long (argc, argv, "a:b:e:svdhi:k:r:l:m:n:t:u:x:y:p:1:2:3:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -252,7 +256,21 @@ int main (int argc, char **argv) {
                 j = 0;
                 optind--;
 
+                if (reel_count == reel_capacity) {
+                    reel_capacity = reel_capacity ? reel_capacity * 2 : 8;
+                    reel_list = realloc(reel_list, reel_capacity * sizeof(reel_list_t));
+
+                    if (!reel_list) {
+                        dcp_fatal(opendcp, "Could not allocate reel list");
+                    }
+                }
+
                 while ( optind < argc && strncmp("-", argv[optind], 1) != 0) {
+                    if (j == 3) {
+                        sprintf(buffer, "Reel %d has more than 3 assets\n", reel_count + 1);
+                        dcp_fatal(opendcp, buffer);
+                    }
+
                     sprintf(reel_list[reel_count].asset_list[j++].filename, "%s", argv[optind++]);
                 }
 
@@ -270,6 +288,10 @@ int main (int argc, char **argv) {
                 sprintf(opendcp->dcp.title, "%.80s", optarg);
                 break;
 
+            case 'u':
+                state_file = optarg;
+                break;
+
             case 'x':
                 width = atoi(optarg);
                 break;
@@ -317,6 +339,14 @@ int main (int argc, char **argv) {
         dcp_fatal(opendcp, "No reels supplied");
     }
 
+    if (state_file) {
+        opendcp->dcp.state = opendcp_state_open(state_file);
+
+        if (opendcp->dcp.state == NULL) {
+            dcp_fatal(opendcp, "Could not open package state file");
+        }
+    }
+
     /* check cert files */
     if (opendcp->xml_signature.sign && opendcp->xml_signature.use_external == 1) {
         FILE *tp;
@@ -392,14 +422,18 @@ int main (int argc, char **argv) {
     }
 
     /* add pkl to the DCP (only one PKL currently support) */
-    pkl_t pkl;
-    create_pkl(opendcp->dcp, &pkl);
-    add_pkl_to_dcp(&opendcp->dcp, pkl);
+    pkl_t *pkl = create_pkl(&opendcp->dcp);
+
+    if (pkl == NULL || add_pkl_to_dcp(&opendcp->dcp, pkl) != OPENDCP_NO_ERROR) {
+        dcp_fatal(opendcp, "Could not create packing list");
+    }
 
     /* add cpl to the DCP/PKL (only one CPL currently support) */
-    cpl_t cpl;
-    create_cpl(opendcp->dcp, &cpl);
-    add_cpl_to_pkl(&opendcp->dcp.pkl[0], cpl);
+    cpl_t *cpl = create_cpl(&opendcp->dcp);
+
+    if (cpl == NULL || add_cpl_to_pkl(pkl, cpl) != OPENDCP_NO_ERROR) {
+        dcp_fatal(opendcp, "Could not create composition playlist");
+    }
 
     /* set the callbacks (optional) for the digest generator */
     if (opendcp->log_level > 0 && opendcp->log_level < 3) {
@@ -409,8 +443,11 @@ int main (int argc, char **argv) {
     /* Add and validate reels */
     for (c = 0; c < reel_count; c++) {
         int a;
-        reel_t reel;
-        create_reel(opendcp->dcp, &reel);
+        reel_t *reel = create_reel(&opendcp->dcp);
+
+        if (reel == NULL) {
+            dcp_fatal(opendcp, "Could not allocate reel");
+        }
 
         for (a = 0; a < reel_list[c].asset_count; a++) {
             val   = 0;
@@ -419,22 +456,33 @@ int main (int argc, char **argv) {
             sprintf(progress_string, "%-.25s %.25s", asset.filename, "Digest Calculation");
             total = atoi(asset.size) / read_size;
 
-            if (opendcp->log_level > 0 && opendcp->log_level < 3) {
-                printf("\n");
-                progress_bar();
+            /* the package state may already hold the digest of an unchanged asset */
+            if (!strlen(asset.digest)) {
+                if (opendcp->log_level > 0 && opendcp->log_level < 3) {
+                    printf("\n");
+                    progress_bar();
+                }
+
+                calculate_digest(opendcp, asset.filename, asset.digest);
+                opendcp_state_digest(opendcp->dcp.state, asset.filename, asset.digest);
             }
 
-            calculate_digest(opendcp, asset.filename, asset.digest);
-            add_asset_to_reel(opendcp, &reel, asset);
+            add_asset_to_reel(opendcp, reel, &asset);
         }
 
-        if (validate_reel(opendcp, &reel, c) == OPENDCP_NO_ERROR) {
-            add_reel_to_cpl(&opendcp->dcp.pkl[0].cpl[0], reel);
-        }
-        else {
+        if (validate_reel(opendcp, reel, c) != OPENDCP_NO_ERROR) {
             sprintf(buffer, "Could not validate reel %d\n", c + 1);
             dcp_fatal(opendcp, buffer);
         }
+
+        if (add_reel_to_cpl(cpl, reel) != OPENDCP_NO_ERROR) {
+            dcp_fatal(opendcp, "Could not allocate reel");
+        }
+    }
+
+    /* keep what was read and hashed even if writing the XML fails */
+    if (opendcp_state_save(opendcp->dcp.state) != OPENDCP_NO_ERROR) {
+        OPENDCP_LOG(LOG_WARN, "Could not save package state");
     }
 
     /* set ASSETMAP/VOLINDEX path */
@@ -450,22 +498,22 @@ int main (int argc, char **argv) {
     /* Write CPL File */
     if (opendcp->log_level > 0 && opendcp->log_level < 3) {
         printf("\n");
-        sprintf(progress_string, "%-.50s", opendcp->dcp.pkl[0].cpl[0].filename);
+        sprintf(progress_string, "%-.50s", cpl->filename);
         progress_bar();
     }
 
-    if (write_cpl(opendcp, &opendcp->dcp.pkl[0].cpl[0]) != OPENDCP_NO_ERROR) {
+    if (write_cpl(opendcp, cpl) != OPENDCP_NO_ERROR) {
         dcp_fatal(opendcp, "Writing composition playlist failed");
     }
 
     /* Write PKL File */
     if (opendcp->log_level > 0 && opendcp->log_level < 3) {
         printf("\n");
-        sprintf(progress_string, "%-.50s", opendcp->dcp.pkl[0].filename);
+        sprintf(progress_string, "%-.50s", pkl->filename);
         progress_bar();
     }
 
-    if (write_pkl(opendcp, &opendcp->dcp.pkl[0]) != OPENDCP_NO_ERROR) {
+    if (write_pkl(opendcp, pkl) != OPENDCP_NO_ERROR) {
         dcp_fatal(opendcp, "Writing packing list failed");
     }
 
@@ -491,6 +539,8 @@ int main (int argc, char **argv) {
 
     OPENDCP_LOG(LOG_INFO, "DCP Complete");
 
+    free(reel_list);
+    opendcp_state_close(opendcp->dcp.state);
     opendcp_delete(opendcp);
 
     exit(0);
@@ -186,6 +186,7 @@ void MainWindow::j2kConvert() {
 
     // set thread limit
     QThreadPool::globalInstance()->setMaxThreadCount(ui->threadsSpinBox->value());
+    opendcp_image_pool_size(ui->threadsSpinBox->value());
 
     QString outLeftDir = ui->outJ2kLeftEdit->text();
     QString outRightDir = ui->outJ2kRightEdit->text();
@@ -388,5 +389,7 @@ void MainWindow::j2kStart() {
     j2kConvert();
 
 Done:
+    // frames pooled by the encoder threads are not needed until the next conversion
+    opendcp_image_pool_drain();
     opendcp_delete(context);
 }
@@ -98,6 +98,9 @@ void MainWindow::startDcp()
     QString     DCP_FAIL_MSG;
     QString     message; 
     int         rc;
+    pkl_t       *pkl;
+    cpl_t       *cpl;
+    reel_t      *reel;
 
     // get dcp destination directory
     path = QFileDialog::getExistingDirectory(this, tr("Choose destination folder"), lastDir);
@@ -146,19 +149,31 @@ void MainWindow::startDcp()
     }
 
     // add pkl to the DCP (only one PKL currently support)
-    pkl_t pkl;
-    create_pkl(xmlContext->dcp, &pkl);
-    add_pkl_to_dcp(&xmlContext->dcp, pkl);
+    pkl = create_pkl(&xmlContext->dcp);
+
+    if (pkl == NULL || add_pkl_to_dcp(&xmlContext->dcp, pkl) != OPENDCP_NO_ERROR) {
+        pkl_free(pkl);
+        QMessageBox::critical(this, DCP_FAIL_MSG, tr("Could not create packing list."));
+        goto Done;
+    }
 
     // add cpl to the DCP/PKL (only one CPL currently support)
-    cpl_t cpl;
-    create_cpl(xmlContext->dcp, &cpl);
-    add_cpl_to_pkl(&xmlContext->dcp.pkl[0], cpl);
+    cpl = create_cpl(&xmlContext->dcp);
+
+    if (cpl == NULL || add_cpl_to_pkl(pkl, cpl) != OPENDCP_NO_ERROR) {
+        cpl_free(cpl);
+        QMessageBox::critical(this, DCP_FAIL_MSG, tr("Could not create composition playlist."));
+        goto Done;
+    }
 
     // add reel
-    reel_t reel;
-    create_reel(xmlContext->dcp, &reel);
-    add_reel_to_cpl(&xmlContext->dcp.pkl[0].cpl[0], reel);
+    reel = create_reel(&xmlContext->dcp);
+
+    if (reel == NULL || add_reel_to_cpl(cpl, reel) != OPENDCP_NO_ERROR) {
+        reel_free(reel);
+        QMessageBox::critical(this, DCP_FAIL_MSG, tr("Could not allocate reel."));
+        goto Done;
+    }
 
     // add assets
     if (!ui->reelPictureEdit->text().isEmpty()) {
@@ -172,7 +187,7 @@ void MainWindow::startDcp()
         }
         //QString digest = xmlCalculateDigestStartThread(xmlContext, asset.filename);
         snprintf(asset.digest, sizeof(asset.digest),"%s", digest.toUtf8().data());
-        add_asset_to_reel(xmlContext, &xmlContext->dcp.pkl[0].cpl[0].reel[0], asset);
+        add_asset_to_reel(xmlContext, reel, &asset);
     }
 
     if (!ui->reelSoundEdit->text().isEmpty()) {
@@ -185,7 +200,7 @@ void MainWindow::startDcp()
             goto Done;
         }
         snprintf(asset.digest, sizeof(asset.digest), "%s", digest.toUtf8().data());
-        add_asset_to_reel(xmlContext, &xmlContext->dcp.pkl[0].cpl[0].reel[0], asset);
+        add_asset_to_reel(xmlContext, reel, &asset);
     }
 
     if (!ui->reelSubtitleEdit->text().isEmpty()) {
@@ -198,26 +213,26 @@ void MainWindow::startDcp()
             goto Done;
         }
         snprintf(asset.digest, sizeof(asset.digest), "%s", digest.toUtf8().data());
-        add_asset_to_reel(xmlContext, &xmlContext->dcp.pkl[0].cpl[0].reel[0], asset);
+        add_asset_to_reel(xmlContext, reel, &asset);
     }
 
     // adjust durations
-    xmlContext->dcp.pkl[0].cpl[0].reel[0].main_picture.duration     = ui->reelPictureDurationSpinBox->value();
-    xmlContext->dcp.pkl[0].cpl[0].reel[0].main_picture.entry_point  = ui->reelPictureOffsetSpinBox->value();
-    xmlContext->dcp.pkl[0].cpl[0].reel[0].main_sound.duration       = ui->reelSoundDurationSpinBox->value();
-    xmlContext->dcp.pkl[0].cpl[0].reel[0].main_sound.entry_point    = ui->reelSoundOffsetSpinBox->value();
-    xmlContext->dcp.pkl[0].cpl[0].reel[0].main_subtitle.duration    = ui->reelSubtitleDurationSpinBox->value();
-    xmlContext->dcp.pkl[0].cpl[0].reel[0].main_subtitle.entry_point = ui->reelSubtitleOffsetSpinBox->value();
-
-    rc = validate_reel(xmlContext, &xmlContext->dcp.pkl[0].cpl[0].reel[0], 0);
+    reel->main_picture.duration     = ui->reelPictureDurationSpinBox->value();
+    reel->main_picture.entry_point  = ui->reelPictureOffsetSpinBox->value();
+    reel->main_sound.duration       = ui->reelSoundDurationSpinBox->value();
+    reel->main_sound.entry_point    = ui->reelSoundOffsetSpinBox->value();
+    reel->main_subtitle.duration    = ui->reelSubtitleDurationSpinBox->value();
+    reel->main_subtitle.entry_point = ui->reelSubtitleOffsetSpinBox->value();
+
+    rc = validate_reel(xmlContext, reel, 0);
     if (rc) {
         message = tr(OPENDCP_ERROR_STRING[rc]);
         QMessageBox::critical(this, DCP_FAIL_MSG, message);
         goto Done;
     }
 
-    snprintf(xmlContext->dcp.pkl[0].cpl[0].filename, sizeof(xmlContext->dcp.pkl[0].cpl[0].filename), "%s/CPL_%s.xml", path.toUtf8().constData(), xmlContext->dcp.pkl[0].cpl[0].uuid);
-    snprintf(xmlContext->dcp.pkl[0].filename, sizeof(xmlContext->dcp.pkl[0].filename), "%s/PKL_%s.xml", path.toUtf8().constData(), xmlContext->dcp.pkl[0].uuid);
+    snprintf(cpl->filename, sizeof(cpl->filename), "%s/CPL_%s.xml", path.toUtf8().constData(), cpl->uuid);
+    snprintf(pkl->filename, sizeof(pkl->filename), "%s/PKL_%s.xml", path.toUtf8().constData(), pkl->uuid);
 
     if (xmlContext->ns == XML_NS_SMPTE) {
         snprintf(xmlContext->dcp.assetmap.filename, sizeof(xmlContext->dcp.assetmap.filename), "%s/ASSETMAP.xml",path.toUtf8().constData());
@@ -228,11 +243,11 @@ void MainWindow::startDcp()
     }
 
     // write XML Files
-    if (write_cpl(xmlContext,&xmlContext->dcp.pkl[0].cpl[0]) != OPENDCP_NO_ERROR) {
+    if (write_cpl(xmlContext,cpl) != OPENDCP_NO_ERROR) {
         QMessageBox::critical(this, DCP_FAIL_MSG, tr("Failed to create composition playlist."));
         goto Done;
     }
-    if (write_pkl(xmlContext,&xmlContext->dcp.pkl[0]) != OPENDCP_NO_ERROR) {
+    if (write_pkl(xmlContext,pkl) != OPENDCP_NO_ERROR) {
         QMessageBox::critical(this, DCP_FAIL_MSG, tr("Failed to create packaging list."));
         goto Done;
     }
@@ -246,13 +261,13 @@ void MainWindow::startDcp()
     }
 
     // copy picture mxf
-    mxfCopy(QString::fromUtf8(xmlContext->dcp.pkl[0].cpl[0].reel[0].main_picture.filename), path);
+    mxfCopy(QString::fromUtf8(reel->main_picture.filename), path);
 
     // copy audio mxf
-    mxfCopy(QString::fromUtf8(xmlContext->dcp.pkl[0].cpl[0].reel[0].main_sound.filename), path);
+    mxfCopy(QString::fromUtf8(reel->main_sound.filename), path);
 
     // copy subtitle mxf
-    mxfCopy(QString::fromUtf8(xmlContext->dcp.pkl[0].cpl[0].reel[0].main_subtitle.filename), path);
+    mxfCopy(QString::fromUtf8(reel->main_subtitle.filename), path);
 
     msgBox.setText("DCP Created successfully");
     msgBox.exec();
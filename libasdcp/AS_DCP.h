@@ -824,6 +824,13 @@ namespace ASDCP {
 	  // out of range.
 	  Result_t LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset, i8_t& temporalOffset, i8_t& keyFrameOffset) const;
 
+	  // Reads frames through a window of span_size bytes filled by positional reads,
+	  // so a sequential scan of the file costs one read per window. The window is
+	  // only refilled when a frame falls outside it. A span_size of 0 restores
+	  // per-frame reads. The window belongs to the reader, so do not call this
+	  // while another thread reads from it. Returns RESULT_INIT if the file is not open.
+	  Result_t SetScanSpan(ui32_t span_size = 8 * 1024 * 1024);
+
 	  // Calculates the first frame in transport order of the GOP in which the requested
 	  // frame is located.  Calls ReadFrame() to fetch the frame at the calculated position.
 	  // Returns RESULT_INIT if the file is not open.
@@ -1035,6 +1042,13 @@ namespace ASDCP {
 	  // out of range.
 	  Result_t LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset, i8_t& temporalOffset, i8_t& keyFrameOffset) const;
 
+	  // Reads frames through a window of span_size bytes filled by positional reads,
+	  // so a sequential scan of the file costs one read per window. The window is
+	  // only refilled when a frame falls outside it. A span_size of 0 restores
+	  // per-frame reads. The window belongs to the reader, so do not call this
+	  // while another thread reads from it. Returns RESULT_INIT if the file is not open.
+	  Result_t SetScanSpan(ui32_t span_size = 8 * 1024 * 1024);
+
 	  // Print debugging information to stream
 	  void     DumpHeaderMetadata(FILE* = 0) const;
 	  void     DumpIndex(FILE* = 0) const;
@@ -1148,6 +1162,15 @@ namespace ASDCP {
 	  // encrypted headers.
 	  Result_t OpenReadFrame(const std::string& filename, FrameBuffer&) const;
 
+	  // Opens a file and parses only the main header (SIZ, COD, QCD) for
+	  // FillPictureDescriptor(), without reading the codestream body. Use
+	  // this to check a sequence before wrapping it.
+	  Result_t OpenReadHeader(const std::string& filename) const;
+
+	  // Returns the size in bytes of the last codestream opened, zero if
+	  // none has been.
+	  ui64_t CodestreamSize() const;
+
 	  // Fill a PictureDescriptor struct with the values from the file's codestream.
 	  // Returns RESULT_INIT if the file is not open.
 	  Result_t FillPictureDescriptor(PictureDescriptor&) const;
@@ -1284,6 +1307,37 @@ namespace ASDCP {
 	  // out of range.
 	  Result_t LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset, i8_t& temporalOffset, i8_t& keyFrameOffset) const;
 
+	  // Reads frames through a window of span_size bytes filled by positional reads,
+	  // so a sequential scan of the file costs one read per window. The window is
+	  // only refilled when a frame falls outside it. A span_size of 0 restores
+	  // per-frame reads. The window belongs to the reader, so do not call this
+	  // while another thread reads from it. Returns RESULT_INIT if the file is not open.
+	  Result_t SetScanSpan(ui32_t span_size = 8 * 1024 * 1024);
+
+	  // The read position of one thread. Any number of threads may call
+	  // ReadFrame(Cursor&, ...) on the same open reader at once, each with its
+	  // own Cursor, FrameBuffer, AESDecContext and HMACContext. The header,
+	  // index and descriptors are parsed once at OpenRead() and only read.
+	  class Cursor
+	    {
+	      friend class MXFReader;
+	      ASDCP_NO_COPY_CONSTRUCT(Cursor);
+
+	      mem_ptr<Kumu::SpanReader> m_Span;
+	      const MXFReader*          m_Owner;
+
+	    public:
+	      Cursor();
+	      ~Cursor();
+	    };
+
+	  // Reads a frame as ReadFrame() above does, with positional reads through
+	  // the cursor. The reader's buffers are not used and the file pointer is
+	  // not consulted. On Win32 a positional read still moves the file pointer,
+	  // so do not mix these reads with ReadFrame() without a cursor, unless the
+	  // reader has a scan span. Do not call Close() while such reads are in progress.
+	  Result_t ReadFrame(Cursor&, ui32_t frame_number, FrameBuffer&, AESDecContext* = 0, HMACContext* = 0) const;
+
 	  // Print debugging information to stream
 	  void     DumpHeaderMetadata(FILE* = 0) const;
 	  void     DumpIndex(FILE* = 0) const;
@@ -1409,6 +1463,13 @@ namespace ASDCP {
 	  // out of range.
 	  Result_t LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset, i8_t& temporalOffset, i8_t& keyFrameOffset) const;
 
+	  // Reads frames through a window of span_size bytes filled by positional reads,
+	  // so a sequential scan of the file costs one read per window. The window is
+	  // only refilled when a frame falls outside it. A span_size of 0 restores
+	  // per-frame reads. The window belongs to the reader, so do not call this
+	  // while another thread reads from it. Returns RESULT_INIT if the file is not open.
+	  Result_t SetScanSpan(ui32_t span_size = 8 * 1024 * 1024);
+
 	  // Print debugging information to stream
 	  void     DumpHeaderMetadata(FILE* = 0) const;
 	  void     DumpIndex(FILE* = 0) const;
@@ -1482,11 +1543,12 @@ namespace ASDCP {
       };
 
       // Resolves resource references by testing the named directory for file names containing
-      // the respective UUID.
+      // the respective UUID. The directory is scanned once, by OpenRead().
       //
       class LocalFilenameResolver : public ASDCP::TimedText::IResourceResolver
 	{
 	  std::string m_Dirname;
+	  std::list<std::string> m_FileList;
 	  ASDCP_NO_COPY_CONSTRUCT(LocalFilenameResolver);
 
 	public:
@@ -1494,6 +1556,9 @@ namespace ASDCP {
 	  virtual ~LocalFilenameResolver();
 	  Result_t OpenRead(const std::string& dirname);
 	  Result_t ResolveRID(const byte_t* uuid, FrameBuffer& FrameBuf) const;
+
+	  // Sets path to the name of the file holding the resource, without reading it.
+	  Result_t ResolveRID(const byte_t* uuid, std::string& path) const;
 	};
 
       //
@@ -1573,6 +1638,12 @@ namespace ASDCP {
 	  // WriteTimedTextResource()
 	  Result_t WriteAncillaryResource(const FrameBuffer&, AESEncContext* = 0, HMACContext* = 0);
 
+	  // Writes the Ancillary Resource held in the named file. A plaintext resource
+	  // is copied from the file a span at a time, so its size is not limited by a
+	  // frame buffer. An encrypted resource is read whole before it is encrypted,
+	  // so it may not exceed 4 GB.
+	  Result_t WriteAncillaryResource(const std::string& filename, AESEncContext* = 0, HMACContext* = 0);
+
 	  // Closes the MXF file, writing the index and revised header.
 	  Result_t Finalize();
 	};
@@ -341,6 +341,7 @@ public:
 
   Result_t    OpenRead(const std::string&, EssenceType_t);
   Result_t    ReadFrame(ui32_t, JP2K::FrameBuffer&, AESDecContext*, HMACContext*);
+  Result_t    ReadFrame(Kumu::SpanReader&, ui32_t, JP2K::FrameBuffer&, AESDecContext*, HMACContext*) const;
 };
 
 
@@ -515,6 +516,15 @@ lh__Reader::ReadFrame(ui32_t FrameNum, JP2K::FrameBuffer& FrameBuf,
   return ReadEKLVFrame(FrameNum, FrameBuf, m_Dict->ul(MDD_JPEG2000Essence), Ctx, HMAC);
 }
 
+//
+ASDCP::Result_t
+lh__Reader::ReadFrame(Kumu::SpanReader& Span, ui32_t FrameNum, JP2K::FrameBuffer& FrameBuf,
+		      AESDecContext* Ctx, HMACContext* HMAC) const
+{
+  assert(m_Dict);
+  return ReadEKLVFrame(Span, FrameNum, FrameBuf, m_Dict->ul(MDD_JPEG2000Essence), Ctx, HMAC);
+}
+
 
 //
 class ASDCP::JP2K::MXFReader::h__Reader : public lh__Reader
@@ -631,6 +641,40 @@ ASDCP::JP2K::MXFReader::LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset,
     return m_Reader->LocateFrame(FrameNum, streamOffset, temporalOffset, keyFrameOffset);
 }
 
+//
+ASDCP::JP2K::MXFReader::Cursor::Cursor() : m_Owner(0) {}
+
+ASDCP::JP2K::MXFReader::Cursor::~Cursor() {}
+
+//
+ASDCP::Result_t
+ASDCP::JP2K::MXFReader::ReadFrame(Cursor& Cur, ui32_t FrameNum, FrameBuffer& FrameBuf,
+				   AESDecContext* Ctx, HMACContext* HMAC) const
+{
+  if ( ! m_Reader || ! m_Reader->m_File.IsOpen() )
+    return RESULT_INIT;
+
+  // a cursor follows the reader it was last used with, the window is
+  // sized to each frame
+  if ( Cur.m_Span.empty() || Cur.m_Owner != this )
+    {
+      Cur.m_Span = new Kumu::SpanReader(m_Reader->m_File, 0);
+      Cur.m_Owner = this;
+    }
+
+  return m_Reader->ReadFrame(*Cur.m_Span, FrameNum, FrameBuf, Ctx, HMAC);
+}
+
+//
+ASDCP::Result_t
+ASDCP::JP2K::MXFReader::SetScanSpan(ui32_t span_size)
+{
+  if ( m_Reader && m_Reader->m_File.IsOpen() )
+    return m_Reader->SetScanSpan(span_size);
+
+  return RESULT_INIT;
+}
+
 
 // Fill the struct with the values from the file's header.
 // Returns RESULT_INIT if the file is not open.
@@ -718,6 +762,28 @@ public:
     Kumu::fpos_t FilePosition = m_HeaderPart.BodyOffset + TmpEntry.StreamOffset;
     Result_t result = RESULT_OK;
 
+    if ( ! m_Span.empty() && ( phase == SP_LEFT || phase == SP_RIGHT ) )
+      {
+	ui32_t SequenceNum = FrameNum * 2;
+	SequenceNum += ( phase == SP_RIGHT ) ? 2 : 1;
+
+	if ( phase == SP_RIGHT )
+	  {
+	    // skip over the companion SP_LEFT frame
+	    KLReader Reader;
+	    result = Reader.ReadKLFromSpan(*m_Span, FilePosition);
+
+	    if ( ASDCP_FAILURE(result) )
+	      return result;
+
+	    FilePosition += Reader.KLLength() + Reader.Length();
+	  }
+
+	assert(m_Dict);
+	return Read_EKLV_Packet(*m_Span, *m_Dict, m_Info, FilePosition, FrameNum, SequenceNum,
+				FrameBuf, m_Dict->ul(MDD_JPEG2000Essence), Ctx, HMAC);
+      }
+
     if ( phase == SP_LEFT )
       {    
 	if ( FilePosition != m_LastPosition )
@@ -747,7 +813,7 @@ public:
 	    if ( ASDCP_SUCCESS(result) )
 	      {
 		// skip over the companion SP_LEFT frame
-		Kumu::fpos_t new_pos = FilePosition + SMPTE_UL_LENGTH + Reader.KLLength() + Reader.Length();
+		Kumu::fpos_t new_pos = FilePosition + Reader.KLLength() + Reader.Length();
 		result = m_File.Seek(new_pos);
 	      }
 	  }
@@ -874,6 +940,16 @@ ASDCP::JP2K::MXFSReader::LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset
     return m_Reader->LocateFrame(FrameNum, streamOffset, temporalOffset, keyFrameOffset);
 }
 
+//
+ASDCP::Result_t
+ASDCP::JP2K::MXFSReader::SetScanSpan(ui32_t span_size)
+{
+  if ( m_Reader && m_Reader->m_File.IsOpen() )
+    return m_Reader->SetScanSpan(span_size);
+
+  return RESULT_INIT;
+}
+
 // Fill the struct with the values from the file's header.
 // Returns RESULT_INIT if the file is not open.
 ASDCP::Result_t
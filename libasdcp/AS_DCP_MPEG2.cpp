@@ -407,6 +407,16 @@ ASDCP::MPEG2::MXFReader::LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset
     return m_Reader->LocateFrame(FrameNum, streamOffset, temporalOffset, keyFrameOffset);
 }
 
+//
+ASDCP::Result_t
+ASDCP::MPEG2::MXFReader::SetScanSpan(ui32_t span_size)
+{
+  if ( m_Reader && m_Reader->m_File.IsOpen() )
+    return m_Reader->SetScanSpan(span_size);
+
+  return RESULT_INIT;
+}
+
 //
 ASDCP::Result_t
 ASDCP::MPEG2::MXFReader::ReadFrameGOPStart(ui32_t FrameNum, FrameBuffer& FrameBuf,
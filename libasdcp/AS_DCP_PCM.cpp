@@ -448,6 +448,16 @@ ASDCP::PCM::MXFReader::LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset,
     return m_Reader->LocateFrame(FrameNum, streamOffset, temporalOffset, keyFrameOffset);
 }
 
+//
+ASDCP::Result_t
+ASDCP::PCM::MXFReader::SetScanSpan(ui32_t span_size)
+{
+  if ( m_Reader && m_Reader->m_File.IsOpen() )
+    return m_Reader->SetScanSpan(span_size);
+
+  return RESULT_INIT;
+}
+
 // Fill the struct with the values from the file's header.
 // Returns RESULT_INIT if the file is not open.
 ASDCP::Result_t
@@ -511,6 +511,8 @@ public:
   Result_t SetSourceStream(const TimedTextDescriptor&);
   Result_t WriteTimedTextResource(const std::string& XMLDoc, AESEncContext* = 0, HMACContext* = 0);
   Result_t WriteAncillaryResource(const FrameBuffer&, AESEncContext* = 0, HMACContext* = 0);
+  Result_t WriteAncillaryResource(const std::string& filename, AESEncContext* = 0, HMACContext* = 0);
+  Result_t WriteGenericStreamPartition();
   Result_t Finalize();
   Result_t TimedText_TDesc_to_MD(TimedText::TimedTextDescriptor& TDesc);
 };
@@ -647,19 +649,14 @@ ASDCP::TimedText::MXFWriter::h__Writer::WriteTimedTextResource(const std::string
 }
 
 
-//
+// each ancillary resource gets a generic stream partition of its own
 ASDCP::Result_t
-ASDCP::TimedText::MXFWriter::h__Writer::WriteAncillaryResource(const ASDCP::TimedText::FrameBuffer& FrameBuf,
-							       ASDCP::AESEncContext* Ctx, ASDCP::HMACContext* HMAC)
+ASDCP::TimedText::MXFWriter::h__Writer::WriteGenericStreamPartition()
 {
-  if ( ! m_State.Test_RUNNING() )
-    return RESULT_STATE;
-
   Kumu::fpos_t here = m_File.Tell();
   assert(m_Dict);
 
   // create generic stream partition header
-  static UL GenericStream_DataElement(m_Dict->ul(MDD_GenericStream_DataElement));
   MXF::Partition GSPart(m_Dict);
 
   GSPart.ThisPartition = here;
@@ -670,7 +667,20 @@ ASDCP::TimedText::MXFWriter::h__Writer::WriteAncillaryResource(const ASDCP::Time
   m_RIP.PairArray.push_back(RIP::PartitionPair(m_EssenceStreamID++, here));
   GSPart.EssenceContainers = m_HeaderPart.EssenceContainers;
   UL TmpUL(m_Dict->ul(MDD_GenericStreamPartition));
-  Result_t result = GSPart.WriteToFile(m_File, TmpUL);
+  return GSPart.WriteToFile(m_File, TmpUL);
+}
+
+//
+ASDCP::Result_t
+ASDCP::TimedText::MXFWriter::h__Writer::WriteAncillaryResource(const ASDCP::TimedText::FrameBuffer& FrameBuf,
+							       ASDCP::AESEncContext* Ctx, ASDCP::HMACContext* HMAC)
+{
+  if ( ! m_State.Test_RUNNING() )
+    return RESULT_STATE;
+
+  assert(m_Dict);
+  static UL GenericStream_DataElement(m_Dict->ul(MDD_GenericStream_DataElement));
+  Result_t result = WriteGenericStreamPartition();
 
   if ( ASDCP_SUCCESS(result) )
     result = WriteEKLVPacket(FrameBuf, GenericStream_DataElement.Value(), Ctx, HMAC);
@@ -679,6 +689,106 @@ ASDCP::TimedText::MXFWriter::h__Writer::WriteAncillaryResource(const ASDCP::Time
   return result;
 }
 
+// A plaintext resource goes from the file to the MXF one span at a time, and
+// the BER length lets it grow past 4 GB. The cipher and the integrity pack
+// need the whole source value, so an encrypted resource is read into a
+// buffer sized to the file and written as a frame.
+ASDCP::Result_t
+ASDCP::TimedText::MXFWriter::h__Writer::WriteAncillaryResource(const std::string& filename,
+							       ASDCP::AESEncContext* Ctx, ASDCP::HMACContext* HMAC)
+{
+  if ( ! m_State.Test_RUNNING() )
+    return RESULT_STATE;
+
+  Kumu::FileReader Reader;
+  Result_t result = Reader.OpenRead(filename);
+
+  if ( ASDCP_FAILURE(result) )
+    return result;
+
+  Kumu::fsize_t file_size = Reader.Size();
+
+  if ( file_size == 0 )
+    {
+      DefaultLogSink().Error("%s: zero file size\n", filename.c_str());
+      return RESULT_EMPTY_FB;
+    }
+
+  if ( m_Info.EncryptedEssence )
+    {
+      if ( (ui64_t)file_size > 0xffffffffULL )
+	{
+	  DefaultLogSink().Error("%s: encrypted resource exceeds 4 GB\n", filename.c_str());
+	  return RESULT_ALLOC;
+	}
+
+      FrameBuffer FrameBuf;
+      ui32_t read_count = 0;
+      result = FrameBuf.Capacity((ui32_t)file_size);
+
+      if ( ASDCP_SUCCESS(result) )
+	result = Reader.Read(FrameBuf.Data(), (ui32_t)file_size, &read_count);
+
+      if ( ASDCP_SUCCESS(result) )
+	{
+	  FrameBuf.Size(read_count);
+	  result = WriteAncillaryResource(FrameBuf, Ctx, HMAC);
+	}
+
+      return result;
+    }
+
+  assert(m_Dict);
+  UL GenericStream_DataElement(m_Dict->ul(MDD_GenericStream_DataElement));
+  ui32_t BER_length = MXF_BER_LENGTH;
+  byte_t overhead[128];
+  Kumu::MemIOWriter Overhead(overhead, 128);
+
+  if ( file_size > 0x00ffffff ) // Need BER integer longer than MXF_BER_LENGTH bytes
+    {
+      BER_length = Kumu::get_BER_length_for_value(file_size);
+
+      if ( BER_length == 0 )
+	return RESULT_KLV_CODING;
+    }
+
+  result = WriteGenericStreamPartition();
+
+  // the key and length are written at once, nothing is left queued that
+  // points at the stack
+  if ( ASDCP_SUCCESS(result) )
+    {
+      Overhead.WriteRaw(GenericStream_DataElement.Value(), SMPTE_UL_LENGTH);
+      Overhead.WriteBER(file_size, BER_length);
+      result = m_File.Write(Overhead.Data(), Overhead.Length());
+    }
+
+  // the span's data is only valid until the next Get(), so each span is
+  // written before the next one is read. a small resource gets a window
+  // its own size
+  const ui32_t span_size = (ui32_t)Kumu::xmin((Kumu::fsize_t)(8 * 1024 * 1024), file_size);
+  Kumu::SpanReader Span(Reader, span_size);
+  Kumu::fpos_t pos = 0;
+
+  while ( ASDCP_SUCCESS(result) && pos < (Kumu::fpos_t)file_size )
+    {
+      ui32_t len = (ui32_t)Kumu::xmin((Kumu::fpos_t)span_size, (Kumu::fpos_t)file_size - pos);
+      byte_t* data = 0;
+      result = Span.Get(pos, len, &data);
+
+      if ( ASDCP_SUCCESS(result) )
+	result = m_File.Write(data, len);
+
+      pos += len;
+    }
+
+  if ( ASDCP_SUCCESS(result) )
+    m_StreamOffset += Overhead.Length() + file_size;
+
+  m_FramesWritten++;
+  return result;
+}
+
 //
 ASDCP::Result_t
 ASDCP::TimedText::MXFWriter::h__Writer::Finalize()
@@ -794,6 +904,16 @@ ASDCP::TimedText::MXFWriter::WriteAncillaryResource(const FrameBuffer& FrameBuf,
   return m_Writer->WriteAncillaryResource(FrameBuf, Ctx, HMAC);
 }
 
+//
+ASDCP::Result_t
+ASDCP::TimedText::MXFWriter::WriteAncillaryResource(const std::string& filename, AESEncContext* Ctx, HMACContext* HMAC)
+{
+  if ( m_Writer.empty() )
+    return RESULT_INIT;
+
+  return m_Writer->WriteAncillaryResource(filename, Ctx, HMAC);
+}
+
 // Closes the MXF file, writing the index and other closing information.
 ASDCP::Result_t
 ASDCP::TimedText::MXFWriter::Finalize()
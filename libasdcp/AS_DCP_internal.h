@@ -162,6 +162,12 @@ namespace ASDCP
 			    ui32_t FrameNum, ui32_t SequenceNum, ASDCP::FrameBuffer& FrameBuf,
 			    const byte_t* EssenceUL, AESDecContext* Ctx, HMACContext* HMAC);
 
+  // reads the packet at Position and moves Position past it, the file pointer is not consulted
+  Result_t Read_EKLV_Packet(Kumu::SpanReader& Span, const ASDCP::Dictionary& Dict,
+			    const ASDCP::WriterInfo& Info, Kumu::fpos_t& Position,
+			    ui32_t FrameNum, ui32_t SequenceNum, ASDCP::FrameBuffer& FrameBuf,
+			    const byte_t* EssenceUL, AESDecContext* Ctx, HMACContext* HMAC);
+
   Result_t Write_EKLV_Packet(Kumu::FileWriter& File, const ASDCP::Dictionary& Dict, const MXF::OP1aHeader& HeaderPart,
 			     const ASDCP::WriterInfo& Info, ASDCP::FrameBuffer& CtFrameBuf, ui32_t& FramesWritten,
 			     ui64_t & StreamOffset, const ASDCP::FrameBuffer& FrameBuf, const byte_t* EssenceUL,
@@ -182,6 +188,7 @@ namespace ASDCP
       inline const ui64_t  KLLength() { return m_KLLength; }
 
       Result_t ReadKLFromFile(Kumu::FileReader& Reader);
+      Result_t ReadKLFromSpan(Kumu::SpanReader& Span, Kumu::fpos_t Position);
     };
 
   namespace MXF
@@ -206,6 +213,7 @@ namespace ASDCP
 	WriterInfo         m_Info;
 	ASDCP::FrameBuffer m_CtFrameBuf;
 	Kumu::fpos_t       m_LastPosition;
+	ASDCP::mem_ptr<Kumu::SpanReader> m_Span;
 
       TrackFileReader(const Dictionary& d) :
 	m_HeaderPart(m_Dict), m_IndexAccess(m_Dict), m_RIP(m_Dict), m_Dict(&d)
@@ -311,6 +319,9 @@ namespace ASDCP
 	  Kumu::fpos_t FilePosition = body_offset + TmpEntry.StreamOffset;
 	  Result_t result = RESULT_OK;
 
+	  if ( ! m_Span.empty() )
+	    return ReadEKLVFrame(*m_Span, body_offset, FrameNum, FrameBuf, EssenceUL, Ctx, HMAC);
+
 	  if ( FilePosition != m_LastPosition )
 	    {
 	      m_LastPosition = FilePosition;
@@ -323,6 +334,39 @@ namespace ASDCP
 	  return result;
 	}
 
+	// reads through a caller owned span with positional reads only. The
+	// header, index and writer info are only read, so threads that each own
+	// a span, FrameBuf and crypto contexts may call this at once.
+	Result_t ReadEKLVFrame(Kumu::SpanReader& Span, const ui64_t& body_offset,
+			       ui32_t FrameNum, ASDCP::FrameBuffer& FrameBuf,
+			       const byte_t* EssenceUL, AESDecContext* Ctx, HMACContext* HMAC) const
+	{
+	  // look up frame index node
+	  IndexTableSegment::IndexEntry TmpEntry, NextEntry;
+
+	  if ( KM_FAILURE(m_IndexAccess.Lookup(FrameNum, TmpEntry)) )
+	    {
+	      DefaultLogSink().Error("Frame value out of range: %u\n", FrameNum);
+	      return RESULT_RANGE;
+	    }
+
+	  Kumu::fpos_t FilePosition = body_offset + TmpEntry.StreamOffset;
+
+	  // the next frame's offset bounds this packet, so key, length and
+	  // value arrive in one read. Without it they are read separately.
+	  if ( KM_SUCCESS(m_IndexAccess.Lookup(FrameNum + 1, NextEntry))
+	       && NextEntry.StreamOffset > TmpEntry.StreamOffset
+	       && NextEntry.StreamOffset - TmpEntry.StreamOffset <= 0xFFFFFFFFL )
+	    {
+	      byte_t* p;
+	      Span.Get(FilePosition, (ui32_t)(NextEntry.StreamOffset - TmpEntry.StreamOffset), &p);
+	    }
+
+	  assert(m_Dict);
+	  return Read_EKLV_Packet(Span, *m_Dict, m_Info, FilePosition,
+				  FrameNum, FrameNum + 1, FrameBuf, EssenceUL, Ctx, HMAC);
+	}
+
 	// positions file before reading
 	// assumes "processed" index entries have absolute positions
 	Result_t ReadEKLVFrame(ui32_t FrameNum, ASDCP::FrameBuffer& FrameBuf,
@@ -340,6 +384,14 @@ namespace ASDCP
 	  // get absolute frame position and go read the frame's key and length
 	  Result_t result = RESULT_OK;
 
+	  if ( ! m_Span.empty() )
+	    {
+	      Kumu::fpos_t FilePosition = TmpEntry.StreamOffset;
+	      assert(m_Dict);
+	      return Read_EKLV_Packet(*m_Span, *m_Dict, m_Info, FilePosition,
+				      FrameNum, FrameNum + 1, FrameBuf, EssenceUL, Ctx, HMAC);
+	    }
+
 	  if ( TmpEntry.StreamOffset != m_LastPosition )
 	    {
 	      m_LastPosition = TmpEntry.StreamOffset;
@@ -383,9 +435,22 @@ namespace ASDCP
 	  return RESULT_OK;
 	}
 
+	// Frames are read through a window of span bytes filled by positional
+	// reads, for a sequential scan of the whole track. A span of 0 goes back
+	// to seeking and reading each packet.
+	Result_t SetScanSpan(ui32_t span)
+	{
+	  m_Span = span ? new Kumu::SpanReader(m_File, span) : 0;
+
+	  // the file pointer no longer follows the frames read
+	  m_LastPosition = -1;
+	  return RESULT_OK;
+	}
+
 	//
 	void Close()
 	{
+	  m_Span = 0;
 	  m_File.Close();
 	}
       };
@@ -858,6 +923,8 @@ namespace ASDCP
       Result_t OpenMXFRead(const std::string& filename);
       Result_t ReadEKLVFrame(ui32_t FrameNum, ASDCP::FrameBuffer& FrameBuf,
 			     const byte_t* EssenceUL, AESDecContext* Ctx, HMACContext* HMAC);
+      Result_t ReadEKLVFrame(Kumu::SpanReader& Span, ui32_t FrameNum, ASDCP::FrameBuffer& FrameBuf,
+			     const byte_t* EssenceUL, AESDecContext* Ctx, HMACContext* HMAC) const;
       Result_t LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset,
                            i8_t& temporalOffset, i8_t& keyFrameOffset);
     };
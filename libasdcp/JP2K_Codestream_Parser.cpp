@@ -36,6 +36,50 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <KM_log.h>
 using Kumu::DefaultLogSink;
 
+// first read of a header probe, doubled until the main header is in the buffer
+const ui32_t HeaderProbeSize = 4096;
+
+//------------------------------------------------------------------------------------------
+
+// Walks the marker segments from SOC up to and including SOD using only their
+// lengths, so a truncated buffer is never read past. Returns RESULT_OK with the
+// header length, RESULT_SMALLBUF if the buffer ends first.
+static ASDCP::Result_t
+h__MainHeaderLength(const byte_t* buf, ui32_t buf_len, ui32_t& header_len)
+{
+  ui32_t offset = 0;
+
+  while ( offset + 2 <= buf_len )
+    {
+      if ( buf[offset] != 0xff )
+	return ASDCP::RESULT_RAW_ESS;
+
+      ui16_t marker = 0xff00 | buf[offset+1];
+      offset += 2;
+
+      if ( marker == ASDCP::JP2K::MRK_SOD )
+	{
+	  header_len = offset;
+	  return ASDCP::RESULT_OK;
+	}
+
+      if ( marker == ASDCP::JP2K::MRK_SOC )
+	continue;
+
+      if ( offset + 2 > buf_len )
+	break;
+
+      ui32_t segment_len = ( buf[offset] << 8 ) | buf[offset+1];
+
+      if ( segment_len < 2 )
+	return ASDCP::RESULT_RAW_ESS;
+
+      offset += segment_len;
+    }
+
+  return ASDCP::RESULT_SMALLBUF;
+}
+
 //------------------------------------------------------------------------------------------
 
 class ASDCP::JP2K::CodestreamParser::h__CodestreamParser
@@ -45,12 +89,14 @@ class ASDCP::JP2K::CodestreamParser::h__CodestreamParser
 public:
   PictureDescriptor  m_PDesc;
   Kumu::FileReader   m_File;
+  ui64_t             m_CodestreamSize;
 
   h__CodestreamParser()
   {
     memset(&m_PDesc, 0, sizeof(m_PDesc));
     m_PDesc.EditRate = Rational(24,1);
     m_PDesc.SampleRate = m_PDesc.EditRate;
+    m_CodestreamSize = 0;
   }
 
   ~h__CodestreamParser() {}
@@ -88,6 +134,62 @@ public:
 	  FB.PlaintextOffset(start_of_data);
       }
 
+    if ( ASDCP_SUCCESS(result) )
+      m_CodestreamSize = read_count;
+
+    return result;
+  }
+
+  //
+  Result_t OpenReadHeader(const std::string& filename)
+  {
+    m_File.Close();
+    Result_t result = m_File.OpenRead(filename);
+
+    if ( ASDCP_FAILURE(result) )
+      return result;
+
+    m_CodestreamSize = m_File.Size();
+    ui32_t probe_size = HeaderProbeSize;
+    ui32_t header_len = 0;
+    ui32_t read_count = 0;
+    FrameBuffer TmpBuffer;
+
+    // most main headers fit the first read, large COM or TLM segments
+    // take another at twice the size
+    for (;;)
+      {
+	if ( probe_size > m_CodestreamSize )
+	  probe_size = (ui32_t)m_CodestreamSize;
+
+	result = TmpBuffer.Capacity(probe_size);
+
+	if ( ASDCP_SUCCESS(result) )
+	  result = m_File.ReadAt(0, TmpBuffer.Data(), probe_size, &read_count);
+
+	if ( ASDCP_SUCCESS(result) )
+	  result = h__MainHeaderLength(TmpBuffer.RoData(), read_count, header_len);
+
+	if ( result != RESULT_SMALLBUF || read_count < probe_size || probe_size == m_CodestreamSize )
+	  break;
+
+	probe_size *= 2;
+      }
+
+    m_File.Close();
+
+    if ( result == RESULT_SMALLBUF )
+      {
+	DefaultLogSink().Error("No start of data found in %s\n", filename.c_str());
+	return RESULT_RAW_ESS;
+      }
+
+    if ( ASDCP_SUCCESS(result) )
+      {
+	TmpBuffer.Size(header_len);
+	result = ParseMetadataIntoDesc(TmpBuffer, m_PDesc);
+      }
+
     return result;
   }
 };
@@ -203,6 +305,25 @@ ASDCP::JP2K::CodestreamParser::OpenReadFrame(const std::string& filename, FrameB
   return m_Parser->OpenReadFrame(filename, FB);
 }
 
+// Opens the stream for reading and parses only the main header, reading a few
+// kilobytes instead of the whole codestream.
+ASDCP::Result_t
+ASDCP::JP2K::CodestreamParser::OpenReadHeader(const std::string& filename) const
+{
+  const_cast<ASDCP::JP2K::CodestreamParser*>(this)->m_Parser = new h__CodestreamParser;
+  return m_Parser->OpenReadHeader(filename);
+}
+
+//
+ui64_t
+ASDCP::JP2K::CodestreamParser::CodestreamSize() const
+{
+  if ( m_Parser.empty() )
+    return 0;
+
+  return m_Parser->m_CodestreamSize;
+}
+
 //
 ASDCP::Result_t
 ASDCP::JP2K::CodestreamParser::FillPictureDescriptor(PictureDescriptor& PDesc) const
@@ -883,6 +883,45 @@ Kumu::FileReader::Read(byte_t* buf, ui32_t buf_len, ui32_t* read_count) const
   return result;
 }
 
+//
+Kumu::Result_t
+Kumu::FileReader::ReadAt(Kumu::fpos_t position, byte_t* buf, ui32_t buf_len, ui32_t* read_count) const
+{
+  KM_TEST_NULL_L(buf);
+  Result_t result = Kumu::RESULT_OK;
+  DWORD    tmp_count = 0;
+  ui32_t tmp_int;
+  OVERLAPPED Overlapped;
+
+  if ( read_count == 0 )
+    read_count = &tmp_int;
+
+  *read_count = 0;
+
+  if ( m_Handle == INVALID_HANDLE_VALUE )
+    return Kumu::RESULT_FILEOPEN;
+
+  // the offset is carried by the request, the file pointer of a
+  // synchronous handle is moved but not consulted
+  memset(&Overlapped, 0, sizeof(Overlapped));
+  Overlapped.Offset = (DWORD)(position & 0xffffffff);
+  Overlapped.OffsetHigh = (DWORD)(position >> 32);
+
+  UINT prev = ::SetErrorMode(SEM_FAILCRITICALERRORS|SEM_NOOPENFILEERRORBOX);
+  if ( ::ReadFile(m_Handle, buf, buf_len, &tmp_count, &Overlapped) == 0 )
+    result = ( ::GetLastError() == ERROR_HANDLE_EOF ) ? Kumu::RESULT_ENDOFFILE : Kumu::RESULT_READFAIL;
+
+  ::SetErrorMode(prev);
+
+  if ( KM_SUCCESS(result) && tmp_count == 0 ) /* EOF */
+    result = Kumu::RESULT_ENDOFFILE;
+
+  if ( KM_SUCCESS(result) )
+    *read_count = tmp_count;
+
+  return result;
+}
+
 
 
 //------------------------------------------------------------------------------------------
@@ -1061,6 +1100,43 @@ Kumu::FileReader::Read(byte_t* buf, ui32_t buf_len, ui32_t* read_count) const
   return (tmp_count == 0 ? RESULT_ENDOFFILE : RESULT_OK);
 }
 
+//
+Kumu::Result_t
+Kumu::FileReader::ReadAt(Kumu::fpos_t position, byte_t* buf, ui32_t buf_len, ui32_t* read_count) const
+{
+  KM_TEST_NULL_L(buf);
+  ssize_t tmp_count = 0;
+  ui32_t tmp_int = 0;
+
+  if ( read_count == 0 )
+    read_count = &tmp_int;
+
+  *read_count = 0;
+
+  if ( m_Handle == -1L )
+    return RESULT_FILEOPEN;
+
+  while ( *read_count < buf_len )
+    {
+      tmp_count = pread(m_Handle, buf + *read_count, buf_len - *read_count, position + *read_count);
+
+      if ( tmp_count == -1L )
+	{
+	  if ( errno == EINTR )
+	    continue;
+
+	  return RESULT_READFAIL;
+	}
+
+      if ( tmp_count == 0 )
+	break;
+
+      *read_count += (ui32_t)tmp_count;
+    }
+
+  return (*read_count == 0 ? RESULT_ENDOFFILE : RESULT_OK);
+}
+
 
 //------------------------------------------------------------------------------------------
 //
@@ -1152,6 +1228,49 @@ Kumu::FileWriter::Write(const byte_t* buf, ui32_t buf_len, ui32_t* bytes_written
 
 #endif // KM_WIN32
 
+//------------------------------------------------------------------------------------------
+//
+
+//
+Kumu::SpanReader::SpanReader(const FileReader& File, ui32_t span) :
+  m_File(File), m_Start(0), m_Span(span) {}
+
+//
+Kumu::Result_t
+Kumu::SpanReader::Get(Kumu::fpos_t pos, ui32_t len, byte_t** data)
+{
+  KM_TEST_NULL_L(data);
+
+  if ( m_Buffer.Length() > 0 && pos >= m_Start
+       && pos + len <= m_Start + m_Buffer.Length() )
+    {
+      *data = m_Buffer.Data() + (pos - m_Start);
+      return RESULT_OK;
+    }
+
+  // refill the window from pos, a packet larger than the span gets a
+  // window of its own
+  ui32_t read_len = xmax(len, m_Span);
+  ui32_t read_count = 0;
+  m_Buffer.Length(0);
+  Result_t result = m_Buffer.Capacity(read_len);
+
+  if ( KM_SUCCESS(result) )
+    result = m_File.ReadAt(pos, m_Buffer.Data(), read_len, &read_count);
+
+  if ( KM_FAILURE(result) )
+    return result;
+
+  m_Start = pos;
+  m_Buffer.Length(read_count);
+
+  if ( read_count < len )
+    return RESULT_ENDOFFILE;
+
+  *data = m_Buffer.Data();
+  return RESULT_OK;
+}
+
 //------------------------------------------------------------------------------------------
 
 
@@ -323,6 +323,7 @@ namespace Kumu
       Result_t Seek(Kumu::fpos_t = 0, SeekPos_t = SP_BEGIN) const;   // move the file pointer
       Result_t Tell(Kumu::fpos_t* pos) const;                        // report the file pointer's location
       Result_t Read(byte_t*, ui32_t, ui32_t* = 0) const;             // read a buffer of data
+      Result_t ReadAt(Kumu::fpos_t, byte_t*, ui32_t, ui32_t* = 0) const; // read at an offset, the file pointer is not consulted (win32 moves it)
 
       inline Kumu::fpos_t Tell() const                               // report the file pointer's location
 	{
@@ -336,6 +337,31 @@ namespace Kumu
       }
     };
 
+  // Reads a file through a window filled by positional reads. A sequential
+  // scan of many KLV packets costs one read per window instead of several per
+  // packet. The FileReader's file pointer is never consulted, so threads that
+  // each own a SpanReader may scan the same FileReader at once. On Win32 the
+  // reads move the file pointer, so they must not be mixed with Seek()/Read()
+  // on the same FileReader from another thread.
+  class SpanReader
+    {
+      KM_NO_COPY_CONSTRUCT(SpanReader);
+      SpanReader();
+
+      const FileReader& m_File;
+      ByteString        m_Buffer;
+      Kumu::fpos_t      m_Start;                                     // file offset of the window
+      ui32_t            m_Span;
+
+    public:
+      SpanReader(const FileReader& File, ui32_t span = 8 * 1024 * 1024);
+      ~SpanReader() {}
+
+      // points data at len bytes of the file starting at pos, the bytes
+      // stay valid until the next call
+      Result_t Get(Kumu::fpos_t pos, ui32_t len, byte_t** data);
+    };
+
   //
   class FileWriter : public FileReader
     {
@@ -29,6 +29,12 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     \brief   Fortuna pseudo-random number generator
   */
 
+// fiber local storage, which frees each thread's generator when it exits,
+// needs the Vista headers
+#if defined(KM_WIN32) && !defined(_WIN32_WINNT)
+# define _WIN32_WINNT 0x0600
+#endif
+
 #include <KM_prng.h>
 #include <KM_log.h>
 #include <KM_mutex.h>
@@ -55,75 +61,63 @@ const ui32_t RNG_BLOCK_SIZE = 16UL;
 const ui32_t MAX_SEQUENCE_LEN = 0x00040000UL;
 
 
-// internal implementation class
-class h__RNG
+// generator state, AES-256 in counter mode. Not locked, each instance
+// is owned by one thread or guarded by its owner.
+class h__RNGState
 {
-  KM_NO_COPY_CONSTRUCT(h__RNG);
+  KM_NO_COPY_CONSTRUCT(h__RNGState);
 
 public:
   AES_KEY   m_Context;
   byte_t    m_ctr_buf[RNG_BLOCK_SIZE];
-  Mutex     m_Lock;
 
-  h__RNG()
+  h__RNGState()
   {
+    memset(&m_Context, 0, sizeof(m_Context));
     memset(m_ctr_buf, 0, RNG_BLOCK_SIZE);
-    byte_t rng_key[RNG_KEY_SIZE];
-
-    { // this block scopes the following AutoMutex so that it will be
-      // released before the call to set_key() below.
-      AutoMutex Lock(m_Lock);
-
-#ifdef KM_WIN32
-      HCRYPTPROV hProvider = 0;
-      CryptAcquireContext(&hProvider, 0, 0, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT);
-      CryptGenRandom(hProvider, RNG_KEY_SIZE, rng_key);
-#else // KM_WIN32
-      // on POSIX systems we simply read some seed from /dev/urandom
-      FileReader URandom;
-
-      Result_t result = URandom.OpenRead(DEV_URANDOM);
-
-      if ( KM_SUCCESS(result) )
-	{
-	  ui32_t read_count;
-	  result = URandom.Read(rng_key, RNG_KEY_SIZE, &read_count);
-	}
-
-      if ( KM_FAILURE(result) )
-	DefaultLogSink().Error("Error opening random device: %s\n", DEV_URANDOM);
-
-#endif // KM_WIN32
-    } // end AutoMutex context
+  }
 
-    set_key(rng_key);
+  ~h__RNGState()
+  {
+    memset(&m_Context, 0, sizeof(m_Context));
+    memset(m_ctr_buf, 0, RNG_BLOCK_SIZE);
   }
-	
-  //
+
+  // the new key is a hash of the old key and the fodder
   void
   set_key(const byte_t* key_fodder)
   {
     assert(key_fodder);
-    byte_t sha_buf[20];
-    SHA_CTX SHA;
-    SHA1_Init(&SHA);
+    byte_t sha_buf[SHA256_DIGEST_LENGTH];
+    SHA256_CTX SHA;
+    SHA256_Init(&SHA);
 
-    SHA1_Update(&SHA, (byte_t*)&m_Context, sizeof(m_Context));
-    SHA1_Update(&SHA, key_fodder, RNG_KEY_SIZE);
-    SHA1_Final(sha_buf, &SHA);
+    SHA256_Update(&SHA, (byte_t*)&m_Context, sizeof(m_Context));
+    SHA256_Update(&SHA, key_fodder, RNG_KEY_SIZE);
+    SHA256_Final(sha_buf, &SHA);
 
-    AutoMutex Lock(m_Lock);
     AES_set_encrypt_key(sha_buf, RNG_KEY_SIZE_BITS, &m_Context);
     *(ui32_t*)(m_ctr_buf + 12) = 1;
+    memset(sha_buf, 0, SHA256_DIGEST_LENGTH);
+  }
+
+  // the next two blocks of output become the key, so output already
+  // handed out can not be recovered from the state
+  void
+  rekey()
+  {
+    byte_t key_buf[RNG_KEY_SIZE_BITS / 8];
+    fill_rand(key_buf, RNG_KEY_SIZE_BITS / 8);
+    AES_set_encrypt_key(key_buf, RNG_KEY_SIZE_BITS, &m_Context);
+    memset(key_buf, 0, RNG_KEY_SIZE_BITS / 8);
   }
-	
+
   //
   void
   fill_rand(byte_t* buf, ui32_t len)
   {
     assert(len <= MAX_SEQUENCE_LEN);
     ui32_t gen_count = 0;
-    AutoMutex Lock(m_Lock);
 
     while ( gen_count + RNG_BLOCK_SIZE <= len )
       {
@@ -131,19 +125,143 @@ public:
 	*(ui32_t*)(m_ctr_buf + 12) += 1;
 	gen_count += RNG_BLOCK_SIZE;
       }
-			
+
     if ( len != gen_count ) // partial count needed?
       {
 	byte_t tmp[RNG_BLOCK_SIZE];
 	AES_encrypt(m_ctr_buf, tmp, &m_Context);
+	*(ui32_t*)(m_ctr_buf + 12) += 1;
 	memcpy(buf + gen_count, tmp, len - gen_count);
       }
   }
 };
 
+// internal implementation class, the process wide generator. It is
+// seeded from the system and only used to seed the per-thread generators.
+class h__RNG
+{
+  KM_NO_COPY_CONSTRUCT(h__RNG);
+
+public:
+  h__RNGState m_State;
+  Mutex       m_Lock;
+
+  h__RNG()
+  {
+    byte_t rng_key[RNG_KEY_SIZE];
+
+#ifdef KM_WIN32
+    HCRYPTPROV hProvider = 0;
+    CryptAcquireContext(&hProvider, 0, 0, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT);
+    CryptGenRandom(hProvider, RNG_KEY_SIZE, rng_key);
+#else // KM_WIN32
+    // on POSIX systems we simply read some seed from /dev/urandom
+    FileReader URandom;
+
+    Result_t result = URandom.OpenRead(DEV_URANDOM);
+
+    if ( KM_SUCCESS(result) )
+      {
+	ui32_t read_count;
+	result = URandom.Read(rng_key, RNG_KEY_SIZE, &read_count);
+      }
+
+    if ( KM_FAILURE(result) )
+      DefaultLogSink().Error("Error opening random device: %s\n", DEV_URANDOM);
+
+#endif // KM_WIN32
+
+    m_State.set_key(rng_key);
+    memset(rng_key, 0, RNG_KEY_SIZE);
+  }
+
+  // a generator for the calling thread, keyed from this one
+  h__RNGState*
+  spawn()
+  {
+    byte_t rng_key[RNG_KEY_SIZE];
+    h__RNGState* State = new h__RNGState;
+
+    {
+      AutoMutex Lock(m_Lock);
+      m_State.fill_rand(rng_key, RNG_KEY_SIZE);
+      m_State.rekey();
+    }
+
+    State->set_key(rng_key);
+    memset(rng_key, 0, RNG_KEY_SIZE);
+    return State;
+  }
+};
+
 
 static h__RNG* s_RNG = 0;
 
+#ifdef KM_WIN32
+static INIT_ONCE s_RNGOnce = INIT_ONCE_STATIC_INIT;
+static DWORD     s_RNGIndex = FLS_OUT_OF_INDEXES;
+
+// called for each thread that still holds a generator when it exits
+static void WINAPI
+thread_rng_free(void* State)
+{
+  delete (h__RNGState*)State;
+}
+
+static BOOL CALLBACK
+rng_init(PINIT_ONCE, void*, void**)
+{
+  s_RNG = new h__RNG;
+  s_RNGIndex = FlsAlloc(thread_rng_free);
+  assert(s_RNGIndex != FLS_OUT_OF_INDEXES);
+  return TRUE;
+}
+
+static h__RNGState*
+thread_rng()
+{
+  h__RNGState* State = (h__RNGState*)FlsGetValue(s_RNGIndex);
+
+  if ( State == 0 )
+    {
+      State = s_RNG->spawn();
+      FlsSetValue(s_RNGIndex, State);
+    }
+
+  return State;
+}
+#else // KM_WIN32
+static pthread_once_t s_RNGOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t  s_RNGKey;
+
+static void
+thread_rng_free(void* State)
+{
+  delete (h__RNGState*)State;
+}
+
+static void
+rng_init()
+{
+  s_RNG = new h__RNG;
+  pthread_key_create(&s_RNGKey, thread_rng_free);
+}
+
+static h__RNGState*
+thread_rng()
+{
+  h__RNGState* State = (h__RNGState*)pthread_getspecific(s_RNGKey);
+
+  if ( State == 0 )
+    {
+      State = s_RNG->spawn();
+      pthread_setspecific(s_RNGKey, State);
+    }
+
+  return State;
+}
+#endif // KM_WIN32
+
 
 //------------------------------------------------------------------------------------------
 //
@@ -151,33 +269,36 @@ static h__RNG* s_RNG = 0;
 
 Kumu::FortunaRNG::FortunaRNG()
 {
-  if ( s_RNG == 0 )
-    s_RNG = new h__RNG;
+#ifdef KM_WIN32
+  InitOnceExecuteOnce(&s_RNGOnce, rng_init, 0, 0);
+#else // KM_WIN32
+  pthread_once(&s_RNGOnce, rng_init);
+#endif // KM_WIN32
 }
 
 Kumu::FortunaRNG::~FortunaRNG() {}
 
-//
+// Each thread draws from its own generator, so concurrent writers never
+// share a lock after their first call.
 const byte_t*
 Kumu::FortunaRNG::FillRandom(byte_t* buf, ui32_t len)
 {
   assert(buf);
   assert(s_RNG);
   const byte_t* front_of_buffer = buf;
+  h__RNGState* RNG = thread_rng();
 
   while ( len )
     {
-      // 2^20 bytes max per seeding, use 2^19 to save
-      // room for generating reseed values
+      // 2^20 bytes max per key, use 2^18 to save
+      // room for generating the next key
       ui32_t gen_size = xmin(len, MAX_SEQUENCE_LEN);
-      s_RNG->fill_rand(buf, gen_size);
+      RNG->fill_rand(buf, gen_size);
       buf += gen_size;
       len -= gen_size;
-	  
-      // re-seed the generator
-      byte_t rng_key[RNG_KEY_SIZE];
-      s_RNG->fill_rand(rng_key, RNG_KEY_SIZE);
-      s_RNG->set_key(rng_key);
+
+      // re-key the generator
+      RNG->rekey();
   }
   
   return front_of_buffer;
@@ -34,6 +34,10 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "S12MTimecode.h"
 #include "KM_xml.h"
 
+#ifdef HAVE_EXPAT
+#include <expat.h>
+#endif
+
 using namespace Kumu;
 using namespace ASDCP;
 
@@ -51,37 +55,66 @@ ASDCP::TimedText::LocalFilenameResolver::~LocalFilenameResolver() {}
 Result_t
 ASDCP::TimedText::LocalFilenameResolver::OpenRead(const std::string& dirname)
 {
+  Result_t result = RESULT_OK;
+
   if ( PathIsDirectory(dirname) )
     {
       m_Dirname = dirname;
-      return RESULT_OK;
+    }
+  else
+    {
+      DefaultLogSink().Error("Path '%s' is not a directory, defaulting to '.'\n", dirname.c_str());
+      m_Dirname = ".";
+      result = RESULT_FALSE;
     }
 
-  DefaultLogSink().Error("Path '%s' is not a directory, defaulting to '.'\n", dirname.c_str());
-  m_Dirname = ".";
-  return RESULT_FALSE;
+  // one scan serves every resource, a subtitle may reference thousands of images
+  m_FileList.clear();
+  FindInPath(PathMatchAny(), m_Dirname, m_FileList);
+  return result;
 }
 
 //
 Result_t
-ASDCP::TimedText::LocalFilenameResolver::ResolveRID(const byte_t* uuid, TimedText::FrameBuffer& FrameBuf) const
+ASDCP::TimedText::LocalFilenameResolver::ResolveRID(const byte_t* uuid, std::string& path) const
 {
-  Result_t result = RESULT_NOT_FOUND;
   char buf[64];
   UUID RID(uuid);
+  RID.EncodeHex(buf, 64);
   PathList_t found_list;
+  PathList_t::const_iterator fi;
 
-#ifndef KM_WIN32
-  // TODO, fix this for win32 (needs regex)
-  FindInPath(PathMatchRegex(RID.EncodeHex(buf, 64)), m_Dirname, found_list);
-#endif
+  for ( fi = m_FileList.begin(); fi != m_FileList.end(); ++fi )
+    {
+      if ( PathBasename(*fi).find(buf) != std::string::npos )
+	found_list.push_back(*fi);
+    }
+
+  if ( found_list.empty() )
+    return RESULT_NOT_FOUND;
 
-  if ( found_list.size() == 1 )
+  if ( found_list.size() > 1 )
     {
-      FileReader Reader;
-      DefaultLogSink().Debug("Retrieving resource %s from file %s\n", buf, found_list.front().c_str());
+      DefaultLogSink().Error("More than one file in %s matches %s.\n", m_Dirname.c_str(), buf);
+      return RESULT_RAW_FORMAT;
+    }
+
+  DefaultLogSink().Debug("Retrieving resource %s from file %s\n", buf, found_list.front().c_str());
+  path = found_list.front();
+  return RESULT_OK;
+}
+
+//
+Result_t
+ASDCP::TimedText::LocalFilenameResolver::ResolveRID(const byte_t* uuid, TimedText::FrameBuffer& FrameBuf) const
+{
+  std::string path;
+  Result_t result = ResolveRID(uuid, path);
 
-      result = Reader.OpenRead(found_list.front().c_str());
+  if ( KM_SUCCESS(result) )
+    {
+      FileReader Reader;
+      result = Reader.OpenRead(path);
 
       if ( KM_SUCCESS(result) )
 	{
@@ -95,11 +128,6 @@ ASDCP::TimedText::LocalFilenameResolver::ResolveRID(const byte_t* uuid, TimedTex
 	    FrameBuf.Size(read_count);
 	}
     }
-  else if ( ! found_list.empty() )
-    {
-      DefaultLogSink().Error("More than one file in %s matches %s.\n", m_Dirname.c_str(), buf);
-      result = RESULT_RAW_FORMAT;
-    }
 
   return result;
 }
@@ -108,9 +136,220 @@ ASDCP::TimedText::LocalFilenameResolver::ResolveRID(const byte_t* uuid, TimedTex
 
 typedef std::map<Kumu::UUID, TimedText::MIMEType_t> ResourceTypeMap_t;
 
+// The parts of a subtitle document the parser uses: the root namespace, the
+// bodies of the root's first Id, EditRate and StartTime children, the bodies of
+// every LoadFont and Image element and the TimeOut of every Subtitle element.
+struct h__SubtitleScan
+{
+  std::string Namespace;
+  std::string Id, EditRate, StartTime;
+  bool HasId, HasEditRate, HasStartTime;
+  std::list<std::string> FontList, ImageList, TimeOutList;
+
+  h__SubtitleScan() : HasId(false), HasEditRate(false), HasStartTime(false) {}
+};
+
+#ifdef HAVE_EXPAT
+
+// Subtitle documents are scanned with expat events, no element tree is built.
+// Only the body of the element being captured is kept.
+class h__SubtitleScanContext
+{
+  KM_NO_COPY_CONSTRUCT(h__SubtitleScanContext);
+  h__SubtitleScanContext();
+
+public:
+  h__SubtitleScan& Scan;
+  ui32_t       Depth;
+  ui32_t       BodyDepth;
+  std::string* Body;
+
+  h__SubtitleScanContext(h__SubtitleScan& scan) : Scan(scan), Depth(0), BodyDepth(0), Body(0) {}
+};
+
+//
+static void
+xph_scan_start(void* p, const XML_Char* name, const XML_Char** attrs)
+{
+  assert(p);  assert(name);  assert(attrs);
+  h__SubtitleScanContext* Ctx = (h__SubtitleScanContext*)p;
+  const char* local_name = strchr(name, '|');
+  Ctx->Depth++;
+
+  if ( local_name == 0 )
+    local_name = name;
+  else
+    local_name++;
+
+  if ( Ctx->Depth == 1 )
+    {
+      if ( local_name != name )
+	Ctx->Scan.Namespace.assign(name, local_name - name - 1);
+
+      return;
+    }
+
+  std::string* Body = 0;
+
+  if ( Ctx->Depth == 2 && strcmp(local_name, "Id") == 0 && ! Ctx->Scan.HasId )
+    {
+      Ctx->Scan.HasId = true;
+      Body = &Ctx->Scan.Id;
+    }
+  else if ( Ctx->Depth == 2 && strcmp(local_name, "EditRate") == 0 && ! Ctx->Scan.HasEditRate )
+    {
+      Ctx->Scan.HasEditRate = true;
+      Body = &Ctx->Scan.EditRate;
+    }
+  else if ( Ctx->Depth == 2 && strcmp(local_name, "StartTime") == 0 && ! Ctx->Scan.HasStartTime )
+    {
+      Ctx->Scan.HasStartTime = true;
+      Body = &Ctx->Scan.StartTime;
+    }
+  else if ( strcmp(local_name, "LoadFont") == 0 )
+    {
+      Ctx->Scan.FontList.push_back(std::string());
+      Body = &Ctx->Scan.FontList.back();
+    }
+  else if ( strcmp(local_name, "Image") == 0 )
+    {
+      Ctx->Scan.ImageList.push_back(std::string());
+      Body = &Ctx->Scan.ImageList.back();
+    }
+  else if ( strcmp(local_name, "Subtitle") == 0 )
+    {
+      std::string TimeOut;
+
+      for ( int i = 0; attrs[i] != 0; i += 2 )
+	{
+	  const char* attr_name = strchr(attrs[i], '|');
+
+	  if ( strcmp(attr_name == 0 ? attrs[i] : attr_name + 1, "TimeOut") == 0 )
+	    TimeOut = attrs[i+1];
+	}
+
+      Ctx->Scan.TimeOutList.push_back(TimeOut);
+    }
+
+  if ( Body != 0 )
+    {
+      Ctx->Body = Body;
+      Ctx->BodyDepth = Ctx->Depth;
+    }
+}
+
+//
+static void
+xph_scan_end(void* p, const XML_Char* name)
+{
+  assert(p);  assert(name);
+  h__SubtitleScanContext* Ctx = (h__SubtitleScanContext*)p;
+
+  if ( Ctx->Depth == Ctx->BodyDepth )
+    {
+      Ctx->Body = 0;
+      Ctx->BodyDepth = 0;
+    }
+
+  Ctx->Depth--;
+}
+
+//
+static void
+xph_scan_char(void* p, const XML_Char* data, int len)
+{
+  assert(p);  assert(data);
+  h__SubtitleScanContext* Ctx = (h__SubtitleScanContext*)p;
+
+  // like an element tree, a body holds only the element's own text
+  if ( Ctx->Body != 0 && Ctx->Depth == Ctx->BodyDepth && len > 0 )
+    Ctx->Body->append(data, len);
+}
+
+//
+static bool
+h__ScanSubtitleDocument(const std::string& document, h__SubtitleScan& Scan)
+{
+  if ( document.empty() )
+    return false;
+
+  XML_Parser Parser = XML_ParserCreateNS("UTF-8", '|');
+
+  if ( Parser == 0 )
+    {
+      DefaultLogSink().Error("Error allocating memory for XML parser.\n");
+      return false;
+    }
+
+  h__SubtitleScanContext Ctx(Scan);
+  XML_SetUserData(Parser, (void*)&Ctx);
+  XML_SetElementHandler(Parser, xph_scan_start, xph_scan_end);
+  XML_SetCharacterDataHandler(Parser, xph_scan_char);
+
+  if ( ! XML_Parse(Parser, document.c_str(), document.size(), 1) )
+    {
+      DefaultLogSink().Error("XML Parse error on line %d: %s\n",
+			     XML_GetCurrentLineNumber(Parser),
+			     XML_ErrorString(XML_GetErrorCode(Parser)));
+      XML_ParserFree(Parser);
+      return false;
+    }
+
+  XML_ParserFree(Parser);
+  return true;
+}
+
+#else // HAVE_EXPAT
+
+// Without expat the document is parsed into an element tree and the same
+// parts are copied out of it.
+static bool
+h__ScanSubtitleDocument(const std::string& document, h__SubtitleScan& Scan)
+{
+  XMLElement Root("**ParserRoot**");
+  ElementList TmpList;
+  Elem_i i;
+
+  if ( ! Root.ParseString(document) )
+    return false;
+
+  if ( Root.Namespace() != 0 )
+    Scan.Namespace = Root.Namespace()->Name();
+
+  XMLElement* Child = Root.GetChildWithName("Id");
+  if ( ( Scan.HasId = ( Child != 0 ) ) )  Scan.Id = Child->GetBody();
+
+  Child = Root.GetChildWithName("EditRate");
+  if ( ( Scan.HasEditRate = ( Child != 0 ) ) )  Scan.EditRate = Child->GetBody();
+
+  Child = Root.GetChildWithName("StartTime");
+  if ( ( Scan.HasStartTime = ( Child != 0 ) ) )  Scan.StartTime = Child->GetBody();
+
+  Root.GetChildrenWithName("LoadFont", TmpList);
+  for ( i = TmpList.begin(); i != TmpList.end(); i++ )
+    Scan.FontList.push_back((*i)->GetBody());
+
+  TmpList.clear();
+  Root.GetChildrenWithName("Image", TmpList);
+  for ( i = TmpList.begin(); i != TmpList.end(); i++ )
+    Scan.ImageList.push_back((*i)->GetBody());
+
+  TmpList.clear();
+  Root.GetChildrenWithName("Subtitle", TmpList);
+  for ( i = TmpList.begin(); i != TmpList.end(); i++ )
+    {
+      const char* TimeOut = (*i)->GetAttrWithName("TimeOut");
+      Scan.TimeOutList.push_back(TimeOut == 0 ? "" : TimeOut);
+    }
+
+  return true;
+}
+
+#endif // HAVE_EXPAT
+
+//
 class ASDCP::TimedText::DCSubtitleParser::h__SubtitleParser
 {
-  XMLElement  m_Root;
   ResourceTypeMap_t m_ResourceTypes;
   Result_t OpenRead();
 
@@ -122,7 +361,7 @@ public:
   TimedTextDescriptor  m_TDesc;
   mem_ptr<LocalFilenameResolver> m_DefaultResolver;
 
-  h__SubtitleParser() : m_Root("**ParserRoot**")
+  h__SubtitleParser()
   {
     memset(&m_TDesc.AssetID, 0, UUIDlen);
   }
@@ -147,24 +386,13 @@ public:
 
 //
 bool
-get_UUID_from_element(XMLElement* Element, UUID& ID)
+get_UUID_from_body(const std::string& Body, UUID& ID)
 {
-  assert(Element);
-  const char* p = Element->GetBody().c_str();
+  const char* p = Body.c_str();
   if ( strncmp(p, "urn:uuid:", 9) == 0 )    p += 9;
   return ID.DecodeHex(p);
 }
 
-//
-bool
-get_UUID_from_child_element(const char* name, XMLElement* Parent, UUID& outID)
-{
-  assert(name); assert(Parent);
-  XMLElement* Child = Parent->GetChildWithName(name);
-  if ( Child == 0 )    return false;
-  return get_UUID_from_element(Child, outID);
-}
-
 //
 Result_t
 ASDCP::TimedText::DCSubtitleParser::h__SubtitleParser::OpenRead(const std::string& filename)
@@ -200,43 +428,41 @@ ASDCP::TimedText::DCSubtitleParser::h__SubtitleParser::OpenRead(const std::strin
 Result_t
 ASDCP::TimedText::DCSubtitleParser::h__SubtitleParser::OpenRead()
 {
-  if ( ! m_Root.ParseString(m_XMLDoc.c_str()) )
+  h__SubtitleScan Scan;
+
+  if ( ! h__ScanSubtitleDocument(m_XMLDoc, Scan) )
     return RESULT_FORMAT;
 
   m_TDesc.EncodingName = "UTF-8"; // the XML parser demands UTF-8
   m_TDesc.ResourceList.clear();
   m_TDesc.ContainerDuration = 0;
-  const XMLNamespace* ns = m_Root.Namespace();
-
-  if ( ns == 0 )
+  if ( Scan.Namespace.empty() )
     {
       DefaultLogSink(). Warn("Document has no namespace name, assuming \"%s\".\n", c_dcst_namespace_name);
       m_TDesc.NamespaceName = c_dcst_namespace_name;
     }
   else
     {
-      m_TDesc.NamespaceName = ns->Name();
+      m_TDesc.NamespaceName = Scan.Namespace;
     }
 
   UUID DocID;
-  if ( ! get_UUID_from_child_element("Id", &m_Root, DocID) )
+  if ( ! Scan.HasId || ! get_UUID_from_body(Scan.Id, DocID) )
     {
       DefaultLogSink(). Error("Id element missing from input document.\n");
       return RESULT_FORMAT;
     }
 
   memcpy(m_TDesc.AssetID, DocID.Value(), DocID.Size());
-  XMLElement* EditRate = m_Root.GetChildWithName("EditRate");
-
-  if ( EditRate == 0 )
+  if ( ! Scan.HasEditRate )
     {
       DefaultLogSink().Error("EditRate element missing from input document.\n");
       return RESULT_FORMAT;
     }
 
-  if ( ! DecodeRational(EditRate->GetBody().c_str(), m_TDesc.EditRate) )
+  if ( ! DecodeRational(Scan.EditRate.c_str(), m_TDesc.EditRate) )
     {
-      DefaultLogSink().Error("Error decoding edit rate value: \"%s\"\n", EditRate->GetBody().c_str());
+      DefaultLogSink().Error("Error decoding edit rate value: \"%s\"\n", Scan.EditRate.c_str());
       return RESULT_FORMAT;
     }
 
@@ -259,14 +485,13 @@ ASDCP::TimedText::DCSubtitleParser::h__SubtitleParser::OpenRead()
       return RESULT_FORMAT;
     }
 
-  // list of fonts
-  ElementList FontList;
-  m_Root.GetChildrenWithName("LoadFont", FontList);
+  std::list<std::string>::const_iterator i;
 
-  for ( Elem_i i = FontList.begin(); i != FontList.end(); i++ )
+  // list of fonts
+  for ( i = Scan.FontList.begin(); i != Scan.FontList.end(); i++ )
     {
       UUID AssetID;
-      if ( ! get_UUID_from_element(*i, AssetID) )
+      if ( ! get_UUID_from_body(*i, AssetID) )
 	{
 	  DefaultLogSink(). Error("LoadFont element does not contain a urn:uuid value as expected.\n");
 	  return RESULT_FORMAT;
@@ -280,14 +505,12 @@ ASDCP::TimedText::DCSubtitleParser::h__SubtitleParser::OpenRead()
     }
 
   // list of images
-  ElementList ImageList;
-  m_Root.GetChildrenWithName("Image", ImageList);
   std::set<Kumu::UUID> visited_items;
 
-  for ( Elem_i i = ImageList.begin(); i != ImageList.end(); i++ )
+  for ( i = Scan.ImageList.begin(); i != Scan.ImageList.end(); i++ )
     {
       UUID AssetID;
-      if ( ! get_UUID_from_element(*i, AssetID) )
+      if ( ! get_UUID_from_body(*i, AssetID) )
 	{
 	  DefaultLogSink(). Error("Image element does not contain a urn:uuid value as expected.\n");
 	  return RESULT_FORMAT;
@@ -309,13 +532,9 @@ ASDCP::TimedText::DCSubtitleParser::h__SubtitleParser::OpenRead()
   // the last instance to be displayed, e.g., element n and element n-1 may have the
   // same start time but n-1 may have a greater duration making it the last to be seen.
   // We must scan the list to accumulate the latest TimeOut value.
-  ElementList InstanceList;
-  ElementList::const_iterator ei;
   ui32_t end_count = 0;
-  
-  m_Root.GetChildrenWithName("Subtitle", InstanceList);
 
-  if ( InstanceList.empty() )
+  if ( Scan.TimeOutList.empty() )
     {
       DefaultLogSink(). Error("XML document contains no Subtitle elements.\n");
       return RESULT_FORMAT;
@@ -326,14 +545,13 @@ ASDCP::TimedText::DCSubtitleParser::h__SubtitleParser::OpenRead()
 
   S12MTimecode beginTC;
   beginTC.SetFPS(TCFrameRate);
-  XMLElement* StartTime = m_Root.GetChildWithName("StartTime");
 
-  if ( StartTime != 0 )
-    beginTC.DecodeString(StartTime->GetBody());
+  if ( Scan.HasStartTime )
+    beginTC.DecodeString(Scan.StartTime);
 
-  for ( ei = InstanceList.begin(); ei != InstanceList.end(); ei++ )
+  for ( i = Scan.TimeOutList.begin(); i != Scan.TimeOutList.end(); i++ )
     {
-      S12MTimecode tmpTC((*ei)->GetAttrWithName("TimeOut"), TCFrameRate);
+      S12MTimecode tmpTC(*i, TCFrameRate);
       if ( end_count < tmpTC.GetFrames() )
 	end_count = tmpTC.GetFrames();
     }
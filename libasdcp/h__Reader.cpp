@@ -167,6 +167,15 @@ ASDCP::h__ASDCPReader::ReadEKLVFrame(ui32_t FrameNum, ASDCP::FrameBuffer& FrameB
 										     EssenceUL, Ctx, HMAC);
 }
 
+// AS-DCP method of reading a frame with positional reads through a caller owned span
+Result_t
+ASDCP::h__ASDCPReader::ReadEKLVFrame(Kumu::SpanReader& Span, ui32_t FrameNum, ASDCP::FrameBuffer& FrameBuf,
+				     const byte_t* EssenceUL, AESDecContext* Ctx, HMACContext* HMAC) const
+{
+  return ASDCP::MXF::TrackFileReader<OP1aHeader, OPAtomIndexFooter>::ReadEKLVFrame(Span, m_HeaderPart.BodyOffset, FrameNum,
+										     FrameBuf, EssenceUL, Ctx, HMAC);
+}
+
 Result_t
 ASDCP::h__ASDCPReader::LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset,
                            i8_t& temporalOffset, i8_t& keyFrameOffset)
@@ -180,29 +189,17 @@ ASDCP::h__ASDCPReader::LocateFrame(ui32_t FrameNum, Kumu::fpos_t& streamOffset,
 //
 
 
-//
-Result_t
-ASDCP::KLReader::ReadKLFromFile(Kumu::FileReader& Reader)
+// the size of the BER length field that starts at ber_start
+static Result_t
+h__BERSize(const byte_t* ber_start, ui8_t& ber_size)
 {
-  ui32_t read_count;
-  ui32_t header_length = SMPTE_UL_LENGTH + MXF_BER_LENGTH;
-  Result_t result = Reader.Read(m_KeyBuf, header_length, &read_count);
-
-  if ( ASDCP_FAILURE(result) )
-    return result;
-
-  if ( read_count != header_length )
-    return RESULT_READFAIL;
-
-  const byte_t* ber_start = m_KeyBuf + SMPTE_UL_LENGTH;
-
   if ( ( *ber_start & 0x80 ) == 0 )
     {
       DefaultLogSink().Error("BER encoding error.\n");
       return RESULT_FORMAT;
     }
 
-  ui8_t ber_size = ( *ber_start & 0x0f ) + 1;
+  ber_size = ( *ber_start & 0x0f ) + 1;
 
   if ( ber_size > 9 )
     {
@@ -217,6 +214,29 @@ ASDCP::KLReader::ReadKLFromFile(Kumu::FileReader& Reader)
       return RESULT_FORMAT;
     }
 
+  return RESULT_OK;
+}
+
+//
+Result_t
+ASDCP::KLReader::ReadKLFromFile(Kumu::FileReader& Reader)
+{
+  ui32_t read_count;
+  ui32_t header_length = SMPTE_UL_LENGTH + MXF_BER_LENGTH;
+  Result_t result = Reader.Read(m_KeyBuf, header_length, &read_count);
+
+  if ( ASDCP_FAILURE(result) )
+    return result;
+
+  if ( read_count != header_length )
+    return RESULT_READFAIL;
+
+  ui8_t ber_size;
+  result = h__BERSize(m_KeyBuf + SMPTE_UL_LENGTH, ber_size);
+
+  if ( ASDCP_FAILURE(result) )
+    return result;
+
   if ( ber_size > MXF_BER_LENGTH )
     {
       ui32_t diff = ber_size - MXF_BER_LENGTH;
@@ -235,11 +255,164 @@ ASDCP::KLReader::ReadKLFromFile(Kumu::FileReader& Reader)
   return InitFromBuffer(m_KeyBuf, header_length);
 }
 
+//
+Result_t
+ASDCP::KLReader::ReadKLFromSpan(Kumu::SpanReader& Span, Kumu::fpos_t Position)
+{
+  byte_t* p;
+  ui32_t header_length = SMPTE_UL_LENGTH + MXF_BER_LENGTH;
+  Result_t result = Span.Get(Position, header_length, &p);
+
+  if ( ASDCP_FAILURE(result) )
+    return result;
+
+  ui8_t ber_size;
+  result = h__BERSize(p + SMPTE_UL_LENGTH, ber_size);
+
+  if ( ASDCP_FAILURE(result) )
+    return result;
+
+  if ( ber_size > MXF_BER_LENGTH )
+    {
+      header_length = SMPTE_UL_LENGTH + ber_size;
+      result = Span.Get(Position, header_length, &p);
+
+      if ( ASDCP_FAILURE(result) )
+	return result;
+    }
+
+  memcpy(m_KeyBuf, p, header_length);
+  return InitFromBuffer(m_KeyBuf, header_length);
+}
+
 
 //------------------------------------------------------------------------------------------
 //
 
 
+// decodes the value of an encrypted triplet held in memory, ess_p is the
+// first byte after the triplet's key and length
+static Result_t
+h__DecodeEKLVValue(byte_t* ess_p, ui64_t PacketLength, const UL& Key, const ASDCP::Dictionary& Dict,
+		   const ASDCP::WriterInfo& Info, ui32_t FrameNum, ui32_t SequenceNum, ASDCP::FrameBuffer& FrameBuf,
+		   const byte_t* EssenceUL, AESDecContext* Ctx, HMACContext* HMAC)
+{
+  Result_t result = RESULT_OK;
+
+  // read context ID length
+  if ( ! Kumu::read_test_BER(&ess_p, UUIDlen) )
+    return RESULT_FORMAT;
+
+  // test the context ID
+  if ( memcmp(ess_p, Info.ContextID, UUIDlen) != 0 )
+    {
+      DefaultLogSink().Error("Packet's Cryptographic Context ID does not match the header.\n");
+      return RESULT_FORMAT;
+    }
+  ess_p += UUIDlen;
+
+  // read PlaintextOffset length
+  if ( ! Kumu::read_test_BER(&ess_p, sizeof(ui64_t)) )
+    return RESULT_FORMAT;
+
+  ui32_t PlaintextOffset = (ui32_t)KM_i64_BE(Kumu::cp2i<ui64_t>(ess_p));
+  ess_p += sizeof(ui64_t);
+
+  // read essence UL length
+  if ( ! Kumu::read_test_BER(&ess_p, SMPTE_UL_LENGTH) )
+    return RESULT_FORMAT;
+
+  // test essence UL
+  if ( ! UL(ess_p).MatchIgnoreStream(EssenceUL) ) // ignore the stream number
+    {
+      char strbuf[IntBufferLen];
+      const MDDEntry* Entry = Dict.FindULAnyVersion(Key.Value());
+
+      if ( Entry == 0 )
+	{
+	  DefaultLogSink().Warn("Unexpected Essence UL found: %s.\n", Key.EncodeString(strbuf, IntBufferLen));
+	}
+      else
+	{
+	  DefaultLogSink().Warn("Unexpected Essence UL found: %s.\n", Entry->name);
+	}
+
+      return RESULT_FORMAT;
+    }
+
+  ess_p += SMPTE_UL_LENGTH;
+
+  // read SourceLength length
+  if ( ! Kumu::read_test_BER(&ess_p, sizeof(ui64_t)) )
+    return RESULT_FORMAT;
+
+  ui32_t SourceLength = (ui32_t)KM_i64_BE(Kumu::cp2i<ui64_t>(ess_p));
+  ess_p += sizeof(ui64_t);
+  assert(SourceLength);
+      
+  if ( FrameBuf.Capacity() < SourceLength )
+    {
+      DefaultLogSink().Error("FrameBuf.Capacity: %u SourceLength: %u\n", FrameBuf.Capacity(), SourceLength);
+      return RESULT_SMALLBUF;
+    }
+
+  ui32_t esv_length = calc_esv_length(SourceLength, PlaintextOffset);
+
+  // read ESV length
+  if ( ! Kumu::read_test_BER(&ess_p, esv_length) )
+    {
+      DefaultLogSink().Error("read_test_BER did not return %u\n", esv_length);
+      return RESULT_FORMAT;
+    }
+
+  ui32_t tmp_len = esv_length + (Info.UsesHMAC ? klv_intpack_size : 0);
+
+  if ( PacketLength < tmp_len )
+    {
+      DefaultLogSink().Error("Frame length is larger than EKLV packet length.\n");
+      return RESULT_FORMAT;
+    }
+
+  if ( Ctx )
+    {
+      // wrap the pointer and length as a FrameBuffer for use by
+      // DecryptFrameBuffer() and TestValues()
+      FrameBuffer TmpWrapper;
+      TmpWrapper.SetData(ess_p, tmp_len);
+      TmpWrapper.Size(tmp_len);
+      TmpWrapper.SourceLength(SourceLength);
+      TmpWrapper.PlaintextOffset(PlaintextOffset);
+
+      result = DecryptFrameBuffer(TmpWrapper, FrameBuf, Ctx);
+      FrameBuf.FrameNumber(FrameNum);
+  
+      // detect and test integrity pack
+      if ( ASDCP_SUCCESS(result) && Info.UsesHMAC && HMAC )
+	{
+	  IntegrityPack IntPack;
+	  result = IntPack.TestValues(TmpWrapper, Info.AssetUUID, SequenceNum, HMAC);
+	}
+    }
+  else // return ciphertext to caller
+    {
+      if ( FrameBuf.Capacity() < tmp_len )
+	{
+	  char intbuf[IntBufferLen];
+	  DefaultLogSink().Error("FrameBuf.Capacity: %u FrameLength: %s\n",
+				 FrameBuf.Capacity(), ui64sz(PacketLength, intbuf));
+	  return RESULT_SMALLBUF;
+	}
+
+      memcpy(FrameBuf.Data(), ess_p, tmp_len);
+      FrameBuf.Size(tmp_len);
+      FrameBuf.FrameNumber(FrameNum);
+      FrameBuf.SourceLength(SourceLength);
+      FrameBuf.PlaintextOffset(PlaintextOffset);
+    }
+
+  return result;
+}
+
 // base subroutine for reading a KLV packet, assumes file position is at the first byte of the packet
 Result_t
 ASDCP::Read_EKLV_Packet(Kumu::FileReader& File, const ASDCP::Dictionary& Dict,
@@ -282,119 +455,8 @@ ASDCP::Read_EKLV_Packet(Kumu::FileReader& File, const ASDCP::Dictionary& Dict,
 
       CtFrameBuf.Size((ui32_t) PacketLength);
 
-      // should be const but mxflib::ReadBER is not
-      byte_t* ess_p = CtFrameBuf.Data();
-
-      // read context ID length
-      if ( ! Kumu::read_test_BER(&ess_p, UUIDlen) )
-	return RESULT_FORMAT;
-
-      // test the context ID
-      if ( memcmp(ess_p, Info.ContextID, UUIDlen) != 0 )
-	{
-	  DefaultLogSink().Error("Packet's Cryptographic Context ID does not match the header.\n");
-	  return RESULT_FORMAT;
-	}
-      ess_p += UUIDlen;
-
-      // read PlaintextOffset length
-      if ( ! Kumu::read_test_BER(&ess_p, sizeof(ui64_t)) )
-	return RESULT_FORMAT;
-
-      ui32_t PlaintextOffset = (ui32_t)KM_i64_BE(Kumu::cp2i<ui64_t>(ess_p));
-      ess_p += sizeof(ui64_t);
-
-      // read essence UL length
-      if ( ! Kumu::read_test_BER(&ess_p, SMPTE_UL_LENGTH) )
-	return RESULT_FORMAT;
-
-      // test essence UL
-      if ( ! UL(ess_p).MatchIgnoreStream(EssenceUL) ) // ignore the stream number
-	{
-	  char strbuf[IntBufferLen];
-	  const MDDEntry* Entry = Dict.FindULAnyVersion(Key.Value());
-
-	  if ( Entry == 0 )
-	    {
-	      DefaultLogSink().Warn("Unexpected Essence UL found: %s.\n", Key.EncodeString(strbuf, IntBufferLen));
-	    }
-	  else
-	    {
-	      DefaultLogSink().Warn("Unexpected Essence UL found: %s.\n", Entry->name);
-	    }
-
-	  return RESULT_FORMAT;
-	}
-
-      ess_p += SMPTE_UL_LENGTH;
-
-      // read SourceLength length
-      if ( ! Kumu::read_test_BER(&ess_p, sizeof(ui64_t)) )
-	return RESULT_FORMAT;
-
-      ui32_t SourceLength = (ui32_t)KM_i64_BE(Kumu::cp2i<ui64_t>(ess_p));
-      ess_p += sizeof(ui64_t);
-      assert(SourceLength);
-	  
-      if ( FrameBuf.Capacity() < SourceLength )
-	{
-	  DefaultLogSink().Error("FrameBuf.Capacity: %u SourceLength: %u\n", FrameBuf.Capacity(), SourceLength);
-	  return RESULT_SMALLBUF;
-	}
-
-      ui32_t esv_length = calc_esv_length(SourceLength, PlaintextOffset);
-
-      // read ESV length
-      if ( ! Kumu::read_test_BER(&ess_p, esv_length) )
-	{
-	  DefaultLogSink().Error("read_test_BER did not return %u\n", esv_length);
-	  return RESULT_FORMAT;
-	}
-
-      ui32_t tmp_len = esv_length + (Info.UsesHMAC ? klv_intpack_size : 0);
-
-      if ( PacketLength < tmp_len )
-	{
-	  DefaultLogSink().Error("Frame length is larger than EKLV packet length.\n");
-	  return RESULT_FORMAT;
-	}
-
-      if ( Ctx )
-	{
-	  // wrap the pointer and length as a FrameBuffer for use by
-	  // DecryptFrameBuffer() and TestValues()
-	  FrameBuffer TmpWrapper;
-	  TmpWrapper.SetData(ess_p, tmp_len);
-	  TmpWrapper.Size(tmp_len);
-	  TmpWrapper.SourceLength(SourceLength);
-	  TmpWrapper.PlaintextOffset(PlaintextOffset);
-
-	  result = DecryptFrameBuffer(TmpWrapper, FrameBuf, Ctx);
-	  FrameBuf.FrameNumber(FrameNum);
-  
-	  // detect and test integrity pack
-	  if ( ASDCP_SUCCESS(result) && Info.UsesHMAC && HMAC )
-	    {
-	      IntegrityPack IntPack;
-	      result = IntPack.TestValues(TmpWrapper, Info.AssetUUID, SequenceNum, HMAC);
-	    }
-	}
-      else // return ciphertext to caller
-	{
-	  if ( FrameBuf.Capacity() < tmp_len )
-	    {
-	      char intbuf[IntBufferLen];
-	      DefaultLogSink().Error("FrameBuf.Capacity: %u FrameLength: %s\n",
-				     FrameBuf.Capacity(), ui64sz(PacketLength, intbuf));
-	      return RESULT_SMALLBUF;
-	    }
-
-	  memcpy(FrameBuf.Data(), ess_p, tmp_len);
-	  FrameBuf.Size(tmp_len);
-	  FrameBuf.FrameNumber(FrameNum);
-	  FrameBuf.SourceLength(SourceLength);
-	  FrameBuf.PlaintextOffset(PlaintextOffset);
-	}
+      result = h__DecodeEKLVValue(CtFrameBuf.Data(), PacketLength, Key, Dict, Info,
+				  FrameNum, SequenceNum, FrameBuf, EssenceUL, Ctx, HMAC);
     }
   else if ( Key.MatchIgnoreStream(EssenceUL) ) // ignore the stream number
     { // read plaintext frame
@@ -448,6 +510,80 @@ ASDCP::Read_EKLV_Packet(Kumu::FileReader& File, const ASDCP::Dictionary& Dict,
   return result;
 }
 
+// reads the KLV packet at Position through a span reader and moves Position past it,
+// the file pointer and the reader's ciphertext buffer are not used
+Result_t
+ASDCP::Read_EKLV_Packet(Kumu::SpanReader& Span, const ASDCP::Dictionary& Dict,
+			const ASDCP::WriterInfo& Info, Kumu::fpos_t& Position,
+			ui32_t FrameNum, ui32_t SequenceNum, ASDCP::FrameBuffer& FrameBuf,
+			const byte_t* EssenceUL, AESDecContext* Ctx, HMACContext* HMAC)
+{
+  KLReader Reader;
+  Result_t result = Reader.ReadKLFromSpan(Span, Position);
+
+  if ( KM_FAILURE(result) )
+    return result;
+
+  UL Key(Reader.Key());
+  ui64_t PacketLength = Reader.Length();
+  byte_t* value;
+
+  if ( PacketLength > 0xFFFFFFFFL )
+    return RESULT_FORMAT;
+
+  result = Span.Get(Position + Reader.KLLength(), (ui32_t) PacketLength, &value);
+
+  if ( ASDCP_FAILURE(result) )
+    {
+      DefaultLogSink().Error("read length is smaller than KLV packet length.\n");
+      return RESULT_READFAIL;
+    }
+
+  Position = Position + Reader.KLLength() + PacketLength;
+
+  if ( Key.MatchIgnoreStream(Dict.ul(MDD_CryptEssence)) )  // ignore the stream numbers
+    {
+      if ( ! Info.EncryptedEssence )
+	{
+	  DefaultLogSink().Error("EKLV packet found, no Cryptographic Context in header.\n");
+	  return RESULT_FORMAT;
+	}
+
+      return h__DecodeEKLVValue(value, PacketLength, Key, Dict, Info,
+				FrameNum, SequenceNum, FrameBuf, EssenceUL, Ctx, HMAC);
+    }
+
+  if ( ! Key.MatchIgnoreStream(EssenceUL) ) // ignore the stream number
+    {
+      char strbuf[IntBufferLen];
+      const MDDEntry* Entry = Dict.FindULAnyVersion(Key.Value());
+
+      if ( Entry == 0 )
+	{
+	  DefaultLogSink().Warn("Unexpected Essence UL found: %s.\n", Key.EncodeString(strbuf, IntBufferLen));
+	}
+      else
+	{
+	  DefaultLogSink().Warn("Unexpected Essence UL found: %s.\n", Entry->name);
+	}
+
+      return RESULT_FORMAT;
+    }
+
+  if ( FrameBuf.Capacity() < PacketLength )
+    {
+      char intbuf[IntBufferLen];
+      DefaultLogSink().Error("FrameBuf.Capacity: %u FrameLength: %s\n",
+			     FrameBuf.Capacity(), ui64sz(PacketLength, intbuf));
+      return RESULT_SMALLBUF;
+    }
+
+  memcpy(FrameBuf.Data(), value, (ui32_t) PacketLength);
+  FrameBuf.FrameNumber(FrameNum);
+  FrameBuf.Size((ui32_t) PacketLength);
+
+  return RESULT_OK;
+}
 
 //
 // end h__Reader.cpp
@@ -23,7 +23,10 @@
 #include <KM_util.h>
 #include <WavFileWriter.h>
 #include <iostream>
+#include <vector>
 #include <assert.h>
+#include <stdio.h>
+#include <fcntl.h>
 
 //#include "md5.h"
 #include "sha1.h"
@@ -32,7 +35,12 @@
 
 using namespace ASDCP;
 
-const ui32_t FRAME_BUFFER_SIZE = 4 * Kumu::Megabyte;
+/* frame buffers grow in steps of this size, never past the limit */
+const ui32_t FRAME_BUFFER_STEP  = 256 * Kumu::Kilobyte;
+const ui32_t FRAME_BUFFER_LIMIT = 64 * Kumu::Megabyte;
+
+/* subtitle resources are read ahead of the writer, never more than this many bytes ahead */
+const ui64_t TT_PREFETCH_WINDOW = 64 * Kumu::Megabyte;
 
 int write_j2k_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file);
 int write_j2k_s_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file);
@@ -412,12 +420,102 @@ extern "C" int read_asset_info(asset_t *asset) {
     return OPENDCP_NO_ERROR;
 }
 
+/* read the main header of a j2k codestream without reading its body */
+extern "C" int read_j2k_header(const char *filename, opendcp_j2k_header_t *header) {
+    JP2K::CodestreamParser  j2k_parser;
+    JP2K::PictureDescriptor picture_desc;
+    Result_t                result = RESULT_OK;
+
+    result = j2k_parser.OpenReadHeader(filename);
+
+    if (ASDCP_FAILURE(result)) {
+        return OPENDCP_FILEOPEN_J2K;
+    }
+
+    j2k_parser.FillPictureDescriptor(picture_desc);
+
+    header->width      = picture_desc.StoredWidth;
+    header->height     = picture_desc.StoredHeight;
+    header->components = picture_desc.Csize;
+    header->profile    = picture_desc.Rsize;
+    header->levels     = picture_desc.CodingStyleDefault.SPcod.DecompositionLevels;
+    header->layers     = KM_i16_BE(Kumu::cp2i<ui16_t>(picture_desc.CodingStyleDefault.SGcod.NumberOfLayers));
+    header->size       = j2k_parser.CodestreamSize();
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* grow a frame buffer to hold size bytes, it keeps its memory when it already does */
+static Result_t frame_buffer_reserve(ASDCP::FrameBuffer &frame_buffer, ui64_t size) {
+    if (size <= frame_buffer.Capacity()) {
+        return RESULT_OK;
+    }
+
+    if (size > FRAME_BUFFER_LIMIT) {
+        OPENDCP_LOG(LOG_ERROR, "frame of %llu bytes exceeds the %u byte limit", (unsigned long long)size, FRAME_BUFFER_LIMIT);
+        return RESULT_SMALLBUF;
+    }
+
+    Result_t result = frame_buffer.Capacity((ui32_t)((size + FRAME_BUFFER_STEP - 1) / FRAME_BUFFER_STEP * FRAME_BUFFER_STEP));
+
+    if (ASDCP_FAILURE(result)) {
+        OPENDCP_LOG(LOG_ERROR, "could not allocate a frame buffer of %llu bytes", (unsigned long long)size);
+    }
+
+    return result;
+}
+
+static Result_t frame_buffer_reserve(JP2K::SFrameBuffer &frame_buffer, ui64_t size) {
+    Result_t result = frame_buffer_reserve(frame_buffer.Left, size);
+
+    if (ASDCP_SUCCESS(result)) {
+        result = frame_buffer_reserve(frame_buffer.Right, size);
+    }
+
+    return result;
+}
+
+static ui32_t frame_buffer_capacity(const ASDCP::FrameBuffer &frame_buffer) {
+    return frame_buffer.Capacity();
+}
+
+static ui32_t frame_buffer_capacity(const JP2K::SFrameBuffer &frame_buffer) {
+    return frame_buffer.Left.Capacity();
+}
+
+/* read a codestream, the frame buffer grows to the size of the file first */
+static Result_t read_j2k_frame(JP2K::CodestreamParser &j2k_parser, const char *filename, JP2K::FrameBuffer &frame_buffer) {
+    Result_t result = frame_buffer_reserve(frame_buffer, Kumu::FileSize(filename));
+
+    if (ASDCP_SUCCESS(result)) {
+        result = j2k_parser.OpenReadFrame(filename, frame_buffer);
+    }
+
+    return result;
+}
+
+/* read an mxf frame, a frame larger than the index suggested doubles the buffer and is read again */
+template <class R, class B>
+static Result_t read_mxf_frame(const R &reader, ui32_t i, B &frame_buffer, AESDecContext *context, HMACContext *hmac) {
+    Result_t result = reader.ReadFrame(i, frame_buffer, context, hmac);
+
+    while (result == RESULT_SMALLBUF && frame_buffer_capacity(frame_buffer) < FRAME_BUFFER_LIMIT) {
+        if (ASDCP_FAILURE(frame_buffer_reserve(frame_buffer, (ui64_t)frame_buffer_capacity(frame_buffer) * 2 + 1))) {
+            break;
+        }
+
+        result = reader.ReadFrame(i, frame_buffer, context, hmac);
+    }
+
+    return result;
+}
+
 /* write the asset to an mxf file */
 extern "C" int write_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
     Result_t      result = RESULT_OK;
     EssenceType_t essence_type;
 
-    result = ASDCP::RawEssenceType(filelist->files[0], essence_type);
+    result = ASDCP::RawEssenceType(filelist_file(filelist, 0), essence_type);
 
     if (ASDCP_FAILURE(result)) {
         return OPENDCP_DETECT_TRACK_TYPE;
@@ -536,7 +634,7 @@ int write_j2k_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
     JP2K::MXFWriter         mxf_writer;
     JP2K::PictureDescriptor picture_desc;
     JP2K::CodestreamParser  j2k_parser;
-    JP2K::FrameBuffer       frame_buffer(FRAME_BUFFER_SIZE);
+    JP2K::FrameBuffer       frame_buffer;
     writer_info_t           writer_info;
     Result_t                result = RESULT_OK;
     ui32_t                  start_frame;
@@ -551,8 +649,14 @@ int write_j2k_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
         start_frame = 0;
     }
 
-    OPENDCP_LOG(LOG_DEBUG, "j2k_parser.OpenReadFrame(%s)", filelist->files[start_frame]);
-    result = j2k_parser.OpenReadFrame(filelist->files[start_frame], frame_buffer);
+    /* sized once from the pre-scan when there was one, otherwise grown frame by frame */
+    if (ASDCP_FAILURE(frame_buffer_reserve(frame_buffer, opendcp->mxf.frame_size))) {
+        OPENDCP_LOG(LOG_ERROR, "could not size the frame buffer for %s", filelist_file(filelist, start_frame));
+        return OPENDCP_FILEOPEN_J2K;
+    }
+
+    OPENDCP_LOG(LOG_DEBUG, "j2k_parser.OpenReadFrame(%s)", filelist_file(filelist, start_frame));
+    result = read_j2k_frame(j2k_parser, filelist_file(filelist, start_frame), frame_buffer);
 
     if (ASDCP_FAILURE(result)) {
         return OPENDCP_FILEOPEN_J2K;
@@ -588,10 +692,10 @@ int write_j2k_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
     /* read each input frame and write to the output mxf until duration is reached */
     while ( ASDCP_SUCCESS(result) && mxf_duration--) {
         if (read) {
-            result = j2k_parser.OpenReadFrame(filelist->files[i], frame_buffer);
+            result = read_j2k_frame(j2k_parser, filelist_file(filelist, i), frame_buffer);
 
             if (opendcp->mxf.delete_intermediate) {
-                unlink(filelist->files[i]);
+                unlink(filelist_file(filelist, i));
             }
 
             if (ASDCP_FAILURE(result)) {
@@ -652,8 +756,8 @@ int write_j2k_s_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file)
     JP2K::PictureDescriptor picture_desc;
     JP2K::CodestreamParser  j2k_parser_left;
     JP2K::CodestreamParser  j2k_parser_right;
-    JP2K::FrameBuffer       frame_buffer_left(FRAME_BUFFER_SIZE);
-    JP2K::FrameBuffer       frame_buffer_right(FRAME_BUFFER_SIZE);
+    JP2K::FrameBuffer       frame_buffer_left;
+    JP2K::FrameBuffer       frame_buffer_right;
     writer_info_t           writer_info;
     Result_t                result = RESULT_OK;
     ui32_t                  start_frame;
@@ -668,13 +772,20 @@ int write_j2k_s_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file)
         start_frame = 0;
     }
 
-    result = j2k_parser_left.OpenReadFrame(filelist->files[0], frame_buffer_left);
+    /* sized once from the pre-scan when there was one, otherwise grown frame by frame */
+    if (ASDCP_FAILURE(frame_buffer_reserve(frame_buffer_left, opendcp->mxf.frame_size)) ||
+        ASDCP_FAILURE(frame_buffer_reserve(frame_buffer_right, opendcp->mxf.frame_size))) {
+        OPENDCP_LOG(LOG_ERROR, "could not size the frame buffers for %s", filelist_file(filelist, 0));
+        return OPENDCP_FILEOPEN_J2K;
+    }
+
+    result = read_j2k_frame(j2k_parser_left, filelist_file(filelist, 0), frame_buffer_left);
 
     if (ASDCP_FAILURE(result)) {
         return OPENDCP_FILEOPEN_J2K;
     }
 
-    result = j2k_parser_right.OpenReadFrame(filelist->files[1], frame_buffer_right);
+    result = read_j2k_frame(j2k_parser_right, filelist_file(filelist, 1), frame_buffer_right);
 
     if (ASDCP_FAILURE(result)) {
         return OPENDCP_FILEOPEN_J2K;
@@ -718,10 +829,10 @@ int write_j2k_s_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file)
     /* read each input frame and write to the output mxf until duration is reached */
     while (ASDCP_SUCCESS(result) && mxf_duration--) {
         if (read) {
-            result = j2k_parser_left.OpenReadFrame(filelist->files[i], frame_buffer_left);
+            result = read_j2k_frame(j2k_parser_left, filelist_file(filelist, i), frame_buffer_left);
 
             if (opendcp->mxf.delete_intermediate) {
-                unlink(filelist->files[i]);
+                unlink(filelist_file(filelist, i));
             }
 
             if (ASDCP_FAILURE(result)) {
@@ -730,10 +841,10 @@ int write_j2k_s_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file)
 
             i++;
 
-            result = j2k_parser_right.OpenReadFrame(filelist->files[i], frame_buffer_right);
+            result = read_j2k_frame(j2k_parser_right, filelist_file(filelist, i), frame_buffer_right);
 
             if (opendcp->mxf.delete_intermediate) {
-                unlink(filelist->files[i]);
+                unlink(filelist_file(filelist, i));
             }
 
             if (ASDCP_FAILURE(result)) {
@@ -812,7 +923,7 @@ int write_pcm_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
     Rational edit_rate(opendcp->frame_rate, 1);
 
     /* read first file */
-    result = pcm_parser_channel[0].OpenRead(filelist->files[0], edit_rate);
+    result = pcm_parser_channel[0].OpenRead(filelist_file(filelist, 0), edit_rate);
 
     if (ASDCP_FAILURE(result)) {
         return OPENDCP_FILEOPEN_WAV;
@@ -824,10 +935,10 @@ int write_pcm_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
     audio_desc.BlockAlign   = 0;
 
     for (file_index = 0; file_index < filelist->nfiles; file_index++) {
-        result = pcm_parser_channel[file_index].OpenRead(filelist->files[file_index], edit_rate);
+        result = pcm_parser_channel[file_index].OpenRead(filelist_file(filelist, file_index), edit_rate);
 
         if (ASDCP_FAILURE(result)) {
-            OPENDCP_LOG(LOG_ERROR, "could not open %s", filelist->files[file_index]);
+            OPENDCP_LOG(LOG_ERROR, "could not open %s", filelist_file(filelist, file_index));
             return OPENDCP_FILEOPEN_WAV;
         }
 
@@ -948,18 +1059,75 @@ int write_pcm_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
     return OPENDCP_NO_ERROR;
 }
 
+/* check a subtitle resource before anything is written, png images must carry a signature and a sized IHDR */
+static int probe_tt_resource(const char *filename, TimedText::MIMEType_t type) {
+    static const byte_t png_signature[8] = { 0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a };
+    byte_t header[24];
+    size_t header_size;
+    FILE  *fp;
+
+    fp = fopen(filename, "rb");
+
+    if (!fp) {
+        OPENDCP_LOG(LOG_ERROR, "could not open subtitle resource %s", filename);
+        return OPENDCP_FILEOPEN_TT;
+    }
+
+    header_size = fread(header, 1, sizeof(header), fp);
+    fclose(fp);
+
+    if (header_size == 0) {
+        OPENDCP_LOG(LOG_ERROR, "subtitle resource %s is empty", filename);
+        return OPENDCP_FILEOPEN_TT;
+    }
+
+    if (type != TimedText::MT_PNG) {
+        return OPENDCP_NO_ERROR;
+    }
+
+    /* signature, then the IHDR chunk: 13 byte length, type, width and height */
+    if (header_size < sizeof(header) || memcmp(header, png_signature, 8) ||
+        KM_i32_BE(Kumu::cp2i<ui32_t>(header + 8)) != 13 || memcmp(header + 12, "IHDR", 4) ||
+        KM_i32_BE(Kumu::cp2i<ui32_t>(header + 16)) == 0 || KM_i32_BE(Kumu::cp2i<ui32_t>(header + 20)) == 0) {
+        OPENDCP_LOG(LOG_ERROR, "subtitle resource %s is not a valid png image", filename);
+        return OPENDCP_FILEOPEN_TT;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* ask the kernel to read the start of a resource before the writer gets to it */
+static void prefetch_tt_resource(const char *filename, ui64_t size) {
+#ifdef POSIX_FADV_WILLNEED
+    FILE *fp = fopen(filename, "rb");
+
+    if (fp) {
+        posix_fadvise(fileno(fp), 0, size, POSIX_FADV_WILLNEED);
+        fclose(fp);
+    }
+#else
+    UNUSED(filename);
+    UNUSED(size);
+#endif
+}
+
 /* write out timed text mxf file */
 int write_tt_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
     TimedText::DCSubtitleParser    tt_parser;
+    TimedText::LocalFilenameResolver tt_resolver;
     TimedText::MXFWriter           mxf_writer;
-    TimedText::FrameBuffer         frame_buffer(FRAME_BUFFER_SIZE);
     TimedText::TimedTextDescriptor tt_desc;
     TimedText::ResourceList_t::const_iterator resource_iterator;
+    std::vector<std::string>       resource_path;
+    std::vector<TimedText::MIMEType_t> resource_type;
+    std::vector<ui64_t>            resource_ahead;
     writer_info_t                  writer_info;
     std::string                    xml_doc;
     Result_t                       result = RESULT_OK;
+    ui64_t                         ahead = 0;
+    int                            i, next = 0, count, errors = 0;
 
-    result = tt_parser.OpenRead(filelist->files[0]);
+    result = tt_parser.OpenRead(filelist_file(filelist, 0));
 
     if (ASDCP_FAILURE(result)) {
         return OPENDCP_FILEOPEN_TT;
@@ -967,6 +1135,39 @@ int write_tt_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
 
     tt_parser.FillTimedTextDescriptor(tt_desc);
 
+    /* resources live beside the subtitle xml, the directory is scanned once for all of them */
+    tt_resolver.OpenRead(Kumu::PathDirname(filelist_file(filelist, 0)));
+
+    for (resource_iterator = tt_desc.ResourceList.begin(); resource_iterator != tt_desc.ResourceList.end(); resource_iterator++) {
+        std::string path;
+        char uuid_buffer[64];
+
+        if (ASDCP_FAILURE(tt_resolver.ResolveRID((*resource_iterator).ResourceID, path))) {
+            OPENDCP_LOG(LOG_ERROR, "could not find subtitle resource %s",
+                        Kumu::bin2UUIDhex((*resource_iterator).ResourceID, UUIDlen, uuid_buffer, 64));
+            return OPENDCP_FILEOPEN_TT;
+        }
+
+        resource_path.push_back(path);
+        resource_type.push_back((*resource_iterator).Type);
+        resource_ahead.push_back(Kumu::xmin((ui64_t)Kumu::FileSize(path), TT_PREFETCH_WINDOW));
+    }
+
+    count = resource_path.size();
+
+    #pragma omp parallel for private(i) reduction(+:errors)
+    for (i = 0; i < count; i++) {
+        if (probe_tt_resource(resource_path[i].c_str(), resource_type[i]) != OPENDCP_NO_ERROR) {
+            errors++;
+        }
+    }
+
+    OPENDCP_LOG(LOG_INFO, "%d subtitle resources checked, %d failed", count, errors);
+
+    if (errors) {
+        return OPENDCP_FILEOPEN_TT;
+    }
+
     fill_writer_info(opendcp, &writer_info);
 
     result = mxf_writer.OpenWrite(output_file, writer_info.info, tt_desc);
@@ -982,16 +1183,16 @@ int write_tt_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
         return OPENDCP_FILEWRITE_MXF;
     }
 
-    resource_iterator = tt_desc.ResourceList.begin();
-
-    while (ASDCP_SUCCESS(result) && resource_iterator != tt_desc.ResourceList.end()) {
-        result = tt_parser.ReadAncillaryResource((*resource_iterator++).ResourceID, frame_buffer);
-
-        if (ASDCP_FAILURE(result)) {
-            return OPENDCP_FILEOPEN_TT;
+    /* resources are copied from disk into the mxf, none is held in memory whole. the ones
+       coming up are prefetched while the window allows, the current one always */
+    for (i = 0; ASDCP_SUCCESS(result) && i < count; i++) {
+        while (next < count && (next <= i || ahead + resource_ahead[next] <= TT_PREFETCH_WINDOW)) {
+            prefetch_tt_resource(resource_path[next].c_str(), resource_ahead[next]);
+            ahead += resource_ahead[next++];
         }
 
-        result = mxf_writer.WriteAncillaryResource(frame_buffer, writer_info.aes_context, writer_info.hmac_context);
+        result = mxf_writer.WriteAncillaryResource(resource_path[i], writer_info.aes_context, writer_info.hmac_context);
+        ahead -= resource_ahead[i];
     }
 
     if (result == RESULT_ENDOFFILE) {
@@ -1011,17 +1212,53 @@ int write_tt_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
     return OPENDCP_NO_ERROR;
 }
 
+/* an mpeg2 picture never outgrows the vbv buffer, which holds no more than a second of
+   the stream, and never outgrows the file. the parser also needs room for one read past it */
+static ui64_t mpeg2_frame_size(const MPEG2::VideoDescriptor &video_desc, const char *filename) {
+    ui64_t size = (ui64_t)video_desc.BitRate / 8;
+    ui64_t file_size = Kumu::FileSize(filename);
+
+    if (!size || size > file_size) {
+        size = file_size;
+    }
+
+    return size + FRAME_BUFFER_STEP;
+}
+
+/* a frame outgrew the buffer after the parser consumed part of it. double the buffer and
+   parse the stream again up to that frame */
+static Result_t reread_mpeg2_frame(MPEG2::Parser &mpeg2_parser, ui32_t frame, MPEG2::FrameBuffer &frame_buffer) {
+    Result_t result = RESULT_SMALLBUF;
+    ui32_t   i;
+
+    while (result == RESULT_SMALLBUF && frame_buffer.Capacity() < FRAME_BUFFER_LIMIT) {
+        if (ASDCP_FAILURE(frame_buffer_reserve(frame_buffer, (ui64_t)frame_buffer.Capacity() * 2 + 1))) {
+            break;
+        }
+
+        OPENDCP_LOG(LOG_DEBUG, "frame %u needs more than %u bytes, parsing again", frame, frame_buffer.Capacity() / 2);
+        result = mpeg2_parser.Reset();
+
+        for (i = 0; ASDCP_SUCCESS(result) && i <= frame; i++) {
+            result = mpeg2_parser.ReadFrame(frame_buffer);
+        }
+    }
+
+    return result;
+}
+
 /* write out mpeg2 mxf file */
 int write_mpeg2_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file) {
-    MPEG2::FrameBuffer     frame_buffer(FRAME_BUFFER_SIZE);
+    MPEG2::FrameBuffer     frame_buffer;
     MPEG2::Parser          mpeg2_parser;
     MPEG2::MXFWriter       mxf_writer;
     MPEG2::VideoDescriptor video_desc;
     writer_info_t          writer_info;
     Result_t               result = RESULT_OK;
     ui32_t                 mxf_duration;
+    ui32_t                 frame = 0;
 
-    result = mpeg2_parser.OpenRead(filelist->files[0]);
+    result = mpeg2_parser.OpenRead(filelist_file(filelist, 0));
 
     if (ASDCP_FAILURE(result)) {
         return OPENDCP_FILEOPEN_MPEG2;
@@ -1029,6 +1266,10 @@ int write_mpeg2_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file)
 
     mpeg2_parser.FillVideoDescriptor(video_desc);
 
+    if (ASDCP_FAILURE(frame_buffer_reserve(frame_buffer, mpeg2_frame_size(video_desc, filelist_file(filelist, 0))))) {
+        return OPENDCP_FILEOPEN_MPEG2;
+    }
+
     fill_writer_info(opendcp, &writer_info);
 
     result = mxf_writer.OpenWrite(output_file, writer_info.info, video_desc);
@@ -1053,6 +1294,10 @@ int write_mpeg2_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file)
     while (ASDCP_SUCCESS(result) && mxf_duration--) {
         result = mpeg2_parser.ReadFrame(frame_buffer);
 
+        if (result == RESULT_SMALLBUF) {
+            result = reread_mpeg2_frame(mpeg2_parser, frame, frame_buffer);
+        }
+
         if (ASDCP_FAILURE(result)) {
             continue;
         }
@@ -1062,6 +1307,7 @@ int write_mpeg2_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file)
         }
 
         result = mxf_writer.WriteFrame(frame_buffer, writer_info.aes_context, writer_info.hmac_context);
+        frame++;
     }
 
     if (result == RESULT_ENDOFFILE) {
@@ -1081,11 +1327,44 @@ int write_mpeg2_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file)
     return OPENDCP_NO_ERROR;
 }
 
+/* walk the index table, every frame has to resolve to an offset past the previous one.
+   the largest step between frames is the buffer any frame but the last needs */
+template <class R>
+static ui32_t walk_mxf_index(const R &reader, ui32_t duration, ui64_t *frame_size = NULL) {
+    Kumu::fpos_t offset, last = 0;
+    i8_t         temporal_offset, key_frame_offset;
+    ui64_t       step = 0;
+    ui32_t       i;
+
+    for (i = 0; i < duration; i++) {
+        if (ASDCP_FAILURE(reader.LocateFrame(i, offset, temporal_offset, key_frame_offset))) {
+            break;
+        }
+
+        if (i && offset <= last) {
+            break;
+        }
+
+        if (i && (ui64_t)(offset - last) > step) {
+            step = offset - last;
+        }
+
+        last = offset;
+    }
+
+    if (frame_size) {
+        *frame_size = step;
+    }
+
+    return i;
+}
+
 extern "C" int read_j2k_mxf(opendcp_t *opendcp, const char *mxf_file) {
     AESDecContext     *context = 0;
     HMACContext       *hmac = 0;
     JP2K::MXFReader    reader;
-    JP2K::FrameBuffer  frame_buffer(FRAME_BUFFER_SIZE);
+    JP2K::FrameBuffer  frame_buffer;
+    ui64_t             frame_size = 0;
     ui32_t             frame_count = 0;
 
     Result_t result = reader.OpenRead(mxf_file);
@@ -1101,6 +1380,13 @@ extern "C" int read_j2k_mxf(opendcp_t *opendcp, const char *mxf_file) {
     frame_count = picture_desc.ContainerDuration;
     OPENDCP_LOG(LOG_INFO, "Detected %d frames", frame_count);
 
+    walk_mxf_index(reader, frame_count, &frame_size);
+
+    if (ASDCP_FAILURE(frame_buffer_reserve(frame_buffer, frame_size))) {
+        OPENDCP_LOG(LOG_ERROR, "could not size the frame buffer for %s", mxf_file);
+        return OPENDCP_FILEREAD_MXF;
+    }
+
     if (opendcp->mxf.key_flag) {
         OPENDCP_LOG(LOG_INFO, "Initialize decryption key");
         context = new AESDecContext;
@@ -1132,8 +1418,11 @@ extern "C" int read_j2k_mxf(opendcp_t *opendcp, const char *mxf_file) {
     char name_format[64];
     snprintf(name_format,  64, "%%s%%0%du.j2c", 6);
 
+    /* frames are read in order, fetch them in large spans */
+    reader.SetScanSpan();
+
     for ( ui32_t i = opendcp->mxf.start_frame; ASDCP_SUCCESS(result) && i < last_frame; i++ ) {
-        result = reader.ReadFrame(i, frame_buffer, context, hmac);
+        result = read_mxf_frame(reader, i, frame_buffer, context, hmac);
 
         if (!ASDCP_SUCCESS(result)) {
             OPENDCP_LOG(LOG_ERROR, "Failed to extract frame %d (%s)", i, result.Label());
@@ -1157,3 +1446,172 @@ extern "C" int read_j2k_mxf(opendcp_t *opendcp, const char *mxf_file) {
 
     return OPENDCP_NO_ERROR;
 }
+
+/* read every frame through the HMAC context, the frames are decrypted on the way,
+   advance is told the offset each read may need so another reader can stay ahead */
+template <class R, class B>
+static int check_mxf_hmac(R &reader, B &frame_buffer, ui32_t duration, const byte_t *key,
+                          opendcp_advance_cb advance, void *ctx, long long ahead) {
+    AESDecContext context;
+    HMACContext   hmac;
+    WriterInfo    info;
+    Kumu::fpos_t  offset;
+    i8_t          temporal_offset, key_frame_offset;
+    Result_t      result = RESULT_OK;
+
+    reader.FillWriterInfo(info);
+
+    if (!info.EncryptedEssence) {
+        return OPENDCP_NO_ERROR;
+    }
+
+    if (!info.UsesHMAC) {
+        OPENDCP_LOG(LOG_WARN, "file is encrypted but does not contain HMAC values");
+        return OPENDCP_NO_ERROR;
+    }
+
+    if (ASDCP_FAILURE(context.InitKey(key)) || ASDCP_FAILURE(hmac.InitKey(key, info.LabelSetType))) {
+        return OPENDCP_VERIFY_HMAC;
+    }
+
+    /* frames are read in order, fetch them in large spans */
+    reader.SetScanSpan();
+
+    for (ui32_t i = 0; i < duration; i++) {
+        if (advance && ASDCP_SUCCESS(reader.LocateFrame(i, offset, temporal_offset, key_frame_offset))) {
+            advance(ctx, (long long)offset + ahead);
+        }
+
+        result = read_mxf_frame(reader, i, frame_buffer, &context, &hmac);
+
+        if (ASDCP_FAILURE(result)) {
+            OPENDCP_LOG(LOG_ERROR, "frame %d failed integrity check (%s)", i, result.Label());
+            return OPENDCP_VERIFY_HMAC;
+        }
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+template <class R, class B>
+static int verify_mxf_reader(R &reader, B &frame_buffer, ui32_t duration, const byte_t *key, int *frames,
+                             opendcp_advance_cb advance, void *ctx, long long ahead) {
+    ui64_t frame_size;
+
+    *frames = walk_mxf_index(reader, duration, &frame_size);
+
+    if ((ui32_t)*frames != duration) {
+        OPENDCP_LOG(LOG_ERROR, "index resolves %d of %d frames", *frames, duration);
+        return OPENDCP_VERIFY_INDEX;
+    }
+
+    if (key) {
+        if (ASDCP_FAILURE(frame_buffer_reserve(frame_buffer, frame_size))) {
+            OPENDCP_LOG(LOG_ERROR, "could not size the frame buffer to check the HMAC of %u frames", duration);
+            return OPENDCP_FILEREAD_MXF;
+        }
+
+        return check_mxf_hmac(reader, frame_buffer, duration, key, advance, ctx, ahead);
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* check the index and, with a key, the HMAC of every frame of an mxf file,
+   advance is called with ahead bytes past each frame before it is read and may be NULL */
+extern "C" int verify_mxf(const char *filename, const byte_t *key, int *frames, opendcp_advance_cb advance, void *ctx, long long ahead) {
+    EssenceType_t essence_type;
+    Result_t      result = RESULT_OK;
+
+    *frames = 0;
+
+    if (ASDCP_FAILURE(ASDCP::EssenceType(filename, essence_type))) {
+        return OPENDCP_DETECT_TRACK_TYPE;
+    }
+
+    switch (essence_type) {
+        case ESS_MPEG2_VES:
+        {
+            MPEG2::MXFReader       reader;
+            MPEG2::VideoDescriptor desc;
+            MPEG2::FrameBuffer     frame_buffer;
+
+            if (ASDCP_FAILURE(reader.OpenRead(filename))) {
+                return OPENDCP_FILEREAD_MXF;
+            }
+
+            reader.FillVideoDescriptor(desc);
+
+            return verify_mxf_reader(reader, frame_buffer, desc.ContainerDuration, key, frames, advance, ctx, ahead);
+        }
+
+        case ESS_JPEG_2000:
+        {
+            JP2K::MXFReader         reader;
+            JP2K::PictureDescriptor desc;
+            JP2K::FrameBuffer       frame_buffer;
+
+            result = reader.OpenRead(filename);
+
+            /* MXF Interop 3D is labeled as 2D */
+            if (ASDCP_FAILURE(result)) {
+                break;
+            }
+
+            reader.FillPictureDescriptor(desc);
+
+            return verify_mxf_reader(reader, frame_buffer, desc.ContainerDuration, key, frames, advance, ctx, ahead);
+        }
+
+        case ESS_JPEG_2000_S:
+            break;
+
+        case ESS_PCM_24b_48k:
+        case ESS_PCM_24b_96k:
+        {
+            PCM::MXFReader       reader;
+            PCM::AudioDescriptor desc;
+            PCM::FrameBuffer     frame_buffer;
+
+            if (ASDCP_FAILURE(reader.OpenRead(filename))) {
+                return OPENDCP_FILEREAD_MXF;
+            }
+
+            reader.FillAudioDescriptor(desc);
+            frame_buffer.Capacity(PCM::CalcFrameBufferSize(desc));
+
+            return verify_mxf_reader(reader, frame_buffer, desc.ContainerDuration, key, frames, advance, ctx, ahead);
+        }
+
+        case ESS_TIMED_TEXT:
+        {
+            TimedText::MXFReader           reader;
+            TimedText::TimedTextDescriptor desc;
+
+            if (ASDCP_FAILURE(reader.OpenRead(filename))) {
+                return OPENDCP_FILEREAD_MXF;
+            }
+
+            /* a single resource, there is no frame index */
+            reader.FillTimedTextDescriptor(desc);
+            *frames = desc.ContainerDuration;
+
+            return OPENDCP_NO_ERROR;
+        }
+
+        default:
+            return OPENDCP_UNKNOWN_TRACK_TYPE;
+    }
+
+    JP2K::MXFSReader        reader;
+    JP2K::PictureDescriptor desc;
+    JP2K::SFrameBuffer      frame_buffer(0);
+
+    if (ASDCP_FAILURE(reader.OpenRead(filename))) {
+        return OPENDCP_FILEREAD_MXF;
+    }
+
+    reader.FillPictureDescriptor(desc);
+
+    return verify_mxf_reader(reader, frame_buffer, desc.ContainerDuration, key, frames, advance, ctx, ahead);
+}
@@ -16,24 +16,246 @@
      along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "opendcp.h"
 #include "opendcp_image.h"
 #include "opendcp_encoder.h"
 
-int opendcp_encode_none(opendcp_t *opendcp, opendcp_image_t *opendcp_image, char *output_file) {
+#define OPENDCP_BUFFER_MIN_SIZE (1024 * 1024)
+
+int opendcp_encode_none_buffer(opendcp_t *opendcp, opendcp_image_t *opendcp_image, opendcp_buffer_t *buffer) {
     UNUSED(opendcp);
     UNUSED(opendcp_image);
-    UNUSED(output_file);
+    UNUSED(buffer);
 
     return OPENDCP_NO_ERROR;
 }
 
+/* the file variant of every encoder encodes into memory and writes the result */
+FOREACH_OPENDCP_ENCODER(GENERATE_ENCODER_FILE)
+
 static opendcp_encoder_t opendcp_encoders[] = {
     FOREACH_OPENDCP_ENCODER(GENERATE_ENCODER_STRUCT)
 };
 
+/*!
+ @function opendcp_buffer_init
+ @abstract Initialize an encoder memory buffer.
+ @discussion If data is NULL the buffer grows as needed, otherwise the
+     caller-provided storage is used and writes beyond capacity fail.
+ @param buffer The buffer to initialize
+ @param data Caller-provided storage or NULL
+ @param capacity The size of data, or an initial size hint for a growable buffer
+*/
+void opendcp_buffer_init(opendcp_buffer_t *buffer, unsigned char *data, size_t capacity) {
+    memset(buffer, 0, sizeof(*buffer));
+
+    if (data) {
+        buffer->data     = data;
+        buffer->capacity = capacity;
+        buffer->fixed    = 1;
+    } else if (capacity) {
+        buffer->data = malloc(capacity);
+
+        if (buffer->data) {
+            buffer->capacity = capacity;
+        }
+    }
+}
+
+/*!
+ @function opendcp_buffer_free
+ @abstract Release the memory of a growable buffer and reset it.
+ @param buffer The buffer
+*/
+void opendcp_buffer_free(opendcp_buffer_t *buffer) {
+    if (!buffer->fixed && buffer->data) {
+        free(buffer->data);
+    }
+
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+/* make room for len bytes at the write position */
+static int opendcp_buffer_reserve(opendcp_buffer_t *buffer, size_t len) {
+    size_t capacity;
+    unsigned char *data;
+
+    if (buffer->pos + len <= buffer->capacity) {
+        return OPENDCP_NO_ERROR;
+    }
+
+    if (buffer->fixed) {
+        OPENDCP_LOG(LOG_ERROR, "encoder buffer too small, %lu bytes needed, %lu available",
+                    (unsigned long)(buffer->pos + len), (unsigned long)buffer->capacity);
+        return OPENDCP_ERROR;
+    }
+
+    capacity = buffer->capacity ? buffer->capacity : OPENDCP_BUFFER_MIN_SIZE;
+
+    while (capacity < buffer->pos + len) {
+        capacity *= 2;
+    }
+
+    data = realloc(buffer->data, capacity);
+
+    if (!data) {
+        OPENDCP_LOG(LOG_ERROR, "unable to allocate %lu bytes for encoder buffer", (unsigned long)capacity);
+        return OPENDCP_ERROR;
+    }
+
+    buffer->data     = data;
+    buffer->capacity = capacity;
+
+    return OPENDCP_NO_ERROR;
+}
+
+/*!
+ @function opendcp_buffer_write
+ @abstract Write bytes at the current position of a buffer.
+ @param buffer The buffer
+ @param data The bytes to write
+ @param len The number of bytes
+ @return OPENDCP_ERROR if a fixed buffer is full or memory could not be allocated
+*/
+int opendcp_buffer_write(opendcp_buffer_t *buffer, const void *data, size_t len) {
+    if (opendcp_buffer_reserve(buffer, len) != OPENDCP_NO_ERROR) {
+        return OPENDCP_ERROR;
+    }
+
+    /* a seek past the end leaves a gap */
+    if (buffer->pos > buffer->size) {
+        memset(buffer->data + buffer->size, 0, buffer->pos - buffer->size);
+    }
+
+    memcpy(buffer->data + buffer->pos, data, len);
+    buffer->pos += len;
+
+    if (buffer->pos > buffer->size) {
+        buffer->size = buffer->pos;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+/*!
+ @function opendcp_buffer_seek
+ @abstract Move the write position of a buffer.
+ @param buffer The buffer
+ @param pos The new absolute position
+ @return OPENDCP_ERROR if the position is beyond a fixed buffer
+*/
+int opendcp_buffer_seek(opendcp_buffer_t *buffer, size_t pos) {
+    if (buffer->fixed && pos > buffer->capacity) {
+        return OPENDCP_ERROR;
+    }
+
+    buffer->pos = pos;
+
+    return OPENDCP_NO_ERROR;
+}
+
+/*!
+ @function opendcp_buffer_save
+ @abstract Write the contents of a buffer to a file.
+ @discussion An existing file is removed first rather than truncated, it may
+     be a hard link shared with other frames.
+ @param buffer The buffer
+ @param filename The output file
+ @return An OPENDCP_ERROR value
+*/
+int opendcp_buffer_save(opendcp_buffer_t *buffer, const char *filename) {
+    FILE *fp;
+    size_t written;
+
+    remove(filename);
+    fp = fopen(filename, "wb");
+
+    if (!fp) {
+        OPENDCP_LOG(LOG_ERROR, "failed to open file %s for writing", filename);
+        return OPENDCP_ERROR;
+    }
+
+    written = fwrite(buffer->data, 1, buffer->size, fp);
+
+    if (fclose(fp) || written != buffer->size) {
+        OPENDCP_LOG(LOG_ERROR, "failed to write file %s", filename);
+        return OPENDCP_ERROR;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+/*!
+ @function opendcp_buffer_load
+ @abstract Append the contents of a file to a buffer.
+ @discussion Used by encoders that can only produce files.
+ @param buffer The buffer
+ @param filename The input file
+ @return An OPENDCP_ERROR value
+*/
+int opendcp_buffer_load(opendcp_buffer_t *buffer, const char *filename) {
+    FILE *fp;
+    long length;
+    int result = OPENDCP_NO_ERROR;
+
+    fp = fopen(filename, "rb");
+
+    if (!fp) {
+        OPENDCP_LOG(LOG_ERROR, "failed to open file %s for reading", filename);
+        return OPENDCP_ERROR;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if (length < 0 || opendcp_buffer_reserve(buffer, length) != OPENDCP_NO_ERROR ||
+        fread(buffer->data + buffer->pos, 1, length, fp) != (size_t)length) {
+        OPENDCP_LOG(LOG_ERROR, "failed to read file %s", filename);
+        result = OPENDCP_ERROR;
+    } else {
+        buffer->pos += length;
+
+        if (buffer->pos > buffer->size) {
+            buffer->size = buffer->pos;
+        }
+    }
+
+    fclose(fp);
+
+    return result;
+}
+
+/*!
+ @function opendcp_encode_file
+ @abstract Encode an image to a file using the memory variant of an encoder.
+ @param encode The memory encode function
+ @param opendcp An opendcp_t context struct
+ @param opendcp_image The source image
+ @param output_file The output file
+ @return An OPENDCP_ERROR value
+*/
+int opendcp_encode_file(opendcp_encode_buffer_t encode, opendcp_t *opendcp, opendcp_image_t *opendcp_image, char *output_file) {
+    opendcp_buffer_t buffer;
+    int result;
+
+    opendcp_buffer_init(&buffer, NULL, 0);
+
+    result = encode(opendcp, opendcp_image, &buffer);
+
+    /* an encoder that produced nothing (none) leaves no file behind */
+    if (result == OPENDCP_NO_ERROR && buffer.size) {
+        result = opendcp_buffer_save(&buffer, output_file);
+    }
+
+    opendcp_buffer_free(&buffer);
+
+    return result;
+}
+
 /*!
  @function opendcp_encoder_find
  @abstract Find an encoder structure
@@ -16,9 +16,17 @@
      along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef _OPENDCP_ENCODER_H_
+#define _OPENDCP_ENCODER_H_
+
+#include <stddef.h>
 #include "opendcp.h"
 #include "opendcp_image.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define FOREACH_OPENDCP_ENCODER(OPENDCP_ENCODER) \
             OPENDCP_ENCODER(OPENDCP_ENCODER_KAKADU,   kakadu,   "j2c;j2k",  0)  \
             OPENDCP_ENCODER(OPENDCP_ENCODER_OPENJPEG, openjpeg, "j2c;j2k",  1)  \
@@ -30,8 +38,36 @@
 #define GENERATE_ENCODER_ENUM(ENCODER, NAME, EXT, ENABLED) ENCODER,
 #define GENERATE_ENCODER_STRING(ENCODER, NAME, EXT, ENABLED) #NAME,
 #define GENERATE_ENCODER_NAME(ENCODER, NAME, EXT, ENABLED) #ENCODER,
-#define GENERATE_ENCODER_STRUCT(ENCODER, NAME, EXT, ENABLED) { ENCODER, ENABLED, #NAME, EXT, opendcp_encode_ ## NAME },
-#define GENERATE_ENCODER_EXTERN(ENCODER, NAME, EXT, ENABLED) extern int opendcp_encode_ ## NAME(opendcp_t *opendcp, opendcp_image_t *opendcp_image, char *output_file);
+#define GENERATE_ENCODER_STRUCT(ENCODER, NAME, EXT, ENABLED) { ENCODER, ENABLED, #NAME, EXT, opendcp_encode_ ## NAME, opendcp_encode_ ## NAME ## _buffer },
+#define GENERATE_ENCODER_EXTERN(ENCODER, NAME, EXT, ENABLED) \
+            extern int opendcp_encode_ ## NAME(opendcp_t *opendcp, opendcp_image_t *opendcp_image, char *output_file); \
+            extern int opendcp_encode_ ## NAME ## _buffer(opendcp_t *opendcp, opendcp_image_t *opendcp_image, opendcp_buffer_t *buffer);
+#define GENERATE_ENCODER_FILE(ENCODER, NAME, EXT, ENABLED) \
+            int opendcp_encode_ ## NAME(opendcp_t *opendcp, opendcp_image_t *opendcp_image, char *output_file) { \
+                return opendcp_encode_file(opendcp_encode_ ## NAME ## _buffer, opendcp, opendcp_image, output_file); \
+            }
+
+/*!
+ @typedef opendcp_buffer_t
+ @abstract A memory buffer an encoder writes a codestream into
+ @discussion The buffer either wraps caller-provided storage of a fixed
+     capacity or grows as needed, in which case the memory belongs to the
+     buffer and is released with opendcp_buffer_free().
+ @field data The buffer memory
+ @field size The number of valid bytes in the buffer
+ @field capacity The allocated size of data
+ @field pos The current write position, encoders may seek back to patch headers
+ @field fixed Set when data was provided by the caller and must not grow or be freed
+*/
+typedef struct {
+    unsigned char *data;
+    size_t        size;
+    size_t        capacity;
+    size_t        pos;
+    int           fixed;
+} opendcp_buffer_t;
+
+typedef int (*opendcp_encode_buffer_t)(opendcp_t *opendcp, opendcp_image_t *opendcp_image, opendcp_buffer_t *buffer);
 
 /*!
  *  @enum OPENDCP_ENCODERS
@@ -52,6 +88,7 @@ FOREACH_OPENDCP_ENCODER(GENERATE_ENCODER_EXTERN)
  @field name The string name of this encoder.
  @field extensions A semicolon separated string of file extensions this encoder can service.
  @field encode The encode function that will be invoked by this encoder
+ @field encode_buffer The encode function that writes into a memory buffer
 */
 typedef struct {
     int  id;
@@ -59,7 +96,27 @@ typedef struct {
     char *name;
     char *extensions;
     int (*encode) (opendcp_t *opendcp, opendcp_image_t *opendcp_image, char *output_file);
+    opendcp_encode_buffer_t encode_buffer;
 } opendcp_encoder_t;
 
 int opendcp_encoder_enable(char *ext, char *name, int id);
+void opendcp_encode_openjpeg_release();
+int  opendcp_encode_openjpeg_threads_supported();
+int  opendcp_encode_tif_path(opendcp_t *opendcp, opendcp_image_t *image, const char *dfile);
+void opendcp_encode_kakadu_release();
+int  opendcp_encode_file(opendcp_encode_buffer_t encode, opendcp_t *opendcp, opendcp_image_t *opendcp_image, char *output_file);
+
+/* encoder memory buffers */
+void opendcp_buffer_init(opendcp_buffer_t *buffer, unsigned char *data, size_t capacity);
+void opendcp_buffer_free(opendcp_buffer_t *buffer);
+int  opendcp_buffer_write(opendcp_buffer_t *buffer, const void *data, size_t len);
+int  opendcp_buffer_seek(opendcp_buffer_t *buffer, size_t pos);
+int  opendcp_buffer_save(opendcp_buffer_t *buffer, const char *filename);
+int  opendcp_buffer_load(opendcp_buffer_t *buffer, const char *filename);
 opendcp_encoder_t *opendcp_encoder_find(char *name, char *ext, int id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  //_OPENDCP_ENCODER_H_
@@ -17,35 +17,319 @@
 */
 
 #include <stdio.h>
-#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif
 #include "opendcp.h"
 #include "opendcp_encoder.h"
 
+#define KAKADU_DEFAULT_CMD   "kdu_compress"
+#define KAKADU_REPLY_MAGIC   "J2C"
+#define KAKADU_IO_CHUNK      (64 * 1024)
+
+/* a worker that went away must show up as a write error, not a SIGPIPE */
+#ifdef MSG_NOSIGNAL
+#define KAKADU_SEND_FLAGS    MSG_NOSIGNAL
+#else
+#define KAKADU_SEND_FLAGS    0
+#endif
+
+/* build the kdu_compress coding arguments shared by both paths */
+static void kakadu_arguments(opendcp_t *opendcp, char *args, int args_len) {
+    int max_cs_len;
+    int max_comp_size;
+    int bw;
+
+    if (opendcp->j2k.bw) {
+        bw = opendcp->j2k.bw;
+    } else {
+        bw = MAX_DCP_JPEG_BITRATE;
+    }
+
+    /* set the max image and component sizes based on frame_rate */
+    max_cs_len = ((float)bw)/8/opendcp->frame_rate;
+
+    /* adjust cs for 3D */
+    if (opendcp->stereoscopic) {
+        max_cs_len = max_cs_len/2;
+    }
+
+    max_comp_size = ((float)max_cs_len)/1.25;
+
+    snprintf(args, args_len, "Sprofile=%s Creslengths=%d Creslengths:C0=%d,%d Creslengths:C1=%d,%d Creslengths:C2=%d,%d -quiet",
+             opendcp->cinema_profile == DCP_CINEMA2K ? "CINEMA2K" : "CINEMA4K",
+             max_cs_len, max_cs_len, max_comp_size, max_cs_len, max_comp_size, max_cs_len, max_comp_size);
+}
+
+#ifndef _WIN32
+/* long-lived encoder process of a thread, both ends of its stdin and stdout are one socket */
+typedef struct {
+    pid_t pid;
+    int   fd;
+    char  command[1024];
+} kakadu_worker_t;
+
+static OPENDCP_TLS kakadu_worker_t kakadu_worker;
+
+static void kakadu_worker_stop(kakadu_worker_t *worker) {
+    if (worker->pid <= 0) {
+        return;
+    }
+
+    /* end of input tells the worker to exit */
+    close(worker->fd);
+    waitpid(worker->pid, NULL, 0);
+
+    memset(worker, 0, sizeof(*worker));
+}
+
+static int kakadu_worker_start(kakadu_worker_t *worker, const char *command) {
+    int sv[2];
+    int type = SOCK_STREAM;
+
+#ifdef SOCK_CLOEXEC
+    /* workers started by other threads at the same time must not inherit this socket */
+    type |= SOCK_CLOEXEC;
+#endif
+
+    if (socketpair(AF_UNIX, type, 0, sv)) {
+        return OPENDCP_ERROR;
+    }
+
+#ifndef SOCK_CLOEXEC
+    fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+    fcntl(sv[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+#ifdef SO_NOSIGPIPE
+    {
+        int on = 1;
+        setsockopt(sv[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+
+    OPENDCP_LOG(LOG_DEBUG, "starting kakadu worker: %s", command);
+
+    worker->pid = fork();
+
+    if (worker->pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        worker->pid = 0;
+        return OPENDCP_ERROR;
+    }
+
+    /* only async-signal-safe calls until exec, the parent is multithreaded */
+    if (worker->pid == 0) {
+        dup2(sv[1], STDIN_FILENO);
+        dup2(sv[1], STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+
+    close(sv[1]);
+
+    worker->fd = sv[0];
+    snprintf(worker->command, sizeof(worker->command), "%s", command);
+
+    return OPENDCP_NO_ERROR;
+}
+
+static int kakadu_send(int fd, const unsigned char *data, size_t len) {
+    ssize_t n;
+
+    while (len) {
+        n = send(fd, data, len, KAKADU_SEND_FLAGS);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return OPENDCP_ERROR;
+        }
+
+        data += n;
+        len  -= n;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* read the reply header line */
+static int kakadu_read_line(int fd, char *line, int line_len) {
+    int i = 0;
+    ssize_t n;
+    char c;
+
+    while (i < line_len - 1) {
+        n = read(fd, &c, 1);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return OPENDCP_ERROR;
+        }
+
+        if (c == '\n') {
+            break;
+        }
+
+        line[i++] = c;
+    }
+
+    line[i] = '\0';
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* send one frame as raw planar samples, 16-bit little endian, and read back the codestream */
+static int kakadu_worker_encode(kakadu_worker_t *worker, opendcp_image_t *simage, opendcp_buffer_t *buffer) {
+    unsigned char chunk[KAKADU_IO_CHUNK];
+    char line[128];
+    long length;
+    int c, i, n, size;
+    ssize_t r;
+
+    size = simage->w * simage->h;
+
+    for (c = 0; c < simage->n_components; c++) {
+        const int *data = simage->component[c].data;
+
+        for (i = 0, n = 0; i < size; i++) {
+            chunk[n++] = data[i] & 0xff;
+            chunk[n++] = (data[i] >> 8) & 0xff;
+
+            if (n == KAKADU_IO_CHUNK || i == size - 1) {
+                if (kakadu_send(worker->fd, chunk, n)) {
+                    return OPENDCP_ERROR;
+                }
+
+                n = 0;
+            }
+        }
+    }
+
+    if (kakadu_read_line(worker->fd, line, sizeof(line))) {
+        return OPENDCP_ERROR;
+    }
+
+    if (strncmp(line, KAKADU_REPLY_MAGIC " ", strlen(KAKADU_REPLY_MAGIC) + 1)) {
+        OPENDCP_LOG(LOG_ERROR, "kakadu worker: %s", line);
+        return OPENDCP_ERROR;
+    }
+
+    length = atol(line + strlen(KAKADU_REPLY_MAGIC) + 1);
+
+    if (length <= 0) {
+        return OPENDCP_ERROR;
+    }
+
+    while (length > 0) {
+        r = read(worker->fd, chunk, length < KAKADU_IO_CHUNK ? length : KAKADU_IO_CHUNK);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (r <= 0 || opendcp_buffer_write(buffer, chunk, r)) {
+            return OPENDCP_ERROR;
+        }
+
+        length -= r;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* encode through the long-lived worker of this thread, restarting it when the frame size or settings change */
+static int kakadu_encode_stream(const char *kakadu, const char *args, opendcp_image_t *simage, opendcp_buffer_t *buffer) {
+    kakadu_worker_t *worker = &kakadu_worker;
+    char command[1024];
+
+    snprintf(command, sizeof(command), "%s -i - -o - Sdims={%d,%d} Scomponents=%d Sprecision=%d Ssigned=no %s",
+             kakadu, simage->h, simage->w, simage->n_components, simage->precision, args);
+
+    if (worker->pid > 0 && strcmp(worker->command, command)) {
+        kakadu_worker_stop(worker);
+    }
+
+    if (worker->pid <= 0 && kakadu_worker_start(worker, command)) {
+        OPENDCP_LOG(LOG_ERROR, "could not start kakadu worker %s", kakadu);
+        return OPENDCP_ERROR;
+    }
+
+    if (kakadu_worker_encode(worker, simage, buffer)) {
+        OPENDCP_LOG(LOG_ERROR, "kakadu worker %s failed", kakadu);
+        kakadu_worker_stop(worker);
+        return OPENDCP_ERROR;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+#endif
+
+/*!
+ @function opendcp_encode_kakadu_release
+ @abstract Stop the kakadu worker of the calling thread.
+ @discussion Call from every thread that encoded in stream mode. Workers
+     also see the end of their input and exit when the encoder process ends.
+*/
+void opendcp_encode_kakadu_release() {
+#ifndef _WIN32
+    kakadu_worker_stop(&kakadu_worker);
+#endif
+}
+
 /*!
- @function opendcp_encoder_kakadu
- @abstract Encode image to file.
- @discussion This function will take the opendcp_image_t struct and encode it.
+ @function opendcp_encode_kakadu_buffer
+ @abstract Encode image to a memory buffer.
+ @discussion This function will take the opendcp_image_t struct and encode it
+     with kdu_compress. In stream mode each thread keeps one worker process
+     alive, started as
+
+       <kakadu> -i - -o - Sdims={h,w} Scomponents=n Sprecision=p Ssigned=no <coding arguments>
+
+     Every frame is sent to its stdin as raw planar samples in 16-bit little
+     endian words, the layout kdu_compress reads from .rawl files, and the
+     worker answers on its stdout with "J2C <length>\n" and the codestream, or
+     with a single error line. kdu_compress itself encodes one image per run,
+     so stream mode needs a wrapper that speaks this; opendcp_kakadu_standin
+     is one for testing. Otherwise, and on windows, the image goes through a
+     temporary tif and the codestream through a temporary j2c.
  @param opendcp An opendcp_t context struct
  @param simage The source image memory buffer to encoder
- @param dfile The output file
+ @param buffer The buffer receiving the codestream
  @return An OPENDCP_ERROR value
 */
-int opendcp_encode_kakadu(opendcp_t *opendcp, opendcp_image_t *simage, char *dfile) {
+int opendcp_encode_kakadu_buffer(opendcp_t *opendcp, opendcp_image_t *simage, opendcp_buffer_t *buffer) {
     int result;
-    int max_cs_len;
-    int max_comp_size;
-    char k_lengths[128];
+    char k_args[256];
     char temp_file[255];
     char temp_path[255];
-    char cmd[512];
+    char dfile[255];
+    char cmd[1024];
+    const char *kakadu;
     FILE *cmdfp = NULL;
-    int bw;
 
-    if (opendcp->j2k.bw) {
-        bw = opendcp->j2k.bw;
-    } else {
-        bw = MAX_DCP_JPEG_BITRATE;
+    kakadu = opendcp->j2k.kakadu ? opendcp->j2k.kakadu : KAKADU_DEFAULT_CMD;
+    kakadu_arguments(opendcp, k_args, sizeof(k_args));
+
+#ifndef _WIN32
+    if (opendcp->j2k.kakadu_stream) {
+        return kakadu_encode_stream(kakadu, k_args, simage, buffer);
     }
+#endif
 
     if (opendcp->tmp_path == NULL) {
         sprintf(temp_path,"./");
@@ -53,43 +337,33 @@ int opendcp_encode_kakadu(opendcp_t *opendcp, opendcp_image_t *simage, char *dfi
         sprintf(temp_path,"%s", opendcp->tmp_path);
     }
 
-    sprintf(temp_file, "%s/tmp_%s.tif", temp_path, basename(dfile));
+    /* the buffer address keeps concurrent encodes apart */
+    sprintf(temp_file, "%s/tmp_%d_%lx.tif", temp_path, (int)getpid(), (unsigned long)(uintptr_t)buffer);
+    sprintf(dfile, "%s/tmp_%d_%lx.j2c", temp_path, (int)getpid(), (unsigned long)(uintptr_t)buffer);
     OPENDCP_LOG(LOG_DEBUG, "writing temporary tif %s", temp_file);
-    result = opendcp_encode_tif(opendcp, simage, temp_file);
+    result = opendcp_encode_tif_path(opendcp, simage, temp_file);
 
     if (result != OPENDCP_NO_ERROR) {
         OPENDCP_LOG(LOG_ERROR,"writing temporary tif failed");
         return OPENDCP_ERROR;
     }
 
-    /* set the max image and component sizes based on frame_rate */
-    max_cs_len = ((float)bw)/8/opendcp->frame_rate;
+    snprintf(cmd, sizeof(cmd), "%s -i \"%s\" -o \"%s\" %s", kakadu, temp_file, dfile, k_args);
 
-    /* adjust cs for 3D */
-    if (opendcp->stereoscopic) {
-        max_cs_len = max_cs_len/2;
-    }
-
-    max_comp_size = ((float)max_cs_len)/1.25;
-
-    sprintf(k_lengths,"Creslengths=%d Creslengths:C0=%d,%d Creslengths:C1=%d,%d Creslengths:C2=%d,%d",max_cs_len,max_cs_len,max_comp_size,max_cs_len,max_comp_size,max_cs_len,max_comp_size);
-
-    if (opendcp->cinema_profile == DCP_CINEMA2K) {
-        sprintf(cmd,"kdu_compress -i \"%s\" -o \"%s\" Sprofile=CINEMA2K %s -quiet",temp_file, dfile, k_lengths);
-    } else {
-        sprintf(cmd,"kdu_compress -i \"%s\" -o \"%s\" Sprofile=CINEMA4K %s -quiet",temp_file, dfile, k_lengths);
-    }
-
-    OPENDCP_LOG(LOG_DEBUG, cmd);
+    OPENDCP_LOG(LOG_DEBUG, "%s", cmd);
 
     cmdfp = popen(cmd,"r");
-    result = pclose(cmdfp);
+    result = cmdfp ? pclose(cmdfp) : -1;
 
     remove(temp_file);
 
     if (result) {
+        remove(dfile);
         return OPENDCP_ERROR;
     }
 
-    return OPENDCP_NO_ERROR;
+    result = opendcp_buffer_load(buffer, dfile);
+    remove(dfile);
+
+    return result;
 }
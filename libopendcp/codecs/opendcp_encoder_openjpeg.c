@@ -21,10 +21,17 @@
 #include <stdlib.h>
 #include <openjpeg.h>
 #include <stdbool.h>
+#include <pthread.h>
 #ifdef OPENMP
 #include <omp.h>
 #endif
 #include "opendcp.h"
+#include "opendcp_encoder.h"
+
+/* multi-threaded codeblock encoding is available from openjpeg 2.4 */
+#if defined(OPJ_VERSION_MAJOR) && (OPJ_VERSION_MAJOR > 2 || (OPJ_VERSION_MAJOR == 2 && OPJ_VERSION_MINOR >= 4))
+#define OPENDCP_OPJ_ENCODE_THREADS 1
+#endif
 
 void set_cinema_encoder_parameters(opendcp_t *opendcp, opj_cparameters_t *parameters);
 static int initialize_4K_poc(opj_poc_t *POC, int numres);
@@ -137,31 +144,123 @@ int opendcp_to_opj(opendcp_image_t *opendcp, opj_image_t **opj_ptr) {
     return OPENDCP_NO_ERROR;
 }
 
-/*!
- @function opendcp_encoder_openjpeg
- @abstract Encode image to file.
- @discussion This function will take the opendcp_image_t struct and encode it.
- @param opendcp An opendcp_t context struct
- @param simage The source image memory buffer to encoder
- @param dfile The output file
- @return An OPENDCP_ERROR value
-*/
-int opendcp_encode_openjpeg(opendcp_t *opendcp, opendcp_image_t *opendcp_image, char *dfile) {
-    bool result;
+/* per thread encoder state, reused while the settings and image geometry are unchanged */
+typedef struct {
+    int               valid;
+    int               cinema_profile;
+    int               frame_rate;
+    int               bw;
+    int               stereoscopic;
+    int               w;
+    int               h;
+    int               precision;
+    int               bpp;
+    int               n_components;
+    int               signed_bit;
+    int               frames;
+    opj_cparameters_t parameters;
+    opj_image_t       *image;
+} opendcp_openjpeg_ctx_t;
+
+/* each thread's state hangs off a key, so it is freed when the thread exits */
+static pthread_key_t  openjpeg_ctx_key;
+static pthread_once_t openjpeg_ctx_once = PTHREAD_ONCE_INIT;
+
+/* release the encoder state of the calling thread */
+static void opendcp_openjpeg_ctx_free(opendcp_openjpeg_ctx_t *ctx) {
+    if (ctx->image) {
+        opj_image_destroy(ctx->image);
+    }
+
+    if (ctx->parameters.cp_comment) {
+        free(ctx->parameters.cp_comment);
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static void opendcp_openjpeg_ctx_destroy(void *ctx) {
+    opendcp_openjpeg_ctx_free(ctx);
+    free(ctx);
+}
+
+static void opendcp_openjpeg_key_create() {
+    pthread_key_create(&openjpeg_ctx_key, opendcp_openjpeg_ctx_destroy);
+}
+
+/* the encoder state of the calling thread, allocated on first use */
+static opendcp_openjpeg_ctx_t *opendcp_openjpeg_ctx_self() {
+    opendcp_openjpeg_ctx_t *ctx;
+
+    pthread_once(&openjpeg_ctx_once, opendcp_openjpeg_key_create);
+    ctx = pthread_getspecific(openjpeg_ctx_key);
+
+    if (!ctx) {
+        ctx = calloc(1, sizeof(*ctx));
+
+        if (ctx && pthread_setspecific(openjpeg_ctx_key, ctx)) {
+            free(ctx);
+            ctx = NULL;
+        }
+    }
+
+    return ctx;
+}
+
+/* compression ratio that fits the image into len bytes */
+static float opendcp_openjpeg_rate(opj_image_t *opj_image, long long len) {
+    return ((float) (opj_image->numcomps * opj_image->comps[0].w * opj_image->comps[0].h * opj_image->comps[0].prec))/
+           (len * 8 * opj_image->comps[0].dx * opj_image->comps[0].dy);
+}
+
+/* get the encoder state of the calling thread, set up again only if a setting changed */
+static opendcp_openjpeg_ctx_t *opendcp_openjpeg_ctx_get(opendcp_t *opendcp, opendcp_image_t *opendcp_image) {
+    opendcp_openjpeg_ctx_t *ctx = opendcp_openjpeg_ctx_self();
+    opj_cparameters_t *parameters;
+    opj_image_t *opj_image;
     int max_comp_size;
     int max_cs_len;
-    opj_cparameters_t parameters;
-    opj_codec_t* l_codec = 00;
-    opj_image_t *opj_image = NULL;
-    opj_stream_t *l_stream = 00;
     int bw;
 
+    if (!ctx) {
+        OPENDCP_LOG(LOG_ERROR, "unable to allocate encoder context");
+        return NULL;
+    }
+
+    parameters = &ctx->parameters;
+
     if (opendcp->j2k.bw) {
         bw = opendcp->j2k.bw;
     } else {
         bw = MAX_DCP_JPEG_BITRATE;
     }
 
+    if (ctx->valid &&
+        ctx->cinema_profile == opendcp->cinema_profile &&
+        ctx->frame_rate     == opendcp->frame_rate &&
+        ctx->bw             == bw &&
+        ctx->stereoscopic   == opendcp->stereoscopic &&
+        ctx->w              == opendcp_image->w &&
+        ctx->h              == opendcp_image->h &&
+        ctx->precision      == opendcp_image->precision &&
+        ctx->bpp            == opendcp_image->bpp &&
+        ctx->n_components   == opendcp_image->n_components &&
+        ctx->signed_bit     == opendcp_image->signed_bit) {
+        ctx->frames++;
+        return ctx;
+    }
+
+    if (ctx->valid) {
+        OPENDCP_LOG(LOG_DEBUG, "encoder settings changed after %d frames, setting up again", ctx->frames);
+    }
+
+    opendcp_openjpeg_ctx_free(ctx);
+
+    /* the image buffers are reused, only the pixel data changes per frame */
+    if (opendcp_to_opj(opendcp_image, &opj_image) != OPENDCP_NO_ERROR) {
+        return NULL;
+    }
+
     /* set the max image and component sizes based on frame_rate */
     max_cs_len = ((float)bw)/8/opendcp->frame_rate;
 
@@ -172,83 +271,251 @@ int opendcp_encode_openjpeg(opendcp_t *opendcp, opendcp_image_t *opendcp_image,
 
     max_comp_size = ((float)max_cs_len)/1.25;
 
-    opendcp_to_opj(opendcp_image, &opj_image);
-
     /* set encoding parameters to default values */
-    opj_setup_encoder(l_codec, &parameters, opj_image);
-    opj_set_default_encoder_parameters(&parameters);
+    opj_set_default_encoder_parameters(parameters);
 
     /* set default cinema parameters */
-    set_cinema_encoder_parameters(opendcp, &parameters);
+    set_cinema_encoder_parameters(opendcp, parameters);
 
-    parameters.cp_comment = (char*)malloc(strlen(OPENDCP_NAME)+1);
-    sprintf(parameters.cp_comment,"%s", OPENDCP_NAME);
+    parameters->cp_comment = (char*)malloc(strlen(OPENDCP_NAME)+1);
+    sprintf(parameters->cp_comment,"%s", OPENDCP_NAME);
 
     /* Decide if MCT should be used */
-    parameters.tcp_mct = opj_image->numcomps >= 3 ? 1 : 0;
+    parameters->tcp_mct = opj_image->numcomps >= 3 ? 1 : 0;
+
+    /* set max image, the cinema profiles derive the rate from max_cs_size */
+    parameters->max_cs_size = max_cs_len;
+    parameters->max_comp_size = max_comp_size;
+    parameters->tcp_rates[0] = opendcp_openjpeg_rate(opj_image, max_cs_len);
+
+    ctx->image          = opj_image;
+    ctx->cinema_profile = opendcp->cinema_profile;
+    ctx->frame_rate     = opendcp->frame_rate;
+    ctx->bw             = bw;
+    ctx->stereoscopic   = opendcp->stereoscopic;
+    ctx->w              = opendcp_image->w;
+    ctx->h              = opendcp_image->h;
+    ctx->precision      = opendcp_image->precision;
+    ctx->bpp            = opendcp_image->bpp;
+    ctx->n_components   = opendcp_image->n_components;
+    ctx->signed_bit     = opendcp_image->signed_bit;
+    ctx->frames         = 1;
+    ctx->valid          = 1;
+
+    OPENDCP_LOG(LOG_DEBUG, "encoder context set up %dx%d, max_cs_len %d", ctx->w, ctx->h, max_cs_len);
+
+    return ctx;
+}
+
+/*!
+ @function opendcp_encode_openjpeg_release
+ @abstract Release the encoder context of the calling thread.
+ @discussion The OpenJPEG encoder keeps its parameters and image buffers per
+     thread between frames. They are freed when the thread exits; worker
+     threads that outlive the encode, such as an OpenMP pool, should call
+     this when the encode is done.
+*/
+void opendcp_encode_openjpeg_release() {
+    opendcp_openjpeg_ctx_t *ctx;
 
-    /* set max image */
-    parameters.max_comp_size = max_comp_size;
-    parameters.tcp_rates[0]= ((float) (opj_image->numcomps * opj_image->comps[0].w * opj_image->comps[0].h * opj_image->comps[0].prec))/
-                              (max_cs_len * 8 * opj_image->comps[0].dx * opj_image->comps[0].dy);
+    pthread_once(&openjpeg_ctx_once, opendcp_openjpeg_key_create);
+    ctx = pthread_getspecific(openjpeg_ctx_key);
+
+    if (ctx) {
+        pthread_setspecific(openjpeg_ctx_key, NULL);
+        opendcp_openjpeg_ctx_destroy(ctx);
+    }
+}
+
+/* openjpeg output stream callbacks writing into an opendcp_buffer_t */
+static OPJ_SIZE_T opendcp_opj_write(void *p_buffer, OPJ_SIZE_T p_nb_bytes, void *p_user_data) {
+    if (opendcp_buffer_write(p_user_data, p_buffer, p_nb_bytes) != OPENDCP_NO_ERROR) {
+        return (OPJ_SIZE_T)-1;
+    }
+
+    return p_nb_bytes;
+}
 
-    /* get a J2K compressor handle */
-    OPENDCP_LOG(LOG_DEBUG, "creating compressor %s", dfile);
+static OPJ_OFF_T opendcp_opj_skip(OPJ_OFF_T p_nb_bytes, void *p_user_data) {
+    opendcp_buffer_t *buffer = p_user_data;
+
+    if (opendcp_buffer_seek(buffer, buffer->pos + p_nb_bytes) != OPENDCP_NO_ERROR) {
+        return -1;
+    }
+
+    return p_nb_bytes;
+}
+
+static OPJ_BOOL opendcp_opj_seek(OPJ_OFF_T p_nb_bytes, void *p_user_data) {
+    return opendcp_buffer_seek(p_user_data, p_nb_bytes) == OPENDCP_NO_ERROR;
+}
+
+/* create an openjpeg output stream on a memory buffer */
+static opj_stream_t *opendcp_opj_stream_create(opendcp_buffer_t *buffer) {
+    opj_stream_t *l_stream;
+
+    l_stream = opj_stream_create(OPJ_J2K_STREAM_CHUNK_SIZE, OPJ_FALSE);
+
+    if (!l_stream) {
+        return NULL;
+    }
+
+    opj_stream_set_user_data(l_stream, buffer, NULL);
+    opj_stream_set_write_function(l_stream, opendcp_opj_write);
+    opj_stream_set_skip_function(l_stream, opendcp_opj_skip);
+    opj_stream_set_seek_function(l_stream, opendcp_opj_seek);
+
+    return l_stream;
+}
+
+/*!
+ @function opendcp_encode_openjpeg_threads_supported
+ @abstract Check whether the linked OpenJPEG can encode one frame with several threads.
+ @discussion Codeblock threads need OpenJPEG 2.4 built with thread support,
+     otherwise the codec_threads setting has no effect.
+ @return 1 if supported, otherwise 0
+*/
+int opendcp_encode_openjpeg_threads_supported() {
+#ifdef OPENDCP_OPJ_ENCODE_THREADS
+    return opj_has_thread_support() ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+/* threads to encode one frame with, the thread budget is shared by the frames in flight */
+static int opendcp_openjpeg_threads(opendcp_t *opendcp) {
+    int inflight, threads;
+
+    if (opendcp->j2k.codec_threads <= 1) {
+        return 1;
+    }
+
+    inflight = __atomic_load_n(&opendcp->j2k.inflight, __ATOMIC_RELAXED);
+    threads  = opendcp->threads / (inflight > 1 ? inflight : 1);
+
+    if (threads > opendcp->j2k.codec_threads) {
+        threads = opendcp->j2k.codec_threads;
+    }
+
+    return threads > 1 ? threads : 1;
+}
+
+/*!
+ @function opendcp_encode_openjpeg_buffer
+ @abstract Encode image to a memory buffer.
+ @discussion This function will take the opendcp_image_t struct and encode it
+     into buffer using an OpenJPEG memory stream. The cinema parameters and
+     image buffers are set up once per thread and reused for every frame with
+     the same settings. The codec is not: an OpenJPEG 2.x codec encodes one
+     image, and opj_setup_encoder cannot be called on it again, so every frame
+     creates and sets up its own. That also lets each frame carry its own rate
+     control budget.
+ @param opendcp An opendcp_t context struct
+ @param opendcp_image The source image to encode
+ @param buffer The buffer receiving the codestream
+ @return An OPENDCP_ERROR value
+*/
+int opendcp_encode_openjpeg_buffer(opendcp_t *opendcp, opendcp_image_t *opendcp_image, opendcp_buffer_t *buffer) {
+    bool result;
+    opendcp_openjpeg_ctx_t *ctx;
+    opj_cparameters_t parameters;
+    opj_codec_t* l_codec = 00;
+    opj_image_t *opj_image = NULL;
+    opj_stream_t *l_stream = 00;
+    int c, size, threads;
+    long long budget;
+
+    ctx = opendcp_openjpeg_ctx_get(opendcp, opendcp_image);
+
+    if (!ctx) {
+        return OPENDCP_ERROR;
+    }
+
+    /* only the pixel data changes between frames */
+    opj_image = ctx->image;
+    size = opendcp_image->w * opendcp_image->h;
+
+    for (c = 0; c < (int)opj_image->numcomps; c++) {
+        memcpy(opj_image->comps[c].data, opendcp_image->component[c].data, size * sizeof(int));
+    }
+
+    /* the encoder may adjust the parameters it is given, hand it a copy */
+    parameters = ctx->parameters;
+
+    /* a rate controlled frame gets its own budget below the ceiling */
+    budget = opendcp_ratecontrol_frame_bytes();
+
+    if (budget > 0) {
+        parameters.max_cs_size = budget;
+        parameters.max_comp_size = ((float)budget)/1.25;
+        parameters.tcp_rates[0] = opendcp_openjpeg_rate(opj_image, budget);
+        OPENDCP_LOG(LOG_DEBUG, "frame budget %lld bytes", budget);
+    }
+
+    /* get a J2K compressor handle, a codec cannot be reused for another image */
+    OPENDCP_LOG(LOG_DEBUG, "creating compressor");
     l_codec = opj_create_compress(OPJ_CODEC_J2K);
 
     /* setup the encoder parameters using the current image and user parameters */
     OPENDCP_LOG(LOG_DEBUG, "setting up j2k encoder");
     opj_setup_encoder(l_codec, &parameters, opj_image);
 
+    /* fewer frames in flight than threads, encode the codeblocks of this frame in parallel */
+    threads = opendcp_openjpeg_threads(opendcp);
+
+    if (threads > 1) {
+#ifdef OPENDCP_OPJ_ENCODE_THREADS
+        if (opj_has_thread_support() && opj_codec_set_threads(l_codec, threads)) {
+            OPENDCP_LOG(LOG_DEBUG, "encoding with %d threads", threads);
+        }
+#else
+        OPENDCP_LOG(LOG_DEBUG, "openjpeg %s cannot encode with threads", opj_version());
+#endif
+    }
+
     /* open a byte stream for writing */
-    /* allocate memory for all tiles */
     OPENDCP_LOG(LOG_DEBUG, "opening J2k output stream");
-    l_stream = opj_stream_create_default_file_stream(dfile, OPJ_FALSE);
+    l_stream = opendcp_opj_stream_create(buffer);
 
     if (! l_stream){
+        opj_destroy_codec(l_codec);
         return OPENDCP_ERROR;
     }
 
-    OPENDCP_LOG(LOG_INFO,"starting compression %s", dfile);
+    OPENDCP_LOG(LOG_INFO,"starting compression");
     result = opj_start_compress(l_codec, opj_image, l_stream);
-    OPENDCP_LOG(LOG_DEBUG, "compression started %s", dfile);
+    OPENDCP_LOG(LOG_DEBUG, "compression started");
 
     if (!result) {
-        OPENDCP_LOG(LOG_ERROR,"unable to start compression jpeg2000 file %s", dfile);
+        OPENDCP_LOG(LOG_ERROR,"unable to start compression jpeg2000 codestream");
         opj_stream_destroy(l_stream);
         opj_destroy_codec(l_codec);
-        opj_image_destroy(opj_image);
         return OPENDCP_ERROR;
     }
 
-    OPENDCP_LOG(LOG_INFO,"starting encoding %s", dfile);
+    OPENDCP_LOG(LOG_INFO,"starting encoding");
     result = opj_encode(l_codec, l_stream);
-    OPENDCP_LOG(LOG_INFO,"encoding started %s", dfile);
+    OPENDCP_LOG(LOG_INFO,"encoding started");
 
     if (!result) {
-        OPENDCP_LOG(LOG_ERROR,"unable to encode jpeg2000 file %s", dfile);
+        OPENDCP_LOG(LOG_ERROR,"unable to encode jpeg2000 codestream");
         opj_stream_destroy(l_stream);
         opj_destroy_codec(l_codec);
-        opj_image_destroy(opj_image);
         return OPENDCP_ERROR;
     }
 
-    OPENDCP_LOG(LOG_DEBUG, "finishing compression %s", dfile);
+    OPENDCP_LOG(LOG_DEBUG, "finishing compression");
     result = opj_end_compress(l_codec, l_stream);
 
     if (!result) {
-        OPENDCP_LOG(LOG_ERROR,"unable to finish compression jpeg2000 file %s", dfile);
+        OPENDCP_LOG(LOG_ERROR,"unable to finish compression jpeg2000 codestream");
     }
 
-    OPENDCP_LOG(LOG_DEBUG, "encoding complete %s", dfile);
-    /* free openjpeg structure */
+    OPENDCP_LOG(LOG_DEBUG, "encoding complete, %lu bytes", (unsigned long)buffer->size);
+    /* free openjpeg structure, the image stays with the thread */
     opj_stream_destroy(l_stream);
     opj_destroy_codec(l_codec);
-    opj_image_destroy(opj_image);
-
-    /* free user parameters structure */
-    if(parameters.cp_comment) free(parameters.cp_comment);
-    if(parameters.cp_matrice) free(parameters.cp_matrice);
 
-    return OPENDCP_NO_ERROR;
+    return result ? OPENDCP_NO_ERROR : OPENDCP_ERROR;
 }
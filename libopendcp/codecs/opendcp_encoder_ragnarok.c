@@ -20,24 +20,30 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
 #include "opendcp.h"
+#include "opendcp_encoder.h"
 
 #ifdef HAVE_RAGNAROK
 #include <opendcp_encoder_ragnarok.h>
 #endif
 
 /*!
- @function opendcp_encoder_openjpeg
- @abstract Encode image to file.
+ @function opendcp_encode_ragnarok_buffer
+ @abstract Encode image to a memory buffer.
  @discussion This function will take the opendcp_image_t struct and encode it.
+     The ragnarok library writes files, the codestream goes through a
+     temporary file that is read back into buffer.
  @param opendcp An opendcp_t context struct
- @param simage The source image memory buffer to encoder
- @param dfile The output file
+ @param opendcp_image The source image to encode
+ @param buffer The buffer receiving the codestream
  @return An OPENDCP_ERROR value
 */
-int opendcp_encode_ragnarok(opendcp_t *opendcp, opendcp_image_t *opendcp_image, char *dfile) {
+int opendcp_encode_ragnarok_buffer(opendcp_t *opendcp, opendcp_image_t *opendcp_image, opendcp_buffer_t *buffer) {
     int max_cs_len;
     int bw, i, x;
+    int result = OPENDCP_NO_ERROR;
 
     if (opendcp->j2k.bw) {
         bw = opendcp->j2k.bw;
@@ -72,10 +78,24 @@ int opendcp_encode_ragnarok(opendcp_t *opendcp, opendcp_image_t *opendcp_image,
         b[i++] = opendcp_image->component[2].data[x] >> 4;
     }
 
-    ragnarok_encode(&ragnarok, b, dfile); 
+    char dfile[255];
+
+    /* the buffer address keeps concurrent encodes apart */
+    sprintf(dfile, "%s/tmp_%d_%lx.j2c", opendcp->tmp_path ? opendcp->tmp_path : ".", (int)getpid(), (unsigned long)(uintptr_t)buffer);
+
+    ragnarok_encode(&ragnarok, b, dfile);
 
     free(b);
+
+    result = opendcp_buffer_load(buffer, dfile);
+    remove(dfile);
+#else
+    UNUSED(opendcp_image);
+    UNUSED(buffer);
+    UNUSED(max_cs_len);
+    UNUSED(i);
+    UNUSED(x);
 #endif
 
-    return OPENDCP_NO_ERROR;
+    return result;
 }
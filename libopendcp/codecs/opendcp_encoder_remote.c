@@ -17,6 +17,7 @@
 #include <md5.h>
 #include "opendcp.h"
 #include "opendcp_image.h"
+#include "opendcp_encoder.h"
 
 #define OPENDCP_ERROR 1
 #define OPENDCP_NO_ERROR 0
@@ -137,6 +138,28 @@ char *calculate_checksum(char *file) {
     return md5;
 }
 
+/* md5 of a memory block as a hex string, caller frees */
+static char *calculate_checksum_buffer(const unsigned char *data, size_t length) {
+    int i;
+    md5_t ctx;
+    unsigned char c[MD5_DIGEST_LENGTH];
+    char *md5 = malloc(MD5_DIGEST_LENGTH * 2 + 1);
+
+    if (!md5) {
+        return NULL;
+    }
+
+    md5_init(&ctx);
+    md5_update(&ctx, data, length);
+    md5_final(&ctx, c);
+
+    for (i = 0; i < MD5_DIGEST_LENGTH; ++i) {
+        snprintf(&md5[i*2], 3, "%02x", c[i]);
+    }
+
+    return md5;
+}
+
 int get_file_length(char *filename) {
     FILE *fp;
     int file_length;
@@ -350,7 +373,7 @@ int send_message(int connection, const message_t *msg) {
     return 0;
 }
 
-int opendcp_request_encoded_file(opendcp_t *opendcp, char *file) {
+int opendcp_request_encoded_file(opendcp_t *opendcp, char *file, opendcp_buffer_t *buffer) {
     int        connection;
     char       md5[40];
     char       *checksum;
@@ -372,29 +395,27 @@ int opendcp_request_encoded_file(opendcp_t *opendcp, char *file) {
     receive_message(connection, &message);
     get_parameter(message.header, strlen(message.header), "md5", md5, sizeof(md5));
 
-    if (write_file("foo.tif", message.data, message.data_length)) {
-        printf("File write error");
-        free(message.data);
-        return 1;
-    }
-    
-    if (message.data) {
-        free(message.data);
-    }
-    
     close(connection);
-    
-    //checksum = malloc(sizeof(MD5_DIGEST_LENGTH*2) + 1);
-    checksum = calculate_checksum("foo.tif");
-    
-    if (strcmp(checksum, md5)) {
+
+    checksum = calculate_checksum_buffer((unsigned char *)message.data, message.data_length);
+
+    if (!checksum || strcmp(checksum, md5)) {
         printf("checksum mismatch\n");
         free(checksum);
+        free(message.data);
         return 1;
     }
-    
+
     free(checksum);
-    
+
+    if (opendcp_buffer_write(buffer, message.data, message.data_length)) {
+        printf("buffer write error");
+        free(message.data);
+        return 1;
+    }
+
+    free(message.data);
+
     return 0;
 }
 
@@ -445,7 +466,7 @@ int opendcp_encode_request(const opendcp_t *opendcp, opendcp_image_t *image) {
     return OPENDCP_NO_ERROR;
 }
 
-int opendcp_encode_remote(opendcp_t *opendcp, opendcp_image_t *simage, char *dfile) {
+int opendcp_encode_remote_buffer(opendcp_t *opendcp, opendcp_image_t *simage, opendcp_buffer_t *buffer) {
     int rc;
     char encoded_file[512];
     
@@ -463,7 +484,7 @@ int opendcp_encode_remote(opendcp_t *opendcp, opendcp_image_t *simage, char *dfi
     }
 
     printf("request file\n");
-    rc = opendcp_request_encoded_file(opendcp, "test.tif");
+    rc = opendcp_request_encoded_file(opendcp, "test.tif", buffer);
     //}
     
     /* encode request complete */
@@ -23,32 +23,83 @@
 #include <tiffio.h>
 #include "opendcp.h"
 #include "opendcp_image.h"
+#include "opendcp_encoder.h"
 
-/*!
- @function opendcp_encoder_tif
- @abstract Encode image to file.
- @discussion This function will take the opendcp_image_t struct and encode it.
- @param opendcp An opendcp_t context struct
- @param simage The source image memory buffer to encoder
- @param dfile The output file
- @return An OPENDCP_ERROR value
-*/
-int opendcp_encode_tif(opendcp_t *opendcp, opendcp_image_t *image, const char *dfile) {
-    int y;
-    TIFF *tif;
-    tdata_t data;
-    UNUSED(opendcp);
+/* libtiff client procedures on an opendcp_buffer_t */
+static tsize_t opendcp_tif_read(thandle_t handle, tdata_t data, tsize_t size) {
+    opendcp_buffer_t *buffer = (opendcp_buffer_t *)handle;
+    tsize_t n = 0;
 
-    /* open tiff using filename or file descriptor */
-    tif = TIFFOpen(dfile, "wb");
+    if (buffer->pos < buffer->size) {
+        n = buffer->size - buffer->pos < (size_t)size ? (tsize_t)(buffer->size - buffer->pos) : size;
+        memcpy(data, buffer->data + buffer->pos, n);
+        buffer->pos += n;
+    }
 
-    OPENDCP_LOG(LOG_DEBUG, "creating file %s for writing", dfile);
+    return n;
+}
 
-    if (tif == NULL) {
-        OPENDCP_LOG(LOG_ERROR, "failed to open file %s for writing", dfile);
-        return OPENDCP_ERROR;
+static tsize_t opendcp_tif_write(thandle_t handle, tdata_t data, tsize_t size) {
+    if (opendcp_buffer_write((opendcp_buffer_t *)handle, data, size) != OPENDCP_NO_ERROR) {
+        return -1;
+    }
+
+    return size;
+}
+
+static toff_t opendcp_tif_seek(thandle_t handle, toff_t offset, int whence) {
+    opendcp_buffer_t *buffer = (opendcp_buffer_t *)handle;
+    size_t pos;
+
+    switch (whence) {
+        case SEEK_CUR:
+            pos = buffer->pos + offset;
+            break;
+
+        case SEEK_END:
+            pos = buffer->size + offset;
+            break;
+
+        default:
+            pos = offset;
+    }
+
+    if (opendcp_buffer_seek(buffer, pos) != OPENDCP_NO_ERROR) {
+        return (toff_t)-1;
     }
 
+    return buffer->pos;
+}
+
+static int opendcp_tif_close(thandle_t handle) {
+    UNUSED(handle);
+
+    return 0;
+}
+
+static toff_t opendcp_tif_size(thandle_t handle) {
+    return ((opendcp_buffer_t *)handle)->size;
+}
+
+static int opendcp_tif_map(thandle_t handle, tdata_t *base, toff_t *size) {
+    UNUSED(handle);
+    UNUSED(base);
+    UNUSED(size);
+
+    return 0;
+}
+
+static void opendcp_tif_unmap(thandle_t handle, tdata_t base, toff_t size) {
+    UNUSED(handle);
+    UNUSED(base);
+    UNUSED(size);
+}
+
+/* write the image as 16-bit rgb scanlines */
+static int opendcp_tif_write_image(TIFF *tif, opendcp_image_t *image) {
+    int y;
+    tdata_t data;
+
     /* Set tags */
     TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, image->w);
     TIFFSetField(tif, TIFFTAG_IMAGELENGTH, image->h);
@@ -63,14 +114,21 @@ int opendcp_encode_tif(opendcp_t *opendcp, opendcp_image_t *image, const char *d
     data = _TIFFmalloc(TIFFScanlineSize(tif));
 
     if (data == NULL) {
-        OPENDCP_LOG(LOG_ERROR, "tiff memory allocation error: %s", dfile);
+        OPENDCP_LOG(LOG_ERROR, "tiff memory allocation error");
+        TIFFClose(tif);
         return OPENDCP_ERROR;
     }
 
     /* write each row */
     for (y = 0; y<image->h; y++) {
         opendcp_image_readline(image, y, data);
-        TIFFWriteScanline(tif, data, y, 0);
+
+        if (TIFFWriteScanline(tif, data, y, 0) < 0) {
+            OPENDCP_LOG(LOG_ERROR, "tiff write error at row %d", y);
+            _TIFFfree(data);
+            TIFFClose(tif);
+            return OPENDCP_ERROR;
+        }
     }
 
     _TIFFfree(data);
@@ -78,3 +136,58 @@ int opendcp_encode_tif(opendcp_t *opendcp, opendcp_image_t *image, const char *d
 
     return OPENDCP_NO_ERROR;
 }
+
+/*!
+ @function opendcp_encode_tif_buffer
+ @abstract Encode image to a memory buffer.
+ @discussion This function will take the opendcp_image_t struct and encode it
+     as a TIFF into buffer.
+ @param opendcp An opendcp_t context struct
+ @param image The source image to encode
+ @param buffer The buffer receiving the TIFF
+ @return An OPENDCP_ERROR value
+*/
+int opendcp_encode_tif_buffer(opendcp_t *opendcp, opendcp_image_t *image, opendcp_buffer_t *buffer) {
+    TIFF *tif;
+    UNUSED(opendcp);
+
+    /* open tiff on the memory buffer */
+    tif = TIFFClientOpen("opendcp", "wb", (thandle_t)buffer,
+                         opendcp_tif_read, opendcp_tif_write, opendcp_tif_seek, opendcp_tif_close,
+                         opendcp_tif_size, opendcp_tif_map, opendcp_tif_unmap);
+
+    OPENDCP_LOG(LOG_DEBUG, "creating tiff buffer for writing");
+
+    if (tif == NULL) {
+        OPENDCP_LOG(LOG_ERROR, "failed to open tiff buffer for writing");
+        return OPENDCP_ERROR;
+    }
+
+    return opendcp_tif_write_image(tif, image);
+}
+
+/*!
+ @function opendcp_encode_tif_path
+ @abstract Encode image straight to a file.
+ @discussion Unlike opendcp_encode_tif, the TIFF is written to disk as it is
+     built instead of going through a memory buffer first.
+ @param opendcp An opendcp_t context struct
+ @param image The source image to encode
+ @param dfile The output file
+ @return An OPENDCP_ERROR value
+*/
+int opendcp_encode_tif_path(opendcp_t *opendcp, opendcp_image_t *image, const char *dfile) {
+    TIFF *tif;
+    UNUSED(opendcp);
+
+    tif = TIFFOpen(dfile, "wb");
+
+    OPENDCP_LOG(LOG_DEBUG, "creating file %s for writing", dfile);
+
+    if (tif == NULL) {
+        OPENDCP_LOG(LOG_ERROR, "failed to open file %s for writing", dfile);
+        return OPENDCP_ERROR;
+    }
+
+    return opendcp_tif_write_image(tif, image);
+}
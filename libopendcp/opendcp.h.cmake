@@ -28,9 +28,6 @@ extern "C" {
 #include <string.h>
 
 #define MAX_ASSETS          10   /* Soft limit */
-#define MAX_REELS           30   /* Soft limit */
-#define MAX_PKL             1    /* Soft limit */
-#define MAX_CPL             5    /* Soft limit */
 #define MAX_PATH_LENGTH     4095
 #define MAX_FILENAME_LENGTH 254
 #define MAX_AUDIO_CHANNELS  16   /* maximum allowed audio channels */
@@ -56,6 +53,13 @@ extern "C" {
 #define DCP_KIND        "feature"
 
 #define UNUSED(x) ( (void)(x) )
+
+/* thread local storage */
+#if _MSC_VER
+#define OPENDCP_TLS __declspec(thread)
+#else
+#define OPENDCP_TLS __thread
+#endif
 #define BASE_FILE (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : strrchr(__FILE__, '\\') ? strrchr(__FILE__, '\\') + 1 : __FILE__)
 #define OPENDCP_LOG(LEVEL, ...) opendcp_log(LEVEL, BASE_FILE, __func__, __LINE__, __VA_ARGS__)
 
@@ -92,6 +96,12 @@ extern "C" {
         OPENDCP_ERROR_MSG(OPENDCP_PARSER_RESET,            "Could not reset MXF parser") \
         OPENDCP_ERROR_MSG(OPENDCP_STRING_LENGTH,           "Input files have differing file lengths") \
         OPENDCP_ERROR_MSG(OPENDCP_STRING_NOTSEQUENTIAL ,   "Input files are not sequential") \
+        OPENDCP_ERROR_MSG(OPENDCP_VERIFY_MISSING,          "Asset listed in the packing list is missing") \
+        OPENDCP_ERROR_MSG(OPENDCP_VERIFY_SIZE,             "Asset size does not match the packing list") \
+        OPENDCP_ERROR_MSG(OPENDCP_VERIFY_HASH,             "Asset hash does not match the packing list") \
+        OPENDCP_ERROR_MSG(OPENDCP_VERIFY_INDEX,            "MXF index does not cover every frame") \
+        OPENDCP_ERROR_MSG(OPENDCP_VERIFY_DURATION,         "MXF frame count does not match the composition playlist") \
+        OPENDCP_ERROR_MSG(OPENDCP_VERIFY_HMAC,             "MXF frame failed the HMAC check") \
         OPENDCP_ERROR_MSG(OPENDCP_MAX_ERROR,               "Maximum error string")
 
 #define GENERATE_ENUM(ERROR, STRING) ERROR,
@@ -210,6 +220,10 @@ typedef struct {
 typedef struct {
     char **files;
     int  nfiles;
+    char *names;
+    int  *index;
+    char *pattern;
+    int  first_number;
 } filelist_t;
 
 typedef struct {
@@ -278,7 +292,8 @@ typedef struct {
     char           rating[32];
     char           filename[MAX_FILENAME_LENGTH];
     int            reel_count;
-    reel_t         reel[MAX_REELS];
+    int            reel_capacity;
+    reel_t         **reel;
 } cpl_t;
 
 typedef struct {
@@ -290,9 +305,104 @@ typedef struct {
     char           timestamp[30];
     char           filename[MAX_FILENAME_LENGTH];
     int            cpl_count;
-    cpl_t          cpl[MAX_CPL];
+    int            cpl_capacity;
+    cpl_t          **cpl;
 } pkl_t;
 
+typedef struct {
+    char           uuid[40];
+    char           filename[MAX_PATH_LENGTH];
+    char           type[64];
+    char           hash[40];
+    char           digest[40];
+    long long      size;
+    int            intrinsic_duration;
+    int            duration;
+    int            frames;
+    int            device;
+    int            result;
+} opendcp_verify_asset_t;
+
+typedef struct {
+    char           path[MAX_PATH_LENGTH];
+    int            asset_count;
+    int            device_count;
+    opendcp_verify_asset_t *asset;
+} opendcp_verify_t;
+
+/* called as a file is read with the offset the reader will need next */
+typedef int (*opendcp_advance_cb)(void *ctx, long long offset);
+
+typedef struct {
+    int            width;
+    int            height;
+    int            components;
+    int            profile;       /* Rsize, DCP_CINEMA2K or DCP_CINEMA4K */
+    int            levels;        /* decomposition levels */
+    int            layers;
+    long long      size;          /* codestream bytes */
+} opendcp_j2k_header_t;
+
+typedef struct {
+    int            start;
+    int            nframes;
+    int            frame_rate;
+    int            analyze_step;  /* frames between analyzed frames */
+    int            eyes;          /* codestreams of an edit unit, 2 when stereoscopic */
+    long long      target_bytes;
+    long long      ceiling_bytes;
+    double         *complexity;
+    long long      *budget;
+    long long      *achieved;
+} opendcp_ratecontrol_t;
+
+typedef struct opendcp_cache_entry {
+    unsigned long long key;
+    long long      size;
+    long long      stamp;         /* modification time when the cache was opened */
+    struct opendcp_cache_entry *chain;   /* next entry in the hash bucket */
+    struct opendcp_cache_entry *older;   /* use order */
+    struct opendcp_cache_entry *newer;
+} opendcp_cache_entry_t;
+
+typedef struct {
+    char           path[MAX_FILENAME_LENGTH];
+    long long      max_bytes;
+    long long      bytes;
+    int            count;
+    int            nbuckets;
+    opendcp_cache_entry_t **buckets;
+    opendcp_cache_entry_t *oldest;
+    opendcp_cache_entry_t *newest;
+    int            hits;
+    int            misses;
+    int            stores;
+    int            evictions;
+    char           codec[256];    /* the encoder and its version, part of every key */
+    void           *lock;
+} opendcp_cache_t;
+
+typedef struct {
+    long long      size;
+    long long      mtime;         /* nanoseconds */
+    long long      ctime;         /* nanoseconds */
+    long long      inode;
+    long long      recorded;      /* seconds, when the entry was taken */
+    asset_t        asset;
+} opendcp_state_entry_t;
+
+typedef struct {
+    char           path[MAX_FILENAME_LENGTH];
+    int            count;
+    int            capacity;
+    opendcp_state_entry_t *entries;
+    int            index_size;
+    int            *index;        /* open addressed on the filename, entry + 1 or 0 */
+    int            hits;
+    int            misses;
+    int            dirty;
+} opendcp_state_t;
+
 typedef struct {
     int            start_frame;
     int            end_frame;
@@ -305,6 +415,13 @@ typedef struct {
     int            xyz;
     int            xyz_method;
     int            resize;
+    int            container;
+    int            codec_threads;
+    int            inflight;
+    char           *kakadu;
+    int            kakadu_stream;
+    opendcp_ratecontrol_t *rate_control;
+    opendcp_cache_t *cache;
 } j2k_t;
 
 typedef struct {
@@ -324,6 +441,7 @@ typedef struct {
     byte_t         key_id[16];
     byte_t         key_value[16];
     int            write_hmac;
+    long long      frame_size;    /* largest input frame from a pre-scan, 0 if unknown */
     opendcp_cb_t   frame_done;
     opendcp_cb_t   file_done;
 } mxf_t;
@@ -340,11 +458,13 @@ typedef struct {
     char           aspect_ratio[20];
     int            digest_flag;
     int            pkl_count;
-    pkl_t          pkl[MAX_PKL];
+    int            pkl_capacity;
+    pkl_t          **pkl;
     assetmap_t     assetmap;
     volindex_t     volindex;
     opendcp_cb_t   sha1_update;
     opendcp_cb_t   sha1_done;
+    opendcp_state_t *state;
 } dcp_t;
 
 typedef struct {
@@ -377,25 +497,37 @@ typedef struct {
 /* common functions */
 void  opendcp_log(int level, const char *file, const char *function, int line,  const char *fmt, ...);
 void  opendcp_log_init(int level);
+int   opendcp_log_enabled(int level);
+int   opendcp_log_json(int level, const char *filename);
+int   opendcp_log_async_start();
+void  opendcp_log_async_stop();
 void  dcp_fatal(opendcp_t *opendcp, char *error, ...);
 void  get_timestamp(char *timestamp);
 int   get_asset_type(asset_t asset);
 int   get_file_essence_class(char *filename, int raw);
 int   validate_reel(opendcp_t *opendcp, reel_t *reel, int reel_number);
 int   add_asset(opendcp_t *opendcp, asset_t *asset, char *filename);
-int   add_asset_to_reel(opendcp_t *opendcp, reel_t *reel, asset_t asset);
-void  add_reel_to_cpl(cpl_t *cpl, reel_t reel);
-void  add_cpl_to_pkl(pkl_t *pkl, cpl_t cpl);
-void  add_pkl_to_dcp(dcp_t *dcp, pkl_t pkl);
-void  create_pkl(dcp_t dcp, pkl_t *pkl);
-void  create_cpl(dcp_t dcp, cpl_t *cpl);
-void  create_reel(dcp_t dcp, reel_t *reel);
+int   add_asset_to_reel(opendcp_t *opendcp, reel_t *reel, asset_t *asset);
+int   add_reel_to_cpl(cpl_t *cpl, reel_t *reel);
+int   add_cpl_to_pkl(pkl_t *pkl, cpl_t *cpl);
+int   add_pkl_to_dcp(dcp_t *dcp, pkl_t *pkl);
+pkl_t *create_pkl(dcp_t *dcp);
+cpl_t *create_cpl(dcp_t *dcp);
+reel_t *create_reel(dcp_t *dcp);
+void  pkl_free(pkl_t *pkl);
+void  cpl_free(cpl_t *cpl);
+void  reel_free(reel_t *reel);
 void  dcp_set_log_level(int log_level);
 
 /* utility functions */
 int         ensure_sequential(char *files[], int nfiles);
 int         order_indexed_files(char *files[], int nfiles);
 filelist_t *filelist_alloc(int nfiles);
+filelist_t *filelist_alloc_names(int nfiles, size_t names_size);
+int         filelist_order(filelist_t *filelist, int *gap);
+filelist_t *filelist_alloc_pattern(const char *pattern, int first_number, int last_number);
+char       *filelist_file(filelist_t *filelist, int i);
+int         is_sequence_pattern(const char *pattern);
 void        filelist_free(filelist_t *filelist);
 void        strnchrdel(const char *src, char *dst, int dst_len, char d);
 int         strcasefind(const char *s, const char *find);
@@ -420,6 +552,8 @@ int calculate_digest(opendcp_t *opendcp, const char *filename, char *digest);
 int get_wav_duration(const char *filename, int frame_rate);
 int get_wav_info(const char *filename, int frame_rate, wav_info_t *wav);
 int get_file_essence_type(char *in_path);
+int verify_mxf(const char *filename, const byte_t *key, int *frames, opendcp_advance_cb advance, void *ctx, long long ahead);
+int read_j2k_header(const char *filename, opendcp_j2k_header_t *header);
 
 /* MXF functions */
 int write_mxf(opendcp_t *opendcp, filelist_t *filelist, char *output_file);
@@ -434,6 +568,40 @@ int xml_sign(opendcp_t *opendcp, char *filename);
 
 /* J2K functions */
 int convert_to_j2k(opendcp_t *opendcp, char *in_file, char *out_file);
+int convert_to_j2k_frame(opendcp_t *opendcp, char *in_file, char *out_file, int frame);
+int check_j2k_sequence(opendcp_t *opendcp, filelist_t *filelist, int start, int end, long long *peak_size);
+
+/* rate control functions */
+opendcp_ratecontrol_t *opendcp_ratecontrol_create(opendcp_t *opendcp, int start, int nframes, int target_bw);
+void      opendcp_ratecontrol_free(opendcp_ratecontrol_t *rc);
+int       opendcp_ratecontrol_analyze(opendcp_ratecontrol_t *rc, int frame, char *file);
+void      opendcp_ratecontrol_allocate(opendcp_ratecontrol_t *rc);
+void      opendcp_ratecontrol_begin(opendcp_ratecontrol_t *rc, int frame);
+void      opendcp_ratecontrol_end(opendcp_ratecontrol_t *rc, int frame, long long bytes);
+long long opendcp_ratecontrol_frame_bytes();
+void      opendcp_ratecontrol_stats(opendcp_ratecontrol_t *rc, int *frames, double *average_bw, double *peak_bw);
+
+/* encode cache functions */
+opendcp_cache_t *opendcp_cache_open(const char *path, long long max_bytes);
+void opendcp_cache_close(opendcp_cache_t *cache);
+int  opendcp_cache_key(opendcp_t *opendcp, const char *sfile, long long budget, unsigned long long *key);
+int  opendcp_cache_fetch(opendcp_cache_t *cache, unsigned long long key, const char *dfile, long long *size);
+int  opendcp_cache_store(opendcp_cache_t *cache, unsigned long long key, const void *data, size_t size);
+int  opendcp_hash_file(const char *file, unsigned long long seed, unsigned long long *hash);
+int  opendcp_compare_files(const char *a, const char *b);
+
+/* package state functions */
+opendcp_state_t *opendcp_state_open(const char *path);
+int  opendcp_state_save(opendcp_state_t *state);
+void opendcp_state_close(opendcp_state_t *state);
+int  opendcp_state_lookup(opendcp_state_t *state, asset_t *asset);
+int  opendcp_state_update(opendcp_state_t *state, asset_t *asset);
+int  opendcp_state_digest(opendcp_state_t *state, const char *filename, const char *digest);
+
+/* package verification functions */
+opendcp_verify_t *opendcp_verify_open(const char *path);
+void opendcp_verify_free(opendcp_verify_t *verify);
+int  opendcp_verify_asset(opendcp_verify_t *verify, int i, const byte_t *key);
 
 /* retrieve error string */
 char *error_string(int error_code);
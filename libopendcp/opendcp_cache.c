@@ -0,0 +1,752 @@
+/*
+     OpenDCP: Builds Digital Cinema Packages
+     Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+     This program is free software: you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published by
+     the Free Software Foundation, either version 3 of the License, or
+     (at your option) any later version.
+
+     This program is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     GNU General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <utime.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include <openjpeg.h>
+#include "opendcp.h"
+#include "opendcp_encoder.h"
+
+#define CACHE_READ_SIZE   (1024 * 1024)
+#define CACHE_KEY_LENGTH  16
+
+/* xxHash64, see https://github.com/Cyan4973/xxHash */
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+typedef struct {
+    uint64_t total;
+    uint64_t v[4];
+    uint64_t seed;
+    uint8_t  mem[32];
+    int      memsize;
+} xxh64_t;
+
+static inline uint64_t xxh_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_read64(const uint8_t *p) {
+    uint64_t v = 0;
+    int i;
+
+    /* little endian regardless of the host */
+    for (i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+
+    return v;
+}
+
+static inline uint32_t xxh_read32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc  = xxh_rotl(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static void xxh64_init(xxh64_t *s, uint64_t seed) {
+    memset(s, 0, sizeof(*s));
+    s->seed = seed;
+    s->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    s->v[1] = seed + XXH_PRIME64_2;
+    s->v[2] = seed;
+    s->v[3] = seed - XXH_PRIME64_1;
+}
+
+static void xxh64_update(xxh64_t *s, const void *data, size_t len) {
+    const uint8_t *p = data;
+    const uint8_t *end = p + len;
+
+    s->total += len;
+
+    if (s->memsize + len < 32) {
+        memcpy(s->mem + s->memsize, p, len);
+        s->memsize += (int)len;
+        return;
+    }
+
+    if (s->memsize) {
+        memcpy(s->mem + s->memsize, p, 32 - s->memsize);
+        p += 32 - s->memsize;
+        s->v[0] = xxh_round(s->v[0], xxh_read64(s->mem));
+        s->v[1] = xxh_round(s->v[1], xxh_read64(s->mem + 8));
+        s->v[2] = xxh_round(s->v[2], xxh_read64(s->mem + 16));
+        s->v[3] = xxh_round(s->v[3], xxh_read64(s->mem + 24));
+        s->memsize = 0;
+    }
+
+    while (p + 32 <= end) {
+        s->v[0] = xxh_round(s->v[0], xxh_read64(p));
+        s->v[1] = xxh_round(s->v[1], xxh_read64(p + 8));
+        s->v[2] = xxh_round(s->v[2], xxh_read64(p + 16));
+        s->v[3] = xxh_round(s->v[3], xxh_read64(p + 24));
+        p += 32;
+    }
+
+    if (p < end) {
+        memcpy(s->mem, p, end - p);
+        s->memsize = (int)(end - p);
+    }
+}
+
+static uint64_t xxh64_digest(xxh64_t *s) {
+    const uint8_t *p = s->mem;
+    const uint8_t *end = p + s->memsize;
+    uint64_t h;
+
+    if (s->total >= 32) {
+        h = xxh_rotl(s->v[0], 1) + xxh_rotl(s->v[1], 7) + xxh_rotl(s->v[2], 12) + xxh_rotl(s->v[3], 18);
+        h = xxh_merge(h, s->v[0]);
+        h = xxh_merge(h, s->v[1]);
+        h = xxh_merge(h, s->v[2]);
+        h = xxh_merge(h, s->v[3]);
+    } else {
+        h = s->seed + XXH_PRIME64_5;
+    }
+
+    h += s->total;
+
+    while (p + 8 <= end) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h  = xxh_rotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+
+    if (p + 4 <= end) {
+        h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+        h  = xxh_rotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+
+    while (p < end) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h  = xxh_rotl(h, 11) * XXH_PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+static void cache_filename(opendcp_cache_t *cache, unsigned long long key, char *filename) {
+    snprintf(filename, MAX_FILENAME_LENGTH, "%s/%016llx.j2c", cache->path, key);
+}
+
+static void cache_lock(opendcp_cache_t *cache) {
+    pthread_mutex_lock((pthread_mutex_t *)cache->lock);
+}
+
+static void cache_unlock(opendcp_cache_t *cache) {
+    pthread_mutex_unlock((pthread_mutex_t *)cache->lock);
+}
+
+/* the key is already a hash, fold it onto the buckets */
+static inline int cache_bucket(opendcp_cache_t *cache, unsigned long long key) {
+    return (int)((key ^ (key >> 32)) & (cache->nbuckets - 1));
+}
+
+/* find an entry, called with the lock held */
+static opendcp_cache_entry_t *cache_find(opendcp_cache_t *cache, unsigned long long key) {
+    opendcp_cache_entry_t *entry;
+
+    for (entry = cache->buckets[cache_bucket(cache, key)]; entry; entry = entry->chain) {
+        if (entry->key == key) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* take an entry out of the use order, called with the lock held */
+static void cache_unlink(opendcp_cache_t *cache, opendcp_cache_entry_t *entry) {
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        cache->newest = entry->older;
+    }
+
+    entry->older = entry->newer = NULL;
+}
+
+/* make an entry the most recently used, called with the lock held */
+static void cache_touch(opendcp_cache_t *cache, opendcp_cache_entry_t *entry) {
+    if (cache->newest == entry) {
+        return;
+    }
+
+    if (entry->older || entry->newer || cache->oldest == entry) {
+        cache_unlink(cache, entry);
+    }
+
+    entry->older = cache->newest;
+
+    if (cache->newest) {
+        cache->newest->newer = entry;
+    } else {
+        cache->oldest = entry;
+    }
+
+    cache->newest = entry;
+}
+
+/* double the buckets once the chains average more than one entry, called with the lock held */
+static void cache_grow(opendcp_cache_t *cache) {
+    opendcp_cache_entry_t **buckets, **old = cache->buckets, *entry, *chain;
+    int i, n = cache->nbuckets;
+
+    buckets = calloc(n * 2, sizeof(*buckets));
+
+    if (!buckets) {
+        return;
+    }
+
+    cache->buckets  = buckets;
+    cache->nbuckets = n * 2;
+
+    for (i = 0; i < n; i++) {
+        for (entry = old[i]; entry; entry = chain) {
+            chain = entry->chain;
+            entry->chain = buckets[cache_bucket(cache, entry->key)];
+            buckets[cache_bucket(cache, entry->key)] = entry;
+        }
+    }
+
+    free(old);
+}
+
+/* add an entry as the most recently used, called with the lock held */
+static opendcp_cache_entry_t *cache_add(opendcp_cache_t *cache, unsigned long long key, long long size) {
+    opendcp_cache_entry_t *entry;
+    int b;
+
+    entry = calloc(1, sizeof(*entry));
+
+    if (!entry) {
+        return NULL;
+    }
+
+    if (cache->count >= cache->nbuckets) {
+        cache_grow(cache);
+    }
+
+    entry->key   = key;
+    entry->size  = size;
+
+    b = cache_bucket(cache, key);
+    entry->chain = cache->buckets[b];
+    cache->buckets[b] = entry;
+
+    cache_touch(cache, entry);
+    cache->count++;
+    cache->bytes += size;
+
+    return entry;
+}
+
+/* remove an entry and free it, called with the lock held */
+static void cache_remove(opendcp_cache_t *cache, opendcp_cache_entry_t *entry) {
+    opendcp_cache_entry_t **p = &cache->buckets[cache_bucket(cache, entry->key)];
+
+    while (*p != entry) {
+        p = &(*p)->chain;
+    }
+
+    *p = entry->chain;
+    cache_unlink(cache, entry);
+
+    cache->bytes -= entry->size;
+    cache->count--;
+    free(entry);
+}
+
+/* evict the least recently used entries until the cache fits, called with the lock held */
+static void cache_evict(opendcp_cache_t *cache) {
+    char filename[MAX_FILENAME_LENGTH];
+
+    while (cache->bytes > cache->max_bytes && cache->oldest) {
+        cache_filename(cache, cache->oldest->key, filename);
+        remove(filename);
+
+        cache_remove(cache, cache->oldest);
+        cache->evictions++;
+    }
+}
+
+static int cache_stamp_cmp(const void *a, const void *b) {
+    const opendcp_cache_entry_t *x = *(opendcp_cache_entry_t * const *)a;
+    const opendcp_cache_entry_t *y = *(opendcp_cache_entry_t * const *)b;
+
+    return x->stamp < y->stamp ? -1 : x->stamp > y->stamp;
+}
+
+/**
+open an encode cache
+
+The cache is a directory of codestreams named after their key. Entries
+already in the directory are indexed in the order they were last used.
+
+@param  path the cache directory, created if it does not exist
+@param  max_bytes the size the cache is trimmed to
+@return opendcp_cache_t pointer, NULL on failure
+*/
+opendcp_cache_t *opendcp_cache_open(const char *path, long long max_bytes) {
+    opendcp_cache_t *cache;
+    opendcp_cache_entry_t *entry, **order;
+    char filename[MAX_FILENAME_LENGTH];
+    unsigned long long key;
+    struct dirent *de;
+    struct stat st;
+    DIR *d;
+    int i;
+
+    if (path == NULL || max_bytes <= 0) {
+        return NULL;
+    }
+
+#ifdef _WIN32
+    mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+
+    if ((d = opendir(path)) == NULL) {
+        OPENDCP_LOG(LOG_ERROR, "could not open cache directory %s", path);
+        return NULL;
+    }
+
+    cache = malloc(sizeof(opendcp_cache_t));
+
+    if (!cache) {
+        closedir(d);
+        return NULL;
+    }
+
+    memset(cache, 0, sizeof(opendcp_cache_t));
+    snprintf(cache->path, sizeof(cache->path), "%s", path);
+    cache->max_bytes = max_bytes;
+    cache->nbuckets  = 256;
+    cache->buckets   = calloc(cache->nbuckets, sizeof(*cache->buckets));
+    cache->lock      = malloc(sizeof(pthread_mutex_t));
+
+    if (!cache->buckets || !cache->lock) {
+        closedir(d);
+        free(cache->buckets);
+        free(cache->lock);
+        free(cache);
+        return NULL;
+    }
+
+    pthread_mutex_init((pthread_mutex_t *)cache->lock, NULL);
+
+    /* the modification time is touched on every hit */
+    while ((de = readdir(d))) {
+        if (strlen(de->d_name) != CACHE_KEY_LENGTH + 4 || strcmp(de->d_name + CACHE_KEY_LENGTH, ".j2c")) {
+            continue;
+        }
+
+        if (sscanf(de->d_name, "%16llx", &key) != 1) {
+            continue;
+        }
+
+        cache_filename(cache, key, filename);
+
+        if (stat(filename, &st) == 0 && (entry = cache_add(cache, key, st.st_size))) {
+            entry->stamp = st.st_mtime;
+        }
+    }
+
+    closedir(d);
+
+    /* put the entries in use order by their times */
+    order = cache->count ? malloc(cache->count * sizeof(*order)) : NULL;
+
+    if (order) {
+        for (i = 0, entry = cache->oldest; entry; entry = entry->newer) {
+            order[i++] = entry;
+        }
+
+        qsort(order, cache->count, sizeof(*order), cache_stamp_cmp);
+
+        for (i = 0; i < cache->count; i++) {
+            cache_touch(cache, order[i]);
+        }
+
+        free(order);
+    }
+
+    cache_evict(cache);
+
+    OPENDCP_LOG(LOG_DEBUG, "cache %s opened, %d entries, %lld bytes", path, cache->count, cache->bytes);
+
+    return cache;
+}
+
+/**
+close an encode cache
+
+@param  cache an encode cache
+@return NONE
+*/
+void opendcp_cache_close(opendcp_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    pthread_mutex_destroy((pthread_mutex_t *)cache->lock);
+    free(cache->lock);
+
+    while (cache->oldest) {
+        cache_remove(cache, cache->oldest);
+    }
+
+    free(cache->buckets);
+
+    free(cache);
+}
+
+/**
+hash the contents of a file
+
+@param  file the file to hash
+@param  seed the xxHash64 seed
+@param  hash receives the hash
+@return OPENDCP_ERROR value
+*/
+int opendcp_hash_file(const char *file, unsigned long long seed, unsigned long long *hash) {
+    unsigned char *data;
+    xxh64_t state;
+    size_t n;
+    FILE *fp;
+
+    fp = fopen(file, "rb");
+
+    if (!fp) {
+        return OPENDCP_ERROR;
+    }
+
+    data = malloc(CACHE_READ_SIZE);
+
+    if (!data) {
+        fclose(fp);
+        return OPENDCP_ERROR;
+    }
+
+    xxh64_init(&state, seed);
+
+    while ((n = fread(data, 1, CACHE_READ_SIZE, fp)) > 0) {
+        xxh64_update(&state, data, n);
+    }
+
+    free(data);
+
+    if (ferror(fp)) {
+        fclose(fp);
+        return OPENDCP_ERROR;
+    }
+
+    fclose(fp);
+
+    *hash = xxh64_digest(&state);
+
+    return OPENDCP_NO_ERROR;
+}
+
+/**
+compare the contents of two files
+
+@param  a the first file
+@param  b the second file
+@return 1 when the files are byte-identical, 0 when they differ or cannot be read
+*/
+int opendcp_compare_files(const char *a, const char *b) {
+    unsigned char *data;
+    FILE *fa, *fb;
+    size_t na, nb;
+    int same = 0;
+
+    fa   = fopen(a, "rb");
+    fb   = fopen(b, "rb");
+    data = malloc(2 * CACHE_READ_SIZE);
+
+    if (fa && fb && data) {
+        do {
+            na = fread(data, 1, CACHE_READ_SIZE, fa);
+            nb = fread(data + CACHE_READ_SIZE, 1, CACHE_READ_SIZE, fb);
+            same = na == nb && !memcmp(data, data + CACHE_READ_SIZE, na);
+        } while (same && na == CACHE_READ_SIZE);
+
+        same = same && !ferror(fa) && !ferror(fb);
+    }
+
+    if (fa) {
+        fclose(fa);
+    }
+
+    if (fb) {
+        fclose(fb);
+    }
+
+    free(data);
+
+    return same;
+}
+
+/* name the encoder and its version, so a codec upgrade misses the cache.
+   kakadu is asked once for its version, called with the lock held */
+static void cache_codec(opendcp_t *opendcp, opendcp_cache_t *cache) {
+    const char *kakadu = opendcp->j2k.kakadu ? opendcp->j2k.kakadu : "kdu_compress";
+    char cmd[MAX_FILENAME_LENGTH + 16];
+    size_t len, n;
+    FILE *fp;
+
+    if (opendcp->j2k.encoder != OPENDCP_ENCODER_KAKADU) {
+        snprintf(cache->codec, sizeof(cache->codec), "openjpeg %s", opj_version());
+        return;
+    }
+
+    len = snprintf(cache->codec, sizeof(cache->codec), "%s ", kakadu);
+    snprintf(cmd, sizeof(cmd), "%s -v 2>&1", kakadu);
+
+    if ((fp = popen(cmd, "r"))) {
+        n = fread(cache->codec + len, 1, sizeof(cache->codec) - len - 1, fp);
+        cache->codec[len + n] = '\0';
+        pclose(fp);
+    }
+
+    OPENDCP_LOG(LOG_DEBUG, "cache keyed on %s", cache->codec);
+}
+
+/**
+compute the cache key of a frame
+
+The key is an xxHash64 of the source file contents, seeded with a hash of
+every setting that changes the encoded codestream and of the encoder version.
+
+@param  opendcp the opendcp context
+@param  sfile the source image
+@param  budget the rate control budget of the frame in bytes, 0 if none
+@param  key receives the key
+@return OPENDCP_ERROR value
+*/
+int opendcp_cache_key(opendcp_t *opendcp, const char *sfile, long long budget, unsigned long long *key) {
+    opendcp_cache_t *cache = opendcp->j2k.cache;
+    char settings[512];
+    xxh64_t state;
+
+    if (cache == NULL) {
+        return OPENDCP_ERROR;
+    }
+
+    cache_lock(cache);
+
+    if (!cache->codec[0]) {
+        cache_codec(opendcp, cache);
+    }
+
+    cache_unlock(cache);
+
+    snprintf(settings, sizeof(settings), "%s %d %d %d %d %d %d %d %d %d %d %d %lld %s",
+             OPENDCP_VERSION, opendcp->j2k.encoder, opendcp->cinema_profile, opendcp->frame_rate,
+             opendcp->stereoscopic, opendcp->j2k.bw, opendcp->j2k.dpx, opendcp->j2k.lut,
+             opendcp->j2k.xyz, opendcp->j2k.xyz_method, opendcp->j2k.resize, opendcp->j2k.container,
+             budget, opendcp->j2k.kakadu ? opendcp->j2k.kakadu : "");
+
+    xxh64_init(&state, 0);
+    xxh64_update(&state, settings, strlen(settings));
+    xxh64_update(&state, cache->codec, strlen(cache->codec));
+
+    return opendcp_hash_file(sfile, xxh64_digest(&state), key);
+}
+
+/**
+copy a cached codestream to a file
+
+@param  cache an encode cache
+@param  key the key of the frame
+@param  dfile the destination codestream
+@param  size receives the size of the codestream
+@return OPENDCP_NO_ERROR on a hit, OPENDCP_ERROR otherwise
+*/
+int opendcp_cache_fetch(opendcp_cache_t *cache, unsigned long long key, const char *dfile, long long *size) {
+    char filename[MAX_FILENAME_LENGTH];
+    opendcp_cache_entry_t *entry;
+    unsigned char *data = NULL;
+    FILE *in = NULL, *out = NULL;
+    long long copied = 0;
+    size_t n;
+    int result = OPENDCP_ERROR;
+
+    cache_lock(cache);
+    entry = cache_find(cache, key);
+
+    if (entry) {
+        cache_touch(cache, entry);
+    }
+
+    cache_unlock(cache);
+
+    if (entry) {
+        cache_filename(cache, key, filename);
+        in   = fopen(filename, "rb");
+
+        /* the destination may be linked to other frames, write a new file */
+        if (in) {
+            remove(dfile);
+        }
+
+        out  = in ? fopen(dfile, "wb") : NULL;
+        data = out ? malloc(CACHE_READ_SIZE) : NULL;
+    }
+
+    if (data) {
+        result = OPENDCP_NO_ERROR;
+
+        while ((n = fread(data, 1, CACHE_READ_SIZE, in)) > 0) {
+            if (fwrite(data, 1, n, out) != n) {
+                result = OPENDCP_ERROR;
+                break;
+            }
+
+            copied += n;
+        }
+
+        if (ferror(in)) {
+            result = OPENDCP_ERROR;
+        }
+
+        free(data);
+    }
+
+    if (in) {
+        fclose(in);
+    }
+
+    if (out && fclose(out)) {
+        result = OPENDCP_ERROR;
+    }
+
+    if (result == OPENDCP_NO_ERROR) {
+        /* keep the use order across runs */
+        utime(filename, NULL);
+        *size = copied;
+    }
+    else if (out) {
+        remove(dfile);
+    }
+
+    cache_lock(cache);
+
+    if (result == OPENDCP_NO_ERROR) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+
+    cache_unlock(cache);
+
+    return result;
+}
+
+/**
+add a codestream to the cache
+
+The codestream is written to a temporary file and renamed into place, so
+concurrent readers never see a partial entry. Least recently used entries
+are evicted to keep the cache below its size.
+
+@param  cache an encode cache
+@param  key the key of the frame
+@param  data the codestream
+@param  size the size of the codestream
+@return OPENDCP_ERROR value
+*/
+int opendcp_cache_store(opendcp_cache_t *cache, unsigned long long key, const void *data, size_t size) {
+    char filename[MAX_FILENAME_LENGTH];
+    char temp[MAX_FILENAME_LENGTH];
+    int result;
+    FILE *fp;
+
+    if ((long long)size > cache->max_bytes) {
+        return OPENDCP_ERROR;
+    }
+
+    cache_filename(cache, key, filename);
+    snprintf(temp, sizeof(temp), "%s/%016llx.%d.%lx.tmp", cache->path, key, (int)getpid(), (unsigned long)(uintptr_t)data);
+
+    fp = fopen(temp, "wb");
+
+    if (!fp) {
+        OPENDCP_LOG(LOG_WARN, "could not write cache entry %s", temp);
+        return OPENDCP_ERROR;
+    }
+
+    result = fwrite(data, 1, size, fp) == size;
+    result = fclose(fp) == 0 && result;
+
+    if (!result || rename(temp, filename)) {
+        remove(temp);
+        return OPENDCP_ERROR;
+    }
+
+    cache_lock(cache);
+
+    if (!cache_find(cache, key)) {
+        cache_add(cache, key, size);
+        cache->stores++;
+    }
+
+    cache_evict(cache);
+    cache_unlock(cache);
+
+    return OPENDCP_NO_ERROR;
+}
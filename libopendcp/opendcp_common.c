@@ -260,20 +260,8 @@ static void prefix_of_all(char *files[], int nfiles, char *prefix) {
     }
 }
 
-/* a filename of the form <prefix>N*.<ext> paired with its index. */
-typedef struct {
-    char *file;
-    int   index;
-} opendcp_sort_t;
-
-/* compare 2 File_and_index structs by their index. */
-static int file_cmp(const void *a, const void *b) {
-    const opendcp_sort_t *fa, *fb;
-    fa = a;
-    fb = b;
-
-    return (fa->index) - (fb->index);
-}
+#define ORDER_RADIX_BITS 11
+#define ORDER_RADIX_SIZE (1 << ORDER_RADIX_BITS)
 
 /* return the index of a filename */
 static int get_index(char *file, int prefix_len) {
@@ -290,6 +278,142 @@ static int get_index(char *file, int prefix_len) {
     return index;
 }
 
+/* stable LSD radix sort of files by their index, passes stop at the highest set bit of the range */
+static int order_by_index(char *files[], int *index, int nfiles) {
+    unsigned int *key, *key_tmp, *key_src, *key_dst, *swap_key;
+    char **file_tmp, **file_src, **file_dst, **swap_file;
+    unsigned int range, digit;
+    int *count;
+    int i, shift, min, max;
+
+    min = max = index[0];
+
+    for (i = 1; i < nfiles; i++) {
+        min = index[i] < min ? index[i] : min;
+        max = index[i] > max ? index[i] : max;
+    }
+
+    range = (unsigned int)max - (unsigned int)min;
+
+    key      = malloc(nfiles * sizeof(*key));
+    key_tmp  = malloc(nfiles * sizeof(*key_tmp));
+    file_tmp = malloc(nfiles * sizeof(*file_tmp));
+    count    = malloc((ORDER_RADIX_SIZE + 1) * sizeof(*count));
+
+    if (!key || !key_tmp || !file_tmp || !count) {
+        free(key);
+        free(key_tmp);
+        free(file_tmp);
+        free(count);
+        return OPENDCP_ERROR;
+    }
+
+    for (i = 0; i < nfiles; i++) {
+        key[i] = (unsigned int)index[i] - (unsigned int)min;
+    }
+
+    key_src  = key;
+    key_dst  = key_tmp;
+    file_src = files;
+    file_dst = file_tmp;
+
+    for (shift = 0; shift < 32 && (range >> shift); shift += ORDER_RADIX_BITS) {
+        memset(count, 0, (ORDER_RADIX_SIZE + 1) * sizeof(*count));
+
+        for (i = 0; i < nfiles; i++) {
+            count[((key_src[i] >> shift) & (ORDER_RADIX_SIZE - 1)) + 1]++;
+        }
+
+        for (i = 1; i <= ORDER_RADIX_SIZE; i++) {
+            count[i] += count[i - 1];
+        }
+
+        for (i = 0; i < nfiles; i++) {
+            digit = (key_src[i] >> shift) & (ORDER_RADIX_SIZE - 1);
+            key_dst[count[digit]]  = key_src[i];
+            file_dst[count[digit]] = file_src[i];
+            count[digit]++;
+        }
+
+        swap_key  = key_src;
+        key_src   = key_dst;
+        key_dst   = swap_key;
+        swap_file = file_src;
+        file_src  = file_dst;
+        file_dst  = swap_file;
+    }
+
+    if (file_src != files) {
+        memcpy(files, file_src, nfiles * sizeof(*files));
+    }
+
+    for (i = 0; i < nfiles; i++) {
+        index[i] = (int)(key_src[i] + (unsigned int)min);
+    }
+
+    free(key);
+    free(key_tmp);
+    free(file_tmp);
+    free(count);
+
+    return OPENDCP_NO_ERROR;
+}
+
+/**
+Order a filelist by index and find the first gap in the sequence
+
+Works like order_indexed_files() followed by ensure_sequential(), but the
+indices are parsed once and kept in filelist->index, and the ordering is
+a linear time radix sort.
+
+@param  filelist the filelist to order
+@param  gap receives 0 if the files are sequential, otherwise the position
+        of the first out of order file as ensure_sequential() returns it,
+        may be NULL
+@return OPENDCP_ERROR_CODE
+*/
+int filelist_order(filelist_t *filelist, int *gap) {
+    int  prefix_len, i;
+    char prefix_buffer[MAX_FILENAME_LENGTH];
+
+    if (gap) {
+        *gap = OPENDCP_NO_ERROR;
+    }
+
+    /* A single file is trivially sorted. */
+    if (filelist->nfiles < 2) {
+        return OPENDCP_NO_ERROR;
+    }
+
+    prefix_of_all(filelist->files, filelist->nfiles, prefix_buffer);
+    prefix_len = strlen(prefix_buffer);
+
+    if (!filelist->index) {
+        filelist->index = malloc(filelist->nfiles * sizeof(*filelist->index));
+
+        if (!filelist->index) {
+            return OPENDCP_ERROR;
+        }
+    }
+
+    for (i = 0; i < filelist->nfiles; i++) {
+        filelist->index[i] = get_index(filelist->files[i], prefix_len);
+    }
+
+    if (order_by_index(filelist->files, filelist->index, filelist->nfiles) != OPENDCP_NO_ERROR) {
+        return OPENDCP_ERROR;
+    }
+
+    for (i = 0; gap && i < filelist->nfiles - 1; i++) {
+        if (filelist->index[i] + 1 != filelist->index[i + 1]) {
+            *gap = i ? i : 1;
+            break;
+        }
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
 /**
 Ensure a list of ordered filenames are sequential
 
@@ -341,9 +465,9 @@ where:
 @return OPENDCP_ERROR_CODE
 */
 int order_indexed_files(char *files[], int nfiles) {
-    int  prefix_len, i;
+    int  prefix_len, i, result;
     char prefix_buffer[MAX_FILENAME_LENGTH];
-    opendcp_sort_t *fis;
+    int  *index;
 
     /* A single file is trivially sorted. */
     if (nfiles < 2) {
@@ -353,24 +477,22 @@ int order_indexed_files(char *files[], int nfiles) {
     prefix_of_all(files, nfiles, prefix_buffer);
     prefix_len = strlen(prefix_buffer);
 
-    /* Create an array of files and their indices to sort. */
-    fis = malloc(sizeof(*fis) * nfiles);
+    /* Parse the indices once and sort the files by them. */
+    index = malloc(sizeof(*index) * nfiles);
 
-    for (i = 0; i < nfiles; i++) {
-        fis[i].file  = files[i];
-        fis[i].index = get_index(files[i], prefix_len);
+    if (!index) {
+        return OPENDCP_ERROR;
     }
 
-    qsort(fis, nfiles, sizeof(*fis), file_cmp);
-
-    /* Reorder the original file array. */
     for (i = 0; i < nfiles; i++) {
-        files[i] = fis[i].file;
+        index[i] = get_index(files[i], prefix_len);
     }
 
-    free(fis);
+    result = order_by_index(files, index, nfiles);
 
-    return OPENDCP_NO_ERROR;
+    free(index);
+
+    return result;
 }
 
 /**
@@ -389,6 +511,10 @@ filelist_t *filelist_alloc(int nfiles) {
 
     filelist->nfiles = nfiles;
     filelist->files  = malloc(filelist->nfiles * sizeof(char*));
+    filelist->names  = NULL;
+    filelist->index  = NULL;
+    filelist->pattern = NULL;
+    filelist->first_number = 0;
 
     if (filelist->nfiles) {
         for (x = 0; x < filelist->nfiles; x++) {
@@ -399,6 +525,167 @@ filelist_t *filelist_alloc(int nfiles) {
     return filelist;
 }
 
+/**
+Allocate a list of filenames sharing one block of memory
+
+The names are stored back to back in filelist->names, the caller fills it
+and points filelist->files into it. Unlike filelist_alloc() the names can
+not grow.
+
+@param  nfiles is the number of files to allocate
+@param  names_size is the total size of the names, terminators included
+@return filelist_t pointer, NULL on failure
+*/
+filelist_t *filelist_alloc_names(int nfiles, size_t names_size) {
+    filelist_t *filelist;
+
+    filelist = malloc(sizeof(filelist_t));
+
+    if (!filelist) {
+        return NULL;
+    }
+
+    filelist->nfiles = nfiles;
+    filelist->index  = NULL;
+    filelist->pattern = NULL;
+    filelist->first_number = 0;
+    filelist->files  = malloc((nfiles ? nfiles : 1) * sizeof(char*));
+    filelist->names  = malloc(names_size ? names_size : 1);
+
+    if (!filelist->files || !filelist->names) {
+        free(filelist->files);
+        free(filelist->names);
+        free(filelist);
+        return NULL;
+    }
+
+    return filelist;
+}
+
+/**
+check for a printf style frame sequence pattern
+
+A pattern holds exactly one integer conversion, for example
+shot_%06d.dpx, literal percent signs are written as %%.
+
+@param  pattern the string to check
+@return 1 if pattern is a sequence pattern, 0 otherwise
+*/
+int is_sequence_pattern(const char *pattern) {
+    const char *p;
+    int conversions = 0;
+
+    for (p = pattern; p && *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+
+        if (*++p == '%') {
+            continue;
+        }
+
+        /* flags and width only, the value is always an int */
+        while (*p == '0' || *p == '-' || *p == '+' || *p == ' ') {
+            p++;
+        }
+
+        while (isdigit((unsigned char)*p)) {
+            p++;
+        }
+
+        if (*p != 'd' && *p != 'i' && *p != 'u') {
+            return 0;
+        }
+
+        conversions++;
+    }
+
+    return conversions == 1;
+}
+
+/**
+Allocate a list of filenames described by a frame sequence pattern
+
+No directory is listed and no file is checked, the names are generated
+by filelist_file() when they are first used.
+
+@param  pattern a printf style pattern with one integer conversion
+@param  first_number the frame number of the first file
+@param  last_number the frame number of the last file
+@return filelist_t pointer, NULL on failure
+*/
+filelist_t *filelist_alloc_pattern(const char *pattern, int first_number, int last_number) {
+    filelist_t *filelist;
+
+    if (!is_sequence_pattern(pattern) || last_number < first_number) {
+        return NULL;
+    }
+
+    filelist = malloc(sizeof(filelist_t));
+
+    if (!filelist) {
+        return NULL;
+    }
+
+    filelist->nfiles       = last_number - first_number + 1;
+    filelist->names        = NULL;
+    filelist->index        = NULL;
+    filelist->first_number = first_number;
+    filelist->files        = calloc(filelist->nfiles, sizeof(char*));
+    filelist->pattern      = strdup(pattern);
+
+    if (!filelist->files || !filelist->pattern) {
+        free(filelist->files);
+        free(filelist->pattern);
+        free(filelist);
+        return NULL;
+    }
+
+    return filelist;
+}
+
+/**
+get a filename of a filelist
+
+Names of a pattern filelist are generated on first use, concurrent callers
+agree on a single copy.
+
+@param  filelist the filelist
+@param  i the position of the file (zero based)
+@return the filename, NULL on failure
+*/
+char *filelist_file(filelist_t *filelist, int i) {
+    char *name, *expected = NULL;
+    int len;
+
+    if (i < 0 || i >= filelist->nfiles) {
+        return NULL;
+    }
+
+    /* pairs with the exchange below, another thread may have just published the name */
+    name = __atomic_load_n(&filelist->files[i], __ATOMIC_ACQUIRE);
+
+    if (name || !filelist->pattern) {
+        return name;
+    }
+
+    len  = snprintf(NULL, 0, filelist->pattern, filelist->first_number + i);
+    name = len < 0 ? NULL : malloc(len + 1);
+
+    if (!name) {
+        return NULL;
+    }
+
+    snprintf(name, len + 1, filelist->pattern, filelist->first_number + i);
+
+    if (!__atomic_compare_exchange_n(&filelist->files[i], &expected, name, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(name);
+        name = expected;
+    }
+
+    return name;
+}
+
 /**
 free a filelist_t structure
 
@@ -414,14 +701,27 @@ void filelist_free(filelist_t *filelist) {
         return;
     }
 
-    if (filelist->files) {
+    if (filelist->names) {
+        free(filelist->names);
+    }
+    else if (filelist->files) {
         for (x = 0; x < filelist->nfiles; x++) {
             free(filelist->files[x]);
         }
+    }
 
+    if (filelist->files) {
         free(filelist->files);
     }
 
+    if (filelist->index) {
+        free(filelist->index);
+    }
+
+    if (filelist->pattern) {
+        free(filelist->pattern);
+    }
+
     free(filelist);
 }
 
@@ -532,32 +832,68 @@ This function will de-allocate an opendcp context.
 @return returns OPENDCP_NO_ERROR on success
 */
 int opendcp_delete(opendcp_t *opendcp) {
+    int p;
+
     if ( opendcp != NULL) {
+        for (p = 0; p < opendcp->dcp.pkl_count; p++) {
+            pkl_free(opendcp->dcp.pkl[p]);
+        }
+
+        if (opendcp->dcp.pkl) {
+            free(opendcp->dcp.pkl);
+        }
+
         free(opendcp);
     }
 
     return OPENDCP_NO_ERROR;
 }
 
+/* make room for one more element, the capacity doubles so appends are amortized constant */
+static int model_reserve(void **array, int *capacity, int count, size_t size) {
+    void *tmp;
+    int  n;
+
+    if (count < *capacity) {
+        return OPENDCP_NO_ERROR;
+    }
+
+    n   = *capacity ? *capacity * 2 : 4;
+    tmp = realloc(*array, n * size);
+
+    if (!tmp) {
+        return OPENDCP_ERROR;
+    }
+
+    *array    = tmp;
+    *capacity = n;
+
+    return OPENDCP_NO_ERROR;
+}
+
 /**
 create a pkl and add information
 
-This function populates a pkl data structure with DCP information
+This function allocates a pkl and populates it with DCP information
 from a dcp_t structure.
 
 @param  dcp dcp_t structure
-@param  pkl pkl_t  structure
-@return NONE
+@return pkl_t pointer, NULL on failure
 */
-void create_pkl(dcp_t dcp, pkl_t *pkl) {
+pkl_t *create_pkl(dcp_t *dcp) {
     char uuid_s[40];
+    pkl_t *pkl;
+
+    pkl = calloc(1, sizeof(pkl_t));
 
-    memset(pkl, 0, sizeof(pkl_t));
+    if (!pkl) {
+        return NULL;
+    }
 
-    strcpy(pkl->issuer,     dcp.issuer);
-    strcpy(pkl->creator,    dcp.creator);
-    strcpy(pkl->annotation, dcp.annotation);
-    strcpy(pkl->timestamp,  dcp.timestamp);
+    strcpy(pkl->issuer,     dcp->issuer);
+    strcpy(pkl->creator,    dcp->creator);
+    strcpy(pkl->annotation, dcp->annotation);
+    strcpy(pkl->timestamp,  dcp->timestamp);
     pkl->cpl_count = 0;
 
     /* Generate UUIDs */
@@ -565,84 +901,144 @@ void create_pkl(dcp_t dcp, pkl_t *pkl) {
     sprintf(pkl->uuid, "%.36s", uuid_s);
 
     /* Generate XML filename */
-    if ( !strcmp(dcp.basename, "") ) {
+    if ( !strcmp(dcp->basename, "") ) {
         sprintf(pkl->filename, "PKL_%.40s.xml", pkl->uuid);
     }
     else {
-        sprintf(pkl->filename, "PKL_%.40s.xml", dcp.basename);
+        sprintf(pkl->filename, "PKL_%.40s.xml", dcp->basename);
     }
 
-    return;
+    return pkl;
+}
+
+/**
+free a pkl and the cpls it holds
+
+@param  pkl pkl_t pointer
+@return NONE
+*/
+void pkl_free(pkl_t *pkl) {
+    int c;
+
+    if (pkl == NULL) {
+        return;
+    }
+
+    for (c = 0; c < pkl->cpl_count; c++) {
+        cpl_free(pkl->cpl[c]);
+    }
+
+    if (pkl->cpl) {
+        free(pkl->cpl);
+    }
+
+    free(pkl);
 }
 
 /**
 add packaging list to dcp
 
-This function adds a pkl to a dcp_t structure
+This function adds a pkl to a dcp_t structure, the dcp takes ownership
+of the pkl.
 
 @param  dcp dcp_t structure
-@param  pkl pkl_t structure
-@return NONE
+@param  pkl pkl_t pointer
+@return OPENDCP_ERROR value
 */
-void add_pkl_to_dcp(dcp_t *dcp, pkl_t pkl) {
-    memcpy(dcp[dcp->pkl_count].pkl, &pkl, sizeof(pkl_t));
-    dcp->pkl_count++;
+int add_pkl_to_dcp(dcp_t *dcp, pkl_t *pkl) {
+    if (model_reserve((void **)&dcp->pkl, &dcp->pkl_capacity, dcp->pkl_count, sizeof(pkl_t *)) != OPENDCP_NO_ERROR) {
+        return OPENDCP_ERROR;
+    }
+
+    dcp->pkl[dcp->pkl_count++] = pkl;
 
-    return;
+    return OPENDCP_NO_ERROR;
 }
 
 /**
-add content playlist to packaging list
+create a content playlist
 
-This function populates a cpl data structure with DCP information
+This function allocates a cpl and populates it with DCP information
 from a dcp_t structure.
 
 @param  dcp dcp_t structure
-@param  cpl cpl_t structure
-@return NONE
+@return cpl_t pointer, NULL on failure
 */
-void create_cpl(dcp_t dcp, cpl_t *cpl) {
+cpl_t *create_cpl(dcp_t *dcp) {
     char uuid_s[40];
+    cpl_t *cpl;
 
-    memset(cpl, 0, sizeof(cpl_t));
+    cpl = calloc(1, sizeof(cpl_t));
+
+    if (!cpl) {
+        return NULL;
+    }
 
-    strcpy(cpl->annotation, dcp.annotation);
-    strcpy(cpl->issuer,     dcp.issuer);
-    strcpy(cpl->creator,    dcp.creator);
-    strcpy(cpl->title,      dcp.title);
-    strcpy(cpl->kind,       dcp.kind);
-    strcpy(cpl->rating,     dcp.rating);
-    strcpy(cpl->timestamp,  dcp.timestamp);
+    strcpy(cpl->annotation, dcp->annotation);
+    strcpy(cpl->issuer,     dcp->issuer);
+    strcpy(cpl->creator,    dcp->creator);
+    strcpy(cpl->title,      dcp->title);
+    strcpy(cpl->kind,       dcp->kind);
+    strcpy(cpl->rating,     dcp->rating);
+    strcpy(cpl->timestamp,  dcp->timestamp);
     cpl->reel_count = 0;
 
     uuid_random(uuid_s);
     sprintf(cpl->uuid, "%.36s", uuid_s);
 
     /* Generate XML filename */
-    if ( !strcmp(dcp.basename, "") ) {
+    if ( !strcmp(dcp->basename, "") ) {
         sprintf(cpl->filename, "CPL_%.40s.xml", cpl->uuid);
     }
     else {
-        sprintf(cpl->filename, "CPL_%.40s.xml", dcp.basename);
+        sprintf(cpl->filename, "CPL_%.40s.xml", dcp->basename);
     }
 
-    return;
+    return cpl;
 }
 
 /**
-add packaging list to packaging list
-
-This functio adds a cpl to a pkl structure
+free a cpl and its reels
 
-@param  dcp dcp_t structure
-@param  cpl cpl_t structure
+@param  cpl cpl_t pointer
 @return NONE
 */
-void add_cpl_to_pkl(pkl_t *pkl, cpl_t cpl) {
-    memcpy(&pkl->cpl[pkl->cpl_count], &cpl, sizeof(cpl_t));
-    pkl->cpl_count++;
+void cpl_free(cpl_t *cpl) {
+    int r;
 
-    return;
+    if (cpl == NULL) {
+        return;
+    }
+
+    for (r = 0; r < cpl->reel_count; r++) {
+        reel_free(cpl->reel[r]);
+    }
+
+    if (cpl->reel) {
+        free(cpl->reel);
+    }
+
+    free(cpl);
+}
+
+/**
+add content playlist to packaging list
+
+This function adds a cpl to a pkl structure, the pkl takes ownership
+of the cpl.
+
+@param  pkl pkl_t structure
+@param  cpl cpl_t pointer
+@return OPENDCP_ERROR value
+*/
+int add_cpl_to_pkl(pkl_t *pkl, cpl_t *cpl) {
+    if (model_reserve((void **)&pkl->cpl, &pkl->cpl_capacity, pkl->cpl_count, sizeof(cpl_t *)) != OPENDCP_NO_ERROR) {
+        return OPENDCP_ERROR;
+    }
+
+    pkl->cpl[pkl->cpl_count++] = cpl;
+
+    return OPENDCP_NO_ERROR;
 }
 
 int init_asset(asset_t *asset) {
@@ -651,16 +1047,42 @@ int init_asset(asset_t *asset) {
     return OPENDCP_NO_ERROR;
 }
 
-void create_reel(dcp_t dcp, reel_t *reel) {
+/**
+create a reel
+
+This function allocates an empty reel with a new uuid and the annotation
+of the dcp.
+
+@param  dcp dcp_t structure
+@return reel_t pointer, NULL on failure
+*/
+reel_t *create_reel(dcp_t *dcp) {
     char uuid_s[40];
+    reel_t *reel;
+
+    reel = calloc(1, sizeof(reel_t));
 
-    memset(reel, 0, sizeof(reel_t));
+    if (!reel) {
+        return NULL;
+    }
 
-    strcpy(reel->annotation, dcp.annotation);
+    strcpy(reel->annotation, dcp->annotation);
 
     /* Generate UUIDs */
     uuid_random(uuid_s);
     sprintf(reel->uuid, "%.36s", uuid_s);
+
+    return reel;
+}
+
+/**
+free a reel
+
+@param  reel reel_t pointer
+@return NONE
+*/
+void reel_free(reel_t *reel) {
+    free(reel);
 }
 
 int validate_reel(opendcp_t *opendcp, reel_t *reel, int reel_number) {
@@ -728,9 +1150,24 @@ int validate_reel(opendcp_t *opendcp, reel_t *reel, int reel_number) {
     return OPENDCP_NO_ERROR;
 }
 
-void add_reel_to_cpl(cpl_t *cpl, reel_t reel) {
-    memcpy(&cpl->reel[cpl->reel_count], &reel, sizeof(reel_t));
-    cpl->reel_count++;
+/**
+add a reel to a content playlist
+
+This function adds a reel to a cpl structure, the cpl takes ownership
+of the reel.
+
+@param  cpl cpl_t structure
+@param  reel reel_t pointer
+@return OPENDCP_ERROR value
+*/
+int add_reel_to_cpl(cpl_t *cpl, reel_t *reel) {
+    if (model_reserve((void **)&cpl->reel, &cpl->reel_capacity, cpl->reel_count, sizeof(reel_t *)) != OPENDCP_NO_ERROR) {
+        return OPENDCP_ERROR;
+    }
+
+    cpl->reel[cpl->reel_count++] = reel;
+
+    return OPENDCP_NO_ERROR;
 }
 
 int add_asset(opendcp_t *opendcp, asset_t *asset, char *filename) {
@@ -761,11 +1198,18 @@ int add_asset(opendcp_t *opendcp, asset_t *asset, char *filename) {
     /* read asset information */
     OPENDCP_LOG(LOG_DEBUG, "add_asset: Reading %s asset information", filename);
 
-    result = read_asset_info(asset);
+    /* an unchanged file keeps the information and digest of the last run */
+    if (opendcp_state_lookup(opendcp->dcp.state, asset) != OPENDCP_NO_ERROR) {
+        result = read_asset_info(asset);
+
+        if (result == OPENDCP_ERROR) {
+            OPENDCP_LOG(LOG_ERROR, "%s is not a proper essence file", filename);
+            return OPENDCP_INVALID_TRACK_TYPE;
+        }
 
-    if (result == OPENDCP_ERROR) {
-        OPENDCP_LOG(LOG_ERROR, "%s is not a proper essence file", filename);
-        return OPENDCP_INVALID_TRACK_TYPE;
+        if (result == OPENDCP_NO_ERROR) {
+            opendcp_state_update(opendcp->dcp.state, asset);
+        }
     }
 
     /* force aspect ratio, if specified */
@@ -799,38 +1243,38 @@ int add_asset(opendcp_t *opendcp, asset_t *asset, char *filename) {
     return OPENDCP_NO_ERROR;
 }
 
-int add_asset_to_reel(opendcp_t *opendcp, reel_t *reel, asset_t asset) {
+int add_asset_to_reel(opendcp_t *opendcp, reel_t *reel, asset_t *asset) {
     int result;
 
     OPENDCP_LOG(LOG_INFO, "Adding asset to reel");
 
     if (opendcp->ns == XML_NS_UNKNOWN) {
-        opendcp->ns = asset.xml_ns;
+        opendcp->ns = asset->xml_ns;
         OPENDCP_LOG(LOG_DEBUG, "add_asset_to_reel: Label type detected: %d", opendcp->ns);
     }
     else {
-        if (opendcp->ns != asset.xml_ns) {
+        if (opendcp->ns != asset->xml_ns) {
             OPENDCP_LOG(LOG_ERROR, "Warning DCP specification mismatch in assets. Please make sure all assets are MXF Interop or SMPTE");
             return OPENDCP_SPECIFICATION_MISMATCH;
         }
     }
 
-    result = get_asset_type(asset);
+    result = get_asset_type(*asset);
 
     switch (result) {
         case ACT_PICTURE:
             OPENDCP_LOG(LOG_DEBUG, "add_asset_to_reel: adding picture");
-            reel->main_picture = asset;
+            reel->main_picture = *asset;
             break;
 
         case ACT_SOUND:
             OPENDCP_LOG(LOG_DEBUG, "add_asset_to_reel: adding sound");
-            reel->main_sound = asset;
+            reel->main_sound = *asset;
             break;
 
         case ACT_TIMED_TEXT:
             OPENDCP_LOG(LOG_DEBUG, "add_asset_to_reel: adding subtitle");
-            reel->main_subtitle = asset;
+            reel->main_subtitle = *asset;
             break;
 
         default:
@@ -32,14 +32,112 @@
 extern int rgb_to_xyz_calculate(opendcp_image_t *image, int index);
 extern int rgb_to_xyz_lut(opendcp_image_t *image, int index);
 
+/* recently released images, reused before allocating new frame buffers. the pool holds
+   about one image per worker thread and is empty until it is sized */
+#define OPENDCP_IMAGE_POOL_MAX 64
+
+static opendcp_image_t *image_pool[OPENDCP_IMAGE_POOL_MAX];
+static int image_pool_count = 0;
+static int image_pool_limit = 0;
+
+/* take an int image with matching dimensions from the pool */
+static opendcp_image_t *image_pool_take(int n_components, int w, int h) {
+    opendcp_image_t *image = NULL;
+    int x;
+
+    #pragma omp critical (opendcp_image_pool)
+    {
+        for (x = 0; x < image_pool_count; x++) {
+            if (image_pool[x]->n_components == n_components && image_pool[x]->w == w && image_pool[x]->h == h) {
+                image = image_pool[x];
+                image_pool[x] = image_pool[--image_pool_count];
+                break;
+            }
+        }
+    }
+
+    return image;
+}
+
+/* return an image to the pool, or free it if the pool is full (int data) */
+void opendcp_image_release(opendcp_image_t *image) {
+    int pooled = 0;
+
+    if (image == NULL) {
+        return;
+    }
+
+    if (!image->use_float && image->n_components == 3) {
+        #pragma omp critical (opendcp_image_pool)
+        {
+            if (image_pool_count < image_pool_limit) {
+                image_pool[image_pool_count++] = image;
+                pooled = 1;
+            }
+        }
+    }
+
+    if (!pooled) {
+        opendcp_image_free(image);
+    }
+}
+
+/* set how many released images are kept, usually the number of threads, images over it are freed */
+void opendcp_image_pool_size(int size) {
+    opendcp_image_t *pool[OPENDCP_IMAGE_POOL_MAX];
+    int x, count = 0;
+
+    if (size < 0) {
+        size = 0;
+    }
+
+    if (size > OPENDCP_IMAGE_POOL_MAX) {
+        size = OPENDCP_IMAGE_POOL_MAX;
+    }
+
+    #pragma omp critical (opendcp_image_pool)
+    {
+        image_pool_limit = size;
+
+        while (image_pool_count > image_pool_limit) {
+            pool[count++] = image_pool[--image_pool_count];
+        }
+    }
+
+    for (x = 0; x < count; x++) {
+        opendcp_image_free(pool[x]);
+    }
+}
+
+/* free every pooled image, called when no more frames will be encoded */
+void opendcp_image_pool_drain() {
+    opendcp_image_t *pool[OPENDCP_IMAGE_POOL_MAX];
+    int x, count;
+
+    #pragma omp critical (opendcp_image_pool)
+    {
+        count = image_pool_count;
+
+        for (x = 0; x < count; x++) {
+            pool[x] = image_pool[x];
+        }
+
+        image_pool_count = 0;
+    }
+
+    for (x = 0; x < count; x++) {
+        opendcp_image_free(pool[x]);
+    }
+}
+
 /* create opendcp image structure for int */
 opendcp_image_t *opendcp_image_create(int n_components, int w, int h) {
     int x;
     opendcp_image_t *image = 00;
 
-    image = (opendcp_image_t*) malloc(sizeof(opendcp_image_t));
+    image = image_pool_take(n_components, w, h);
 
-    if (image) {
+    if (!image && (image = (opendcp_image_t*) malloc(sizeof(opendcp_image_t)))) {
         memset(image, 0, sizeof(opendcp_image_t));
         image->component = (opendcp_image_component_t*) malloc(n_components * sizeof(opendcp_image_component_t));
 
@@ -63,6 +161,11 @@ opendcp_image_t *opendcp_image_create(int n_components, int w, int h) {
         }
     }
 
+    if (!image) {
+        OPENDCP_LOG(LOG_ERROR, "unable to allocate memory for image");
+        return NULL;
+    }
+
     /* set default image parameters 12-bit RGB integer */
     image->bpp          = 12;
     image->precision    = 12;
@@ -272,9 +375,24 @@ int check_image_compliance(int profile, opendcp_image_t *image, char *file) {
     int w, h;
     int dci_w = MAX_WIDTH_2K;
     int dci_h = MAX_HEIGHT_2K;
+    char *extension;
     opendcp_image_t *tmp;
+    opendcp_j2k_header_t header;
 
-    if (image == NULL) {
+    extension = image == NULL ? strrchr(file, '.') : NULL;
+
+    /* a codestream's dimensions are in its main header, no need to decode it */
+    if (extension && strlen(extension) == 4 && (strcasefind(extension, ".j2c") || strcasefind(extension, ".j2k"))) {
+        OPENDCP_LOG(LOG_DEBUG, "reading codestream header %s", file);
+
+        if (read_j2k_header(file, &header) != OPENDCP_NO_ERROR) {
+            return OPENDCP_ERROR;
+        }
+
+        h = header.height;
+        w = header.width;
+    }
+    else if (image == NULL) {
         OPENDCP_LOG(LOG_DEBUG, "reading file %s", file);
 
         if (read_image(&tmp, file) == OPENDCP_NO_ERROR) {
@@ -467,6 +585,112 @@ int rgb_to_xyz_lut(opendcp_image_t *image, int index) {
     return OPENDCP_NO_ERROR;
 }
 
+/* tables for the calculated rgb to xyz path, built on first use
+
+   The input gamma only ever sees 12-bit code values, so it is tabulated
+   exactly per colorspace. The DCI companding is replaced by the input
+   thresholds at which each 12-bit output code value starts, found with a
+   short binary search seeded from a coarse table. The result is identical
+   to dci_transfer() except where double rounding puts an input exactly on
+   a code boundary, a maximum error of one code value. */
+#define DCI_TRANSFER_BINS 65536
+
+static float  calc_gamma_in[LI_MAX][COLOR_DEPTH + 1];
+static int    calc_gamma_ready[LI_MAX];
+static double dci_threshold[COLOR_DEPTH + 2];
+static short  dci_seed[DCI_TRANSFER_BINS + 1];
+static double dci_bin_scale;
+static int    dci_ready = 0;
+
+static void rgb_to_xyz_calculate_init(int index) {
+    int c, j;
+
+    #pragma omp critical (opendcp_xyz_tables)
+    {
+        if (!calc_gamma_ready[index]) {
+            for (c = 0; c <= COLOR_DEPTH; c++) {
+                calc_gamma_in[index][c] = complex_gamma(c, GAMMA[index], index);
+            }
+
+            calc_gamma_ready[index] = 1;
+        }
+
+        if (!dci_ready) {
+            /* smallest input that produces each output code value */
+            for (c = 0; c <= COLOR_DEPTH + 1; c++) {
+                dci_threshold[c] = pow((double)c / COLOR_DEPTH, DCI_GAMMA) / (DCI_COEFFICENT);
+            }
+
+            dci_bin_scale = DCI_TRANSFER_BINS / dci_threshold[COLOR_DEPTH + 1];
+
+            /* output code value at the start of each bin */
+            for (c = 0, j = 0; j <= DCI_TRANSFER_BINS; j++) {
+                while (c <= COLOR_DEPTH && dci_threshold[c + 1] * dci_bin_scale <= j) {
+                    c++;
+                }
+
+                dci_seed[j] = c;
+            }
+
+            dci_ready = 1;
+        }
+    }
+}
+
+/* dci transfer using the threshold table (int data) */
+static inline int dci_transfer_lookup(float p) {
+    int lo, hi, mid, j;
+
+    if (!(p > 0)) {
+        return -HEADROOM;
+    }
+
+    /* above peak white, outside of the table */
+    if (p >= dci_threshold[COLOR_DEPTH + 1]) {
+        return dci_transfer(p);
+    }
+
+    j = (int)(p * dci_bin_scale);
+
+    if (j >= DCI_TRANSFER_BINS) {
+        j = DCI_TRANSFER_BINS - 1;
+    }
+
+    lo = dci_seed[j];
+    hi = dci_seed[j + 1];
+
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+
+        if (dci_threshold[mid] <= p) {
+            lo = mid;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+
+    /* bin edges are computed in floating point, settle on the exact code */
+    while (lo > 0 && dci_threshold[lo] > p) {
+        lo--;
+    }
+
+    while (lo < COLOR_DEPTH && dci_threshold[lo + 1] <= p) {
+        lo++;
+    }
+
+    return lo - HEADROOM;
+}
+
+/* gamma of a 12-bit code value using the table */
+static inline float calc_gamma_lookup(int v, int index) {
+    if (v < 0 || v > COLOR_DEPTH) {
+        return complex_gamma(v, GAMMA[index], index);
+    }
+
+    return calc_gamma_in[index][v];
+}
+
 /* rgb to xyz color conversion hard calculations (int data) */
 int rgb_to_xyz_calculate(opendcp_image_t *image, int index) {
     int i;
@@ -477,18 +701,20 @@ int rgb_to_xyz_calculate(opendcp_image_t *image, int index) {
     size = image->w * image->h;
     OPENDCP_LOG(LOG_DEBUG, "gamma: %f", GAMMA[index]);
 
+    rgb_to_xyz_calculate_init(index);
+
     for (i = 0; i < size; i++) {
-        s.r = complex_gamma(image->component[0].data[i], GAMMA[index], index);
-        s.g = complex_gamma(image->component[1].data[i], GAMMA[index], index);
-        s.b = complex_gamma(image->component[2].data[i], GAMMA[index], index);
+        s.r = calc_gamma_lookup(image->component[0].data[i], index);
+        s.g = calc_gamma_lookup(image->component[1].data[i], index);
+        s.b = calc_gamma_lookup(image->component[2].data[i], index);
 
         d.x = ((s.r * color_matrix[index][0][0]) + (s.g * color_matrix[index][0][1]) + (s.b * color_matrix[index][0][2]));
         d.y = ((s.r * color_matrix[index][1][0]) + (s.g * color_matrix[index][1][1]) + (s.b * color_matrix[index][1][2]));
         d.z = ((s.r * color_matrix[index][2][0]) + (s.g * color_matrix[index][2][1]) + (s.b * color_matrix[index][2][2]));
 
-        image->component[0].data[i] = dci_transfer(d.x);
-        image->component[1].data[i] = dci_transfer(d.y);
-        image->component[2].data[i] = dci_transfer(d.z);
+        image->component[0].data[i] = dci_transfer_lookup(d.x);
+        image->component[1].data[i] = dci_transfer_lookup(d.y);
+        image->component[2].data[i] = dci_transfer_lookup(d.z);
     }
 
     return OPENDCP_NO_ERROR;
@@ -521,30 +747,253 @@ int rgb_to_xyz_calculate_float(opendcp_image_t *image, int index) {
     return OPENDCP_NO_ERROR;
 }
 
-float b_spline(float x) {
-    float c = (float)1 / (float)6;
+/* bilinear (triangle) filter kernel */
+static float filter_bilinear(float x) {
+    x = fabsf(x);
+
+    if (x < 1.0f) {
+        return 1.0f - x;
+    }
+
+    return 0.0f;
+}
+
+/* bicubic filter kernel (keys, a = -0.5) */
+static float filter_bicubic(float x) {
+    const float a = -0.5f;
+
+    x = fabsf(x);
+
+    if (x < 1.0f) {
+        return ((a + 2.0f) * x - (a + 3.0f)) * x * x + 1.0f;
+    }
+
+    if (x < 2.0f) {
+        return ((a * x - 5.0f * a) * x + 8.0f * a) * x - 4.0f * a;
+    }
+
+    return 0.0f;
+}
+
+/* lanczos-3 filter kernel */
+static float filter_lanczos(float x) {
+    float px;
+
+    x = fabsf(x);
 
-    if (x > 2.0 || x < -2.0) {
+    if (x < 1e-6f) {
+        return 1.0f;
+    }
+
+    if (x >= 3.0f) {
         return 0.0f;
     }
 
-    if (x < -1.0) {
-        return(((x + 2.0f) * (x + 2.0f) * (x + 2.0f)) * c);
+    px = (float)M_PI * x;
+
+    return 3.0f * sinf(px) * sinf(px / 3.0f) / (px * px);
+}
+
+/* precomputed filter taps for one axis */
+typedef struct {
+    int   n_taps;   /* taps per output sample       */
+    int   *start;   /* first source sample          */
+    float *weight;  /* n_taps weights per output    */
+} resize_taps_t;
+
+static void resize_taps_free(resize_taps_t *taps) {
+    if (taps->start) {
+        free(taps->start);
     }
 
-    if (x < 0.0) {
-        return(((x + 4.0f) * (x) * (-6.0f - 3.0f * x)) * c);
+    if (taps->weight) {
+        free(taps->weight);
     }
+}
 
-    if (x < 1.0) {
-        return(((x + 4.0f) * (x) * (-6.0f + 3.0f * x)) * c);
+/* build the normalized filter taps that map src_len samples to dst_len samples */
+static int resize_taps_create(resize_taps_t *taps, int src_len, int dst_len, int method) {
+    float (*kernel)(float);
+    float radius, scale, support, center, sum;
+    int   i, k, first;
+    float *w;
+
+    switch (method) {
+        case BILINEAR:
+            kernel = filter_bilinear;
+            radius = 1.0f;
+            break;
+
+        case LANCZOS:
+            kernel = filter_lanczos;
+            radius = 3.0f;
+            break;
+
+        default:
+            kernel = filter_bicubic;
+            radius = 2.0f;
+            break;
     }
 
-    if (x < 2.0) {
-        return(((2.0f - x) * (2.0f - x) * (2.0f - x)) * c);
+    /* when down scaling, stretch the filter to cover every source sample */
+    scale   = (float)src_len / dst_len;
+    support = scale > 1.0f ? radius * scale : radius;
+
+    taps->n_taps = (int)ceilf(support) * 2 + 1;
+    taps->start  = malloc(dst_len * sizeof(int));
+    taps->weight = malloc(dst_len * taps->n_taps * sizeof(float));
+
+    if (!taps->start || !taps->weight) {
+        resize_taps_free(taps);
+        return OPENDCP_ERROR;
     }
 
-    return 0;
+    for (i = 0; i < dst_len; i++) {
+        center = (i + 0.5f) * scale - 0.5f;
+        first  = (int)floorf(center - support) + 1;
+        w      = &taps->weight[i * taps->n_taps];
+        sum    = 0.0f;
+
+        /* keep the window inside the source, edge samples absorb the rest */
+        if (first < 0) {
+            first = 0;
+        }
+
+        if (first > src_len - taps->n_taps) {
+            first = src_len - taps->n_taps > 0 ? src_len - taps->n_taps : 0;
+        }
+
+        for (k = 0; k < taps->n_taps; k++) {
+            if (first + k < src_len) {
+                w[k] = kernel((first + k - center) / (scale > 1.0f ? scale : 1.0f));
+            }
+            else {
+                w[k] = 0.0f;
+            }
+
+            sum += w[k];
+        }
+
+        for (k = 0; k < taps->n_taps; k++) {
+            w[k] = sum != 0.0f ? w[k] / sum : 0.0f;
+        }
+
+        taps->start[i] = first;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* separable two-pass resize of integer image data (horizontal, then vertical) into
+   the w x h region of dst starting at x0, y0 */
+static int resize_filter(opendcp_image_t *src, opendcp_image_t *dst, int x0, int y0, int w, int h, int method) {
+    resize_taps_t h_taps, v_taps;
+    float *tmp;
+    int   c, max_value;
+    int   result = OPENDCP_NO_ERROR;
+
+    memset(&h_taps, 0, sizeof(h_taps));
+    memset(&v_taps, 0, sizeof(v_taps));
+
+    if (resize_taps_create(&h_taps, src->w, w, method) != OPENDCP_NO_ERROR ||
+        resize_taps_create(&v_taps, src->h, h, method) != OPENDCP_NO_ERROR) {
+        OPENDCP_LOG(LOG_ERROR, "unable to allocate memory for resize filter");
+        resize_taps_free(&h_taps);
+        resize_taps_free(&v_taps);
+        return OPENDCP_ERROR;
+    }
+
+    /* intermediate image, source height by destination width */
+    tmp = malloc((size_t)src->h * w * sizeof(float));
+
+    if (!tmp) {
+        OPENDCP_LOG(LOG_ERROR, "unable to allocate memory for resize buffer");
+        resize_taps_free(&h_taps);
+        resize_taps_free(&v_taps);
+        return OPENDCP_ERROR;
+    }
+
+    max_value = (1 << dst->precision) - 1;
+
+    for (c = 0; c < dst->n_components; c++) {
+        int *s_data = src->component[c].data;
+        int *d_data = dst->component[c].data;
+        int x, y;
+
+        /* horizontal pass, threaded over source rows */
+        #pragma omp parallel for private(x)
+        for (y = 0; y < src->h; y++) {
+            const int *s_row = &s_data[y * src->w];
+            float     *t_row = &tmp[y * w];
+
+            for (x = 0; x < w; x++) {
+                const float *wt = &h_taps.weight[x * h_taps.n_taps];
+                float sum = 0.0f;
+                int   k, i;
+
+                /* a row narrower than the filter would put taps past its end */
+                for (k = 0; k < h_taps.n_taps; k++) {
+                    i = h_taps.start[x] + k;
+                    sum += s_row[i < src->w ? i : src->w - 1] * wt[k];
+                }
+
+                t_row[x] = sum;
+            }
+        }
+
+        /* vertical pass, threaded over output bands and vectorized across each row */
+        #pragma omp parallel private(x, y)
+        {
+            float *acc = malloc(w * sizeof(float));
+
+            #pragma omp for
+            for (y = 0; y < h; y++) {
+                const float *wt    = &v_taps.weight[y * v_taps.n_taps];
+                int         *d_row = &d_data[(y0 + y) * dst->w + x0];
+                int         k, i;
+
+                if (!acc) {
+                    result = OPENDCP_ERROR;
+                    continue;
+                }
+
+                for (x = 0; x < w; x++) {
+                    acc[x] = 0.0f;
+                }
+
+                for (k = 0; k < v_taps.n_taps; k++) {
+                    const float *t;
+                    const float wk = wt[k];
+
+                    if (wk == 0.0f) {
+                        continue;
+                    }
+
+                    i = v_taps.start[y] + k;
+                    t = &tmp[(i < src->h ? i : src->h - 1) * w];
+
+                    for (x = 0; x < w; x++) {
+                        acc[x] += t[x] * wk;
+                    }
+                }
+
+                for (x = 0; x < w; x++) {
+                    int v = (int)(acc[x] + 0.5f);
+                    d_row[x] = CLIP(v, max_value);
+                }
+            }
+
+            if (acc) {
+                free(acc);
+            }
+        }
+    }
+
+    free(tmp);
+    resize_taps_free(&h_taps);
+    resize_taps_free(&v_taps);
+
+    return result;
 }
 
 /* get the pixel index based on x,y (int data) */
@@ -577,29 +1026,93 @@ static inline rgb_pixel_float_t get_pixel_float(opendcp_image_t *image, int x, i
     return p;
 }
 
+/* fill everything outside the w x h picture region at x0, y0 with black (int data) */
+static void fill_matte(opendcp_image_t *image, int x0, int y0, int w, int h) {
+    int c, y;
+
+    for (c = 0; c < image->n_components; c++) {
+        int *data = image->component[c].data;
+
+        /* top and bottom matte rows */
+        if (y0 > 0) {
+            memset(data, 0, (size_t)y0 * image->w * sizeof(int));
+        }
+
+        if (y0 + h < image->h) {
+            memset(&data[(y0 + h) * image->w], 0, (size_t)(image->h - y0 - h) * image->w * sizeof(int));
+        }
+
+        /* left and right matte columns */
+        if (w < image->w) {
+            for (y = y0; y < y0 + h; y++) {
+                int *row = &data[y * image->w];
+
+                memset(row, 0, x0 * sizeof(int));
+                memset(row + x0 + w, 0, (image->w - x0 - w) * sizeof(int));
+            }
+        }
+    }
+}
+
+/* copy an image unscaled into dst at x0, y0 (int data) */
+static void composite_copy(opendcp_image_t *src, opendcp_image_t *dst, int x0, int y0) {
+    int c, y;
+
+    for (c = 0; c < dst->n_components; c++) {
+        for (y = 0; y < src->h; y++) {
+            memcpy(&dst->component[c].data[(y0 + y) * dst->w + x0],
+                   &src->component[c].data[y * src->w],
+                   src->w * sizeof(int));
+        }
+    }
+}
+
+/* nearest pixel scale of an image into the w x h region of dst at x0, y0 (int data) */
+static void composite_nearest(opendcp_image_t *src, opendcp_image_t *dst, int x0, int y0, int w, int h) {
+    int c, x, y;
+    float tx, ty;
+
+    tx = (float)src->w / w;
+    ty = (float)src->h / h;
+
+    for (c = 0; c < dst->n_components; c++) {
+        for (y = 0; y < h; y++) {
+            const int *s_row = &src->component[c].data[(int)(y * ty) * src->w];
+            int       *d_row = &dst->component[c].data[(y0 + y) * dst->w + x0];
+
+            for (x = 0; x < w; x++) {
+                d_row[x] = s_row[(int)(x * tx)];
+            }
+        }
+    }
+}
+
+/* letter box (int data) */
 int letterbox(opendcp_image_t **image, int w, int h) {
     int num_components = 3;
-    int x, y;
     opendcp_image_t *ptr = *image;
-    rgb_pixel_float_t p;
+    int x0, y0;
+
+    if (ptr->w > w || ptr->h > h) {
+        OPENDCP_LOG(LOG_ERROR, "image %dx%d does not fit in %dx%d", ptr->w, ptr->h, w, h);
+        return OPENDCP_ERROR;
+    }
 
     /* create the image */
     opendcp_image_t *d_image = opendcp_image_create(num_components, w, h);
 
     if (!d_image) {
-        return -1;
+        return OPENDCP_ERROR;
     }
 
-    for (y = 0; y < h; y++) {
-        for (x = 0; x < w; x++) {
-            p = get_pixel(ptr, x, y);
-            d_image->component[0].data[0] = (int)p.r;
-            d_image->component[1].data[0] = (int)p.g;
-            d_image->component[2].data[0] = (int)p.b;
-        }
-    }
+    /* center the picture and only touch the matte around it */
+    x0 = (w - ptr->w) / 2;
+    y0 = (h - ptr->h) / 2;
 
-    opendcp_image_free(*image);
+    composite_copy(ptr, d_image, x0, y0);
+    fill_matte(d_image, x0, y0, ptr->w, ptr->h);
+
+    opendcp_image_release(*image);
     *image = d_image;
 
     return OPENDCP_NO_ERROR;
@@ -608,23 +1121,38 @@ int letterbox(opendcp_image_t **image, int w, int h) {
 /* letter box (float data) */
 int letterbox_float(opendcp_image_t **image, int w, int h) {
     int num_components = 3;
-    int x, y;
+    int c, y, x0, y0;
     opendcp_image_t *ptr = *image;
-    rgb_pixel_float_t p;
+
+    if (ptr->w > w || ptr->h > h) {
+        OPENDCP_LOG(LOG_ERROR, "image %dx%d does not fit in %dx%d", ptr->w, ptr->h, w, h);
+        return OPENDCP_ERROR;
+    }
 
     /* create the image */
-    opendcp_image_t *d_image = opendcp_image_create(num_components, w, h);
+    opendcp_image_t *d_image = opendcp_image_float_create(num_components, w, h);
 
     if (!d_image) {
-        return -1;
+        return OPENDCP_ERROR;
     }
 
-    for (y = 0; y < h; y++) {
-        for (x = 0; x < w; x++) {
-            p = get_pixel(ptr, x, y);
-            d_image->component[0].float_data[0] = p.r;
-            d_image->component[1].float_data[0] = p.g;
-            d_image->component[2].float_data[0] = p.b;
+    x0 = (w - ptr->w) / 2;
+    y0 = (h - ptr->h) / 2;
+
+    for (c = 0; c < num_components; c++) {
+        float *data = d_image->component[c].float_data;
+
+        for (y = 0; y < h; y++) {
+            float *row = &data[y * w];
+
+            if (y < y0 || y >= y0 + ptr->h) {
+                memset(row, 0, w * sizeof(float));
+                continue;
+            }
+
+            memset(row, 0, x0 * sizeof(float));
+            memcpy(row + x0, &ptr->component[c].float_data[(y - y0) * ptr->w], ptr->w * sizeof(float));
+            memset(row + x0 + ptr->w, 0, (w - x0 - ptr->w) * sizeof(float));
         }
     }
 
@@ -633,6 +1161,119 @@ int letterbox_float(opendcp_image_t **image, int w, int h) {
 
     return OPENDCP_NO_ERROR;
 }
+
+/* get the dimensions of a dci container */
+int container_size(int profile, int container, int *w, int *h) {
+    switch (container) {
+        case CONTAINER_FLAT:
+            *w = 1998;
+            *h = MAX_HEIGHT_2K;
+            break;
+
+        case CONTAINER_SCOPE:
+            *w = MAX_WIDTH_2K;
+            *h = 858;
+            break;
+
+        case CONTAINER_FULL:
+            *w = MAX_WIDTH_2K;
+            *h = MAX_HEIGHT_2K;
+            break;
+
+        default:
+            return OPENDCP_ERROR;
+    }
+
+    /* adjust for 4K */
+    if (profile == DCP_CINEMA4K) {
+        *w *= 2;
+        *h *= 2;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* fit an image into a dci container (int data)
+
+   The picture is scaled to the largest size that fits the container while
+   keeping its aspect ratio, written straight into a container sized image at
+   its final offset, and only the matte rows/columns around it are filled. */
+int container_fit(opendcp_image_t **image, int profile, int container, int method) {
+    int num_components = 3;
+    opendcp_image_t *ptr = *image;
+    int cw, ch, w, h, x0, y0;
+
+    if (container_size(profile, container, &cw, &ch) != OPENDCP_NO_ERROR) {
+        OPENDCP_LOG(LOG_ERROR, "unknown container %d", container);
+        return OPENDCP_ERROR;
+    }
+
+    /* already a container sized image */
+    if (ptr->w == cw && ptr->h == ch) {
+        return OPENDCP_NO_ERROR;
+    }
+
+    /* fit to width or height, depending on which is the limiting dimension */
+    if ((long long)ptr->w * ch >= (long long)ptr->h * cw) {
+        w = cw;
+        h = (int)((long long)ptr->h * cw / ptr->w);
+    }
+    else {
+        w = (int)((long long)ptr->w * ch / ptr->h);
+        h = ch;
+    }
+
+    /* the picture dimensions must be even values */
+    w -= w % 2;
+    h -= h % 2;
+
+    /* an image that already fits only needs the matte */
+    if (ptr->w <= cw && ptr->h <= ch && (ptr->w == cw || ptr->h == ch)) {
+        w = ptr->w;
+        h = ptr->h;
+    }
+
+    if ((w != ptr->w || h != ptr->h) && method == SAMPLE_NONE) {
+        OPENDCP_LOG(LOG_WARN, "image %dx%d needs scaling to fit the %dx%d container, select a resize method", ptr->w, ptr->h, cw, ch);
+        return OPENDCP_ERROR;
+    }
+
+    x0 = (cw - w) / 2;
+    y0 = (ch - h) / 2;
+
+    OPENDCP_LOG(LOG_INFO, "fitting %dx%d into %dx%d container at %d,%d (%dx%d) method %d", ptr->w, ptr->h, cw, ch, x0, y0, w, h, method);
+
+    /* create the image */
+    opendcp_image_t *d_image = opendcp_image_create(num_components, cw, ch);
+
+    if (!d_image) {
+        return OPENDCP_ERROR;
+    }
+
+    if (w == ptr->w && h == ptr->h) {
+        composite_copy(ptr, d_image, x0, y0);
+    }
+    else if (method == NEAREST_PIXEL) {
+        composite_nearest(ptr, d_image, x0, y0, w, h);
+    }
+    else {
+        d_image->precision = ptr->precision;
+        d_image->bpp       = ptr->bpp;
+
+        if (resize_filter(ptr, d_image, x0, y0, w, h, method) != OPENDCP_NO_ERROR) {
+            opendcp_image_release(d_image);
+            return OPENDCP_ERROR;
+        }
+    }
+
+    fill_matte(d_image, x0, y0, w, h);
+
+    opendcp_image_release(*image);
+    *image = d_image;
+
+    return OPENDCP_NO_ERROR;
+}
+
 /* resize image (int data) */
 int resize(opendcp_image_t **image, int profile, int method) {
     int num_components = 3;
@@ -681,7 +1322,7 @@ int resize(opendcp_image_t **image, int profile, int method) {
         h *= 2;
     }
 
-    OPENDCP_LOG(LOG_INFO, "resizing from %dx%d to %dx%d (%f) (int data)", ptr->w, ptr->h, w, h, aspect);
+    OPENDCP_LOG(LOG_INFO, "resizing from %dx%d to %dx%d (%f) (int data) method %d", ptr->w, ptr->h, w, h, aspect, method);
 
     /* create the image */
     opendcp_image_t *d_image = opendcp_image_create(num_components, w, h);
@@ -711,8 +1352,18 @@ int resize(opendcp_image_t **image, int profile, int method) {
             }
         }
     }
+    /* filtered resize - bilinear, bicubic, lanczos */
+    else {
+        d_image->precision = ptr->precision;
+        d_image->bpp       = ptr->bpp;
+
+        if (resize_filter(ptr, d_image, 0, 0, w, h, method) != OPENDCP_NO_ERROR) {
+            opendcp_image_release(d_image);
+            return OPENDCP_ERROR;
+        }
+    }
 
-    opendcp_image_free(*image);
+    opendcp_image_release(*image);
     *image = d_image;
 
     return OPENDCP_NO_ERROR;
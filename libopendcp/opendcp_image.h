@@ -26,7 +26,16 @@ extern "C" {
 enum SAMPLE_METHOD {
     SAMPLE_NONE = 0,
     NEAREST_PIXEL,
-    BICUBIC
+    BICUBIC,
+    BILINEAR,
+    LANCZOS
+};
+
+enum DCI_CONTAINER {
+    CONTAINER_NONE = 0,
+    CONTAINER_FLAT,
+    CONTAINER_SCOPE,
+    CONTAINER_FULL
 };
 
 typedef struct {
@@ -66,10 +75,16 @@ typedef struct {
 
 int  read_image(opendcp_image_t **image, char *file);
 void opendcp_image_free(opendcp_image_t *image);
+void opendcp_image_release(opendcp_image_t *image);
+void opendcp_image_pool_size(int size);
+void opendcp_image_pool_drain();
 int opendcp_image_size(opendcp_image_t *opendcp_image);
 int  opendcp_image_readline(opendcp_image_t *image, int y, unsigned char *data);
 int  rgb_to_xyz(opendcp_image_t *image, int gamma, int method);
 int  resize(opendcp_image_t **image, int profile, int method);
+int  container_size(int profile, int container, int *w, int *h);
+int  container_fit(opendcp_image_t **image, int profile, int container, int method);
+int  letterbox(opendcp_image_t **image, int w, int h);
 rgb_pixel_float_t yuv444toRGB888(int y, int cb, int cr);
 opendcp_image_t *opendcp_image_create(int n_components, int w, int h);
 
@@ -24,9 +24,42 @@
 #include "opendcp_encoder.h"
 
 int convert_to_j2k(opendcp_t *opendcp, char *sfile, char *dfile) {
+    return convert_to_j2k_frame(opendcp, sfile, dfile, -1);
+}
+
+static int convert_frame(opendcp_t *opendcp, char *sfile, char *dfile, int frame);
+
+/**
+convert an image to jpeg2000 as a frame of the reel
+
+The frame index selects the byte budget when j2k.rate_control is set, the
+size of the codestream is recorded with it.
+
+@param  opendcp the opendcp context
+@param  sfile the source image
+@param  dfile the destination codestream
+@param  frame the frame index (zero based), negative if unknown
+@return OPENDCP_ERROR value
+*/
+int convert_to_j2k_frame(opendcp_t *opendcp, char *sfile, char *dfile, int frame) {
+    int result;
+
+    /* a frame is in flight from read to saved, the encoder splits the thread budget between them */
+    __atomic_add_fetch(&opendcp->j2k.inflight, 1, __ATOMIC_RELAXED);
+    result = convert_frame(opendcp, sfile, dfile, frame);
+    __atomic_sub_fetch(&opendcp->j2k.inflight, 1, __ATOMIC_RELAXED);
+
+    return result;
+}
+
+static int convert_frame(opendcp_t *opendcp, char *sfile, char *dfile, int frame) {
     opendcp_image_t *opendcp_image;
     opendcp_encoder_t *encoder;
+    opendcp_buffer_t buffer;
+    unsigned long long key;
+    long long size;
     char *extension;
+    int cached = 0;
     int result = 0;
 
     extension = strrchr(dfile, '.');
@@ -39,6 +72,20 @@ int convert_to_j2k(opendcp_t *opendcp, char *sfile, char *dfile) {
     encoder = opendcp_encoder_find(NULL, extension, 0);
     OPENDCP_LOG(LOG_INFO, "using %s encoder (%s) to convert file %s to %s", encoder->name, extension, basename(sfile), basename(dfile));
 
+    /* the frame's budget is part of the cache key */
+    opendcp_ratecontrol_begin(opendcp->j2k.rate_control, frame);
+
+    /* identical source and settings, serve the codestream from the encode cache */
+    if (opendcp->j2k.cache) {
+        cached = opendcp_cache_key(opendcp, sfile, opendcp_ratecontrol_frame_bytes(), &key) == OPENDCP_NO_ERROR;
+
+        if (cached && opendcp_cache_fetch(opendcp->j2k.cache, key, dfile, &size) == OPENDCP_NO_ERROR) {
+            OPENDCP_LOG(LOG_INFO, "%s served from the encode cache", basename(sfile));
+            opendcp_ratecontrol_end(opendcp->j2k.rate_control, frame, size);
+            return OPENDCP_NO_ERROR;
+        }
+    }
+
     OPENDCP_LOG(LOG_DEBUG, "reading input file %s", basename(sfile));
     result = read_image(&opendcp_image, sfile);
 
@@ -52,19 +99,27 @@ int convert_to_j2k(opendcp_t *opendcp, char *sfile, char *dfile) {
         return OPENDCP_ERROR;
     }
 
+    /* fit image into a dci container */
+    if (opendcp->j2k.container) {
+        if (container_fit(&opendcp_image, opendcp->cinema_profile, opendcp->j2k.container, opendcp->j2k.resize) != OPENDCP_NO_ERROR) {
+            OPENDCP_LOG(LOG_ERROR, "could not fit %s into the container", basename(sfile));
+            opendcp_image_release(opendcp_image);
+            return OPENDCP_ERROR;
+        }
+    }
     /* verify image is dci compliant */
-    if (check_image_compliance(opendcp->cinema_profile, opendcp_image, NULL) != OPENDCP_NO_ERROR) {
+    else if (check_image_compliance(opendcp->cinema_profile, opendcp_image, NULL) != OPENDCP_NO_ERROR) {
 
         /* resize image */
         if (opendcp->j2k.resize) {
             if (resize(&opendcp_image, opendcp->cinema_profile, opendcp->j2k.resize) != OPENDCP_NO_ERROR) {
-                opendcp_image_free(opendcp_image);
+                opendcp_image_release(opendcp_image);
                 return OPENDCP_ERROR;
             }
         }
         else {
             OPENDCP_LOG(LOG_WARN, "the image resolution of %s is not DCI compliant", sfile);
-            opendcp_image_free(opendcp_image);
+            opendcp_image_release(opendcp_image);
             return OPENDCP_ERROR;
         }
     }
@@ -74,14 +129,27 @@ int convert_to_j2k(opendcp_t *opendcp, char *sfile, char *dfile) {
 
         if (rgb_to_xyz(opendcp_image, opendcp->j2k.lut, opendcp->j2k.xyz_method)) {
             OPENDCP_LOG(LOG_ERROR, "color conversion failed %s", basename(sfile));
-            opendcp_image_free(opendcp_image);
+            opendcp_image_release(opendcp_image);
             return OPENDCP_ERROR;
         }
     }
 
-    result = encoder->encode(opendcp, opendcp_image, dfile);
+    opendcp_buffer_init(&buffer, NULL, 0);
+    result = encoder->encode_buffer(opendcp, opendcp_image, &buffer);
+    opendcp_ratecontrol_end(opendcp->j2k.rate_control, frame, result == OPENDCP_NO_ERROR ? (long long)buffer.size : 0);
 
-    opendcp_image_free(opendcp_image);
+    opendcp_image_release(opendcp_image);
+
+    /* an encoder that produced nothing (none) leaves no file behind */
+    if (result == OPENDCP_NO_ERROR && buffer.size) {
+        result = opendcp_buffer_save(&buffer, dfile);
+
+        if (result == OPENDCP_NO_ERROR && cached) {
+            opendcp_cache_store(opendcp->j2k.cache, key, buffer.data, buffer.size);
+        }
+    }
+
+    opendcp_buffer_free(&buffer);
 
     if ( result != OPENDCP_NO_ERROR) {
         OPENDCP_LOG(LOG_ERROR, "JPEG2000 conversion failed %s", basename(sfile));
@@ -90,3 +158,84 @@ int convert_to_j2k(opendcp_t *opendcp, char *sfile, char *dfile) {
 
     return OPENDCP_NO_ERROR;
 }
+
+/**
+check every codestream of a sequence against the first one
+
+Only the main header of each file is read and the files are probed in
+parallel. Mismatched dimensions, components, profiles or decomposition levels
+are logged and fail the check.
+
+@param  opendcp the opendcp context
+@param  filelist the codestreams in frame order
+@param  start the index of the first codestream to check
+@param  end one past the index of the last codestream to check
+@param  peak_size set to the largest codestream in bytes, may be NULL
+@return OPENDCP_ERROR value
+*/
+int check_j2k_sequence(opendcp_t *opendcp, filelist_t *filelist, int start, int end, long long *peak_size) {
+    opendcp_j2k_header_t first;
+    long long peak, limit;
+    int i, errors = 0;
+
+    if (start < 0 || end > filelist->nfiles || start >= end) {
+        return OPENDCP_ERROR;
+    }
+
+    if (read_j2k_header(filelist_file(filelist, start), &first) != OPENDCP_NO_ERROR) {
+        OPENDCP_LOG(LOG_ERROR, "could not read the codestream header of %s", filelist_file(filelist, start));
+        return OPENDCP_FILEOPEN_J2K;
+    }
+
+    peak = first.size;
+
+    #pragma omp parallel for private(i) reduction(+:errors)
+    for (i = start + 1; i < end; i++) {
+        opendcp_j2k_header_t header;
+
+        if (read_j2k_header(filelist_file(filelist, i), &header) != OPENDCP_NO_ERROR) {
+            OPENDCP_LOG(LOG_ERROR, "could not read the codestream header of %s", filelist_file(filelist, i));
+            errors++;
+            continue;
+        }
+
+        if (header.width != first.width || header.height != first.height) {
+            OPENDCP_LOG(LOG_ERROR, "%s is %dx%d, the sequence is %dx%d", filelist_file(filelist, i),
+                        header.width, header.height, first.width, first.height);
+            errors++;
+        }
+        else if (header.components != first.components || header.profile != first.profile ||
+                 header.levels != first.levels) {
+            OPENDCP_LOG(LOG_ERROR, "%s has profile %d, %d components and %d levels, the sequence %d, %d and %d",
+                        filelist_file(filelist, i), header.profile, header.components, header.levels,
+                        first.profile, first.components, first.levels);
+            errors++;
+        }
+
+        #pragma omp critical (opendcp_j2k_sequence)
+        {
+            if (header.size > peak) {
+                peak = header.size;
+            }
+        }
+    }
+
+    /* stereoscopic sequences interleave both eyes in one edit unit */
+    limit = (long long)MAX_DCP_JPEG_BITRATE / 8;
+
+    if (opendcp->frame_rate > 0) {
+        limit /= opendcp->frame_rate * (opendcp->stereoscopic ? 2 : 1);
+
+        if (peak > limit) {
+            OPENDCP_LOG(LOG_WARN, "largest codestream is %lld bytes, above the %lld bytes a DCI frame allows", peak, limit);
+        }
+    }
+
+    OPENDCP_LOG(LOG_INFO, "%d codestreams checked, %d mismatched, largest %lld bytes", end - start, errors, peak);
+
+    if (peak_size) {
+        *peak_size = peak;
+    }
+
+    return errors ? OPENDCP_ERROR : OPENDCP_NO_ERROR;
+}
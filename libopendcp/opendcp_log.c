@@ -25,37 +25,310 @@
 
 #if _MSC_VER
 #define snprintf _snprintf
+#else
+/* the asynchronous writer needs pthreads and gcc atomics, msvc logs synchronously */
+#define OPENDCP_LOG_ASYNC
+#include <unistd.h>
+#include <pthread.h>
 #endif
 
 #define OPENDCP_LOG_MAX_SUBCRIBERS 5
+#define OPENDCP_LOG_MSG_SIZE       255
+#define OPENDCP_LOG_LINE_SIZE      512
+#define OPENDCP_LOG_RING_SIZE      1024  /* must be a power of 2 */
+#define OPENDCP_LOG_IDLE_USEC      1000
+
+/* a log message before it is laid out for a sink */
+typedef struct {
+    int         level;
+    int         line;
+    const char *file;
+    const char *function;
+    time_t      time;
+    char        msg[OPENDCP_LOG_MSG_SIZE];
+} opendcp_log_record_t;
+
+#ifdef OPENDCP_LOG_ASYNC
+/* ring slot, seq tells producers and the writer who owns the slot */
+typedef struct {
+    unsigned int         seq;
+    opendcp_log_record_t record;
+} opendcp_log_slot_t;
+#endif
 
 static int subscriber_count = 0;
 static opendcp_log_cb_t subscribers[OPENDCP_LOG_MAX_SUBCRIBERS];
 
+/* highest level any sink wants, checked before a message is formatted */
+static int log_level_max = LOG_NONE;
+
+/* structured sink */
+static FILE *json_fp    = NULL;
+static int   json_level = LOG_NONE;
+
+#ifdef OPENDCP_LOG_ASYNC
+/* asynchronous ring, many producers and a single writer thread */
+static opendcp_log_slot_t ring[OPENDCP_LOG_RING_SIZE];
+static unsigned int ring_tail = 0;
+static unsigned int ring_head = 0;
+static unsigned int ring_dropped = 0;
+static unsigned int ring_end = 0;       /* one past the last slot claimed before the ring was closed */
+static int          ring_running = 0;
+static int          ring_stop = 0;
+static pthread_t    ring_writer;
+#endif
+
 void opendcp_log_init(int level);
-char *opendcp_log_timestamp();
+void opendcp_log_async_stop();
 
 void opendcp_log_print_message(void *arg, const char *msg) {
     UNUSED(arg);
     fprintf(stdout, "%s\n", msg);
 }
 
+/* thread-safe timestamp, buffer must hold at least 30 characters */
+static char *opendcp_log_timestamp(time_t t, const char *format, char *buffer) {
+    struct tm time_struct;
+
+#ifdef _WIN32
+    localtime_s(&time_struct, &t);
+#else
+    localtime_r(&t, &time_struct);
+#endif
+    strftime(buffer, 30, format, &time_struct);
+
+    return buffer;
+}
+
+/* write a string as a json string value */
+static void opendcp_log_json_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+
+    for (; *s; s++) {
+        switch (*s) {
+            case '"':
+                fputs("\\\"", fp);
+                break;
+
+            case '\\':
+                fputs("\\\\", fp);
+                break;
+
+            case '\n':
+                fputs("\\n", fp);
+                break;
+
+            case '\r':
+                fputs("\\r", fp);
+                break;
+
+            case '\t':
+                fputs("\\t", fp);
+                break;
+
+            default:
+                if ((unsigned char)*s < 0x20) {
+                    fprintf(fp, "\\u%04x", *s);
+                }
+                else {
+                    fputc(*s, fp);
+                }
+        }
+    }
+
+    fputc('"', fp);
+}
+
+/* hand a record to every sink that wants it */
+static void opendcp_log_dispatch(opendcp_log_record_t *record) {
+    char line[OPENDCP_LOG_LINE_SIZE];
+    char timestamp[30];
+    int  x, pad;
+
+    if (record->level <= json_level && json_fp) {
+        opendcp_log_timestamp(record->time, "%Y-%m-%dT%H:%M:%S", timestamp);
+        fprintf(json_fp, "{\"time\":\"%s\",\"level\":\"%s\",\"file\":", timestamp, OPENDCP_LOGLEVEL_NAME[record->level]);
+        opendcp_log_json_string(json_fp, record->file);
+        fprintf(json_fp, ",\"line\":%d,\"function\":", record->line);
+        opendcp_log_json_string(json_fp, record->function);
+        fputs(",\"message\":", json_fp);
+        opendcp_log_json_string(json_fp, record->msg);
+        fputs("}\n", json_fp);
+    }
+
+    for (x = 0; x < subscriber_count; x++) {
+        if (record->level <= subscribers[x].level) {
+            break;
+        }
+    }
+
+    if (x == subscriber_count) {
+        return;
+    }
+
+    pad = 40 - strlen(record->file) - 4;
+    snprintf(line, sizeof(line), "%s | %5s | %s:%-4d %*s | %-30s | %s",
+             opendcp_log_timestamp(record->time, "%Y%m%d%I%M%S", timestamp), OPENDCP_LOGLEVEL_NAME[record->level],
+             record->file, record->line, pad, "", record->function, record->msg);
+
+    for (; x < subscriber_count; x++) {
+        if (record->level <= subscribers[x].level) {
+            subscribers[x].callback(subscribers[x].argument, line);
+        }
+    }
+}
+
+#ifdef OPENDCP_LOG_ASYNC
+/* claim a free ring slot, returns NULL if the ring is full */
+static opendcp_log_slot_t *opendcp_log_ring_claim(unsigned int *pos) {
+    opendcp_log_slot_t *slot;
+    unsigned int seq;
+    int dif;
+
+    /* acquire, so a producer that finds the ring closed also sees it stopped */
+    *pos = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        slot = &ring[*pos & (OPENDCP_LOG_RING_SIZE - 1)];
+        seq  = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        dif  = (int)(seq - *pos);
+
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&ring_tail, pos, *pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_ACQUIRE)) {
+                return slot;
+            }
+        }
+        else if (dif < 0) {
+            return NULL;
+        }
+        else {
+            *pos = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+        }
+    }
+}
+
+/* dispatch everything currently in the ring, returns the number of records */
+static int opendcp_log_ring_drain() {
+    opendcp_log_slot_t *slot;
+    unsigned int dropped;
+    int count = 0;
+
+    for (;;) {
+        slot = &ring[ring_head & (OPENDCP_LOG_RING_SIZE - 1)];
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != ring_head + 1) {
+            break;
+        }
+
+        opendcp_log_dispatch(&slot->record);
+        __atomic_store_n(&slot->seq, ring_head + OPENDCP_LOG_RING_SIZE, __ATOMIC_RELEASE);
+        ring_head++;
+        count++;
+    }
+
+    dropped = __atomic_exchange_n(&ring_dropped, 0, __ATOMIC_RELAXED);
+
+    if (dropped) {
+        opendcp_log_record_t record;
+
+        memset(&record, 0, sizeof(record));
+        record.level    = LOG_WARN;
+        record.file     = BASE_FILE;
+        record.function = __func__;
+        record.line     = __LINE__;
+        record.time     = time(NULL);
+        snprintf(record.msg, sizeof(record.msg), "log ring full, %u messages dropped", dropped);
+        opendcp_log_dispatch(&record);
+    }
+
+    if (count && json_fp) {
+        fflush(json_fp);
+    }
+
+    return count;
+}
+
+/* single writer thread, drains the ring until it is closed and every claimed slot is written */
+static void *opendcp_log_writer(void *arg) {
+    UNUSED(arg);
+
+    while (!__atomic_load_n(&ring_stop, __ATOMIC_ACQUIRE) || ring_head != ring_end) {
+        if (!opendcp_log_ring_drain()) {
+            usleep(OPENDCP_LOG_IDLE_USEC);
+        }
+    }
+
+    return NULL;
+}
+#endif
+
 void opendcp_log(int level, const char *file, const char *function, int line,  const char *fmt, ...) {
-    char msg[255];
+    static OPENDCP_TLS opendcp_log_record_t local;
+    opendcp_log_record_t *record = &local;
     va_list vl;
-    va_start(vl, fmt);
-    int x, pad;
+#ifdef OPENDCP_LOG_ASYNC
+    opendcp_log_slot_t *slot = NULL;
+    unsigned int pos = 0;
+#endif
 
-    pad = 40 - strlen(file) - 4;
-    snprintf(msg, sizeof(msg), "%s | %5s | %s:%-4d %*s | %-30s | ", opendcp_log_timestamp(), OPENDCP_LOGLEVEL_NAME[level], file, line, pad, "", function);
-    vsnprintf(msg + strlen(msg), sizeof(msg) - strlen(msg), fmt, vl);
-    va_end(vl);
+    /* nobody listens, skip the formatting */
+    if (level > log_level_max || level <= LOG_NONE) {
+        return;
+    }
 
-    for (x = 0; x < subscriber_count; x++) {
-        if (level <= subscribers[x].level) {
-            subscribers[x].callback(subscribers[x].argument, msg);
+#ifdef OPENDCP_LOG_ASYNC
+    if (__atomic_load_n(&ring_running, __ATOMIC_ACQUIRE)) {
+        /* errors and warnings wait for room, chatter is dropped */
+        while ((slot = opendcp_log_ring_claim(&pos)) == NULL) {
+            /* the ring was closed, a closed ring looks full */
+            if (!__atomic_load_n(&ring_running, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+
+            if (level > LOG_WARN) {
+                __atomic_add_fetch(&ring_dropped, 1, __ATOMIC_RELAXED);
+                return;
+            }
+
+            usleep(OPENDCP_LOG_IDLE_USEC);
+        }
+
+        if (slot) {
+            record = &slot->record;
         }
     }
+#endif
+
+    record->level    = level;
+    record->file     = file;
+    record->function = function;
+    record->line     = line;
+    record->time     = time(NULL);
+
+    va_start(vl, fmt);
+    vsnprintf(record->msg, sizeof(record->msg), fmt, vl);
+    va_end(vl);
+
+#ifdef OPENDCP_LOG_ASYNC
+    if (slot) {
+        __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    }
+    else {
+        opendcp_log_dispatch(record);
+    }
+#else
+    opendcp_log_dispatch(record);
+#endif
+}
+
+/**
+check if a log level has any listener
+
+@param  level the log level
+@return 1 if a message at the level would be written, otherwise 0
+*/
+int opendcp_log_enabled(int level) {
+    return level > LOG_NONE && level <= log_level_max;
 }
 
 void opendcp_log_subscribe(opendcp_log_cb_t *cb) {
@@ -64,18 +337,115 @@ void opendcp_log_subscribe(opendcp_log_cb_t *cb) {
     }
 
     subscribers[subscriber_count++] = *cb;
+
+    if (cb->level > log_level_max) {
+        log_level_max = cb->level;
+    }
 }
 
-char *opendcp_log_timestamp() {
-    time_t time_ptr;
-    struct tm *time_struct;
-    static char buffer[30];
+/**
+write log messages as json lines
 
-    time(&time_ptr);
-    time_struct = localtime(&time_ptr);
-    strftime(buffer, 30, "%Y%m%d%I%M%S", time_struct);
+Each message is written as one JSON object per line with the time, level,
+source location and message text as separate fields.
 
-    return buffer;
+@param  level the highest log level to write
+@param  filename the file to append to, "-" for stdout
+@return OPENDCP_ERROR_CODE
+*/
+int opendcp_log_json(int level, const char *filename) {
+    FILE *fp;
+
+    if (!strcmp(filename, "-")) {
+        fp = stdout;
+    }
+    else {
+        fp = fopen(filename, "a");
+    }
+
+    if (!fp) {
+        OPENDCP_LOG(LOG_ERROR, "could not open json log file %s", filename);
+        return OPENDCP_ERROR;
+    }
+
+    json_fp    = fp;
+    json_level = level;
+
+    if (level > log_level_max) {
+        log_level_max = level;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+/**
+start the asynchronous log writer
+
+Messages are formatted by the calling thread into a lock-free ring and
+written to the sinks by a single writer thread, so subscribers are no
+longer called from worker threads. Call after the sinks are registered.
+The ring is flushed at exit. Not available in msvc builds, where logging
+stays synchronous.
+
+@return OPENDCP_ERROR_CODE
+*/
+int opendcp_log_async_start() {
+#ifdef OPENDCP_LOG_ASYNC
+    int x;
+
+    if (ring_running) {
+        return OPENDCP_NO_ERROR;
+    }
+
+    for (x = 0; x < OPENDCP_LOG_RING_SIZE; x++) {
+        ring[x].seq = x;
+    }
+
+    ring_head = ring_tail = 0;
+    ring_stop = 0;
+
+    if (pthread_create(&ring_writer, NULL, opendcp_log_writer, NULL)) {
+        OPENDCP_LOG(LOG_WARN, "could not start log writer, logging synchronously");
+        return OPENDCP_ERROR;
+    }
+
+    __atomic_store_n(&ring_running, 1, __ATOMIC_SEQ_CST);
+    atexit(opendcp_log_async_stop);
+
+    return OPENDCP_NO_ERROR;
+#else
+    return OPENDCP_ERROR;
+#endif
+}
+
+/**
+stop the asynchronous log writer
+
+Closes the ring to new messages and waits for the writer thread to write
+every slot claimed before that. Logging continues synchronously afterwards.
+
+@return NONE
+*/
+void opendcp_log_async_stop() {
+#ifdef OPENDCP_LOG_ASYNC
+    if (!__atomic_load_n(&ring_running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    __atomic_store_n(&ring_running, 0, __ATOMIC_RELEASE);
+
+    /* move the tail a whole ring ahead, a producer that has not claimed its slot yet
+       then finds the ring full, sees it is no longer running and logs synchronously */
+    ring_end = __atomic_fetch_add(&ring_tail, OPENDCP_LOG_RING_SIZE, __ATOMIC_ACQ_REL);
+
+    /* the writer stops once the slot sequence catches up with the last claimed slot */
+    __atomic_store_n(&ring_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(ring_writer, NULL);
+
+    if (json_fp) {
+        fflush(json_fp);
+    }
+#endif
 }
 
 void opendcp_log_init(int level) {
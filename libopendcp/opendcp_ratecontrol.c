@@ -0,0 +1,379 @@
+/*
+     OpenDCP: Builds Digital Cinema Packages
+     Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+     This program is free software: you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published by
+     the Free Software Foundation, either version 3 of the License, or
+     (at your option) any later version.
+
+     This program is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     GNU General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "opendcp.h"
+#include "opendcp_image.h"
+
+/* analysis samples every Nth pixel of every Nth line */
+#define RATECONTROL_STEP        4
+
+/* frames analyzed, every Nth frame is decoded and the rest interpolated */
+#define RATECONTROL_FRAME_STEP  8
+
+/* the smallest budget a frame gets, as a fraction of the average */
+#define RATECONTROL_FLOOR       0.25
+
+#define RATECONTROL_ITERATIONS  64
+
+/* budget of the frame the calling thread is encoding, 0 when not rate controlled */
+static OPENDCP_TLS long long rate_frame_bytes;
+
+/* bytes per frame for a bit rate */
+static long long ratecontrol_frame_bytes(opendcp_t *opendcp, int bw) {
+    long long bytes = (long long)bw / 8 / opendcp->frame_rate;
+
+    /* each eye gets half */
+    if (opendcp->stereoscopic) {
+        bytes = bytes / 2;
+    }
+
+    return bytes;
+}
+
+/**
+create a rate controller for a reel
+
+The controller holds a complexity estimate, a byte budget and the achieved
+size of every frame. When target_bw is 0 frames are not budgeted and only
+the achieved sizes are recorded. Only every analyze_step frame needs to be
+analyzed, the others are interpolated.
+
+@param  opendcp the opendcp context, frame_rate, stereoscopic and j2k.bw are used
+@param  start the first frame index (zero based)
+@param  nframes the number of frames
+@param  target_bw the average bit rate to aim for in bits per second, 0 to disable
+@return opendcp_ratecontrol_t pointer, NULL on failure
+*/
+opendcp_ratecontrol_t *opendcp_ratecontrol_create(opendcp_t *opendcp, int start, int nframes, int target_bw) {
+    opendcp_ratecontrol_t *rc;
+    int bw, i;
+
+    if (nframes < 1 || opendcp->frame_rate < 1) {
+        return NULL;
+    }
+
+    rc = malloc(sizeof(opendcp_ratecontrol_t));
+
+    if (!rc) {
+        return NULL;
+    }
+
+    memset(rc, 0, sizeof(opendcp_ratecontrol_t));
+
+    rc->complexity = calloc(nframes, sizeof(*rc->complexity));
+    rc->budget     = calloc(nframes, sizeof(*rc->budget));
+    rc->achieved   = calloc(nframes, sizeof(*rc->achieved));
+
+    if (!rc->complexity || !rc->budget || !rc->achieved) {
+        opendcp_ratecontrol_free(rc);
+        return NULL;
+    }
+
+    /* nothing is known until a frame is analyzed */
+    for (i = 0; i < nframes; i++) {
+        rc->complexity[i] = -1.0;
+    }
+
+    bw = opendcp->j2k.bw ? opendcp->j2k.bw : MAX_DCP_JPEG_BITRATE;
+
+    if (target_bw > bw) {
+        target_bw = bw;
+    }
+
+    rc->start         = start;
+    rc->nframes       = nframes;
+    rc->frame_rate    = opendcp->frame_rate;
+    rc->analyze_step  = RATECONTROL_FRAME_STEP;
+    rc->eyes          = opendcp->stereoscopic ? 2 : 1;
+    rc->ceiling_bytes = ratecontrol_frame_bytes(opendcp, bw);
+    rc->target_bytes  = target_bw > 0 ? ratecontrol_frame_bytes(opendcp, target_bw) : 0;
+
+    return rc;
+}
+
+/**
+free a rate controller
+
+@param  rc a rate controller
+@return NONE
+*/
+void opendcp_ratecontrol_free(opendcp_ratecontrol_t *rc) {
+    if (rc == NULL) {
+        return;
+    }
+
+    if (rc->complexity) {
+        free(rc->complexity);
+    }
+
+    if (rc->budget) {
+        free(rc->budget);
+    }
+
+    if (rc->achieved) {
+        free(rc->achieved);
+    }
+
+    free(rc);
+}
+
+/* sample of component c at x,y on a 12 bit scale */
+static inline int ratecontrol_sample(opendcp_image_t *image, int c, int x, int y) {
+    int i = y * image->w + x;
+
+    if (image->use_float) {
+        return (int)(image->component[c].float_data[i] * 4095.0f);
+    }
+
+    return image->component[c].data[i];
+}
+
+/**
+estimate the coding complexity of a frame
+
+The estimate is the mean log magnitude of the horizontal and vertical
+gradients on a sparse grid, which follows the size of the wavelet high
+pass bands closely enough to share a bit budget between frames.
+
+@param  rc a rate controller
+@param  frame the frame index (zero based)
+@param  file the image file of the frame
+@return OPENDCP_ERROR value
+*/
+int opendcp_ratecontrol_analyze(opendcp_ratecontrol_t *rc, int frame, char *file) {
+    opendcp_image_t *image = NULL;
+    double activity = 0.0;
+    long samples = 0;
+    int c, x, y, d;
+
+    if (rc == NULL || frame < rc->start || frame >= rc->start + rc->nframes) {
+        return OPENDCP_ERROR;
+    }
+
+    if (read_image(&image, file) != OPENDCP_NO_ERROR || !image) {
+        OPENDCP_LOG(LOG_WARN, "rate control could not analyze %s", file);
+        rc->complexity[frame - rc->start] = -1.0;
+        return OPENDCP_ERROR;
+    }
+
+    for (c = 0; c < image->n_components; c++) {
+        for (y = RATECONTROL_STEP; y < image->h; y += RATECONTROL_STEP) {
+            for (x = RATECONTROL_STEP; x < image->w; x += RATECONTROL_STEP) {
+                d = ratecontrol_sample(image, c, x, y);
+                d = abs(d - ratecontrol_sample(image, c, x - 1, y)) + abs(d - ratecontrol_sample(image, c, x, y - 1));
+                activity += log2(1.0 + d);
+                samples++;
+            }
+        }
+    }
+
+    rc->complexity[frame - rc->start] = samples ? activity / samples : 0.0;
+
+    OPENDCP_LOG(LOG_DEBUG, "frame %d complexity %f", frame, rc->complexity[frame - rc->start]);
+
+    opendcp_image_release(image);
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* total bytes of the budgets for scale s */
+static double ratecontrol_total(opendcp_ratecontrol_t *rc, double s, double floor_bytes) {
+    double total = 0.0, b;
+    int i;
+
+    for (i = 0; i < rc->nframes; i++) {
+        b = s * rc->complexity[i];
+        b = b < floor_bytes ? floor_bytes : b;
+        b = b > rc->ceiling_bytes ? rc->ceiling_bytes : b;
+        total += b;
+    }
+
+    return total;
+}
+
+/* fill in the frames without an estimate from their analyzed neighbours */
+static void ratecontrol_interpolate(opendcp_ratecontrol_t *rc, double mean) {
+    int i, prev = -1, next;
+
+    for (i = 0; i < rc->nframes; i++) {
+        if (rc->complexity[i] >= 0.0) {
+            prev = i;
+            continue;
+        }
+
+        for (next = i + 1; next < rc->nframes && rc->complexity[next] < 0.0; next++);
+
+        if (prev < 0 && next >= rc->nframes) {
+            rc->complexity[i] = mean;
+        } else if (prev < 0) {
+            rc->complexity[i] = rc->complexity[next];
+        } else if (next >= rc->nframes) {
+            rc->complexity[i] = rc->complexity[prev];
+        } else {
+            rc->complexity[i] = rc->complexity[prev] +
+                                (rc->complexity[next] - rc->complexity[prev]) * (i - prev) / (next - prev);
+        }
+    }
+}
+
+/**
+share the reel byte budget between the analyzed frames
+
+Every frame gets a budget proportional to its complexity, clamped between
+a floor and the DCI ceiling, scaled so the reel averages the target rate.
+Frames that were skipped or could not be analyzed take the complexity
+interpolated between the nearest analyzed frames on either side.
+
+@param  rc a rate controller
+@return NONE
+*/
+void opendcp_ratecontrol_allocate(opendcp_ratecontrol_t *rc) {
+    double mean = 0.0, lo, hi, s, want, floor_bytes;
+    int i, analyzed = 0;
+
+    if (rc == NULL || !rc->target_bytes) {
+        return;
+    }
+
+    for (i = 0; i < rc->nframes; i++) {
+        if (rc->complexity[i] >= 0.0) {
+            mean += rc->complexity[i];
+            analyzed++;
+        }
+    }
+
+    mean = analyzed ? mean / analyzed : 0.0;
+
+    ratecontrol_interpolate(rc, mean);
+
+    /* nothing to go by, every frame gets the average */
+    if (mean <= 0.0) {
+        for (i = 0; i < rc->nframes; i++) {
+            rc->budget[i] = rc->target_bytes;
+        }
+
+        return;
+    }
+
+    want        = (double)rc->target_bytes * rc->nframes;
+    floor_bytes = rc->target_bytes * RATECONTROL_FLOOR;
+
+    /* the clamped total grows with the scale, search for the one that meets the target */
+    lo = 0.0;
+    hi = rc->ceiling_bytes / mean;
+
+    while (ratecontrol_total(rc, hi, floor_bytes) < want && hi < 1e12) {
+        hi *= 2.0;
+    }
+
+    for (i = 0; i < RATECONTROL_ITERATIONS; i++) {
+        s = (lo + hi) / 2.0;
+
+        if (ratecontrol_total(rc, s, floor_bytes) < want) {
+            lo = s;
+        } else {
+            hi = s;
+        }
+    }
+
+    for (i = 0; i < rc->nframes; i++) {
+        s = lo * rc->complexity[i];
+        s = s < floor_bytes ? floor_bytes : s;
+        s = s > rc->ceiling_bytes ? rc->ceiling_bytes : s;
+        rc->budget[i] = (long long)s;
+    }
+
+    OPENDCP_LOG(LOG_INFO, "rate control allocated %d frames, average %lld bytes, ceiling %lld bytes",
+                rc->nframes, rc->target_bytes, rc->ceiling_bytes);
+}
+
+/**
+mark the start of encoding a frame on the calling thread
+
+The frame's budget is made available to the encoder through
+opendcp_ratecontrol_frame_bytes().
+
+@param  rc a rate controller, may be NULL
+@param  frame the frame index (zero based), negative if unknown
+@return NONE
+*/
+void opendcp_ratecontrol_begin(opendcp_ratecontrol_t *rc, int frame) {
+    rate_frame_bytes = 0;
+
+    if (rc && frame >= rc->start && frame < rc->start + rc->nframes) {
+        rate_frame_bytes = rc->budget[frame - rc->start];
+    }
+}
+
+/**
+record the codestream size of a frame
+
+@param  rc a rate controller, may be NULL
+@param  frame the frame index (zero based), negative if unknown
+@param  bytes the size of the codestream
+@return NONE
+*/
+void opendcp_ratecontrol_end(opendcp_ratecontrol_t *rc, int frame, long long bytes) {
+    rate_frame_bytes = 0;
+
+    if (rc && frame >= rc->start && frame < rc->start + rc->nframes) {
+        rc->achieved[frame - rc->start] = bytes;
+    }
+}
+
+/**
+get the byte budget of the frame the calling thread is encoding
+
+@return the budget in bytes, 0 if the frame is not rate controlled
+*/
+long long opendcp_ratecontrol_frame_bytes() {
+    return rate_frame_bytes;
+}
+
+/**
+get the achieved bit rates of a reel
+
+The rates are of the whole picture track, in stereoscopic both eyes of an
+edit unit are counted, each at the rate of the codestreams measured.
+
+@param  rc a rate controller
+@param  frames receives the number of encoded codestreams
+@param  average_bw receives the average bit rate in bits per second
+@param  peak_bw receives the bit rate of the largest frame in bits per second
+@return NONE
+*/
+void opendcp_ratecontrol_stats(opendcp_ratecontrol_t *rc, int *frames, double *average_bw, double *peak_bw) {
+    long long total = 0, peak = 0;
+    int i, n = 0;
+
+    for (i = 0; rc && i < rc->nframes; i++) {
+        if (rc->achieved[i] > 0) {
+            total += rc->achieved[i];
+            peak   = rc->achieved[i] > peak ? rc->achieved[i] : peak;
+            n++;
+        }
+    }
+
+    *frames     = n;
+    *average_bw = n ? (double)total * 8 * rc->frame_rate * rc->eyes / n : 0.0;
+    *peak_bw    = rc ? (double)peak * 8 * rc->frame_rate * rc->eyes : 0.0;
+}
@@ -0,0 +1,506 @@
+/*
+     OpenDCP: Builds Digital Cinema Packages
+     Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+     This program is free software: you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published by
+     the Free Software Foundation, either version 3 of the License, or
+     (at your option) any later version.
+
+     This program is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     GNU General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include "opendcp.h"
+
+#define STATE_MAGIC    "OPENDCP_STATE 2"
+#define STATE_FIELDS   19
+#define STATE_LINE_MAX (MAX_FILENAME_LENGTH + 1024)
+
+/* sub-second file times, where the platform keeps them */
+#if defined(__APPLE__)
+#define STATE_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#define STATE_CTIME_NSEC(st) ((st).st_ctimespec.tv_nsec)
+#elif defined(_WIN32)
+#define STATE_MTIME_NSEC(st) 0
+#define STATE_CTIME_NSEC(st) 0
+#else
+#define STATE_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#define STATE_CTIME_NSEC(st) ((st).st_ctim.tv_nsec)
+#endif
+
+typedef struct {
+    long long size;
+    long long mtime;
+    long long ctime;
+    long long inode;
+} state_stat_t;
+
+/* the file a state entry was made from, 0 if it can not be read */
+static int state_stat(const char *filename, state_stat_t *s) {
+    struct stat st;
+
+    if (stat(filename, &st)) {
+        return 0;
+    }
+
+    s->size  = (long long)st.st_size;
+    s->mtime = (long long)st.st_mtime * 1000000000LL + STATE_MTIME_NSEC(st);
+    s->ctime = (long long)st.st_ctime * 1000000000LL + STATE_CTIME_NSEC(st);
+    s->inode = (long long)st.st_ino;
+
+    return 1;
+}
+
+/* an entry still describes the file when nothing about it changed, and it
+   was not written in the second the entry was taken, where a coarse clock
+   could hide a later rewrite */
+static int state_fresh(opendcp_state_entry_t *e, state_stat_t *s) {
+    return e->size == s->size && e->mtime == s->mtime && e->ctime == s->ctime && e->inode == s->inode &&
+           s->mtime / 1000000000LL < e->recorded && s->ctime / 1000000000LL < e->recorded;
+}
+
+/* FNV-1a of a filename */
+static unsigned int state_hash(const char *filename) {
+    unsigned int h = 2166136261u;
+
+    while (*filename) {
+        h = (h ^ (unsigned char)*filename++) * 16777619u;
+    }
+
+    return h;
+}
+
+/* slot of a filename in the index, either its entry or the empty slot it goes in */
+static int state_slot(opendcp_state_t *state, const char *filename) {
+    int i = state_hash(filename) & (state->index_size - 1);
+
+    while (state->index[i] && strcmp(state->entries[state->index[i] - 1].asset.filename, filename)) {
+        i = (i + 1) & (state->index_size - 1);
+    }
+
+    return i;
+}
+
+/* rebuild the index at twice the entries it has to hold */
+static int state_reindex(opendcp_state_t *state, int size) {
+    int *index, i;
+
+    index = calloc(size, sizeof(*index));
+
+    if (!index) {
+        return OPENDCP_ERROR;
+    }
+
+    free(state->index);
+    state->index      = index;
+    state->index_size = size;
+
+    for (i = 0; i < state->count; i++) {
+        state->index[state_slot(state, state->entries[i].asset.filename)] = i + 1;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+static opendcp_state_entry_t *state_find(opendcp_state_t *state, const char *filename) {
+    int i;
+
+    if (!state->index_size) {
+        return NULL;
+    }
+
+    i = state_slot(state, filename);
+
+    return state->index[i] ? &state->entries[state->index[i] - 1] : NULL;
+}
+
+static opendcp_state_entry_t *state_add(opendcp_state_t *state, const char *filename) {
+    opendcp_state_entry_t *tmp;
+    int n;
+
+    /* keep the index at most half full */
+    if ((state->count + 1) * 2 > state->index_size &&
+        state_reindex(state, state->index_size ? state->index_size * 2 : 64) != OPENDCP_NO_ERROR) {
+        return NULL;
+    }
+
+    if (state->count == state->capacity) {
+        n   = state->capacity ? state->capacity * 2 : 16;
+        tmp = realloc(state->entries, n * sizeof(*state->entries));
+
+        if (!tmp) {
+            return NULL;
+        }
+
+        state->entries  = tmp;
+        state->capacity = n;
+    }
+
+    tmp = &state->entries[state->count++];
+    memset(tmp, 0, sizeof(*tmp));
+    snprintf(tmp->asset.filename, sizeof(tmp->asset.filename), "%s", filename);
+    state->index[state_slot(state, tmp->asset.filename)] = state->count;
+
+    return tmp;
+}
+
+/* split the next tab separated field off a line, empty fields are written as - */
+static char *state_field(char **line) {
+    char *field = *line;
+    char *end;
+
+    if (field == NULL) {
+        return NULL;
+    }
+
+    end = field + strcspn(field, "\t\r\n");
+
+    if (*end == '\t') {
+        *line = end + 1;
+    }
+    else {
+        *line = NULL;
+    }
+
+    *end = '\0';
+
+    return strcmp(field, "-") ? field : "";
+}
+
+static void state_copy(char *dst, size_t size, const char *src) {
+    snprintf(dst, size, "%s", src);
+}
+
+static int state_parse(opendcp_state_t *state, char *line) {
+    opendcp_state_entry_t e, *added;
+    char *f[STATE_FIELDS];
+    int i;
+
+    for (i = 0; i < STATE_FIELDS; i++) {
+        if ((f[i] = state_field(&line)) == NULL) {
+            return OPENDCP_ERROR;
+        }
+    }
+
+    memset(&e, 0, sizeof(e));
+    e.size                     = atoll(f[0]);
+    e.mtime                    = atoll(f[1]);
+    e.ctime                    = atoll(f[2]);
+    e.inode                    = atoll(f[3]);
+    e.recorded                 = atoll(f[4]);
+    state_copy(e.asset.uuid, sizeof(e.asset.uuid), f[5]);
+    e.asset.essence_class      = atoi(f[6]);
+    e.asset.essence_type       = atoi(f[7]);
+    e.asset.intrinsic_duration = atoi(f[8]);
+    e.asset.xml_ns             = atoi(f[9]);
+    e.asset.stereoscopic       = atoi(f[10]);
+    e.asset.encrypted          = atoi(f[11]);
+    state_copy(e.asset.key_id,       sizeof(e.asset.key_id),       f[12]);
+    state_copy(e.asset.edit_rate,    sizeof(e.asset.edit_rate),    f[13]);
+    state_copy(e.asset.frame_rate,   sizeof(e.asset.frame_rate),   f[14]);
+    state_copy(e.asset.sample_rate,  sizeof(e.asset.sample_rate),  f[15]);
+    state_copy(e.asset.aspect_ratio, sizeof(e.asset.aspect_ratio), f[16]);
+    state_copy(e.asset.digest,       sizeof(e.asset.digest),       f[17]);
+    state_copy(e.asset.filename,     sizeof(e.asset.filename),     f[18]);
+
+    if (!strlen(e.asset.filename) || !strlen(e.asset.uuid) || state_find(state, e.asset.filename)) {
+        return OPENDCP_ERROR;
+    }
+
+    if ((added = state_add(state, e.asset.filename)) == NULL) {
+        return OPENDCP_ERROR;
+    }
+
+    *added = e;
+
+    return OPENDCP_NO_ERROR;
+}
+
+/**
+open a package state file
+
+The state file records the track file information and digest of every
+asset of a package, together with the size, modification and change times
+and inode of the file they were taken from. A missing file, or one from an
+older version, gives an empty state.
+
+@param  path the state file
+@return opendcp_state_t pointer, NULL on failure
+*/
+opendcp_state_t *opendcp_state_open(const char *path) {
+    opendcp_state_t *state;
+    char *line;
+    FILE *fp;
+
+    if (path == NULL) {
+        return NULL;
+    }
+
+    state = malloc(sizeof(opendcp_state_t));
+
+    if (!state) {
+        return NULL;
+    }
+
+    memset(state, 0, sizeof(opendcp_state_t));
+    snprintf(state->path, sizeof(state->path), "%s", path);
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        OPENDCP_LOG(LOG_DEBUG, "no package state in %s, starting a new one", path);
+        return state;
+    }
+
+    line = malloc(STATE_LINE_MAX);
+
+    if (!line) {
+        fclose(fp);
+        free(state);
+        return NULL;
+    }
+
+    if (fgets(line, STATE_LINE_MAX, fp) == NULL || strncmp(line, STATE_MAGIC, strlen(STATE_MAGIC))) {
+        if (!feof(fp) && !strncmp(line, STATE_MAGIC, strlen(STATE_MAGIC) - 1)) {
+            OPENDCP_LOG(LOG_INFO, "%s is from an older version, assets will be read again", path);
+        }
+        else {
+            OPENDCP_LOG(LOG_WARN, "%s is not a package state file, it will be rewritten", path);
+        }
+
+        state->dirty = 1;
+    }
+    else {
+        while (fgets(line, STATE_LINE_MAX, fp)) {
+            if (state_parse(state, line) != OPENDCP_NO_ERROR) {
+                state->dirty = 1;
+            }
+        }
+    }
+
+    free(line);
+    fclose(fp);
+
+    OPENDCP_LOG(LOG_DEBUG, "package state %s opened, %d assets", path, state->count);
+
+    return state;
+}
+
+static const char *state_value(const char *s) {
+    return strlen(s) ? s : "-";
+}
+
+/**
+write a package state file
+
+The file is written next to the old one and renamed over it, so an
+interrupted run leaves the previous state intact.
+
+@param  state a package state
+@return OPENDCP_ERROR value
+*/
+int opendcp_state_save(opendcp_state_t *state) {
+    char tmp[MAX_FILENAME_LENGTH + 8];
+    opendcp_state_entry_t *e;
+    FILE *fp;
+    int i;
+
+    if (state == NULL || !state->dirty) {
+        return OPENDCP_NO_ERROR;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", state->path);
+
+    if ((fp = fopen(tmp, "w")) == NULL) {
+        OPENDCP_LOG(LOG_ERROR, "could not write package state %s", tmp);
+        return OPENDCP_FILEOPEN;
+    }
+
+    fprintf(fp, "%s\n", STATE_MAGIC);
+
+    for (i = 0; i < state->count; i++) {
+        e = &state->entries[i];
+
+        /* tabs and line breaks are the separators */
+        if (strpbrk(e->asset.filename, "\t\r\n")) {
+            continue;
+        }
+
+        fprintf(fp, "%lld\t%lld\t%lld\t%lld\t%lld\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n",
+                e->size, e->mtime, e->ctime, e->inode, e->recorded, state_value(e->asset.uuid),
+                e->asset.essence_class, e->asset.essence_type, e->asset.intrinsic_duration,
+                e->asset.xml_ns, e->asset.stereoscopic, e->asset.encrypted,
+                state_value(e->asset.key_id), state_value(e->asset.edit_rate),
+                state_value(e->asset.frame_rate), state_value(e->asset.sample_rate),
+                state_value(e->asset.aspect_ratio), state_value(e->asset.digest),
+                e->asset.filename);
+    }
+
+    if (fclose(fp)) {
+        remove(tmp);
+        OPENDCP_LOG(LOG_ERROR, "could not write package state %s", tmp);
+        return OPENDCP_ERROR;
+    }
+
+#ifdef _WIN32
+    remove(state->path);
+#endif
+
+    if (rename(tmp, state->path)) {
+        remove(tmp);
+        OPENDCP_LOG(LOG_ERROR, "could not replace package state %s", state->path);
+        return OPENDCP_ERROR;
+    }
+
+    state->dirty = 0;
+
+    return OPENDCP_NO_ERROR;
+}
+
+/**
+close a package state
+
+@param  state a package state
+@return NONE
+*/
+void opendcp_state_close(opendcp_state_t *state) {
+    if (state == NULL) {
+        return;
+    }
+
+    OPENDCP_LOG(LOG_INFO, "package state: %d assets reused, %d read", state->hits, state->misses);
+
+    if (state->entries) {
+        free(state->entries);
+    }
+
+    free(state->index);
+    free(state);
+}
+
+/**
+fill in an asset from the package state
+
+The asset filename must be set. When the file has the size, modification
+and change times and inode that were recorded, the track file information
+and digest are copied into the asset and the file does not need to be
+opened. A file written in the same second its entry was taken is always
+read again.
+
+@param  state a package state
+@param  asset the asset to fill in
+@return OPENDCP_NO_ERROR if the asset was found unchanged, OPENDCP_ERROR otherwise
+*/
+int opendcp_state_lookup(opendcp_state_t *state, asset_t *asset) {
+    opendcp_state_entry_t *e;
+    state_stat_t st;
+
+    if (state == NULL) {
+        return OPENDCP_ERROR;
+    }
+
+    e = state_find(state, asset->filename);
+
+    if (e == NULL || !state_stat(asset->filename, &st) || !state_fresh(e, &st)) {
+        state->misses++;
+        return OPENDCP_ERROR;
+    }
+
+    sprintf(asset->uuid, "%s", e->asset.uuid);
+    asset->essence_class      = e->asset.essence_class;
+    asset->essence_type       = e->asset.essence_type;
+    asset->duration           = e->asset.intrinsic_duration;
+    asset->intrinsic_duration = e->asset.intrinsic_duration;
+    asset->entry_point        = 0;
+    asset->xml_ns             = e->asset.xml_ns;
+    asset->stereoscopic       = e->asset.stereoscopic;
+    asset->encrypted          = e->asset.encrypted;
+    sprintf(asset->key_id, "%s", e->asset.key_id);
+    sprintf(asset->edit_rate, "%s", e->asset.edit_rate);
+    sprintf(asset->frame_rate, "%s", e->asset.frame_rate);
+    sprintf(asset->sample_rate, "%s", e->asset.sample_rate);
+    sprintf(asset->aspect_ratio, "%s", e->asset.aspect_ratio);
+    sprintf(asset->digest, "%s", e->asset.digest);
+
+    state->hits++;
+
+    OPENDCP_LOG(LOG_DEBUG, "package state: %s unchanged", asset->filename);
+
+    return OPENDCP_NO_ERROR;
+}
+
+/**
+record the track file information of an asset
+
+Call with the information as read from the track file, before any
+duration, entry point or aspect ratio overrides. The recorded digest is
+replaced by the asset's, which is normally empty until
+opendcp_state_digest() is called.
+
+@param  state a package state
+@param  asset the asset
+@return OPENDCP_ERROR value
+*/
+int opendcp_state_update(opendcp_state_t *state, asset_t *asset) {
+    opendcp_state_entry_t *e;
+    state_stat_t st;
+
+    if (state == NULL) {
+        return OPENDCP_NO_ERROR;
+    }
+
+    if (!state_stat(asset->filename, &st)) {
+        return OPENDCP_FILEOPEN;
+    }
+
+    e = state_find(state, asset->filename);
+
+    if (e == NULL && (e = state_add(state, asset->filename)) == NULL) {
+        return OPENDCP_ERROR;
+    }
+
+    e->size     = st.size;
+    e->mtime    = st.mtime;
+    e->ctime    = st.ctime;
+    e->inode    = st.inode;
+    e->recorded = (long long)time(NULL);
+    e->asset    = *asset;
+    state->dirty = 1;
+
+    return OPENDCP_NO_ERROR;
+}
+
+/**
+record the digest of an asset
+
+@param  state a package state
+@param  filename the asset filename
+@param  digest the base64 encoded SHA-1 digest
+@return OPENDCP_ERROR value
+*/
+int opendcp_state_digest(opendcp_state_t *state, const char *filename, const char *digest) {
+    opendcp_state_entry_t *e;
+
+    if (state == NULL) {
+        return OPENDCP_NO_ERROR;
+    }
+
+    if ((e = state_find(state, filename)) == NULL) {
+        return OPENDCP_ERROR;
+    }
+
+    snprintf(e->asset.digest, sizeof(e->asset.digest), "%s", digest);
+    state->dirty = 1;
+
+    return OPENDCP_NO_ERROR;
+}
@@ -0,0 +1,648 @@
+/*
+     OpenDCP: Builds Digital Cinema Packages
+     Copyright (c) 2010-2013 Terrence Meiczinger, All Rights Reserved
+
+     This program is free software: you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published by
+     the Free Software Foundation, either version 3 of the License, or
+     (at your option) any later version.
+
+     This program is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     GNU General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+#include <libxml/xmlreader.h>
+
+#include "opendcp.h"
+#include "sha1.h"
+
+/* large reads keep a drive streaming while the digest is computed */
+#define VERIFY_READ_SIZE    (8 * 1024 * 1024)
+
+/* how far the digest reads ahead of the track file checks sharing its pass */
+#define VERIFY_READ_AHEAD   (2 * VERIFY_READ_SIZE)
+
+#define VERIFY_DEVICES_MAX  64
+
+typedef struct {
+    char           uuid[40];
+    char           path[MAX_PATH_LENGTH];
+    int            packing_list;
+} verify_chunk_t;
+
+typedef struct {
+    int            count;
+    verify_chunk_t *chunk;
+} verify_assetmap_t;
+
+typedef struct {
+    const char     *name;
+    char           *value;
+    int            len;
+} verify_field_t;
+
+typedef struct {
+    int            capacity;
+    verify_assetmap_t *map;
+    const char     *path;
+} verify_assetmap_ctx_t;
+
+typedef struct {
+    opendcp_verify_t  *verify;
+    verify_assetmap_t *map;
+} verify_pkl_ctx_t;
+
+typedef struct {
+    opendcp_verify_t *verify;
+    const char     *filename;
+} verify_cpl_ctx_t;
+
+typedef struct {
+    FILE           *fp;
+    unsigned char  *data;
+    sha1_t         sha;
+    long long      size;
+    int            result;
+} verify_digest_t;
+
+typedef int (*verify_record_cb)(void *ctx, verify_field_t *field);
+
+/* copy the text of an element into the first field of that name still unset */
+static void verify_field(xmlTextReaderPtr reader, const char *name, verify_field_t *field, int nfields) {
+    xmlChar *content;
+    int i;
+
+    for (i = 0; i < nfields; i++) {
+        if (field[i].value[0] == '\0' && !strcmp(field[i].name, name)) {
+            break;
+        }
+    }
+
+    if (i == nfields || (content = xmlTextReaderReadString(reader)) == NULL) {
+        return;
+    }
+
+    snprintf(field[i].value, field[i].len, "%s", (const char *)content);
+    xmlFree(content);
+}
+
+/**
+stream a document and hand each record element to a callback
+
+The document is read with an xmlTextReader, so only the current node is held
+in memory. A record is an element reached from the root through path, "*"
+matches any name and namespaces are ignored. The text of the first element
+below a record with a field's name is copied into that field.
+
+@param  filename the document
+@param  root the local name the root element must have
+@param  path local names from below the root down to the record element
+@param  depth number of names in path
+@param  field the fields to fill, cleared for every record
+@param  nfields number of fields
+@param  cb called as each record ends, a non-zero return fails the read
+@param  ctx passed to cb
+@return OPENDCP_ERROR value
+*/
+static int verify_stream_xml(const char *filename, const char *root, const char **path, int depth,
+                             verify_field_t *field, int nfields, verify_record_cb cb, void *ctx) {
+    xmlTextReaderPtr reader;
+    const char *name;
+    int i, d, type, matched = 0, result = OPENDCP_NO_ERROR, status;
+
+    reader = xmlReaderForFile(filename, NULL, XML_PARSE_NONET);
+
+    if (reader == NULL) {
+        OPENDCP_LOG(LOG_ERROR, "could not open %s", filename);
+        return OPENDCP_ERROR;
+    }
+
+    while ((status = xmlTextReaderRead(reader)) == 1) {
+        type = xmlTextReaderNodeType(reader);
+        d    = xmlTextReaderDepth(reader);
+
+        if (type == XML_READER_TYPE_ELEMENT) {
+            name = (const char *)xmlTextReaderConstLocalName(reader);
+
+            /* the wrong root ends the read at its first element */
+            if (d == 0 && strcmp(name, root)) {
+                result = OPENDCP_ERROR;
+                break;
+            }
+
+            if (matched == d && d <= depth && (d == 0 || !strcmp(path[d - 1], "*") || !strcmp(path[d - 1], name))) {
+                matched = d + 1;
+
+                if (d == depth) {
+                    for (i = 0; i < nfields; i++) {
+                        field[i].value[0] = '\0';
+                    }
+                }
+            }
+            else if (matched == depth + 1 && d > depth) {
+                verify_field(reader, name, field, nfields);
+            }
+
+            if (!xmlTextReaderIsEmptyElement(reader)) {
+                continue;
+            }
+        }
+        else if (type != XML_READER_TYPE_END_ELEMENT) {
+            continue;
+        }
+
+        /* an element closes, either its end tag or an empty element */
+        if (d == depth && matched == depth + 1 && cb(ctx, field)) {
+            result = OPENDCP_ERROR;
+            break;
+        }
+
+        if (matched > d) {
+            matched = d;
+        }
+    }
+
+    if (status < 0) {
+        OPENDCP_LOG(LOG_ERROR, "could not parse %s", filename);
+        result = OPENDCP_ERROR;
+    }
+
+    xmlFreeTextReader(reader);
+
+    return result;
+}
+
+/* uuid of an Id element without the urn prefix */
+static void verify_uuid(const char *id, char *uuid) {
+    snprintf(uuid, 40, "%s", strncmp(id, "urn:uuid:", 9) ? id : id + 9);
+}
+
+static int verify_find(opendcp_verify_t *verify, const char *uuid) {
+    int i;
+
+    for (i = 0; i < verify->asset_count; i++) {
+        if (!strcmp(verify->asset[i].uuid, uuid)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int verify_assetmap_asset(void *ctx, verify_field_t *field) {
+    verify_assetmap_ctx_t *c = ctx;
+    verify_assetmap_t *map = c->map;
+    verify_chunk_t *chunk, *tmp;
+
+    if (map->count == c->capacity) {
+        c->capacity = c->capacity ? c->capacity * 2 : 16;
+        tmp = realloc(map->chunk, c->capacity * sizeof(verify_chunk_t));
+
+        if (!tmp) {
+            return 1;
+        }
+
+        map->chunk = tmp;
+    }
+
+    chunk = &map->chunk[map->count++];
+    verify_uuid(field[0].value, chunk->uuid);
+    snprintf(chunk->path, sizeof(chunk->path), "%s/%s", c->path, field[1].value);
+    chunk->packing_list = !strcmp(field[2].value, "true");
+
+    return 0;
+}
+
+static int verify_read_assetmap(const char *path, verify_assetmap_t *map) {
+    static const char *record[] = { "AssetList", "Asset" };
+    char filename[MAX_PATH_LENGTH], id[80], chunk_path[MAX_PATH_LENGTH], flag[16];
+    struct stat st;
+    verify_field_t field[] = {
+        { "Id",          id,         sizeof(id) },
+        { "Path",        chunk_path, sizeof(chunk_path) },
+        { "PackingList", flag,       sizeof(flag) }
+    };
+    verify_assetmap_ctx_t ctx;
+
+    snprintf(filename, sizeof(filename), "%s/ASSETMAP.xml", path);
+
+    if (stat(filename, &st) != 0) {
+        snprintf(filename, sizeof(filename), "%s/ASSETMAP", path);
+    }
+
+    map->count = 0;
+    map->chunk = NULL;
+    ctx.capacity = 0;
+    ctx.map      = map;
+    ctx.path     = path;
+
+    if (verify_stream_xml(filename, "AssetMap", record, 2, field, 3, verify_assetmap_asset, &ctx) != OPENDCP_NO_ERROR) {
+        OPENDCP_LOG(LOG_ERROR, "%s is not an asset map", filename);
+        free(map->chunk);
+        map->chunk = NULL;
+        return OPENDCP_ERROR;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+static const char *verify_path(verify_assetmap_t *map, const char *uuid) {
+    int i;
+
+    for (i = 0; i < map->count; i++) {
+        if (!strcmp(map->chunk[i].uuid, uuid)) {
+            return map->chunk[i].path;
+        }
+    }
+
+    return NULL;
+}
+
+static int verify_pkl_asset(void *ctx, verify_field_t *field) {
+    verify_pkl_ctx_t *c = ctx;
+    opendcp_verify_t *verify = c->verify;
+    opendcp_verify_asset_t *asset, *tmp;
+    const char *path;
+
+    tmp = realloc(verify->asset, (verify->asset_count + 1) * sizeof(opendcp_verify_asset_t));
+
+    if (!tmp) {
+        return 1;
+    }
+
+    verify->asset = tmp;
+    asset = &verify->asset[verify->asset_count];
+    memset(asset, 0, sizeof(opendcp_verify_asset_t));
+
+    verify_uuid(field[0].value, asset->uuid);
+    snprintf(asset->hash, sizeof(asset->hash), "%s", field[1].value);
+    snprintf(asset->type, sizeof(asset->type), "%s", field[2].value);
+
+    /* an asset shared by several packing lists is checked once */
+    if (verify_find(verify, asset->uuid) >= 0) {
+        return 0;
+    }
+
+    path = verify_path(c->map, asset->uuid);
+    snprintf(asset->filename, sizeof(asset->filename), "%s", path ? path : "");
+    asset->size               = atoll(field[3].value);
+    asset->intrinsic_duration = -1;
+    asset->result             = path ? OPENDCP_NO_ERROR : OPENDCP_VERIFY_MISSING;
+    verify->asset_count++;
+
+    return 0;
+}
+
+static int verify_read_pkl(opendcp_verify_t *verify, verify_assetmap_t *map, const char *filename) {
+    static const char *record[] = { "AssetList", "Asset" };
+    char id[80], hash[40], type[64], size[24];
+    verify_field_t field[] = {
+        { "Id",   id,   sizeof(id) },
+        { "Hash", hash, sizeof(hash) },
+        { "Type", type, sizeof(type) },
+        { "Size", size, sizeof(size) }
+    };
+    verify_pkl_ctx_t ctx;
+
+    ctx.verify = verify;
+    ctx.map    = map;
+
+    if (verify_stream_xml(filename, "PackingList", record, 2, field, 4, verify_pkl_asset, &ctx) != OPENDCP_NO_ERROR) {
+        OPENDCP_LOG(LOG_ERROR, "%s is not a packing list", filename);
+        return OPENDCP_ERROR;
+    }
+
+    return OPENDCP_NO_ERROR;
+}
+
+static int verify_cpl_asset(void *ctx, verify_field_t *field) {
+    verify_cpl_ctx_t *c = ctx;
+    opendcp_verify_asset_t *asset;
+    char uuid[40];
+    int i, intrinsic_duration, entry_point, duration;
+
+    verify_uuid(field[0].value, uuid);
+
+    if ((i = verify_find(c->verify, uuid)) < 0) {
+        return 0;
+    }
+
+    asset = &c->verify->asset[i];
+
+    intrinsic_duration = atoi(field[1].value);
+    entry_point = atoi(field[2].value);
+    duration = field[3].value[0] ? atoi(field[3].value) : intrinsic_duration - entry_point;
+
+    if (asset->intrinsic_duration >= 0 && asset->intrinsic_duration != intrinsic_duration) {
+        OPENDCP_LOG(LOG_WARN, "%s has differing intrinsic durations in %s", uuid, c->filename);
+    }
+
+    asset->intrinsic_duration = intrinsic_duration;
+
+    if (entry_point + duration > asset->duration) {
+        asset->duration = entry_point + duration;
+    }
+
+    return 0;
+}
+
+/* record the durations a composition expects of its track files */
+static void verify_read_cpl(opendcp_verify_t *verify, const char *filename) {
+    static const char *record[] = { "ReelList", "Reel", "AssetList", "*" };
+    char id[80], intrinsic_duration[24], entry_point[24], duration[24];
+    verify_field_t field[] = {
+        { "Id",                id,                 sizeof(id) },
+        { "IntrinsicDuration", intrinsic_duration, sizeof(intrinsic_duration) },
+        { "EntryPoint",        entry_point,        sizeof(entry_point) },
+        { "Duration",          duration,           sizeof(duration) }
+    };
+    verify_cpl_ctx_t ctx;
+
+    ctx.verify   = verify;
+    ctx.filename = filename;
+
+    /* subtitles are text/xml as well, their read stops at the root element */
+    verify_stream_xml(filename, "CompositionPlaylist", record, 4, field, 4, verify_cpl_asset, &ctx);
+}
+
+/* group assets by the device they live on, so readers can be spread over drives */
+static void verify_devices(opendcp_verify_t *verify) {
+    dev_t device[VERIFY_DEVICES_MAX];
+    struct stat st;
+    int i, d;
+
+    verify->device_count = 0;
+
+    for (i = 0; i < verify->asset_count; i++) {
+        verify->asset[i].device = 0;
+
+        if (stat(verify->asset[i].filename, &st) != 0) {
+            continue;
+        }
+
+        for (d = 0; d < verify->device_count && device[d] != st.st_dev; d++);
+
+        if (d == verify->device_count && d < VERIFY_DEVICES_MAX) {
+            device[verify->device_count++] = st.st_dev;
+        }
+
+        verify->asset[i].device = d < VERIFY_DEVICES_MAX ? d : 0;
+    }
+
+    if (verify->device_count == 0) {
+        verify->device_count = 1;
+    }
+}
+
+/**
+read the asset map, packing lists and composition playlists of a package
+
+Every asset of every packing list is collected with the hash and size the
+packing list records and, for track files, the durations the composition
+playlists use. Nothing is hashed here, see opendcp_verify_asset().
+
+@param  path the package directory
+@return opendcp_verify_t pointer, NULL on failure
+*/
+opendcp_verify_t *opendcp_verify_open(const char *path) {
+    opendcp_verify_t *verify;
+    verify_assetmap_t map;
+    int i, pkl_count = 0;
+
+    if (verify_read_assetmap(path, &map) != OPENDCP_NO_ERROR) {
+        return NULL;
+    }
+
+    verify = calloc(1, sizeof(opendcp_verify_t));
+
+    if (!verify) {
+        free(map.chunk);
+        return NULL;
+    }
+
+    snprintf(verify->path, sizeof(verify->path), "%s", path);
+
+    for (i = 0; i < map.count; i++) {
+        if (map.chunk[i].packing_list) {
+            if (verify_read_pkl(verify, &map, map.chunk[i].path) != OPENDCP_NO_ERROR) {
+                opendcp_verify_free(verify);
+                free(map.chunk);
+                return NULL;
+            }
+
+            pkl_count++;
+        }
+    }
+
+    free(map.chunk);
+
+    if (pkl_count == 0) {
+        OPENDCP_LOG(LOG_ERROR, "asset map does not list a packing list");
+        opendcp_verify_free(verify);
+        return NULL;
+    }
+
+    for (i = 0; i < verify->asset_count; i++) {
+        if (strstr(verify->asset[i].type, "text/xml") && verify->asset[i].result == OPENDCP_NO_ERROR) {
+            verify_read_cpl(verify, verify->asset[i].filename);
+        }
+    }
+
+    verify_devices(verify);
+
+    OPENDCP_LOG(LOG_INFO, "%d assets in %d packing lists on %d devices", verify->asset_count, pkl_count, verify->device_count);
+
+    return verify;
+}
+
+/**
+free a package verification
+
+@param  verify a package verification
+@return NONE
+*/
+void opendcp_verify_free(opendcp_verify_t *verify) {
+    if (verify == NULL) {
+        return;
+    }
+
+    if (verify->asset) {
+        free(verify->asset);
+    }
+
+    free(verify);
+}
+
+/* start a sha1 of a file, it is read front to back in large blocks */
+static int verify_digest_open(verify_digest_t *d, const char *filename) {
+    memset(d, 0, sizeof(*d));
+
+    d->fp = fopen(filename, "rb");
+
+    if (!d->fp) {
+        return OPENDCP_VERIFY_MISSING;
+    }
+
+    d->data = malloc(VERIFY_READ_SIZE);
+
+    if (!d->data) {
+        fclose(d->fp);
+        return OPENDCP_ERROR;
+    }
+
+    /* the blocks are already large, skip the stdio buffer */
+    setvbuf(d->fp, NULL, _IONBF, 0);
+
+#if !defined(_WIN32) && defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fileno(d->fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    sha1_init(&d->sha);
+
+    return OPENDCP_NO_ERROR;
+}
+
+/* digest the file up to offset, a negative offset reads to the end */
+static int verify_digest_advance(void *ctx, long long offset) {
+    verify_digest_t *d = ctx;
+    size_t n;
+
+    while (d->result == OPENDCP_NO_ERROR && (offset < 0 || d->size < offset)) {
+        n = fread(d->data, 1, VERIFY_READ_SIZE, d->fp);
+
+        if (n == 0) {
+            d->result = ferror(d->fp) ? OPENDCP_FILEOPEN : OPENDCP_NO_ERROR;
+            break;
+        }
+
+        sha1_update(&d->sha, d->data, n);
+        d->size += n;
+    }
+
+    return d->result;
+}
+
+/* read the rest of the file and write the sha1 as base64 */
+static int verify_digest_close(verify_digest_t *d, char *digest, long long *size) {
+    static const char *b64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned char hash[SHA1_BLOCK_SIZE];
+    int i, j, v;
+
+    verify_digest_advance(d, -1);
+
+    free(d->data);
+    fclose(d->fp);
+
+    if (d->result != OPENDCP_NO_ERROR) {
+        return d->result;
+    }
+
+    sha1_final(&d->sha, hash);
+
+    /* 20 bytes encode to 27 characters and one pad */
+    for (i = j = 0; i < SHA1_BLOCK_SIZE; i += 3) {
+        v = hash[i] << 16 | (i + 1 < SHA1_BLOCK_SIZE ? hash[i + 1] << 8 : 0) | (i + 2 < SHA1_BLOCK_SIZE ? hash[i + 2] : 0);
+        digest[j++] = b64[v >> 18 & 63];
+        digest[j++] = b64[v >> 12 & 63];
+        digest[j++] = i + 1 < SHA1_BLOCK_SIZE ? b64[v >> 6 & 63] : '=';
+        digest[j++] = i + 2 < SHA1_BLOCK_SIZE ? b64[v & 63] : '=';
+    }
+
+    digest[j] = '\0';
+    *size = d->size;
+
+    return OPENDCP_NO_ERROR;
+}
+
+/**
+verify one asset of a package
+
+The size and sha1 digest are checked against the packing list. Track files
+have their index walked, the frame count must match the intrinsic duration
+of the composition playlists. When a key is given every frame of an
+encrypted track file is also checked against its HMAC. The file is read
+once, the digest runs just ahead of the frame checks so they are served
+from the page cache.
+
+Assets can be verified from several threads at once.
+
+@param  verify a package verification
+@param  i the asset index
+@param  key the 16 byte content key, NULL to skip the HMAC check
+@return OPENDCP_ERROR value, also stored in the asset
+*/
+int opendcp_verify_asset(opendcp_verify_t *verify, int i, const byte_t *key) {
+    opendcp_verify_asset_t *asset = &verify->asset[i];
+    verify_digest_t digest;
+    struct stat st;
+    long long size;
+    int result, mxf_result = OPENDCP_NO_ERROR;
+
+    if (asset->result != OPENDCP_NO_ERROR) {
+        return asset->result;
+    }
+
+    if (stat(asset->filename, &st) != 0) {
+        return asset->result = OPENDCP_VERIFY_MISSING;
+    }
+
+    if ((long long)st.st_size != asset->size) {
+        OPENDCP_LOG(LOG_ERROR, "%s is %lld bytes, packing list has %lld", asset->filename, (long long)st.st_size, asset->size);
+        return asset->result = OPENDCP_VERIFY_SIZE;
+    }
+
+    result = verify_digest_open(&digest, asset->filename);
+
+    if (result != OPENDCP_NO_ERROR) {
+        return asset->result = result;
+    }
+
+    if (strstr(asset->type, "mxf")) {
+        mxf_result = verify_mxf(asset->filename, key, &asset->frames, verify_digest_advance, &digest, VERIFY_READ_AHEAD);
+    }
+
+    result = verify_digest_close(&digest, asset->digest, &size);
+
+    if (result != OPENDCP_NO_ERROR) {
+        return asset->result = result;
+    }
+
+    if (size != asset->size) {
+        return asset->result = OPENDCP_VERIFY_SIZE;
+    }
+
+    if (strcmp(asset->digest, asset->hash)) {
+        OPENDCP_LOG(LOG_ERROR, "%s hash is %s, packing list has %s", asset->filename, asset->digest, asset->hash);
+        return asset->result = OPENDCP_VERIFY_HASH;
+    }
+
+    if (!strstr(asset->type, "mxf")) {
+        return asset->result = OPENDCP_NO_ERROR;
+    }
+
+    if (mxf_result != OPENDCP_NO_ERROR) {
+        return asset->result = mxf_result;
+    }
+
+    if (asset->intrinsic_duration >= 0 && (asset->frames != asset->intrinsic_duration || asset->duration > asset->frames)) {
+        OPENDCP_LOG(LOG_ERROR, "%s has %d frames, composition playlist uses %d of %d",
+                    asset->filename, asset->frames, asset->duration, asset->intrinsic_duration);
+        return asset->result = OPENDCP_VERIFY_DURATION;
+    }
+
+    return asset->result = OPENDCP_NO_ERROR;
+}
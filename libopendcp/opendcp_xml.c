@@ -85,10 +85,10 @@ char *get_aspect_ratio(char *dimension_string) {
     return(ratio);
 }
 
-int is_valid_asset(asset_t asset) {
-    if (asset.essence_class == ACT_PICTURE ||
-            asset.essence_class == ACT_SOUND ||
-            asset.essence_class == ACT_TIMED_TEXT ) {
+int is_valid_asset(asset_t *asset) {
+    if (asset->essence_class == ACT_PICTURE ||
+            asset->essence_class == ACT_SOUND ||
+            asset->essence_class == ACT_TIMED_TEXT ) {
 
         return 1;
     }
@@ -96,13 +96,13 @@ int is_valid_asset(asset_t asset) {
     return 0;
 }
 
-int write_cpl_asset(opendcp_t *opendcp, xmlTextWriterPtr xml, asset_t asset) {
+int write_cpl_asset(opendcp_t *opendcp, xmlTextWriterPtr xml, asset_t *asset) {
     if (!is_valid_asset(asset)) {
         return OPENDCP_NO_ERROR;
     }
 
-    if (asset.essence_class == ACT_PICTURE) {
-        if (asset.stereoscopic) {
+    if (asset->essence_class == ACT_PICTURE) {
+        if (asset->stereoscopic) {
             xmlTextWriterStartElement(xml, BAD_CAST "msp-cpl:MainStereoscopicPicture");
             xmlTextWriterWriteAttribute(xml, BAD_CAST "xmlns:msp-cpl", BAD_CAST NS_CPL_3D[opendcp->ns]);
         }
@@ -110,37 +110,37 @@ int write_cpl_asset(opendcp_t *opendcp, xmlTextWriterPtr xml, asset_t asset) {
             xmlTextWriterStartElement(xml, BAD_CAST "MainPicture");
         }
     }
-    else if (asset.essence_class == ACT_SOUND) {
+    else if (asset->essence_class == ACT_SOUND) {
         xmlTextWriterStartElement(xml, BAD_CAST "MainSound");
     }
-    else if (asset.essence_class == ACT_TIMED_TEXT) {
+    else if (asset->essence_class == ACT_TIMED_TEXT) {
         xmlTextWriterStartElement(xml, BAD_CAST "MainSubtitle");
     }
     else {
         return OPENDCP_NO_ERROR;
     }
 
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", asset.uuid);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "AnnotationText", "%s", asset.annotation);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "EditRate", "%s", asset.edit_rate);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "IntrinsicDuration", "%d", asset.intrinsic_duration);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "EntryPoint", "%d", asset.entry_point);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Duration", "%d", asset.duration);
-    if ( asset.encrypted ) {
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "KeyId", "%s%s", "urn:uuid:", asset.key_id);
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", asset->uuid);
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "AnnotationText", "%s", asset->annotation);
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "EditRate", "%s", asset->edit_rate);
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "IntrinsicDuration", "%d", asset->intrinsic_duration);
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "EntryPoint", "%d", asset->entry_point);
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Duration", "%d", asset->duration);
+    if ( asset->encrypted ) {
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "KeyId", "%s%s", "urn:uuid:", asset->key_id);
     }
     if ( opendcp->dcp.digest_flag ) {
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Hash", "%s", asset.digest);
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Hash", "%s", asset->digest);
     }
 
-    if (asset.essence_class == ACT_PICTURE) {
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "FrameRate", "%s", asset.frame_rate);
+    if (asset->essence_class == ACT_PICTURE) {
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "FrameRate", "%s", asset->frame_rate);
 
         if (opendcp->ns == XML_NS_SMPTE) {
-            xmlTextWriterWriteFormatElement(xml, BAD_CAST "ScreenAspectRatio", "%s", asset.aspect_ratio);
+            xmlTextWriterWriteFormatElement(xml, BAD_CAST "ScreenAspectRatio", "%s", asset->aspect_ratio);
         }
         else {
-            xmlTextWriterWriteFormatElement(xml, BAD_CAST "ScreenAspectRatio", "%s", get_aspect_ratio(asset.aspect_ratio));
+            xmlTextWriterWriteFormatElement(xml, BAD_CAST "ScreenAspectRatio", "%s", get_aspect_ratio(asset->aspect_ratio));
         }
     }
 
@@ -149,28 +149,28 @@ int write_cpl_asset(opendcp_t *opendcp, xmlTextWriterPtr xml, asset_t asset) {
     return OPENDCP_NO_ERROR;
 }
 
-int write_pkl_asset(opendcp_t *opendcp, xmlTextWriterPtr xml, asset_t asset) {
+int write_pkl_asset(opendcp_t *opendcp, xmlTextWriterPtr xml, asset_t *asset) {
     if (!is_valid_asset(asset)) {
         return OPENDCP_NO_ERROR;
     }
 
     xmlTextWriterStartElement(xml, BAD_CAST "Asset");
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", asset.uuid);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "AnnotationText", "%s", asset.annotation);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Hash", "%s", asset.digest);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Size", "%s", asset.size);
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", asset->uuid);
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "AnnotationText", "%s", asset->annotation);
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Hash", "%s", asset->digest);
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Size", "%s", asset->size);
 
     if (opendcp->ns == XML_NS_SMPTE) {
         xmlTextWriterWriteFormatElement(xml, BAD_CAST "Type", "%s", "application/mxf");
     }
     else {
-        if (asset.essence_class == ACT_PICTURE) {
+        if (asset->essence_class == ACT_PICTURE) {
             xmlTextWriterWriteFormatElement(xml, BAD_CAST "Type", "%s", "application/x-smpte-mxf;asdcpKind=Picture");
         }
-        else if (asset.essence_class == ACT_SOUND) {
+        else if (asset->essence_class == ACT_SOUND) {
             xmlTextWriterWriteFormatElement(xml, BAD_CAST "Type", "%s", "application/x-smpte-mxf;asdcpKind=Sound");
         }
-        else if (asset.essence_class == ACT_TIMED_TEXT) {
+        else if (asset->essence_class == ACT_TIMED_TEXT) {
             xmlTextWriterWriteFormatElement(xml, BAD_CAST "Type", "%s", "application/x-smpte-mxf;asdcpKind=Subtitle");
         }
         else {
@@ -178,26 +178,26 @@ int write_pkl_asset(opendcp_t *opendcp, xmlTextWriterPtr xml, asset_t asset) {
         }
     }
 
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "OriginalFileName", "%s", basename(asset.filename));
+    xmlTextWriterWriteFormatElement(xml, BAD_CAST "OriginalFileName", "%s", basename(asset->filename));
     xmlTextWriterEndElement(xml);      /* end asset */
 
     return OPENDCP_NO_ERROR;
 }
 
-int write_assetmap_asset(xmlTextWriterPtr xml, asset_t asset) {
+int write_assetmap_asset(xmlTextWriterPtr xml, asset_t *asset) {
     if (!is_valid_asset(asset)) {
         return OPENDCP_NO_ERROR;
     }
 
-    if (asset.uuid != NULL) {
+    if (asset->uuid != NULL) {
         xmlTextWriterStartElement(xml, BAD_CAST "Asset");
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", asset.uuid);
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", asset->uuid);
         xmlTextWriterStartElement(xml, BAD_CAST "ChunkList");
         xmlTextWriterStartElement(xml, BAD_CAST "Chunk");
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Path", "%s", basename(asset.filename));
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Path", "%s", basename(asset->filename));
         xmlTextWriterWriteFormatElement(xml, BAD_CAST "VolumeIndex", "%d", 1);
         xmlTextWriterWriteFormatElement(xml, BAD_CAST "Offset", "%d", 0);
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Length", "%s", asset.size);
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Length", "%s", asset->size);
         xmlTextWriterEndElement(xml); /* end chunk */
         xmlTextWriterEndElement(xml); /* end chunklist */
         xmlTextWriterEndElement(xml); /* end cpl asset */
@@ -264,21 +264,21 @@ int write_cpl(opendcp_t *opendcp, cpl_t *cpl) {
     xmlTextWriterStartElement(xml, BAD_CAST "ReelList");
 
     for (r = 0; r < cpl->reel_count; r++) {
-        reel_t reel = cpl->reel[r];
+        reel_t *reel = cpl->reel[r];
         xmlTextWriterStartElement(xml, BAD_CAST "Reel");
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", reel.uuid);
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", reel->uuid);
         xmlTextWriterStartElement(xml, BAD_CAST "AssetList");
 
         /* write picture first, unless stereoscopic */
-        if (cpl->reel[r].main_picture.stereoscopic) {
-            write_cpl_asset(opendcp, xml, cpl->reel[r].main_sound);
-            write_cpl_asset(opendcp, xml, cpl->reel[r].main_subtitle);
-            write_cpl_asset(opendcp, xml, cpl->reel[r].main_picture);
+        if (reel->main_picture.stereoscopic) {
+            write_cpl_asset(opendcp, xml, &reel->main_sound);
+            write_cpl_asset(opendcp, xml, &reel->main_subtitle);
+            write_cpl_asset(opendcp, xml, &reel->main_picture);
         }
         else {
-            write_cpl_asset(opendcp, xml, cpl->reel[r].main_picture);
-            write_cpl_asset(opendcp, xml, cpl->reel[r].main_sound);
-            write_cpl_asset(opendcp, xml, cpl->reel[r].main_subtitle);
+            write_cpl_asset(opendcp, xml, &reel->main_picture);
+            write_cpl_asset(opendcp, xml, &reel->main_sound);
+            write_cpl_asset(opendcp, xml, &reel->main_subtitle);
         }
 
         xmlTextWriterEndElement(xml);     /* end assetlist */
@@ -376,20 +376,20 @@ int write_pkl(opendcp_t *opendcp, pkl_t *pkl) {
     xmlTextWriterStartElement(xml, BAD_CAST "AssetList");
 
     for (c = 0; c < pkl->cpl_count; c++) {
-        cpl_t cpl = pkl->cpl[c];
-        OPENDCP_LOG(LOG_INFO, "reels: %d", cpl.reel_count);
+        cpl_t *cpl = pkl->cpl[c];
+        OPENDCP_LOG(LOG_INFO, "reels: %d", cpl->reel_count);
 
-        for (r = 0; r < cpl.reel_count; r++) {
-            write_pkl_asset(opendcp, xml, cpl.reel[r].main_picture);
-            write_pkl_asset(opendcp, xml, cpl.reel[r].main_sound);
-            write_pkl_asset(opendcp, xml, cpl.reel[r].main_subtitle);
+        for (r = 0; r < cpl->reel_count; r++) {
+            write_pkl_asset(opendcp, xml, &cpl->reel[r]->main_picture);
+            write_pkl_asset(opendcp, xml, &cpl->reel[r]->main_sound);
+            write_pkl_asset(opendcp, xml, &cpl->reel[r]->main_subtitle);
         }
 
         /* cpl */
         xmlTextWriterStartElement(xml, BAD_CAST "Asset");
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", cpl.uuid);
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Hash", "%s", cpl.digest);
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Size", "%s", cpl.size);
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", cpl->uuid);
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Hash", "%s", cpl->digest);
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Size", "%s", cpl->size);
 
         if (opendcp->ns == XML_NS_SMPTE) {
             xmlTextWriterWriteFormatElement(xml, BAD_CAST "Type", "%s", "text/xml");
@@ -398,7 +398,7 @@ int write_pkl(opendcp_t *opendcp, pkl_t *pkl) {
             xmlTextWriterWriteFormatElement(xml, BAD_CAST "Type", "%s", "text/xml;asdcpKind=CPL");
         }
 
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "OriginalFileName", "%s", basename(cpl.filename));
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "OriginalFileName", "%s", basename(cpl->filename));
         xmlTextWriterEndElement(xml);      /* end cpl asset */
     }
 
@@ -445,9 +445,9 @@ int write_assetmap(opendcp_t *opendcp) {
     xmlIndentTreeOutput = 1;
     xmlDocPtr        doc;
     xmlTextWriterPtr xml;
-    int              c, r, rc;
+    int              p, c, r, rc;
     char             uuid_s[40];
-    reel_t           reel;
+    reel_t           *reel;
 
     assetmap_t assetmap = opendcp->dcp.assetmap;
 
@@ -489,45 +489,48 @@ int write_assetmap(opendcp_t *opendcp) {
 
     OPENDCP_LOG(LOG_INFO, "writing ASSETMAP PKL");
 
-    /* PKL */
-    pkl_t pkl = opendcp->dcp.pkl[0];
-    xmlTextWriterStartElement(xml, BAD_CAST "Asset");
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", pkl.uuid);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "PackingList", "%s", "true");
-    xmlTextWriterStartElement(xml, BAD_CAST "ChunkList");
-    xmlTextWriterStartElement(xml, BAD_CAST "Chunk");
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Path", "%s", basename(pkl.filename));
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "VolumeIndex", "%d", 1);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Offset", "%d", 0);
-    xmlTextWriterWriteFormatElement(xml, BAD_CAST "Length", "%s", pkl.size);
-    xmlTextWriterEndElement(xml); /* end chunk */
-    xmlTextWriterEndElement(xml); /* end chunklist */
-    xmlTextWriterEndElement(xml); /* end pkl asset */
-
-    OPENDCP_LOG(LOG_INFO, "writing ASSETMAP CPLs");
-
-    /* CPL */
-    for (c = 0; c < pkl.cpl_count; c++) {
-        cpl_t cpl = pkl.cpl[c];
+    /* PKL(s) */
+    for (p = 0; p < opendcp->dcp.pkl_count; p++) {
+        pkl_t *pkl = opendcp->dcp.pkl[p];
+
         xmlTextWriterStartElement(xml, BAD_CAST "Asset");
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", cpl.uuid);
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", pkl->uuid);
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "PackingList", "%s", "true");
         xmlTextWriterStartElement(xml, BAD_CAST "ChunkList");
         xmlTextWriterStartElement(xml, BAD_CAST "Chunk");
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Path", "%s", basename(cpl.filename));
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Path", "%s", basename(pkl->filename));
         xmlTextWriterWriteFormatElement(xml, BAD_CAST "VolumeIndex", "%d", 1);
         xmlTextWriterWriteFormatElement(xml, BAD_CAST "Offset", "%d", 0);
-        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Length", "%s", cpl.size);
+        xmlTextWriterWriteFormatElement(xml, BAD_CAST "Length", "%s", pkl->size);
         xmlTextWriterEndElement(xml); /* end chunk */
         xmlTextWriterEndElement(xml); /* end chunklist */
-        xmlTextWriterEndElement(xml); /* end cpl asset */
-
-        /* assets(s) start */
-        for (r = 0; r < cpl.reel_count; r++) {
-            reel = cpl.reel[r];
-
-            write_assetmap_asset(xml, reel.main_picture);
-            write_assetmap_asset(xml, reel.main_sound);
-            write_assetmap_asset(xml, reel.main_subtitle);
+        xmlTextWriterEndElement(xml); /* end pkl asset */
+
+        OPENDCP_LOG(LOG_INFO, "writing ASSETMAP CPLs");
+
+        /* CPL */
+        for (c = 0; c < pkl->cpl_count; c++) {
+            cpl_t *cpl = pkl->cpl[c];
+            xmlTextWriterStartElement(xml, BAD_CAST "Asset");
+            xmlTextWriterWriteFormatElement(xml, BAD_CAST "Id", "%s%s", "urn:uuid:", cpl->uuid);
+            xmlTextWriterStartElement(xml, BAD_CAST "ChunkList");
+            xmlTextWriterStartElement(xml, BAD_CAST "Chunk");
+            xmlTextWriterWriteFormatElement(xml, BAD_CAST "Path", "%s", basename(cpl->filename));
+            xmlTextWriterWriteFormatElement(xml, BAD_CAST "VolumeIndex", "%d", 1);
+            xmlTextWriterWriteFormatElement(xml, BAD_CAST "Offset", "%d", 0);
+            xmlTextWriterWriteFormatElement(xml, BAD_CAST "Length", "%s", cpl->size);
+            xmlTextWriterEndElement(xml); /* end chunk */
+            xmlTextWriterEndElement(xml); /* end chunklist */
+            xmlTextWriterEndElement(xml); /* end cpl asset */
+
+            /* assets(s) start */
+            for (r = 0; r < cpl->reel_count; r++) {
+                reel = cpl->reel[r];
+
+                write_assetmap_asset(xml, &reel->main_picture);
+                write_assetmap_asset(xml, &reel->main_sound);
+                write_assetmap_asset(xml, &reel->main_subtitle);
+            }
         }
     }
 